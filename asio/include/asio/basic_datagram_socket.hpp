@@ -76,6 +76,34 @@ public:
   /// The endpoint type.
   typedef typename Protocol::endpoint endpoint_type;
 
+#if defined(ASIO_HAS_MMSG) || defined(GENERATING_DOCUMENTATION)
+  /// A datagram in a batched receive operation.
+  struct mutable_datagram
+  {
+    /// The buffer into which the datagram is received.
+    mutable_buffer buffer;
+
+    /// Receives the endpoint of the sender.
+    endpoint_type endpoint;
+
+    /// Receives the number of bytes in the datagram.
+    std::size_t size;
+  };
+
+  /// A datagram in a batched send operation.
+  struct const_datagram
+  {
+    /// The data to be sent.
+    const_buffer buffer;
+
+    /// The endpoint to which the datagram is sent.
+    endpoint_type endpoint;
+
+    /// Receives the number of bytes sent.
+    std::size_t size;
+  };
+#endif // defined(ASIO_HAS_MMSG) || defined(GENERATING_DOCUMENTATION)
+
   /// Construct a basic_datagram_socket without opening it.
   /**
    * This constructor creates a datagram socket without opening it. The open()
@@ -1065,6 +1093,277 @@ public:
         buffers, &sender_endpoint, flags);
   }
 
+#if defined(ASIO_HAS_MMSG) || defined(GENERATING_DOCUMENTATION)
+  /// Send a batch of datagrams.
+  /**
+   * This function is used to send a number of datagrams, each to its own
+   * endpoint, using as few system calls as possible. The function call will
+   * block until all of the datagrams have been sent or an error occurs.
+   *
+   * @param datagrams The datagrams to be sent. On return, the size member of
+   * each datagram that was sent holds the number of bytes sent.
+   *
+   * @param count The number of datagrams in the array.
+   *
+   * @returns The number of datagrams sent.
+   *
+   * @throws asio::system_error Thrown on failure.
+   *
+   * @note This operation is only available on Linux, where it uses the
+   * @c sendmmsg system call.
+   */
+  std::size_t send_batch(const_datagram* datagrams, std::size_t count)
+  {
+    asio::error_code ec;
+    std::size_t s = this->impl_.get_service().send_batch(
+        this->impl_.get_implementation(), datagrams, count, 0, ec);
+    asio::detail::throw_error(ec, "send_batch");
+    return s;
+  }
+
+  /// Send a batch of datagrams.
+  /**
+   * This function is used to send a number of datagrams, each to its own
+   * endpoint, using as few system calls as possible. The function call will
+   * block until all of the datagrams have been sent or an error occurs.
+   *
+   * @param datagrams The datagrams to be sent. On return, the size member of
+   * each datagram that was sent holds the number of bytes sent.
+   *
+   * @param count The number of datagrams in the array.
+   *
+   * @param flags Flags specifying how the send call is to be made.
+   *
+   * @param ec Set to indicate what error occurred, if any.
+   *
+   * @returns The number of datagrams sent. This is less than count only if an
+   * error occurred.
+   */
+  std::size_t send_batch(const_datagram* datagrams, std::size_t count,
+      socket_base::message_flags flags, asio::error_code& ec)
+  {
+    return this->impl_.get_service().send_batch(
+        this->impl_.get_implementation(), datagrams, count, flags, ec);
+  }
+
+  /// Start an asynchronous send of a batch of datagrams.
+  /**
+   * This function is used to asynchronously send a number of datagrams, each
+   * to its own endpoint, using as few system calls as possible. The function
+   * call always returns immediately.
+   *
+   * @param datagrams The datagrams to be sent. Ownership of the array, and of
+   * the memory referred to by its buffers, is retained by the caller, which
+   * must guarantee that they remain valid until the handler is called.
+   *
+   * @param count The number of datagrams in the array.
+   *
+   * @param handler The handler to be called when all of the datagrams have
+   * been sent or an error occurs. Copies will be made of the handler as
+   * required. The function signature of the handler must be:
+   * @code void handler(
+   *   const asio::error_code& error, // Result of operation.
+   *   std::size_t datagrams_sent // Number of datagrams sent.
+   * ); @endcode
+   * Regardless of whether the asynchronous operation completes immediately or
+   * not, the handler will not be invoked from within this function. On
+   * immediate completion, invocation of the handler will be performed in a
+   * manner equivalent to using asio::post().
+   */
+  template <ASIO_COMPLETION_TOKEN_FOR(void (asio::error_code,
+        std::size_t)) WriteHandler
+          ASIO_DEFAULT_COMPLETION_TOKEN_TYPE(executor_type)>
+  ASIO_INITFN_AUTO_RESULT_TYPE(WriteHandler,
+      void (asio::error_code, std::size_t))
+  async_send_batch(const_datagram* datagrams, std::size_t count,
+      ASIO_MOVE_ARG(WriteHandler) handler
+        ASIO_DEFAULT_COMPLETION_TOKEN(executor_type))
+  {
+    return async_initiate<WriteHandler,
+      void (asio::error_code, std::size_t)>(
+        initiate_async_send_batch(this), handler,
+        datagrams, count, socket_base::message_flags(0));
+  }
+
+  /// Start an asynchronous send of a batch of datagrams.
+  /**
+   * This function is used to asynchronously send a number of datagrams, each
+   * to its own endpoint, using as few system calls as possible. The function
+   * call always returns immediately.
+   *
+   * @param datagrams The datagrams to be sent. Ownership of the array, and of
+   * the memory referred to by its buffers, is retained by the caller, which
+   * must guarantee that they remain valid until the handler is called.
+   *
+   * @param count The number of datagrams in the array.
+   *
+   * @param flags Flags specifying how the send call is to be made.
+   *
+   * @param handler The handler to be called when all of the datagrams have
+   * been sent or an error occurs. Copies will be made of the handler as
+   * required. The function signature of the handler must be:
+   * @code void handler(
+   *   const asio::error_code& error, // Result of operation.
+   *   std::size_t datagrams_sent // Number of datagrams sent.
+   * ); @endcode
+   * Regardless of whether the asynchronous operation completes immediately or
+   * not, the handler will not be invoked from within this function. On
+   * immediate completion, invocation of the handler will be performed in a
+   * manner equivalent to using asio::post().
+   */
+  template <ASIO_COMPLETION_TOKEN_FOR(void (asio::error_code,
+        std::size_t)) WriteHandler
+          ASIO_DEFAULT_COMPLETION_TOKEN_TYPE(executor_type)>
+  ASIO_INITFN_AUTO_RESULT_TYPE(WriteHandler,
+      void (asio::error_code, std::size_t))
+  async_send_batch(const_datagram* datagrams, std::size_t count,
+      socket_base::message_flags flags,
+      ASIO_MOVE_ARG(WriteHandler) handler
+        ASIO_DEFAULT_COMPLETION_TOKEN(executor_type))
+  {
+    return async_initiate<WriteHandler,
+      void (asio::error_code, std::size_t)>(
+        initiate_async_send_batch(this), handler, datagrams, count, flags);
+  }
+
+  /// Receive a batch of datagrams.
+  /**
+   * This function is used to receive as many datagrams as are available, up
+   * to the size of the array, in as few system calls as possible. The function
+   * call will block until at least one datagram has been received or an error
+   * occurs.
+   *
+   * @param datagrams The datagrams to be received into. On return, the first
+   * datagrams received hold the size of each datagram and the endpoint of its
+   * sender. At most 64 datagrams are received in one call.
+   *
+   * @param count The number of datagrams in the array.
+   *
+   * @returns The number of datagrams received.
+   *
+   * @throws asio::system_error Thrown on failure.
+   *
+   * @note This operation is only available on Linux, where it uses the
+   * @c recvmmsg system call.
+   */
+  std::size_t receive_batch(mutable_datagram* datagrams, std::size_t count)
+  {
+    asio::error_code ec;
+    std::size_t s = this->impl_.get_service().receive_batch(
+        this->impl_.get_implementation(), datagrams, count, 0, ec);
+    asio::detail::throw_error(ec, "receive_batch");
+    return s;
+  }
+
+  /// Receive a batch of datagrams.
+  /**
+   * This function is used to receive as many datagrams as are available, up
+   * to the size of the array, in as few system calls as possible. The function
+   * call will block until at least one datagram has been received or an error
+   * occurs.
+   *
+   * @param datagrams The datagrams to be received into. On return, the first
+   * datagrams received hold the size of each datagram and the endpoint of its
+   * sender. At most 64 datagrams are received in one call.
+   *
+   * @param count The number of datagrams in the array.
+   *
+   * @param flags Flags specifying how the receive call is to be made.
+   *
+   * @param ec Set to indicate what error occurred, if any.
+   *
+   * @returns The number of datagrams received.
+   */
+  std::size_t receive_batch(mutable_datagram* datagrams, std::size_t count,
+      socket_base::message_flags flags, asio::error_code& ec)
+  {
+    return this->impl_.get_service().receive_batch(
+        this->impl_.get_implementation(), datagrams, count, flags, ec);
+  }
+
+  /// Start an asynchronous receive of a batch of datagrams.
+  /**
+   * This function is used to asynchronously receive as many datagrams as are
+   * available, up to the size of the array, in as few system calls as
+   * possible. The function call always returns immediately.
+   *
+   * @param datagrams The datagrams to be received into. Ownership of the
+   * array, and of the memory referred to by its buffers, is retained by the
+   * caller, which must guarantee that they remain valid until the handler is
+   * called. At most 64 datagrams are received in one operation.
+   *
+   * @param count The number of datagrams in the array.
+   *
+   * @param handler The handler to be called when at least one datagram has
+   * been received or an error occurs. Copies will be made of the handler as
+   * required. The function signature of the handler must be:
+   * @code void handler(
+   *   const asio::error_code& error, // Result of operation.
+   *   std::size_t datagrams_received // Number of datagrams received.
+   * ); @endcode
+   * Regardless of whether the asynchronous operation completes immediately or
+   * not, the handler will not be invoked from within this function. On
+   * immediate completion, invocation of the handler will be performed in a
+   * manner equivalent to using asio::post().
+   */
+  template <ASIO_COMPLETION_TOKEN_FOR(void (asio::error_code,
+        std::size_t)) ReadHandler
+          ASIO_DEFAULT_COMPLETION_TOKEN_TYPE(executor_type)>
+  ASIO_INITFN_AUTO_RESULT_TYPE(ReadHandler,
+      void (asio::error_code, std::size_t))
+  async_receive_batch(mutable_datagram* datagrams, std::size_t count,
+      ASIO_MOVE_ARG(ReadHandler) handler
+        ASIO_DEFAULT_COMPLETION_TOKEN(executor_type))
+  {
+    return async_initiate<ReadHandler,
+      void (asio::error_code, std::size_t)>(
+        initiate_async_receive_batch(this), handler,
+        datagrams, count, socket_base::message_flags(0));
+  }
+
+  /// Start an asynchronous receive of a batch of datagrams.
+  /**
+   * This function is used to asynchronously receive as many datagrams as are
+   * available, up to the size of the array, in as few system calls as
+   * possible. The function call always returns immediately.
+   *
+   * @param datagrams The datagrams to be received into. Ownership of the
+   * array, and of the memory referred to by its buffers, is retained by the
+   * caller, which must guarantee that they remain valid until the handler is
+   * called. At most 64 datagrams are received in one operation.
+   *
+   * @param count The number of datagrams in the array.
+   *
+   * @param flags Flags specifying how the receive call is to be made.
+   *
+   * @param handler The handler to be called when at least one datagram has
+   * been received or an error occurs. Copies will be made of the handler as
+   * required. The function signature of the handler must be:
+   * @code void handler(
+   *   const asio::error_code& error, // Result of operation.
+   *   std::size_t datagrams_received // Number of datagrams received.
+   * ); @endcode
+   * Regardless of whether the asynchronous operation completes immediately or
+   * not, the handler will not be invoked from within this function. On
+   * immediate completion, invocation of the handler will be performed in a
+   * manner equivalent to using asio::post().
+   */
+  template <ASIO_COMPLETION_TOKEN_FOR(void (asio::error_code,
+        std::size_t)) ReadHandler
+          ASIO_DEFAULT_COMPLETION_TOKEN_TYPE(executor_type)>
+  ASIO_INITFN_AUTO_RESULT_TYPE(ReadHandler,
+      void (asio::error_code, std::size_t))
+  async_receive_batch(mutable_datagram* datagrams, std::size_t count,
+      socket_base::message_flags flags,
+      ASIO_MOVE_ARG(ReadHandler) handler
+        ASIO_DEFAULT_COMPLETION_TOKEN(executor_type))
+  {
+    return async_initiate<ReadHandler,
+      void (asio::error_code, std::size_t)>(
+        initiate_async_receive_batch(this), handler, datagrams, count, flags);
+  }
+#endif // defined(ASIO_HAS_MMSG) || defined(GENERATING_DOCUMENTATION)
+
 private:
   class initiate_async_send
   { 
@@ -1201,6 +1500,76 @@ private:
   private:
     basic_datagram_socket* self_;
   };
+
+#if defined(ASIO_HAS_MMSG)
+  class initiate_async_send_batch
+  {
+  public:
+    typedef Executor executor_type;
+
+    explicit initiate_async_send_batch(basic_datagram_socket* self)
+      : self_(self)
+    {
+    }
+
+    executor_type get_executor() const ASIO_NOEXCEPT
+    {
+      return self_->get_executor();
+    }
+
+    template <typename WriteHandler>
+    void operator()(ASIO_MOVE_ARG(WriteHandler) handler,
+        const_datagram* datagrams, std::size_t count,
+        socket_base::message_flags flags) const
+    {
+      // If you get an error on the following line it means that your handler
+      // does not meet the documented type requirements for a WriteHandler.
+      ASIO_WRITE_HANDLER_CHECK(WriteHandler, handler) type_check;
+
+      detail::non_const_lvalue<WriteHandler> handler2(handler);
+      self_->impl_.get_service().async_send_batch(
+          self_->impl_.get_implementation(), datagrams, count, flags,
+          handler2.value, self_->impl_.get_implementation_executor());
+    }
+
+  private:
+    basic_datagram_socket* self_;
+  };
+
+  class initiate_async_receive_batch
+  {
+  public:
+    typedef Executor executor_type;
+
+    explicit initiate_async_receive_batch(basic_datagram_socket* self)
+      : self_(self)
+    {
+    }
+
+    executor_type get_executor() const ASIO_NOEXCEPT
+    {
+      return self_->get_executor();
+    }
+
+    template <typename ReadHandler>
+    void operator()(ASIO_MOVE_ARG(ReadHandler) handler,
+        mutable_datagram* datagrams, std::size_t count,
+        socket_base::message_flags flags) const
+    {
+      // If you get an error on the following line it means that your handler
+      // does not meet the documented type requirements for a ReadHandler.
+      ASIO_READ_HANDLER_CHECK(ReadHandler, handler) type_check;
+
+      detail::non_const_lvalue<ReadHandler> handler2(handler);
+      self_->impl_.get_service().async_receive_batch(
+          self_->impl_.get_implementation(), datagrams, count, flags,
+          handler2.value, self_->impl_.get_implementation_executor());
+    }
+
+  private:
+    basic_datagram_socket* self_;
+  };
+#endif // defined(ASIO_HAS_MMSG)
 };
 
 } // namespace asio
@@ -329,6 +329,62 @@ public:
   {
   }
 
+#if defined(ASIO_HAS_MSG_ZEROCOPY) || defined(GENERATING_DOCUMENTATION)
+  /// Enable zero-copy transmission for large asynchronous sends.
+  /**
+   * This function causes asynchronous send operations of at least @c size
+   * bytes to be transmitted with @c MSG_ZEROCOPY, so that the kernel sends
+   * directly from the caller's buffers rather than copying them. A size of
+   * zero disables zero-copy sends.
+   *
+   * A zero-copy operation sends all of the supplied data and its handler is
+   * not called until the kernel has released the buffers, which may be some
+   * time after the data has been sent. Zero-copy transmission only pays for
+   * itself on large buffers, and the kernel falls back to copying on routes
+   * that cannot avoid it, such as loopback.
+   *
+   * @param size The threshold in bytes.
+   *
+   * @throws asio::system_error Thrown on failure, including when the
+   * kernel does not support @c SO_ZEROCOPY.
+   */
+  void set_zerocopy_threshold(std::size_t size)
+  {
+    asio::error_code ec;
+    this->impl_.get_service().set_zerocopy_threshold(
+        this->impl_.get_implementation(), size, ec);
+    asio::detail::throw_error(ec, "set_zerocopy_threshold");
+  }
+
+  /// Enable zero-copy transmission for large asynchronous sends.
+  /**
+   * This function causes asynchronous send operations of at least @c size
+   * bytes to be transmitted with @c MSG_ZEROCOPY. A size of zero disables
+   * zero-copy sends.
+   *
+   * @param size The threshold in bytes.
+   *
+   * @param ec Set to indicate what error occurred, if any.
+   */
+  ASIO_SYNC_OP_VOID set_zerocopy_threshold(std::size_t size,
+      asio::error_code& ec)
+  {
+    this->impl_.get_service().set_zerocopy_threshold(
+        this->impl_.get_implementation(), size, ec);
+    ASIO_SYNC_OP_VOID_RETURN(ec);
+  }
+
+  /// Get the size at or above which asynchronous sends use zero-copy.
+  /**
+   * @returns The threshold in bytes, or zero if zero-copy sends are disabled.
+   */
+  std::size_t zerocopy_threshold() const
+  {
+    return this->impl_.get_service().zerocopy_threshold(
+        this->impl_.get_implementation());
+  }
+#endif // defined(ASIO_HAS_MSG_ZEROCOPY) || defined(GENERATING_DOCUMENTATION)
+
   /// Send some data on the socket.
   /**
    * This function is used to send data on the stream socket. The function
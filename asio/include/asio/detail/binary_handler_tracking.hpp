@@ -0,0 +1,233 @@
+//
+// detail/binary_handler_tracking.hpp
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2003-2020 Christopher M. Kohlhoff (chris at kohlhoff dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef ASIO_DETAIL_BINARY_HANDLER_TRACKING_HPP
+#define ASIO_DETAIL_BINARY_HANDLER_TRACKING_HPP
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include "asio/detail/config.hpp"
+#include "asio/error_code.hpp"
+#include "asio/detail/cstdint.hpp"
+
+#include "asio/detail/push_options.hpp"
+
+namespace asio {
+
+class execution_context;
+
+namespace detail {
+
+// Handler tracking that records fixed-size binary events into per-thread ring
+// buffers. Enabled by defining ASIO_ENABLE_BINARY_HANDLER_TRACKING. Events are
+// timestamped with the CPU timestamp counter where available. The buffers are
+// written out with dump(), or automatically at exit when the environment
+// variable ASIO_HANDLER_TRACKING_FILE names an output file. The dumps are
+// decoded by src/tools/handlertrace.pl.
+class binary_handler_tracking
+{
+public:
+  // The kinds of event written to the ring buffers.
+  enum event_type
+  {
+    creation_event = 1,
+    invocation_begin_event = 2,
+    invocation_end_event = 3,
+    destroyed_event = 4,
+    exception_event = 5,
+    operation_event = 6,
+    reactor_registration_event = 7,
+    reactor_deregistration_event = 8,
+    reactor_events_event = 9,
+    reactor_operation_event = 10
+  };
+
+  // A single fixed-size event. The name and op fields hold the addresses of
+  // static strings, which are resolved into a string table when dumped.
+  struct event
+  {
+    uint64_t timestamp;
+    uint64_t id;
+    uint64_t arg;
+    uint64_t name;
+    uint64_t op;
+    uint32_t type;
+    int32_t error;
+  };
+
+  class completion;
+
+  // Base class for objects containing tracked handlers.
+  class tracked_handler
+  {
+  private:
+    // Only the handler tracking classes have access to the id. An id of zero
+    // means that the handler was not selected for sampling.
+    friend class binary_handler_tracking;
+    friend class completion;
+    uint64_t id_;
+
+  protected:
+    // Constructor initialises with no id.
+    tracked_handler() : id_(0) {}
+
+    // Prevent deletion through this type.
+    ~tracked_handler() {}
+  };
+
+  // Initialise the tracking system.
+  ASIO_DECL static void init();
+
+  // Record one in every rate new handlers. A rate of zero disables recording.
+  // The initial rate is ASIO_BINARY_HANDLER_TRACKING_SAMPLE_RATE, or the value
+  // of the environment variable ASIO_HANDLER_TRACKING_SAMPLE_RATE, or 1.
+  ASIO_DECL static void sample_rate(unsigned long rate);
+
+  // Write the contents of all ring buffers to the named file. Returns false if
+  // the file could not be written.
+  ASIO_DECL static bool dump(const char* path);
+
+  // Record the creation of a tracked handler.
+  ASIO_DECL static void creation(
+      execution_context& context, tracked_handler& h,
+      const char* object_type, void* object,
+      uintmax_t native_handle, const char* op_name);
+
+  class completion
+  {
+  public:
+    // Constructor records that handler is to be invoked with no arguments.
+    ASIO_DECL explicit completion(const tracked_handler& h);
+
+    // Destructor records only when an exception is thrown from the handler, or
+    // if the memory is being freed without the handler having been invoked.
+    ASIO_DECL ~completion();
+
+    // Records that handler is to be invoked with no arguments.
+    ASIO_DECL void invocation_begin();
+
+    // Records that handler is to be invoked with one arguments.
+    ASIO_DECL void invocation_begin(const asio::error_code& ec);
+
+    // Constructor records that handler is to be invoked with two arguments.
+    ASIO_DECL void invocation_begin(
+        const asio::error_code& ec, std::size_t bytes_transferred);
+
+    // Constructor records that handler is to be invoked with two arguments.
+    ASIO_DECL void invocation_begin(
+        const asio::error_code& ec, int signal_number);
+
+    // Constructor records that handler is to be invoked with two arguments.
+    ASIO_DECL void invocation_begin(
+        const asio::error_code& ec, const char* arg);
+
+    // Record that handler invocation has ended.
+    ASIO_DECL void invocation_end();
+
+  private:
+    friend class binary_handler_tracking;
+    uint64_t id_;
+    bool invoked_;
+    completion* next_;
+  };
+
+  // Record an operation that is not directly associated with a handler.
+  ASIO_DECL static void operation(execution_context& context,
+      const char* object_type, void* object,
+      uintmax_t native_handle, const char* op_name);
+
+  // Record that a descriptor has been registered with the reactor.
+  ASIO_DECL static void reactor_registration(execution_context& context,
+      uintmax_t native_handle, uintmax_t registration);
+
+  // Record that a descriptor has been deregistered from the reactor.
+  ASIO_DECL static void reactor_deregistration(execution_context& context,
+      uintmax_t native_handle, uintmax_t registration);
+
+  // Record reactor-based readiness events associated with a descriptor.
+  ASIO_DECL static void reactor_events(execution_context& context,
+      uintmax_t registration, unsigned events);
+
+  // Record a reactor-based operation that is associated with a handler.
+  ASIO_DECL static void reactor_operation(
+      const tracked_handler& h, const char* op_name,
+      const asio::error_code& ec);
+
+  // Record a reactor-based operation that is associated with a handler.
+  ASIO_DECL static void reactor_operation(
+      const tracked_handler& h, const char* op_name,
+      const asio::error_code& ec, std::size_t bytes_transferred);
+
+private:
+  struct thread_state;
+  struct tracking_state;
+  ASIO_DECL static tracking_state* get_state();
+  ASIO_DECL static thread_state* get_thread_state();
+  ASIO_DECL static uint64_t now();
+  ASIO_DECL static uint64_t nanoseconds();
+  ASIO_DECL static void dump_at_exit();
+
+  // Append an event to the calling thread's ring buffer.
+  ASIO_DECL static void record(event_type type, uint64_t id, uint64_t arg,
+      const void* name, const void* op, int error);
+};
+
+} // namespace detail
+} // namespace asio
+
+#include "asio/detail/pop_options.hpp"
+
+# define ASIO_INHERIT_TRACKED_HANDLER \
+  : public asio::detail::binary_handler_tracking::tracked_handler
+
+# define ASIO_ALSO_INHERIT_TRACKED_HANDLER \
+  , public asio::detail::binary_handler_tracking::tracked_handler
+
+# define ASIO_HANDLER_TRACKING_INIT \
+  asio::detail::binary_handler_tracking::init()
+
+# define ASIO_HANDLER_CREATION(args) \
+  asio::detail::binary_handler_tracking::creation args
+
+# define ASIO_HANDLER_COMPLETION(args) \
+  asio::detail::binary_handler_tracking::completion tracked_completion args
+
+# define ASIO_HANDLER_INVOCATION_BEGIN(args) \
+  tracked_completion.invocation_begin args
+
+# define ASIO_HANDLER_INVOCATION_END \
+  tracked_completion.invocation_end()
+
+# define ASIO_HANDLER_OPERATION(args) \
+  asio::detail::binary_handler_tracking::operation args
+
+# define ASIO_HANDLER_REACTOR_REGISTRATION(args) \
+  asio::detail::binary_handler_tracking::reactor_registration args
+
+# define ASIO_HANDLER_REACTOR_DEREGISTRATION(args) \
+  asio::detail::binary_handler_tracking::reactor_deregistration args
+
+# define ASIO_HANDLER_REACTOR_READ_EVENT 1
+# define ASIO_HANDLER_REACTOR_WRITE_EVENT 2
+# define ASIO_HANDLER_REACTOR_ERROR_EVENT 4
+
+# define ASIO_HANDLER_REACTOR_EVENTS(args) \
+  asio::detail::binary_handler_tracking::reactor_events args
+
+# define ASIO_HANDLER_REACTOR_OPERATION(args) \
+  asio::detail::binary_handler_tracking::reactor_operation args
+
+#if defined(ASIO_HEADER_ONLY)
+# include "asio/detail/impl/binary_handler_tracking.ipp"
+#endif // defined(ASIO_HEADER_ONLY)
+
+#endif // ASIO_DETAIL_BINARY_HANDLER_TRACKING_HPP
@@ -1312,6 +1312,22 @@
 # endif // defined(ASIO_HAS_THREADS)
 #endif // !defined(ASIO_HAS_PTHREADS)
 
+// Lock-free strand implementation. Opt-in, and requires std::atomic.
+#if !defined(ASIO_HAS_LOCK_FREE_STRAND)
+# if defined(ASIO_ENABLE_LOCK_FREE_STRAND)
+#  if defined(ASIO_HAS_THREADS) && defined(ASIO_HAS_STD_ATOMIC)
+#   define ASIO_HAS_LOCK_FREE_STRAND 1
+#  endif // defined(ASIO_HAS_THREADS) && defined(ASIO_HAS_STD_ATOMIC)
+# endif // defined(ASIO_ENABLE_LOCK_FREE_STRAND)
+#endif // !defined(ASIO_HAS_LOCK_FREE_STRAND)
+
+// Pooled record buffers for ssl::stream. Opt-in.
+#if !defined(ASIO_HAS_SSL_BUFFER_POOL)
+# if defined(ASIO_ENABLE_SSL_BUFFER_POOL)
+#  define ASIO_HAS_SSL_BUFFER_POOL 1
+# endif // defined(ASIO_ENABLE_SSL_BUFFER_POOL)
+#endif // !defined(ASIO_HAS_SSL_BUFFER_POOL)
+
 // Helper to prevent macro expansion.
 #define ASIO_PREVENT_MACRO_SUBSTITUTION
 
@@ -1493,7 +1509,26 @@
 #    define ASIO_HAS_CO_AWAIT 1
 #   endif // __has_include(<experimental/coroutine>)
 #  endif // (__cplusplus >= 201703) && (__cpp_coroutines >= 201703)
-# endif // defined(__clang__)
+# elif defined(__GNUC__)
+#  if (__cplusplus >= 201709) && (__cpp_impl_coroutine >= 201902)
+#   if __has_include(<coroutine>)
+#    define ASIO_HAS_CO_AWAIT 1
+#   endif // __has_include(<coroutine>)
+#  endif // (__cplusplus >= 201709) && (__cpp_impl_coroutine >= 201902)
+# endif // defined(__GNUC__)
 #endif // !defined(ASIO_HAS_CO_AWAIT)
 
+// Standard library support for coroutines.
+#if !defined(ASIO_HAS_STD_COROUTINE)
+# if !defined(ASIO_DISABLE_STD_COROUTINE)
+#  if defined(__GNUC__) && !defined(__clang__)
+#   if (__cplusplus >= 201709) && (__cpp_impl_coroutine >= 201902)
+#    if __has_include(<coroutine>)
+#     define ASIO_HAS_STD_COROUTINE 1
+#    endif // __has_include(<coroutine>)
+#   endif // (__cplusplus >= 201709) && (__cpp_impl_coroutine >= 201902)
+#  endif // defined(__GNUC__) && !defined(__clang__)
+# endif // !defined(ASIO_DISABLE_STD_COROUTINE)
+#endif // !defined(ASIO_HAS_STD_COROUTINE)
+
 #endif // ASIO_DETAIL_CONFIG_HPP
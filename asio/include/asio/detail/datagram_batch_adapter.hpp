@@ -0,0 +1,100 @@
+//
+// detail/datagram_batch_adapter.hpp
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2003-2020 Christopher M. Kohlhoff (chris at kohlhoff dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef ASIO_DETAIL_DATAGRAM_BATCH_ADAPTER_HPP
+#define ASIO_DETAIL_DATAGRAM_BATCH_ADAPTER_HPP
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include "asio/detail/config.hpp"
+#include "asio/detail/socket_types.hpp"
+
+#if defined(ASIO_HAS_MMSG)
+
+#include <cstddef>
+#include "asio/detail/noncopyable.hpp"
+#include "asio/detail/socket_ops.hpp"
+
+#include "asio/detail/push_options.hpp"
+
+namespace asio {
+namespace detail {
+
+// Converts a user-supplied array of datagrams, each with a buffer, an endpoint
+// and a size, to the message headers used by recvmmsg and sendmmsg. At most
+// max_datagrams are converted, so callers work through longer arrays in
+// several calls.
+template <typename Datagram>
+class datagram_batch_adapter
+  : private noncopyable
+{
+public:
+  enum { max_datagrams = 64 };
+
+  datagram_batch_adapter(Datagram* datagrams,
+      std::size_t count, bool is_receive)
+    : datagrams_(datagrams),
+      count_(count < max_datagrams ? count : max_datagrams)
+  {
+    for (std::size_t i = 0; i < count_; ++i)
+    {
+      Datagram& d = datagrams_[i];
+      bufs_[i].iov_base = const_cast<void*>(
+          static_cast<const void*>(d.buffer.data()));
+      bufs_[i].iov_len = d.buffer.size();
+      msgs_[i].msg_hdr = msghdr();
+      msgs_[i].msg_hdr.msg_name = d.endpoint.data();
+      msgs_[i].msg_hdr.msg_namelen = static_cast<socklen_t>(
+          is_receive ? d.endpoint.capacity() : d.endpoint.size());
+      msgs_[i].msg_hdr.msg_iov = &bufs_[i];
+      msgs_[i].msg_hdr.msg_iovlen = 1;
+      msgs_[i].msg_len = 0;
+    }
+  }
+
+  mmsghdr_type* msgs()
+  {
+    return msgs_;
+  }
+
+  std::size_t count() const
+  {
+    return count_;
+  }
+
+  // Record the sizes, and for receives the sender endpoints, of the first n
+  // datagrams.
+  void complete(std::size_t n, bool is_receive)
+  {
+    for (std::size_t i = 0; i < n && i < count_; ++i)
+    {
+      datagrams_[i].size = msgs_[i].msg_len;
+      if (is_receive)
+        datagrams_[i].endpoint.resize(msgs_[i].msg_hdr.msg_namelen);
+    }
+  }
+
+private:
+  Datagram* datagrams_;
+  std::size_t count_;
+  mmsghdr_type msgs_[max_datagrams];
+  socket_ops::buf bufs_[max_datagrams];
+};
+
+} // namespace detail
+} // namespace asio
+
+#include "asio/detail/pop_options.hpp"
+
+#endif // defined(ASIO_HAS_MMSG)
+
+#endif // ASIO_DETAIL_DATAGRAM_BATCH_ADAPTER_HPP
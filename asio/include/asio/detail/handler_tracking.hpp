@@ -25,6 +25,8 @@ class execution_context;
 
 #if defined(ASIO_CUSTOM_HANDLER_TRACKING)
 # include ASIO_CUSTOM_HANDLER_TRACKING
+#elif defined(ASIO_ENABLE_BINARY_HANDLER_TRACKING)
+# include "asio/detail/binary_handler_tracking.hpp"
 #elif defined(ASIO_ENABLE_HANDLER_TRACKING)
 # include "asio/error_code.hpp"
 # include "asio/detail/cstdint.hpp"
@@ -60,6 +62,14 @@ namespace detail {
 #  define ASIO_ENABLE_HANDLER_TRACKING 1
 # endif /// !defined(ASIO_ENABLE_HANDLER_TRACKING)
 
+#elif defined(ASIO_ENABLE_BINARY_HANDLER_TRACKING)
+
+// The macros are defined by binary_handler_tracking.hpp.
+
+# if !defined(ASIO_ENABLE_HANDLER_TRACKING)
+#  define ASIO_ENABLE_HANDLER_TRACKING 1
+# endif /// !defined(ASIO_ENABLE_HANDLER_TRACKING)
+
 #elif defined(ASIO_ENABLE_HANDLER_TRACKING)
 
 class handler_tracking
@@ -0,0 +1,418 @@
+//
+// detail/impl/binary_handler_tracking.ipp
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2003-2020 Christopher M. Kohlhoff (chris at kohlhoff dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef ASIO_DETAIL_IMPL_BINARY_HANDLER_TRACKING_IPP
+#define ASIO_DETAIL_IMPL_BINARY_HANDLER_TRACKING_IPP
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include "asio/detail/config.hpp"
+
+#if defined(ASIO_ENABLE_BINARY_HANDLER_TRACKING)
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "asio/detail/binary_handler_tracking.hpp"
+#include "asio/detail/static_mutex.hpp"
+#include "asio/detail/tss_ptr.hpp"
+
+#if defined(ASIO_HAS_CHRONO)
+# include "asio/detail/chrono.hpp"
+#endif // defined(ASIO_HAS_CHRONO)
+
+#if defined(ASIO_MSVC) && (defined(_M_IX86) || defined(_M_X64))
+# include <intrin.h>
+# define ASIO_BINARY_HANDLER_TRACKING_RDTSC 1
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+# include <x86intrin.h>
+# define ASIO_BINARY_HANDLER_TRACKING_RDTSC 1
+#endif // defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+
+#if !defined(ASIO_BINARY_HANDLER_TRACKING_BUFFER_SIZE)
+# define ASIO_BINARY_HANDLER_TRACKING_BUFFER_SIZE 65536
+#endif // !defined(ASIO_BINARY_HANDLER_TRACKING_BUFFER_SIZE)
+
+#if !defined(ASIO_BINARY_HANDLER_TRACKING_SAMPLE_RATE)
+# define ASIO_BINARY_HANDLER_TRACKING_SAMPLE_RATE 1
+#endif // !defined(ASIO_BINARY_HANDLER_TRACKING_SAMPLE_RATE)
+
+#include "asio/detail/push_options.hpp"
+
+namespace asio {
+namespace detail {
+
+// Number of events held by each thread's ring buffer. Must be a power of two.
+enum { binary_handler_tracking_buffer_size =
+  ASIO_BINARY_HANDLER_TRACKING_BUFFER_SIZE };
+
+struct binary_handler_tracking::thread_state
+{
+  event* buffer_;
+  uint64_t head_;
+  uint64_t next_id_;
+  unsigned long sample_count_;
+  uint32_t index_;
+  completion* current_completion_;
+  thread_state* next_;
+};
+
+struct binary_handler_tracking::tracking_state
+{
+  static_mutex mutex_;
+  tss_ptr<thread_state>* thread_state_;
+  thread_state* threads_;
+  uint32_t next_thread_index_;
+  unsigned long sample_rate_;
+  uint64_t start_ticks_;
+  uint64_t start_nanoseconds_;
+  char* dump_path_;
+};
+
+binary_handler_tracking::tracking_state* binary_handler_tracking::get_state()
+{
+  static tracking_state state = { ASIO_STATIC_MUTEX_INIT, 0, 0, 0, 0, 0, 0, 0 };
+  return &state;
+}
+
+void binary_handler_tracking::init()
+{
+  static tracking_state* state = get_state();
+
+  state->mutex_.init();
+
+  static_mutex::scoped_lock lock(state->mutex_);
+  if (state->thread_state_ == 0)
+  {
+    state->thread_state_ = new tss_ptr<thread_state>;
+    state->sample_rate_ = ASIO_BINARY_HANDLER_TRACKING_SAMPLE_RATE;
+    if (const char* rate = std::getenv("ASIO_HANDLER_TRACKING_SAMPLE_RATE"))
+      state->sample_rate_ = std::strtoul(rate, 0, 10);
+    state->start_ticks_ = now();
+    state->start_nanoseconds_ = nanoseconds();
+
+    if (const char* path = std::getenv("ASIO_HANDLER_TRACKING_FILE"))
+    {
+      state->dump_path_ = new char[std::strlen(path) + 1];
+      std::strcpy(state->dump_path_, path);
+      std::atexit(&binary_handler_tracking::dump_at_exit);
+    }
+  }
+}
+
+void binary_handler_tracking::sample_rate(unsigned long rate)
+{
+  static tracking_state* state = get_state();
+
+  static_mutex::scoped_lock lock(state->mutex_);
+  state->sample_rate_ = rate;
+}
+
+binary_handler_tracking::thread_state*
+binary_handler_tracking::get_thread_state()
+{
+  static tracking_state* state = get_state();
+
+  if (thread_state* t = *state->thread_state_)
+    return t;
+
+  // Thread states are never freed so that a dump can include the events of
+  // threads that have already exited.
+  thread_state* t = new thread_state;
+  t->buffer_ = new event[binary_handler_tracking_buffer_size];
+  t->head_ = 0;
+  t->next_id_ = 0;
+  t->sample_count_ = 0;
+  t->current_completion_ = 0;
+
+  static_mutex::scoped_lock lock(state->mutex_);
+  t->index_ = ++state->next_thread_index_;
+  t->next_ = state->threads_;
+  state->threads_ = t;
+  *state->thread_state_ = t;
+  return t;
+}
+
+uint64_t binary_handler_tracking::nanoseconds()
+{
+#if defined(ASIO_HAS_CHRONO)
+  return static_cast<uint64_t>(
+      chrono::duration_cast<chrono::nanoseconds>(
+        chrono::steady_clock::now().time_since_epoch()).count());
+#else // defined(ASIO_HAS_CHRONO)
+  return 0;
+#endif // defined(ASIO_HAS_CHRONO)
+}
+
+uint64_t binary_handler_tracking::now()
+{
+#if defined(ASIO_BINARY_HANDLER_TRACKING_RDTSC)
+  return static_cast<uint64_t>(__rdtsc());
+#else // defined(ASIO_BINARY_HANDLER_TRACKING_RDTSC)
+  return nanoseconds();
+#endif // defined(ASIO_BINARY_HANDLER_TRACKING_RDTSC)
+}
+
+void binary_handler_tracking::record(event_type type, uint64_t id,
+    uint64_t arg, const void* name, const void* op, int error)
+{
+  thread_state* t = get_thread_state();
+  event& e = t->buffer_[t->head_ & (binary_handler_tracking_buffer_size - 1)];
+  e.timestamp = now();
+  e.id = id;
+  e.arg = arg;
+  e.name = reinterpret_cast<std::size_t>(name);
+  e.op = reinterpret_cast<std::size_t>(op);
+  e.type = type;
+  e.error = error;
+  ++t->head_;
+}
+
+void binary_handler_tracking::dump_at_exit()
+{
+  dump(0);
+}
+
+bool binary_handler_tracking::dump(const char* path)
+{
+  static tracking_state* state = get_state();
+
+  static_mutex::scoped_lock lock(state->mutex_);
+
+  if (!path)
+    path = state->dump_path_;
+  if (!path)
+    return false;
+
+  std::FILE* file = std::fopen(path, "wb");
+  if (!file)
+    return false;
+
+  uint32_t thread_count = 0;
+  for (thread_state* t = state->threads_; t; t = t->next_)
+    ++thread_count;
+
+  // File header. The two tick/nanosecond pairs allow the decoder to convert
+  // timestamps into wall-clock durations.
+  char magic[8] = { 'A', 'S', 'I', 'O', 'T', 'R', 'C', '1' };
+  uint32_t header[2] = { 1, static_cast<uint32_t>(sizeof(event)) };
+  uint64_t clock[4] = { state->start_ticks_, state->start_nanoseconds_,
+    now(), nanoseconds() };
+  uint32_t count_header[2] = { thread_count, 0 };
+  std::fwrite(magic, sizeof(magic), 1, file);
+  std::fwrite(header, sizeof(header), 1, file);
+  std::fwrite(clock, sizeof(clock), 1, file);
+  std::fwrite(count_header, sizeof(count_header), 1, file);
+
+  // Each thread's events, oldest first.
+  std::vector<uint64_t> strings;
+  for (thread_state* t = state->threads_; t; t = t->next_)
+  {
+    uint64_t head = t->head_;
+    uint64_t count = head < static_cast<uint64_t>(
+        binary_handler_tracking_buffer_size)
+      ? head : binary_handler_tracking_buffer_size;
+    uint32_t thread_header[2] = { t->index_, 0 };
+    std::fwrite(thread_header, sizeof(thread_header), 1, file);
+    std::fwrite(&count, sizeof(count), 1, file);
+    for (uint64_t i = head - count; i != head; ++i)
+    {
+      const event& e = t->buffer_[i & (binary_handler_tracking_buffer_size - 1)];
+      std::fwrite(&e, sizeof(e), 1, file);
+      if (e.name)
+        strings.push_back(e.name);
+      if (e.op)
+        strings.push_back(e.op);
+    }
+  }
+
+  // The string table maps the addresses recorded in events to their text.
+  std::sort(strings.begin(), strings.end());
+  strings.erase(std::unique(strings.begin(), strings.end()), strings.end());
+  uint32_t string_header[2] = { static_cast<uint32_t>(strings.size()), 0 };
+  std::fwrite(string_header, sizeof(string_header), 1, file);
+  for (std::size_t i = 0; i < strings.size(); ++i)
+  {
+    const char* s = reinterpret_cast<const char*>(
+        static_cast<std::size_t>(strings[i]));
+    uint32_t length = static_cast<uint32_t>(std::strlen(s));
+    std::fwrite(&strings[i], sizeof(strings[i]), 1, file);
+    std::fwrite(&length, sizeof(length), 1, file);
+    std::fwrite(s, length, 1, file);
+  }
+
+  return std::fclose(file) == 0;
+}
+
+void binary_handler_tracking::creation(execution_context&,
+    binary_handler_tracking::tracked_handler& h,
+    const char* object_type, void* /*object*/,
+    uintmax_t /*native_handle*/, const char* op_name)
+{
+  static tracking_state* state = get_state();
+
+  thread_state* t = get_thread_state();
+  unsigned long rate = state->sample_rate_;
+  if (rate == 0 || t->sample_count_++ % rate != 0)
+    return;
+
+  // Ids are allocated per thread so that creation does not contend.
+  h.id_ = (static_cast<uint64_t>(t->index_) << 40) | ++t->next_id_;
+
+  uint64_t current_id = 0;
+  if (completion* current_completion = t->current_completion_)
+    current_id = current_completion->id_;
+
+  record(creation_event, h.id_, current_id, object_type, op_name, 0);
+}
+
+binary_handler_tracking::completion::completion(
+    const binary_handler_tracking::tracked_handler& h)
+  : id_(h.id_),
+    invoked_(false),
+    next_(get_thread_state()->current_completion_)
+{
+  get_thread_state()->current_completion_ = this;
+}
+
+binary_handler_tracking::completion::~completion()
+{
+  if (id_)
+    record(invoked_ ? exception_event : destroyed_event, id_, 0, 0, 0, 0);
+
+  get_thread_state()->current_completion_ = next_;
+}
+
+void binary_handler_tracking::completion::invocation_begin()
+{
+  if (id_)
+    record(invocation_begin_event, id_, 0, 0, 0, 0);
+
+  invoked_ = true;
+}
+
+void binary_handler_tracking::completion::invocation_begin(
+    const asio::error_code& ec)
+{
+  if (id_)
+    record(invocation_begin_event, id_, 0,
+        ec.category().name(), 0, ec.value());
+
+  invoked_ = true;
+}
+
+void binary_handler_tracking::completion::invocation_begin(
+    const asio::error_code& ec, std::size_t bytes_transferred)
+{
+  if (id_)
+    record(invocation_begin_event, id_, bytes_transferred,
+        ec.category().name(), 0, ec.value());
+
+  invoked_ = true;
+}
+
+void binary_handler_tracking::completion::invocation_begin(
+    const asio::error_code& ec, int signal_number)
+{
+  if (id_)
+    record(invocation_begin_event, id_, signal_number,
+        ec.category().name(), 0, ec.value());
+
+  invoked_ = true;
+}
+
+void binary_handler_tracking::completion::invocation_begin(
+    const asio::error_code& ec, const char* /*arg*/)
+{
+  if (id_)
+    record(invocation_begin_event, id_, 0,
+        ec.category().name(), 0, ec.value());
+
+  invoked_ = true;
+}
+
+void binary_handler_tracking::completion::invocation_end()
+{
+  if (id_)
+  {
+    record(invocation_end_event, id_, 0, 0, 0, 0);
+
+    id_ = 0;
+  }
+}
+
+void binary_handler_tracking::operation(execution_context&,
+    const char* object_type, void* /*object*/,
+    uintmax_t /*native_handle*/, const char* op_name)
+{
+  thread_state* t = get_thread_state();
+  if (completion* current_completion = t->current_completion_)
+    if (current_completion->id_)
+      record(operation_event, current_completion->id_, 0,
+          object_type, op_name, 0);
+}
+
+void binary_handler_tracking::reactor_registration(
+    execution_context& /*context*/, uintmax_t native_handle,
+    uintmax_t registration)
+{
+  record(reactor_registration_event, registration, native_handle, 0, 0, 0);
+}
+
+void binary_handler_tracking::reactor_deregistration(
+    execution_context& /*context*/, uintmax_t native_handle,
+    uintmax_t registration)
+{
+  record(reactor_deregistration_event, registration, native_handle, 0, 0, 0);
+}
+
+void binary_handler_tracking::reactor_events(execution_context& /*context*/,
+    uintmax_t registration, unsigned events)
+{
+  static tracking_state* state = get_state();
+
+  // Readiness events are not tied to a handler, so they are sampled using
+  // the same per-thread count as handler creation.
+  thread_state* t = get_thread_state();
+  unsigned long rate = state->sample_rate_;
+  if (rate != 0 && t->sample_count_++ % rate == 0)
+    record(reactor_events_event, registration, events, 0, 0, 0);
+}
+
+void binary_handler_tracking::reactor_operation(
+    const tracked_handler& h, const char* op_name,
+    const asio::error_code& ec)
+{
+  if (h.id_)
+    record(reactor_operation_event, h.id_, 0,
+        ec.category().name(), op_name, ec.value());
+}
+
+void binary_handler_tracking::reactor_operation(
+    const tracked_handler& h, const char* op_name,
+    const asio::error_code& ec, std::size_t bytes_transferred)
+{
+  if (h.id_)
+    record(reactor_operation_event, h.id_, bytes_transferred,
+        ec.category().name(), op_name, ec.value());
+}
+
+} // namespace detail
+} // namespace asio
+
+#include "asio/detail/pop_options.hpp"
+
+#endif // defined(ASIO_ENABLE_BINARY_HANDLER_TRACKING)
+
+#endif // ASIO_DETAIL_IMPL_BINARY_HANDLER_TRACKING_IPP
@@ -21,6 +21,10 @@
 
 // The handler tracking implementation is provided by the user-specified header.
 
+#elif defined(ASIO_ENABLE_BINARY_HANDLER_TRACKING)
+
+// The handler tracking implementation is in binary_handler_tracking.ipp.
+
 #elif defined(ASIO_ENABLE_HANDLER_TRACKING)
 
 #include <cstdarg>
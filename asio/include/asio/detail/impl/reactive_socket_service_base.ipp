@@ -43,6 +43,9 @@ void reactive_socket_service_base::construct(
 {
   impl.socket_ = invalid_socket;
   impl.state_ = 0;
+#if defined(ASIO_HAS_MSG_ZEROCOPY)
+  impl.zerocopy_.reset();
+#endif // defined(ASIO_HAS_MSG_ZEROCOPY)
 }
 
 void reactive_socket_service_base::base_move_construct(
@@ -56,6 +59,11 @@ void reactive_socket_service_base::base_move_construct(
   impl.state_ = other_impl.state_;
   other_impl.state_ = 0;
 
+#if defined(ASIO_HAS_MSG_ZEROCOPY)
+  impl.zerocopy_ = other_impl.zerocopy_;
+  other_impl.zerocopy_.reset();
+#endif // defined(ASIO_HAS_MSG_ZEROCOPY)
+
   reactor_.move_descriptor(impl.socket_,
       impl.reactor_data_, other_impl.reactor_data_);
 }
@@ -73,6 +81,11 @@ void reactive_socket_service_base::base_move_assign(
   impl.state_ = other_impl.state_;
   other_impl.state_ = 0;
 
+#if defined(ASIO_HAS_MSG_ZEROCOPY)
+  impl.zerocopy_ = other_impl.zerocopy_;
+  other_impl.zerocopy_.reset();
+#endif // defined(ASIO_HAS_MSG_ZEROCOPY)
+
   other_service.reactor_.move_descriptor(impl.socket_,
       impl.reactor_data_, other_impl.reactor_data_);
 }
@@ -168,6 +181,37 @@ asio::error_code reactive_socket_service_base::cancel(
   return ec;
 }
 
+#if defined(ASIO_HAS_MSG_ZEROCOPY)
+asio::error_code reactive_socket_service_base::set_zerocopy_threshold(
+    reactive_socket_service_base::base_implementation_type& impl,
+    std::size_t size, asio::error_code& ec)
+{
+  if (!is_open(impl))
+  {
+    ec = asio::error::bad_descriptor;
+    return ec;
+  }
+
+  // The kernel's completion ids are per socket, so the state is kept until
+  // the socket is closed even if zero-copy sends are later disabled.
+  if (size != 0 && !impl.zerocopy_)
+  {
+    int optval = 1;
+    if (socket_ops::setsockopt(impl.socket_, impl.state_, SOL_SOCKET,
+          SO_ZEROCOPY, &optval, sizeof(optval), ec) != 0)
+      return ec;
+
+    impl.zerocopy_.reset(new reactive_socket_zerocopy_state);
+  }
+
+  if (impl.zerocopy_)
+    impl.zerocopy_->threshold_ = size;
+
+  ec = asio::error_code();
+  return ec;
+}
+#endif // defined(ASIO_HAS_MSG_ZEROCOPY)
+
 asio::error_code reactive_socket_service_base::do_open(
     reactive_socket_service_base::base_implementation_type& impl,
     int af, int type, int protocol, asio::error_code& ec)
@@ -27,6 +27,10 @@
 #include "asio/detail/socket_ops.hpp"
 #include "asio/error.hpp"
 
+#if defined(ASIO_HAS_MSG_ZEROCOPY)
+# include <linux/errqueue.h>
+#endif // defined(ASIO_HAS_MSG_ZEROCOPY)
+
 #if defined(ASIO_WINDOWS_RUNTIME)
 # include <codecvt>
 # include <locale>
@@ -1280,6 +1284,66 @@ bool non_blocking_send(socket_type s,
 
 #endif // defined(ASIO_HAS_IOCP)
 
+#if defined(ASIO_HAS_MSG_ZEROCOPY)
+
+bool non_blocking_recv_zerocopy(socket_type s,
+    uint32_t& first, uint32_t& last, bool& copied,
+    asio::error_code& ec)
+{
+  for (;;)
+  {
+    union
+    {
+      cmsghdr align;
+      char data[CMSG_SPACE(sizeof(sock_extended_err))
+        + CMSG_SPACE(sizeof(sockaddr_in6))];
+    } control;
+    msghdr msg = msghdr();
+    msg.msg_control = control.data;
+    msg.msg_controllen = sizeof(control.data);
+
+    clear_last_error();
+    signed_size_type result = error_wrapper(
+        ::recvmsg(s, &msg, MSG_ERRQUEUE), ec);
+
+    // Retry operation if interrupted by signal.
+    if (ec == asio::error::interrupted)
+      continue;
+
+    // Check if we need to run the operation again.
+    if (ec == asio::error::would_block
+        || ec == asio::error::try_again)
+      return false;
+
+    // Operation failed.
+    if (result < 0)
+      return true;
+
+    // Skip anything on the error queue that is not a zero-copy completion.
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+        cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+      if ((cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR)
+          || (cmsg->cmsg_level == SOL_IPV6
+            && cmsg->cmsg_type == IPV6_RECVERR))
+      {
+        sock_extended_err err;
+        std::memcpy(&err, CMSG_DATA(cmsg), sizeof(err));
+        if (err.ee_origin == SO_EE_ORIGIN_ZEROCOPY && err.ee_errno == 0)
+        {
+          first = err.ee_info;
+          last = err.ee_data;
+          copied = (err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) != 0;
+          ec = asio::error_code();
+          return true;
+        }
+      }
+    }
+  }
+}
+
+#endif // defined(ASIO_HAS_MSG_ZEROCOPY)
+
 signed_size_type sendto(socket_type s, const buf* bufs, size_t count,
     int flags, const socket_addr_type* addr, std::size_t addrlen,
     asio::error_code& ec)
@@ -1386,6 +1450,175 @@ bool non_blocking_sendto(socket_type s,
 
 #endif // !defined(ASIO_HAS_IOCP)
 
+#if defined(ASIO_HAS_MMSG)
+
+signed_size_type recvmmsg(socket_type s, mmsghdr_type* msgs,
+    size_t count, int flags, asio::error_code& ec)
+{
+  clear_last_error();
+  signed_size_type result = error_wrapper(::recvmmsg(s, msgs,
+        static_cast<unsigned int>(count), flags, 0), ec);
+  if (result >= 0)
+    ec = asio::error_code();
+  return result;
+}
+
+size_t sync_recvmmsg(socket_type s, state_type state,
+    mmsghdr_type* msgs, size_t count, int flags, asio::error_code& ec)
+{
+  if (s == invalid_socket)
+  {
+    ec = asio::error::bad_descriptor;
+    return 0;
+  }
+
+  // A request to receive 0 datagrams on a datagram socket is a no-op.
+  if (count == 0)
+  {
+    ec = asio::error_code();
+    return 0;
+  }
+
+  // Read some datagrams.
+  for (;;)
+  {
+    // Try to complete the operation without blocking.
+    signed_size_type datagrams = socket_ops::recvmmsg(
+        s, msgs, count, flags, ec);
+
+    // Check if operation succeeded.
+    if (datagrams >= 0)
+      return datagrams;
+
+    // Operation failed.
+    if ((state & user_set_non_blocking)
+        || (ec != asio::error::would_block
+          && ec != asio::error::try_again))
+      return 0;
+
+    // Wait for socket to become ready.
+    if (socket_ops::poll_read(s, 0, -1, ec) < 0)
+      return 0;
+  }
+}
+
+bool non_blocking_recvmmsg(socket_type s,
+    mmsghdr_type* msgs, size_t count, int flags,
+    asio::error_code& ec, size_t& datagrams_transferred)
+{
+  for (;;)
+  {
+    // Read some datagrams.
+    signed_size_type datagrams = socket_ops::recvmmsg(
+        s, msgs, count, flags, ec);
+
+    // Retry operation if interrupted by signal.
+    if (ec == asio::error::interrupted)
+      continue;
+
+    // Check if we need to run the operation again.
+    if (ec == asio::error::would_block
+        || ec == asio::error::try_again)
+      return false;
+
+    // Operation is complete.
+    if (datagrams >= 0)
+    {
+      ec = asio::error_code();
+      datagrams_transferred = datagrams;
+    }
+    else
+      datagrams_transferred = 0;
+
+    return true;
+  }
+}
+
+signed_size_type sendmmsg(socket_type s, mmsghdr_type* msgs,
+    size_t count, int flags, asio::error_code& ec)
+{
+  clear_last_error();
+  flags |= MSG_NOSIGNAL;
+  signed_size_type result = error_wrapper(::sendmmsg(s, msgs,
+        static_cast<unsigned int>(count), flags), ec);
+  if (result >= 0)
+    ec = asio::error_code();
+  return result;
+}
+
+size_t sync_sendmmsg(socket_type s, state_type state,
+    mmsghdr_type* msgs, size_t count, int flags, asio::error_code& ec)
+{
+  if (s == invalid_socket)
+  {
+    ec = asio::error::bad_descriptor;
+    return 0;
+  }
+
+  // A request to send 0 datagrams is a no-op.
+  if (count == 0)
+  {
+    ec = asio::error_code();
+    return 0;
+  }
+
+  // Write some datagrams.
+  for (;;)
+  {
+    // Try to complete the operation without blocking.
+    signed_size_type datagrams = socket_ops::sendmmsg(
+        s, msgs, count, flags, ec);
+
+    // Check if operation succeeded.
+    if (datagrams >= 0)
+      return datagrams;
+
+    // Operation failed.
+    if ((state & user_set_non_blocking)
+        || (ec != asio::error::would_block
+          && ec != asio::error::try_again))
+      return 0;
+
+    // Wait for socket to become ready.
+    if (socket_ops::poll_write(s, 0, -1, ec) < 0)
+      return 0;
+  }
+}
+
+bool non_blocking_sendmmsg(socket_type s,
+    mmsghdr_type* msgs, size_t count, int flags,
+    asio::error_code& ec, size_t& datagrams_transferred)
+{
+  for (;;)
+  {
+    // Write some datagrams.
+    signed_size_type datagrams = socket_ops::sendmmsg(
+        s, msgs, count, flags, ec);
+
+    // Retry operation if interrupted by signal.
+    if (ec == asio::error::interrupted)
+      continue;
+
+    // Check if we need to run the operation again.
+    if (ec == asio::error::would_block
+        || ec == asio::error::try_again)
+      return false;
+
+    // Operation is complete.
+    if (datagrams >= 0)
+    {
+      ec = asio::error_code();
+      datagrams_transferred = datagrams;
+    }
+    else
+      datagrams_transferred = 0;
+
+    return true;
+  }
+}
+
+#endif // defined(ASIO_HAS_MMSG)
+
 socket_type socket(int af, int type, int protocol,
     asio::error_code& ec)
 {
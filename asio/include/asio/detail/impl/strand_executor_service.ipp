@@ -26,7 +26,9 @@ namespace detail {
 strand_executor_service::strand_executor_service(execution_context& ctx)
   : execution_context_service_base<strand_executor_service>(ctx),
     mutex_(),
+#if !defined(ASIO_HAS_LOCK_FREE_STRAND)
     salt_(0),
+#endif // !defined(ASIO_HAS_LOCK_FREE_STRAND)
     impl_list_(0)
 {
 }
@@ -40,11 +42,26 @@ void strand_executor_service::shutdown()
   strand_impl* impl = impl_list_;
   while (impl)
   {
+#if defined(ASIO_HAS_LOCK_FREE_STRAND)
+    impl->shutdown_.store(true, std::memory_order_seq_cst);
+    std::size_t state = impl->state_.load(std::memory_order_acquire);
+    while (state != 0 && state != locked_empty)
+    {
+      if (impl->state_.compare_exchange_weak(state, locked_empty,
+            std::memory_order_acq_rel, std::memory_order_acquire))
+      {
+        take_waiting(state, ops);
+        break;
+      }
+    }
+    ops.push(impl->ready_queue_);
+#else // defined(ASIO_HAS_LOCK_FREE_STRAND)
     impl->mutex_->lock();
     impl->shutdown_ = true;
     ops.push(impl->waiting_queue_);
     ops.push(impl->ready_queue_);
     impl->mutex_->unlock();
+#endif // defined(ASIO_HAS_LOCK_FREE_STRAND)
     impl = impl->next_;
   }
 }
@@ -53,6 +70,12 @@ strand_executor_service::implementation_type
 strand_executor_service::create_implementation()
 {
   implementation_type new_impl(new strand_impl);
+#if defined(ASIO_HAS_LOCK_FREE_STRAND)
+  new_impl->state_.store(0, std::memory_order_relaxed);
+  new_impl->shutdown_.store(false, std::memory_order_relaxed);
+
+  asio::detail::mutex::scoped_lock lock(mutex_);
+#else // defined(ASIO_HAS_LOCK_FREE_STRAND)
   new_impl->locked_ = false;
   new_impl->shutdown_ = false;
 
@@ -67,6 +90,7 @@ strand_executor_service::create_implementation()
   if (!mutexes_[mutex_index].get())
     mutexes_[mutex_index].reset(new mutex);
   new_impl->mutex_ = mutexes_[mutex_index].get();
+#endif // defined(ASIO_HAS_LOCK_FREE_STRAND)
 
   // Insert implementation into linked list of all implementations.
   new_impl->next_ = impl_list_;
@@ -81,6 +105,14 @@ strand_executor_service::create_implementation()
 
 strand_executor_service::strand_impl::~strand_impl()
 {
+#if defined(ASIO_HAS_LOCK_FREE_STRAND)
+  // Destroy any handlers that were enqueued after shutdown started.
+  op_queue<scheduler_operation> ops;
+  std::size_t state = state_.load(std::memory_order_acquire);
+  if (state != 0 && state != locked_empty)
+    take_waiting(state, ops);
+#endif // defined(ASIO_HAS_LOCK_FREE_STRAND)
+
   asio::detail::mutex::scoped_lock lock(service_->mutex_);
 
   // Remove implementation from linked list of all implementations.
@@ -92,6 +124,93 @@ strand_executor_service::strand_impl::~strand_impl()
     next_->prev_= prev_;
 }
 
+#if defined(ASIO_HAS_LOCK_FREE_STRAND)
+
+bool strand_executor_service::enqueue(const implementation_type& impl,
+    scheduler_operation* op)
+{
+  if (impl->shutdown_.load(std::memory_order_acquire))
+  {
+    op->destroy();
+    return false;
+  }
+
+  std::size_t state = impl->state_.load(std::memory_order_relaxed);
+  for (;;)
+  {
+    if (state == 0)
+    {
+      // The function is acquiring the strand lock and so is responsible for
+      // scheduling the strand.
+      if (impl->state_.compare_exchange_weak(state, locked_empty,
+            std::memory_order_acquire, std::memory_order_relaxed))
+      {
+        impl->ready_queue_.push(op);
+        return true;
+      }
+    }
+    else
+    {
+      // Some other function already holds the strand lock. Enqueue for later.
+      op_queue_access::next(op, state == locked_empty
+          ? static_cast<scheduler_operation*>(0)
+          : reinterpret_cast<scheduler_operation*>(state));
+      if (impl->state_.compare_exchange_weak(state,
+            reinterpret_cast<std::size_t>(op),
+            std::memory_order_release, std::memory_order_relaxed))
+        return false;
+    }
+  }
+}
+
+bool strand_executor_service::push_waiting_to_ready(
+    const implementation_type& impl)
+{
+  std::size_t state = impl->state_.exchange(
+      locked_empty, std::memory_order_acquire);
+  if (state != locked_empty)
+    take_waiting(state, impl->ready_queue_);
+
+  while (impl->ready_queue_.empty())
+  {
+    // Nothing left to run, so try to release the lock. This fails only if
+    // another handler was enqueued in the meantime.
+    state = locked_empty;
+    if (impl->state_.compare_exchange_strong(state, 0,
+          std::memory_order_release, std::memory_order_relaxed))
+      return false;
+
+    state = impl->state_.exchange(locked_empty, std::memory_order_acquire);
+    take_waiting(state, impl->ready_queue_);
+  }
+
+  return true;
+}
+
+void strand_executor_service::take_waiting(std::size_t state,
+    op_queue<scheduler_operation>& ops)
+{
+  // Reverse the LIFO chain so that handlers run in the order they were added.
+  scheduler_operation* op = reinterpret_cast<scheduler_operation*>(state);
+  scheduler_operation* prev = 0;
+  while (op)
+  {
+    scheduler_operation* next = op_queue_access::next(op);
+    op_queue_access::next(op, prev);
+    prev = op;
+    op = next;
+  }
+
+  while (prev)
+  {
+    scheduler_operation* next = op_queue_access::next(prev);
+    ops.push(prev);
+    prev = next;
+  }
+}
+
+#else // defined(ASIO_HAS_LOCK_FREE_STRAND)
+
 bool strand_executor_service::enqueue(const implementation_type& impl,
     scheduler_operation* op)
 {
@@ -120,6 +239,18 @@ bool strand_executor_service::enqueue(const implementation_type& impl,
   }
 }
 
+bool strand_executor_service::push_waiting_to_ready(
+    const implementation_type& impl)
+{
+  impl->mutex_->lock();
+  impl->ready_queue_.push(impl->waiting_queue_);
+  bool more_handlers = impl->locked_ = !impl->ready_queue_.empty();
+  impl->mutex_->unlock();
+  return more_handlers;
+}
+
+#endif // defined(ASIO_HAS_LOCK_FREE_STRAND)
+
 bool strand_executor_service::running_in_this_thread(
     const implementation_type& impl)
 {
@@ -0,0 +1,144 @@
+//
+// detail/impl/thread_info_base.ipp
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2003-2020 Christopher M. Kohlhoff (chris at kohlhoff dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef ASIO_DETAIL_IMPL_THREAD_INFO_BASE_IPP
+#define ASIO_DETAIL_IMPL_THREAD_INFO_BASE_IPP
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include "asio/detail/config.hpp"
+#include "asio/detail/static_mutex.hpp"
+#include "asio/detail/thread_info_base.hpp"
+
+#include "asio/detail/push_options.hpp"
+
+namespace asio {
+namespace detail {
+
+struct thread_info_base::depot
+{
+  static_mutex mutex_;
+  void* free_list_[num_size_classes];
+  std::size_t free_count_[num_size_classes];
+  cache_statistics exited_;
+
+  static depot* init(depot* d)
+  {
+    d->mutex_.init();
+    return d;
+  }
+};
+
+thread_info_base::depot* thread_info_base::get_depot()
+{
+  static depot d = { ASIO_STATIC_MUTEX_INIT, { 0 }, { 0 }, { 0 } };
+  static depot* const instance = depot::init(&d);
+  return instance;
+}
+
+thread_info_base::cache_statistics
+thread_info_base::exited_thread_statistics()
+{
+  depot* d = get_depot();
+  static_mutex::scoped_lock lock(d->mutex_);
+  return d->exited_;
+}
+
+bool thread_info_base::refill(thread_info_base* this_thread,
+    std::size_t index)
+{
+  depot* d = get_depot();
+  static_mutex::scoped_lock lock(d->mutex_);
+
+  std::size_t moved = 0;
+  while (moved < batch_size && d->free_list_[index])
+  {
+    void* pointer = d->free_list_[index];
+    d->free_list_[index] = *static_cast<void**>(pointer);
+    --d->free_count_[index];
+    this_thread->push(index, pointer);
+    ++moved;
+  }
+
+  return moved != 0;
+}
+
+void thread_info_base::flush(thread_info_base* this_thread,
+    std::size_t index)
+{
+  depot* d = get_depot();
+  static_mutex::scoped_lock lock(d->mutex_);
+
+  for (std::size_t i = 0; i < batch_size; ++i)
+  {
+    void* pointer = this_thread->pop(index);
+    if (!pointer)
+      break;
+
+    if (d->free_count_[index] < depot_size)
+    {
+      *static_cast<void**>(pointer) = d->free_list_[index];
+      d->free_list_[index] = pointer;
+      ++d->free_count_[index];
+      ++this_thread->statistics_.returned;
+    }
+    else
+    {
+      ::operator delete(pointer);
+      ++this_thread->statistics_.freed;
+    }
+  }
+}
+
+void thread_info_base::return_to_depot(std::size_t index, void* pointer)
+{
+  depot* d = get_depot();
+  static_mutex::scoped_lock lock(d->mutex_);
+
+  if (d->free_count_[index] < depot_size)
+  {
+    *static_cast<void**>(pointer) = d->free_list_[index];
+    d->free_list_[index] = pointer;
+    ++d->free_count_[index];
+  }
+  else
+  {
+    lock.unlock();
+    ::operator delete(pointer);
+  }
+}
+
+void thread_info_base::thread_exit(thread_info_base* this_thread)
+{
+  for (std::size_t index = 0; index < num_size_classes; ++index)
+    while (this_thread->free_list_[index])
+      flush(this_thread, index);
+
+  depot* d = get_depot();
+  static_mutex::scoped_lock lock(d->mutex_);
+
+  const cache_statistics& s = this_thread->statistics_;
+  d->exited_.hits += s.hits;
+  d->exited_.depot_hits += s.depot_hits;
+  d->exited_.misses += s.misses;
+  d->exited_.oversized += s.oversized;
+  d->exited_.cached += s.cached;
+  d->exited_.returned += s.returned;
+  d->exited_.freed += s.freed;
+}
+
+} // namespace detail
+} // namespace asio
+
+#include "asio/detail/pop_options.hpp"
+
+#endif // ASIO_DETAIL_IMPL_THREAD_INFO_BASE_IPP
@@ -0,0 +1,240 @@
+//
+// detail/reactive_socket_send_zerocopy_op.hpp
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2003-2020 Christopher M. Kohlhoff (chris at kohlhoff dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef ASIO_DETAIL_REACTIVE_SOCKET_SEND_ZEROCOPY_OP_HPP
+#define ASIO_DETAIL_REACTIVE_SOCKET_SEND_ZEROCOPY_OP_HPP
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include "asio/detail/config.hpp"
+#include "asio/detail/socket_types.hpp"
+
+#if defined(ASIO_HAS_MSG_ZEROCOPY)
+
+#include "asio/detail/bind_handler.hpp"
+#include "asio/detail/buffer_sequence_adapter.hpp"
+#include "asio/detail/cstdint.hpp"
+#include "asio/detail/fenced_block.hpp"
+#include "asio/detail/memory.hpp"
+#include "asio/detail/reactor_op.hpp"
+#include "asio/detail/socket_ops.hpp"
+
+#include "asio/detail/push_options.hpp"
+
+namespace asio {
+namespace detail {
+
+// Per-socket zero-copy state. The kernel numbers each successful MSG_ZEROCOPY
+// send on a socket, starting from zero, and reports released ranges of these
+// ids on the error queue. Only accessed while holding the descriptor's lock.
+struct reactive_socket_zerocopy_state
+{
+  reactive_socket_zerocopy_state()
+    : threshold_(0),
+      next_id_(0),
+      released_(0),
+      copied_(0)
+  {
+  }
+
+  // Sends of at least this many bytes use MSG_ZEROCOPY. Zero disables.
+  std::size_t threshold_;
+
+  // The id that the kernel will assign to the next zero-copy send.
+  uint32_t next_id_;
+
+  // All ids before this one have been released by the kernel.
+  uint32_t released_;
+
+  // The number of sends for which the kernel fell back to copying.
+  uint64_t copied_;
+};
+
+// Sends all of the buffers using MSG_ZEROCOPY and then waits on the socket's
+// error queue until the kernel no longer references them. The op stays on the
+// reactor's write queue while it waits, since error-queue readiness is
+// reported to the write queue as EPOLLERR.
+template <typename ConstBufferSequence>
+class reactive_socket_send_zerocopy_op_base : public reactor_op
+{
+public:
+  reactive_socket_send_zerocopy_op_base(socket_type socket,
+      const shared_ptr<reactive_socket_zerocopy_state>& zerocopy,
+      const ConstBufferSequence& buffers, socket_base::message_flags flags,
+      func_type complete_func)
+    : reactor_op(&reactive_socket_send_zerocopy_op_base::do_perform,
+        complete_func),
+      socket_(socket),
+      zerocopy_(zerocopy),
+      buffers_(buffers),
+      flags_(flags),
+      pending_(false),
+      last_id_(0)
+  {
+  }
+
+  static status do_perform(reactor_op* base)
+  {
+    reactive_socket_send_zerocopy_op_base* o(
+        static_cast<reactive_socket_send_zerocopy_op_base*>(base));
+
+    buffer_sequence_adapter<asio::const_buffer,
+        ConstBufferSequence> bufs(o->buffers_);
+
+    while (o->bytes_transferred_ < bufs.total_size())
+    {
+      // Skip over the data sent by previous attempts.
+      socket_ops::buf* b = bufs.buffers();
+      std::size_t count = bufs.count();
+      std::size_t offset = o->bytes_transferred_;
+      while (offset >= b->iov_len)
+      {
+        offset -= b->iov_len;
+        ++b;
+        --count;
+      }
+      b->iov_base = static_cast<char*>(b->iov_base) + offset;
+      b->iov_len -= offset;
+
+      std::size_t bytes = 0;
+      if (!socket_ops::non_blocking_send(o->socket_, b, count,
+            o->flags_ | MSG_ZEROCOPY, o->ec_, bytes))
+        return not_done;
+
+      bool zerocopy = true;
+      if (o->ec_ == asio::error::no_buffer_space)
+      {
+        // The pages could not be pinned, so send this part by copying.
+        zerocopy = false;
+        if (!socket_ops::non_blocking_send(o->socket_,
+              b, count, o->flags_, o->ec_, bytes))
+          return not_done;
+      }
+
+      if (o->ec_)
+      {
+        o->pending_ = false;
+        break;
+      }
+
+      o->bytes_transferred_ += bytes;
+      if (zerocopy)
+      {
+        o->last_id_ = o->zerocopy_->next_id_++;
+        o->pending_ = true;
+      }
+    }
+
+    while (o->pending_)
+    {
+      reactive_socket_zerocopy_state& z = *o->zerocopy_;
+      if (static_cast<int32_t>(z.released_ - o->last_id_) > 0)
+        break;
+
+      uint32_t first = 0, last = 0;
+      bool copied = false;
+      if (!socket_ops::non_blocking_recv_zerocopy(
+            o->socket_, first, last, copied, o->ec_))
+        return not_done;
+
+      if (o->ec_)
+        break;
+
+      // TCP completes in send order, so a range only ever moves the released
+      // mark forward.
+      if (static_cast<int32_t>(last + 1 - z.released_) > 0)
+        z.released_ = last + 1;
+      if (copied)
+        z.copied_ += last - first + 1;
+    }
+
+    ASIO_HANDLER_REACTOR_OPERATION((*o, "non_blocking_send_zerocopy",
+          o->ec_, o->bytes_transferred_));
+
+    return done;
+  }
+
+private:
+  socket_type socket_;
+  shared_ptr<reactive_socket_zerocopy_state> zerocopy_;
+  ConstBufferSequence buffers_;
+  socket_base::message_flags flags_;
+  bool pending_;
+  uint32_t last_id_;
+};
+
+template <typename ConstBufferSequence, typename Handler, typename IoExecutor>
+class reactive_socket_send_zerocopy_op :
+  public reactive_socket_send_zerocopy_op_base<ConstBufferSequence>
+{
+public:
+  ASIO_DEFINE_HANDLER_PTR(reactive_socket_send_zerocopy_op);
+
+  reactive_socket_send_zerocopy_op(socket_type socket,
+      const shared_ptr<reactive_socket_zerocopy_state>& zerocopy,
+      const ConstBufferSequence& buffers, socket_base::message_flags flags,
+      Handler& handler, const IoExecutor& io_ex)
+    : reactive_socket_send_zerocopy_op_base<ConstBufferSequence>(
+        socket, zerocopy, buffers, flags,
+        &reactive_socket_send_zerocopy_op::do_complete),
+      handler_(ASIO_MOVE_CAST(Handler)(handler)),
+      io_executor_(io_ex)
+  {
+    handler_work<Handler, IoExecutor>::start(handler_, io_executor_);
+  }
+
+  static void do_complete(void* owner, operation* base,
+      const asio::error_code& /*ec*/,
+      std::size_t /*bytes_transferred*/)
+  {
+    // Take ownership of the handler object.
+    reactive_socket_send_zerocopy_op* o(
+        static_cast<reactive_socket_send_zerocopy_op*>(base));
+    ptr p = { asio::detail::addressof(o->handler_), o, o };
+    handler_work<Handler, IoExecutor> w(o->handler_, o->io_executor_);
+
+    ASIO_HANDLER_COMPLETION((*o));
+
+    // Make a copy of the handler so that the memory can be deallocated before
+    // the upcall is made. Even if we're not about to make an upcall, a
+    // sub-object of the handler may be the true owner of the memory associated
+    // with the handler. Consequently, a local copy of the handler is required
+    // to ensure that any owning sub-object remains valid until after we have
+    // deallocated the memory here.
+    detail::binder2<Handler, asio::error_code, std::size_t>
+      handler(o->handler_, o->ec_, o->bytes_transferred_);
+    p.h = asio::detail::addressof(handler.handler_);
+    p.reset();
+
+    // Make the upcall if required.
+    if (owner)
+    {
+      fenced_block b(fenced_block::half);
+      ASIO_HANDLER_INVOCATION_BEGIN((handler.arg1_, handler.arg2_));
+      w.complete(handler, handler.handler_);
+      ASIO_HANDLER_INVOCATION_END;
+    }
+  }
+
+private:
+  Handler handler_;
+  IoExecutor io_executor_;
+};
+
+} // namespace detail
+} // namespace asio
+
+#include "asio/detail/pop_options.hpp"
+
+#endif // defined(ASIO_HAS_MSG_ZEROCOPY)
+
+#endif // ASIO_DETAIL_REACTIVE_SOCKET_SEND_ZEROCOPY_OP_HPP
@@ -29,7 +29,9 @@
 #include "asio/detail/reactive_null_buffers_op.hpp"
 #include "asio/detail/reactive_socket_accept_op.hpp"
 #include "asio/detail/reactive_socket_connect_op.hpp"
+#include "asio/detail/reactive_socket_recvmmsg_op.hpp"
 #include "asio/detail/reactive_socket_recvfrom_op.hpp"
+#include "asio/detail/reactive_socket_sendmmsg_op.hpp"
 #include "asio/detail/reactive_socket_sendto_op.hpp"
 #include "asio/detail/reactive_socket_service_base.hpp"
 #include "asio/detail/reactor.hpp"
@@ -382,6 +384,101 @@ public:
     p.v = p.p = 0;
   }
 
+#if defined(ASIO_HAS_MMSG)
+  // Receive a batch of datagrams, blocking until at least one is available.
+  // Returns the number of datagrams received.
+  template <typename Datagram>
+  size_t receive_batch(implementation_type& impl, Datagram* datagrams,
+      std::size_t count, socket_base::message_flags flags,
+      asio::error_code& ec)
+  {
+    datagram_batch_adapter<Datagram> batch(datagrams, count, true);
+
+    std::size_t datagrams_recvd = socket_ops::sync_recvmmsg(
+        impl.socket_, impl.state_, batch.msgs(), batch.count(), flags, ec);
+
+    if (!ec)
+      batch.complete(datagrams_recvd, true);
+
+    return datagrams_recvd;
+  }
+
+  // Start an asynchronous batched receive. The datagrams must be valid for
+  // the lifetime of the asynchronous operation.
+  template <typename Datagram, typename Handler, typename IoExecutor>
+  void async_receive_batch(implementation_type& impl, Datagram* datagrams,
+      std::size_t count, socket_base::message_flags flags,
+      Handler& handler, const IoExecutor& io_ex)
+  {
+    bool is_continuation =
+      asio_handler_cont_helpers::is_continuation(handler);
+
+    // Allocate and construct an operation to wrap the handler.
+    typedef reactive_socket_recvmmsg_op<Datagram, Handler, IoExecutor> op;
+    typename op::ptr p = { asio::detail::addressof(handler),
+      op::ptr::allocate(handler), 0 };
+    p.p = new (p.v) op(impl.socket_, datagrams, count, flags, handler, io_ex);
+
+    ASIO_HANDLER_CREATION((reactor_.context(), *p.p, "socket",
+          &impl, impl.socket_, "async_receive_batch"));
+
+    start_op(impl,
+        (flags & socket_base::message_out_of_band)
+          ? reactor::except_op : reactor::read_op,
+        p.p, is_continuation, true, count == 0);
+    p.v = p.p = 0;
+  }
+
+  // Send a batch of datagrams, each to its own endpoint. Returns the number
+  // of datagrams sent, which is less than count only if an error occurred.
+  template <typename Datagram>
+  size_t send_batch(implementation_type& impl, Datagram* datagrams,
+      std::size_t count, socket_base::message_flags flags,
+      asio::error_code& ec)
+  {
+    ec = asio::error_code();
+    std::size_t datagrams_sent = 0;
+    while (datagrams_sent < count)
+    {
+      datagram_batch_adapter<Datagram> batch(
+          datagrams + datagrams_sent, count - datagrams_sent, false);
+
+      std::size_t n = socket_ops::sync_sendmmsg(impl.socket_,
+          impl.state_, batch.msgs(), batch.count(), flags, ec);
+      if (ec)
+        break;
+
+      batch.complete(n, false);
+      datagrams_sent += n;
+    }
+
+    return datagrams_sent;
+  }
+
+  // Start an asynchronous batched send. The datagrams must be valid for the
+  // lifetime of the asynchronous operation.
+  template <typename Datagram, typename Handler, typename IoExecutor>
+  void async_send_batch(implementation_type& impl, Datagram* datagrams,
+      std::size_t count, socket_base::message_flags flags,
+      Handler& handler, const IoExecutor& io_ex)
+  {
+    bool is_continuation =
+      asio_handler_cont_helpers::is_continuation(handler);
+
+    // Allocate and construct an operation to wrap the handler.
+    typedef reactive_socket_sendmmsg_op<Datagram, Handler, IoExecutor> op;
+    typename op::ptr p = { asio::detail::addressof(handler),
+      op::ptr::allocate(handler), 0 };
+    p.p = new (p.v) op(impl.socket_, datagrams, count, flags, handler, io_ex);
+
+    ASIO_HANDLER_CREATION((reactor_.context(), *p.p, "socket",
+          &impl, impl.socket_, "async_send_batch"));
+
+    start_op(impl, reactor::write_op, p.p, is_continuation, true, count == 0);
+    p.v = p.p = 0;
+  }
+#endif // defined(ASIO_HAS_MMSG)
+
   // Accept a new connection.
   template <typename Socket>
   asio::error_code accept(implementation_type& impl,
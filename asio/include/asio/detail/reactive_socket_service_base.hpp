@@ -30,6 +30,7 @@
 #include "asio/detail/reactive_socket_recv_op.hpp"
 #include "asio/detail/reactive_socket_recvmsg_op.hpp"
 #include "asio/detail/reactive_socket_send_op.hpp"
+#include "asio/detail/reactive_socket_send_zerocopy_op.hpp"
 #include "asio/detail/reactive_wait_op.hpp"
 #include "asio/detail/reactor.hpp"
 #include "asio/detail/reactor_op.hpp"
@@ -59,6 +60,11 @@ public:
 
     // Per-descriptor data used by the reactor.
     reactor::per_descriptor_data reactor_data_;
+
+#if defined(ASIO_HAS_MSG_ZEROCOPY)
+    // Zero-copy send state, created when zero-copy sends are first enabled.
+    shared_ptr<reactive_socket_zerocopy_state> zerocopy_;
+#endif // defined(ASIO_HAS_MSG_ZEROCOPY)
   };
 
   // Constructor.
@@ -166,6 +172,19 @@ public:
     return ec;
   }
 
+#if defined(ASIO_HAS_MSG_ZEROCOPY)
+  // Sets the size at or above which asynchronous sends use MSG_ZEROCOPY.
+  ASIO_DECL asio::error_code set_zerocopy_threshold(
+      base_implementation_type& impl, std::size_t size,
+      asio::error_code& ec);
+
+  // Gets the size at or above which asynchronous sends use MSG_ZEROCOPY.
+  std::size_t zerocopy_threshold(const base_implementation_type& impl) const
+  {
+    return impl.zerocopy_ ? impl.zerocopy_->threshold_ : 0;
+  }
+#endif // defined(ASIO_HAS_MSG_ZEROCOPY)
+
   // Wait for the socket to become ready to read, ready to write, or to have
   // pending error conditions.
   asio::error_code wait(base_implementation_type& impl,
@@ -264,6 +283,28 @@ public:
     bool is_continuation =
       asio_handler_cont_helpers::is_continuation(handler);
 
+#if defined(ASIO_HAS_MSG_ZEROCOPY)
+    if (impl.zerocopy_ && impl.zerocopy_->threshold_
+        && (impl.state_ & socket_ops::stream_oriented)
+        && asio::buffer_size(buffers) >= impl.zerocopy_->threshold_)
+    {
+      // Allocate and construct an operation to wrap the handler.
+      typedef reactive_socket_send_zerocopy_op<
+          ConstBufferSequence, Handler, IoExecutor> op;
+      typename op::ptr p = { asio::detail::addressof(handler),
+        op::ptr::allocate(handler), 0 };
+      p.p = new (p.v) op(impl.socket_, impl.zerocopy_,
+          buffers, flags, handler, io_ex);
+
+      ASIO_HANDLER_CREATION((reactor_.context(), *p.p, "socket",
+            &impl, impl.socket_, "async_send(zerocopy)"));
+
+      start_op(impl, reactor::write_op, p.p, is_continuation, true, false);
+      p.v = p.p = 0;
+      return;
+    }
+#endif // defined(ASIO_HAS_MSG_ZEROCOPY)
+
     // Allocate and construct an operation to wrap the handler.
     typedef reactive_socket_send_op<
         ConstBufferSequence, Handler, IoExecutor> op;
@@ -18,6 +18,7 @@
 #include "asio/detail/config.hpp"
 
 #include "asio/error_code.hpp"
+#include "asio/detail/cstdint.hpp"
 #include "asio/detail/memory.hpp"
 #include "asio/detail/socket_types.hpp"
 
@@ -222,6 +223,17 @@ ASIO_DECL bool non_blocking_send(socket_type s,
 
 #endif // defined(ASIO_HAS_IOCP)
 
+#if defined(ASIO_HAS_MSG_ZEROCOPY)
+
+// Read one zero-copy completion from the socket's error queue. On success the
+// ids [first, last] have been released by the kernel, and copied is set if the
+// kernel fell back to copying the data. Returns false if the queue is empty.
+ASIO_DECL bool non_blocking_recv_zerocopy(socket_type s,
+    uint32_t& first, uint32_t& last, bool& copied,
+    asio::error_code& ec);
+
+#endif // defined(ASIO_HAS_MSG_ZEROCOPY)
+
 ASIO_DECL signed_size_type sendto(socket_type s, const buf* bufs,
     size_t count, int flags, const socket_addr_type* addr,
     std::size_t addrlen, asio::error_code& ec);
@@ -239,6 +251,32 @@ ASIO_DECL bool non_blocking_sendto(socket_type s,
 
 #endif // !defined(ASIO_HAS_IOCP)
 
+#if defined(ASIO_HAS_MMSG)
+
+// Receive or send up to count datagrams in one call. Returns the number of
+// datagrams transferred, with the size of each one in its msg_len.
+ASIO_DECL signed_size_type recvmmsg(socket_type s, mmsghdr_type* msgs,
+    size_t count, int flags, asio::error_code& ec);
+
+ASIO_DECL size_t sync_recvmmsg(socket_type s, state_type state,
+    mmsghdr_type* msgs, size_t count, int flags, asio::error_code& ec);
+
+ASIO_DECL bool non_blocking_recvmmsg(socket_type s,
+    mmsghdr_type* msgs, size_t count, int flags,
+    asio::error_code& ec, size_t& datagrams_transferred);
+
+ASIO_DECL signed_size_type sendmmsg(socket_type s, mmsghdr_type* msgs,
+    size_t count, int flags, asio::error_code& ec);
+
+ASIO_DECL size_t sync_sendmmsg(socket_type s, state_type state,
+    mmsghdr_type* msgs, size_t count, int flags, asio::error_code& ec);
+
+ASIO_DECL bool non_blocking_sendmmsg(socket_type s,
+    mmsghdr_type* msgs, size_t count, int flags,
+    asio::error_code& ec, size_t& datagrams_transferred);
+
+#endif // defined(ASIO_HAS_MMSG)
+
 ASIO_DECL socket_type socket(int af, int type, int protocol,
     asio::error_code& ec);
 
@@ -403,6 +403,26 @@ const int max_iov_len = IOV_MAX;
 // POSIX platforms are not required to define IOV_MAX.
 const int max_iov_len = 16;
 # endif
+// Linux zero-copy transmission. Completions are read from the socket's error
+// queue, which the epoll reactor reports as an error event.
+# if !defined(ASIO_HAS_MSG_ZEROCOPY)
+#  if !defined(ASIO_DISABLE_MSG_ZEROCOPY)
+#   if defined(ASIO_HAS_EPOLL) && defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+#    define ASIO_HAS_MSG_ZEROCOPY 1
+#   endif // defined(ASIO_HAS_EPOLL) && defined(SO_ZEROCOPY) && ...
+#  endif // !defined(ASIO_DISABLE_MSG_ZEROCOPY)
+# endif // !defined(ASIO_HAS_MSG_ZEROCOPY)
+// Linux batched datagram operations, using recvmmsg and sendmmsg.
+# if !defined(ASIO_HAS_MMSG)
+#  if !defined(ASIO_DISABLE_MMSG)
+#   if defined(__linux__) && defined(_GNU_SOURCE)
+#    define ASIO_HAS_MMSG 1
+#   endif // defined(__linux__) && defined(_GNU_SOURCE)
+#  endif // !defined(ASIO_DISABLE_MMSG)
+# endif // !defined(ASIO_HAS_MMSG)
+# if defined(ASIO_HAS_MMSG)
+typedef mmsghdr mmsghdr_type;
+# endif // defined(ASIO_HAS_MMSG)
 #endif
 const int custom_socket_option_level = 0xA5100000;
 const int enable_connection_aborted_option = 1;
@@ -25,6 +25,10 @@
 #include "asio/detail/scoped_ptr.hpp"
 #include "asio/execution_context.hpp"
 
+#if defined(ASIO_HAS_LOCK_FREE_STRAND)
+# include <atomic>
+#endif // defined(ASIO_HAS_LOCK_FREE_STRAND)
+
 #include "asio/detail/push_options.hpp"
 
 namespace asio {
@@ -44,6 +48,20 @@ public:
   private:
     friend class strand_executor_service;
 
+#if defined(ASIO_HAS_LOCK_FREE_STRAND)
+    // Combined lock state and waiting queue. A value of zero means that the
+    // strand is not locked. The value locked_empty means that the strand is
+    // locked by a handler with no other handlers waiting. Any other value is
+    // a pointer to the most recently enqueued waiting handler, with older
+    // handlers linked through their next_ pointers (i.e. in LIFO order).
+    // Producers push with a compare-and-swap; only the lock holder may take
+    // the waiting handlers or release the lock.
+    std::atomic<std::size_t> state_;
+
+    // Indicates that the strand has been shut down and will accept no further
+    // handlers.
+    std::atomic<bool> shutdown_;
+#else // defined(ASIO_HAS_LOCK_FREE_STRAND)
     // Mutex to protect access to internal data.
     mutex* mutex_;
 
@@ -60,6 +78,7 @@ public:
     // after the next time the strand is scheduled. This queue must only be
     // modified while the mutex is locked.
     op_queue<scheduler_operation> waiting_queue_;
+#endif // defined(ASIO_HAS_LOCK_FREE_STRAND)
 
     // The handlers that are ready to be run. Logically speaking, these are the
     // handlers that hold the strand's lock. The ready queue is only modified
@@ -112,9 +131,26 @@ private:
   ASIO_DECL static bool enqueue(const implementation_type& impl,
       scheduler_operation* op);
 
+  // Moves waiting handlers to the ready queue, and releases the lock if there
+  // are none. Must only be called by the holder of the strand lock. Returns
+  // true if the strand is still locked and must be rescheduled.
+  ASIO_DECL static bool push_waiting_to_ready(
+      const implementation_type& impl);
+
+#if defined(ASIO_HAS_LOCK_FREE_STRAND)
+  // Value of strand_impl::state_ when locked with no waiting handlers.
+  enum { locked_empty = 1 };
+
+  // Takes all waiting handlers from a state value and appends them, in the
+  // order in which they were enqueued, to the given queue.
+  ASIO_DECL static void take_waiting(std::size_t state,
+      op_queue<scheduler_operation>& ops);
+#endif // defined(ASIO_HAS_LOCK_FREE_STRAND)
+
   // Mutex to protect access to the service-wide state.
   mutex mutex_;
 
+#if !defined(ASIO_HAS_LOCK_FREE_STRAND)
   // Number of mutexes shared between all strand objects.
   enum { num_mutexes = 193 };
 
@@ -124,6 +160,7 @@ private:
   // Extra value used when hashing to prevent recycled memory locations from
   // getting the same mutex.
   std::size_t salt_;
+#endif // !defined(ASIO_HAS_LOCK_FREE_STRAND)
 
   // The head of a linked list of all implementations.
   strand_impl* impl_list_;
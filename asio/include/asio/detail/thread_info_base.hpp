@@ -15,7 +15,7 @@
 # pragma once
 #endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
 
-#include <climits>
+#include "asio/detail/config.hpp"
 #include <cstddef>
 #include "asio/detail/noncopyable.hpp"
 
@@ -24,35 +24,69 @@
 namespace asio {
 namespace detail {
 
+// Per-thread cache of recently freed memory blocks, used to recycle the memory
+// for handlers and other short-lived objects. Blocks are grouped into
+// power-of-two size classes, each of which keeps a small free list. When a
+// thread's free list overflows, or a block is freed on a thread that is not
+// running an execution context, blocks are returned to a bounded depot that is
+// shared between all threads. A thread with an empty free list refills it
+// from the depot before falling back to ::operator new.
 class thread_info_base
   : private noncopyable
 {
 public:
   struct default_tag
   {
-    enum { mem_index = 0 };
   };
 
   struct awaitable_frame_tag
   {
-    enum { mem_index = 1 };
   };
 
   struct executor_function_tag
   {
-    enum { mem_index = 2 };
+  };
+
+  // Counters describing how allocations were satisfied.
+  struct cache_statistics
+  {
+    // Allocations served from this thread's free lists.
+    std::size_t hits;
+
+    // Allocations served from the shared depot.
+    std::size_t depot_hits;
+
+    // Allocations that fell through to ::operator new.
+    std::size_t misses;
+
+    // Allocations larger than the largest size class.
+    std::size_t oversized;
+
+    // Deallocations kept on this thread's free lists.
+    std::size_t cached;
+
+    // Deallocations returned to the shared depot.
+    std::size_t returned;
+
+    // Deallocations passed to ::operator delete.
+    std::size_t freed;
   };
 
   thread_info_base()
   {
-    for (int i = 0; i < max_mem_index; ++i)
-      reusable_memory_[i] = 0;
+    for (int i = 0; i < num_size_classes; ++i)
+    {
+      free_list_[i] = 0;
+      free_count_[i] = 0;
+    }
+
+    cache_statistics zero = { 0, 0, 0, 0, 0, 0, 0 };
+    statistics_ = zero;
   }
 
   ~thread_info_base()
   {
-    for (int i = 0; i < max_mem_index; ++i)
-      ::operator delete(reusable_memory_[i]);
+    thread_exit(this);
   }
 
   static void* allocate(thread_info_base* this_thread, std::size_t size)
@@ -70,51 +104,150 @@ public:
   static void* allocate(Purpose, thread_info_base* this_thread,
       std::size_t size)
   {
-    std::size_t chunks = (size + chunk_size - 1) / chunk_size;
-
-    if (this_thread && this_thread->reusable_memory_[Purpose::mem_index])
+    std::size_t index = size_class(size);
+    if (index >= num_size_classes)
     {
-      void* const pointer = this_thread->reusable_memory_[Purpose::mem_index];
-      this_thread->reusable_memory_[Purpose::mem_index] = 0;
+      if (this_thread)
+        ++this_thread->statistics_.oversized;
+      return ::operator new(size);
+    }
 
-      unsigned char* const mem = static_cast<unsigned char*>(pointer);
-      if (static_cast<std::size_t>(mem[0]) >= chunks)
+    if (this_thread)
+    {
+      if (void* pointer = this_thread->pop(index))
       {
-        mem[size] = mem[0];
+        ++this_thread->statistics_.hits;
         return pointer;
       }
 
-      ::operator delete(pointer);
+      if (refill(this_thread, index))
+      {
+        ++this_thread->statistics_.depot_hits;
+        return this_thread->pop(index);
+      }
+
+      ++this_thread->statistics_.misses;
     }
 
-    void* const pointer = ::operator new(chunks * chunk_size + 1);
-    unsigned char* const mem = static_cast<unsigned char*>(pointer);
-    mem[size] = (chunks <= UCHAR_MAX) ? static_cast<unsigned char>(chunks) : 0;
-    return pointer;
+    return ::operator new(block_size(index));
   }
 
   template <typename Purpose>
   static void deallocate(Purpose, thread_info_base* this_thread,
       void* pointer, std::size_t size)
   {
-    if (size <= chunk_size * UCHAR_MAX)
+    std::size_t index = size_class(size);
+    if (index >= num_size_classes)
     {
-      if (this_thread && this_thread->reusable_memory_[Purpose::mem_index] == 0)
-      {
-        unsigned char* const mem = static_cast<unsigned char*>(pointer);
-        mem[0] = mem[size];
-        this_thread->reusable_memory_[Purpose::mem_index] = pointer;
-        return;
-      }
+      ::operator delete(pointer);
+      return;
+    }
+
+    if (this_thread)
+    {
+      if (this_thread->free_count_[index] >= cache_size)
+        flush(this_thread, index);
+      this_thread->push(index, pointer);
+      ++this_thread->statistics_.cached;
+      return;
     }
 
-    ::operator delete(pointer);
+    return_to_depot(index, pointer);
+  }
+
+  // Get the statistics for the specified thread.
+  static cache_statistics statistics(thread_info_base* this_thread)
+  {
+    if (this_thread)
+      return this_thread->statistics_;
+    cache_statistics zero = { 0, 0, 0, 0, 0, 0, 0 };
+    return zero;
   }
 
+  // Get the statistics accumulated by all threads that have exited.
+  ASIO_DECL static cache_statistics exited_thread_statistics();
+
 private:
-  enum { chunk_size = 4 };
-  enum { max_mem_index = 3 };
-  void* reusable_memory_[max_mem_index];
+  // The smallest size class holds blocks of 1 << min_block_shift bytes.
+  enum { min_block_shift = 6 };
+
+  // Number of size classes. The largest holds 4096 byte blocks.
+  enum { num_size_classes = 7 };
+
+  // Number of blocks held per size class on each thread.
+#if defined(ASIO_RECYCLING_ALLOCATOR_CACHE_SIZE)
+  enum { cache_size = ASIO_RECYCLING_ALLOCATOR_CACHE_SIZE };
+#else // defined(ASIO_RECYCLING_ALLOCATOR_CACHE_SIZE)
+  enum { cache_size = 8 };
+#endif // defined(ASIO_RECYCLING_ALLOCATOR_CACHE_SIZE)
+
+  // Number of blocks held per size class in the shared depot.
+#if defined(ASIO_RECYCLING_ALLOCATOR_DEPOT_SIZE)
+  enum { depot_size = ASIO_RECYCLING_ALLOCATOR_DEPOT_SIZE };
+#else // defined(ASIO_RECYCLING_ALLOCATOR_DEPOT_SIZE)
+  enum { depot_size = 64 };
+#endif // defined(ASIO_RECYCLING_ALLOCATOR_DEPOT_SIZE)
+
+  // Number of blocks moved to or from the depot at a time.
+  enum { batch_size = (cache_size + 1) / 2 };
+
+  static std::size_t size_class(std::size_t size)
+  {
+    std::size_t index = 0;
+    size = (size - 1) >> min_block_shift;
+    while (size)
+    {
+      ++index;
+      size >>= 1;
+    }
+    return index;
+  }
+
+  static std::size_t block_size(std::size_t index)
+  {
+    return static_cast<std::size_t>(1) << (index + min_block_shift);
+  }
+
+  void* pop(std::size_t index)
+  {
+    void* pointer = free_list_[index];
+    if (pointer)
+    {
+      free_list_[index] = *static_cast<void**>(pointer);
+      --free_count_[index];
+    }
+    return pointer;
+  }
+
+  void push(std::size_t index, void* pointer)
+  {
+    *static_cast<void**>(pointer) = free_list_[index];
+    free_list_[index] = pointer;
+    ++free_count_[index];
+  }
+
+  // Move a batch of blocks from the depot to the thread's free list. Returns
+  // true if at least one block was moved.
+  ASIO_DECL static bool refill(thread_info_base* this_thread,
+      std::size_t index);
+
+  // Move a batch of blocks from the thread's free list to the depot, freeing
+  // any that do not fit.
+  ASIO_DECL static void flush(thread_info_base* this_thread,
+      std::size_t index);
+
+  // Return a single block to the depot, or free it if the depot is full.
+  ASIO_DECL static void return_to_depot(std::size_t index, void* pointer);
+
+  // Release all of a thread's blocks and record its statistics.
+  ASIO_DECL static void thread_exit(thread_info_base* this_thread);
+
+  struct depot;
+  ASIO_DECL static depot* get_depot();
+
+  void* free_list_[num_size_classes];
+  std::size_t free_count_[num_size_classes];
+  cache_statistics statistics_;
 };
 
 } // namespace detail
@@ -122,4 +255,8 @@ private:
 
 #include "asio/detail/pop_options.hpp"
 
+#if defined(ASIO_HEADER_ONLY)
+# include "asio/detail/impl/thread_info_base.ipp"
+#endif // defined(ASIO_HEADER_ONLY)
+
 #endif // ASIO_DETAIL_THREAD_INFO_BASE_HPP
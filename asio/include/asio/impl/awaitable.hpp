@@ -405,7 +405,11 @@ protected:
 
 #if !defined(GENERATING_DOCUMENTATION)
 
+#if defined(ASIO_HAS_STD_COROUTINE)
+namespace std {
+#else // defined(ASIO_HAS_STD_COROUTINE)
 namespace std { namespace experimental {
+#endif // defined(ASIO_HAS_STD_COROUTINE)
 
 template <typename T, typename Executor, typename... Args>
 struct coroutine_traits<asio::awaitable<T, Executor>, Args...>
@@ -413,7 +417,11 @@ struct coroutine_traits<asio::awaitable<T, Executor>, Args...>
   typedef asio::detail::awaitable_frame<T, Executor> promise_type;
 };
 
+#if defined(ASIO_HAS_STD_COROUTINE)
+} // namespace std
+#else // defined(ASIO_HAS_STD_COROUTINE)
 }} // namespace std::experimental
+#endif // defined(ASIO_HAS_STD_COROUTINE)
 
 #endif // !defined(GENERATING_DOCUMENTATION)
 
@@ -133,7 +133,7 @@ co_spawn(const Executor& ex, F&& f, CompletionToken&& token,
     >::type*)
 {
   return async_initiate<CompletionToken,
-    typename detail::awaitable_signature<typename result_of<F()>::type>>(
+    typename detail::awaitable_signature<typename result_of<F()>::type>::type>(
       detail::initiate_co_spawn<
         typename result_of<F()>::type::executor_type>(ex),
       token, std::forward<F>(f));
@@ -0,0 +1,113 @@
+//
+// ssl/detail/buffer_pool.hpp
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2003-2020 Christopher M. Kohlhoff (chris at kohlhoff dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef ASIO_SSL_DETAIL_BUFFER_POOL_HPP
+#define ASIO_SSL_DETAIL_BUFFER_POOL_HPP
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include "asio/detail/config.hpp"
+#include <cstddef>
+#include <vector>
+#include "asio/detail/mutex.hpp"
+#include "asio/detail/noncopyable.hpp"
+
+#include "asio/detail/push_options.hpp"
+
+namespace asio {
+namespace ssl {
+namespace detail {
+
+// A process-wide free list of buffers of Size bytes, shared by all SSL
+// streams. A stream takes a buffer only while an operation is using it, so
+// the memory held follows the number of busy streams rather than the number
+// of open ones. Up to max_cached returned buffers are kept for reuse.
+template <std::size_t Size>
+class buffer_pool
+  : private asio::detail::noncopyable
+{
+public:
+  enum { max_cached = 1024 };
+
+  // The pool is never destroyed, so streams that outlive static destruction
+  // can still return their buffers.
+  static buffer_pool& instance()
+  {
+    static buffer_pool* pool = new buffer_pool;
+    return *pool;
+  }
+
+  unsigned char* allocate()
+  {
+    {
+      asio::detail::mutex::scoped_lock lock(mutex_);
+      if (!free_.empty())
+      {
+        unsigned char* buffer = free_.back();
+        free_.pop_back();
+        ++in_use_;
+        return buffer;
+      }
+    }
+
+    unsigned char* buffer = new unsigned char[Size];
+    asio::detail::mutex::scoped_lock lock(mutex_);
+    ++in_use_;
+    return buffer;
+  }
+
+  void deallocate(unsigned char* buffer)
+  {
+    asio::detail::mutex::scoped_lock lock(mutex_);
+    --in_use_;
+    if (free_.size() < max_cached)
+    {
+      free_.push_back(buffer);
+      return;
+    }
+    lock.unlock();
+    delete[] buffer;
+  }
+
+  // The number of buffers held by streams.
+  std::size_t in_use() const
+  {
+    asio::detail::mutex::scoped_lock lock(mutex_);
+    return in_use_;
+  }
+
+  // The number of buffers kept for reuse.
+  std::size_t cached() const
+  {
+    asio::detail::mutex::scoped_lock lock(mutex_);
+    return free_.size();
+  }
+
+private:
+  buffer_pool()
+    : in_use_(0)
+  {
+    free_.reserve(max_cached);
+  }
+
+  mutable asio::detail::mutex mutex_;
+  std::vector<unsigned char*> free_;
+  std::size_t in_use_;
+};
+
+} // namespace detail
+} // namespace ssl
+} // namespace asio
+
+#include "asio/detail/pop_options.hpp"
+
+#endif // ASIO_SSL_DETAIL_BUFFER_POOL_HPP
@@ -21,12 +21,39 @@
 #include "asio/ssl/detail/stream_core.hpp"
 #include "asio/write.hpp"
 
+#if defined(ASIO_HAS_SSL_BUFFER_POOL)
+# include "asio/basic_stream_socket.hpp"
+#endif // defined(ASIO_HAS_SSL_BUFFER_POOL)
+
 #include "asio/detail/push_options.hpp"
 
 namespace asio {
 namespace ssl {
 namespace detail {
 
+#if defined(ASIO_HAS_SSL_BUFFER_POOL)
+
+// With pooled buffers, an asynchronous read first waits for the transport to
+// become readable and only then takes the input buffer, so that a connection
+// waiting for its peer doesn't hold one. Only sockets can be waited on;
+// other transports are read into the buffer straight away.
+template <typename Stream, typename Handler>
+inline bool async_wait_readable(Stream&, Handler&)
+{
+  return false;
+}
+
+template <typename Protocol, typename Executor, typename Handler>
+inline bool async_wait_readable(
+    basic_stream_socket<Protocol, Executor>& socket, Handler& handler)
+{
+  socket.async_wait(socket_base::wait_read,
+      ASIO_MOVE_CAST(Handler)(handler));
+  return true;
+}
+
+#endif // defined(ASIO_HAS_SSL_BUFFER_POOL)
+
 template <typename Stream, typename Operation>
 std::size_t io(Stream& next_layer, stream_core& core,
     const Operation& op, asio::error_code& ec)
@@ -41,6 +68,7 @@ std::size_t io(Stream& next_layer, stream_core& core,
     // the underlying transport.
     if (core.input_.size() == 0)
     {
+      core.acquire_input_buffer();
       core.input_ = asio::buffer(core.input_buffer_,
           next_layer.read_some(core.input_buffer_, io_ec));
       if (!ec)
@@ -49,6 +77,7 @@ std::size_t io(Stream& next_layer, stream_core& core,
 
     // Pass the new input data to the engine.
     core.input_ = core.engine_.put_input(core.input_);
+    core.release_input_buffer();
 
     // Try the operation again.
     continue;
@@ -57,8 +86,10 @@ std::size_t io(Stream& next_layer, stream_core& core,
 
     // Get output data from the engine and write it to the underlying
     // transport.
+    core.acquire_output_buffer();
     asio::write(next_layer,
         core.engine_.get_output(core.output_buffer_), io_ec);
+    core.release_output_buffer();
     if (!ec)
       ec = io_ec;
 
@@ -69,8 +100,10 @@ std::size_t io(Stream& next_layer, stream_core& core,
 
     // Get output data from the engine and write it to the underlying
     // transport.
+    core.acquire_output_buffer();
     asio::write(next_layer,
         core.engine_.get_output(core.output_buffer_), io_ec);
+    core.release_output_buffer();
     if (!ec)
       ec = io_ec;
 
@@ -103,6 +136,9 @@ public:
       start_(0),
       want_(engine::want_nothing),
       bytes_transferred_(0),
+#if defined(ASIO_HAS_SSL_BUFFER_POOL)
+      waiting_readable_(false),
+#endif // defined(ASIO_HAS_SSL_BUFFER_POOL)
       handler_(ASIO_MOVE_CAST(Handler)(handler))
   {
   }
@@ -116,6 +152,9 @@ public:
       want_(other.want_),
       ec_(other.ec_),
       bytes_transferred_(other.bytes_transferred_),
+#if defined(ASIO_HAS_SSL_BUFFER_POOL)
+      waiting_readable_(other.waiting_readable_),
+#endif // defined(ASIO_HAS_SSL_BUFFER_POOL)
       handler_(other.handler_)
   {
   }
@@ -128,6 +167,9 @@ public:
       want_(other.want_),
       ec_(other.ec_),
       bytes_transferred_(other.bytes_transferred_),
+#if defined(ASIO_HAS_SSL_BUFFER_POOL)
+      waiting_readable_(other.waiting_readable_),
+#endif // defined(ASIO_HAS_SSL_BUFFER_POOL)
       handler_(ASIO_MOVE_CAST(Handler)(other.handler_))
   {
   }
@@ -150,6 +192,7 @@ public:
           if (core_.input_.size() != 0)
           {
             core_.input_ = core_.engine_.put_input(core_.input_);
+            core_.release_input_buffer();
             continue;
           }
 
@@ -162,7 +205,19 @@ public:
             // Prevent other read operations from being started.
             core_.pending_read_.expires_at(core_.pos_infin());
 
+#if defined(ASIO_HAS_SSL_BUFFER_POOL)
+            // Wait until there is something to read before taking a buffer.
+            if (!core_.has_input_buffer())
+            {
+              waiting_readable_ = true;
+              if (async_wait_readable(next_layer_, *this))
+                return;
+              waiting_readable_ = false;
+            }
+#endif // defined(ASIO_HAS_SSL_BUFFER_POOL)
+
             // Start reading some data from the underlying transport.
+            core_.acquire_input_buffer();
             next_layer_.async_read_some(
                 asio::buffer(core_.input_buffer_),
                 ASIO_MOVE_CAST(io_op)(*this));
@@ -190,6 +245,7 @@ public:
             core_.pending_write_.expires_at(core_.pos_infin());
 
             // Start writing all the data to the underlying transport.
+            core_.acquire_output_buffer();
             asio::async_write(next_layer_,
                 core_.engine_.get_output(core_.output_buffer_),
                 ASIO_MOVE_CAST(io_op)(*this));
@@ -238,6 +294,20 @@ public:
         {
         case engine::want_input_and_retry:
 
+#if defined(ASIO_HAS_SSL_BUFFER_POOL)
+          // The transport is readable: take a buffer and read into it. A
+          // failed wait shows up as an error from the read.
+          if (waiting_readable_)
+          {
+            waiting_readable_ = false;
+            core_.acquire_input_buffer();
+            next_layer_.async_read_some(
+                asio::buffer(core_.input_buffer_),
+                ASIO_MOVE_CAST(io_op)(*this));
+            return;
+          }
+#endif // defined(ASIO_HAS_SSL_BUFFER_POOL)
+
           // Add received data to the engine's input.
           core_.input_ = asio::buffer(
               core_.input_buffer_, bytes_transferred);
@@ -245,6 +315,7 @@ public:
 
           // Release any waiting read operations.
           core_.pending_read_.expires_at(core_.neg_infin());
+          core_.release_input_buffer();
 
           // Try the operation again.
           continue;
@@ -253,6 +324,7 @@ public:
 
           // Release any waiting write operations.
           core_.pending_write_.expires_at(core_.neg_infin());
+          core_.release_output_buffer();
 
           // Try the operation again.
           continue;
@@ -261,6 +333,7 @@ public:
 
           // Release any waiting write operations.
           core_.pending_write_.expires_at(core_.neg_infin());
+          core_.release_output_buffer();
 
           // Fall through to call handler.
 
@@ -289,6 +362,9 @@ public:
   engine::want want_;
   asio::error_code ec_;
   std::size_t bytes_transferred_;
+#if defined(ASIO_HAS_SSL_BUFFER_POOL)
+  bool waiting_readable_;
+#endif // defined(ASIO_HAS_SSL_BUFFER_POOL)
   Handler handler_;
 };
 
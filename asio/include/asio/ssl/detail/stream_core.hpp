@@ -25,6 +25,10 @@
 #include "asio/ssl/detail/engine.hpp"
 #include "asio/buffer.hpp"
 
+#if defined(ASIO_HAS_SSL_BUFFER_POOL)
+# include "asio/ssl/detail/buffer_pool.hpp"
+#endif // defined(ASIO_HAS_SSL_BUFFER_POOL)
+
 #include "asio/detail/push_options.hpp"
 
 namespace asio {
@@ -42,10 +46,15 @@ struct stream_core
     : engine_(context),
       pending_read_(ex),
       pending_write_(ex),
+#if defined(ASIO_HAS_SSL_BUFFER_POOL)
+      output_buffer_space_(0),
+      input_buffer_space_(0)
+#else // defined(ASIO_HAS_SSL_BUFFER_POOL)
       output_buffer_space_(max_tls_record_size),
       output_buffer_(asio::buffer(output_buffer_space_)),
       input_buffer_space_(max_tls_record_size),
       input_buffer_(asio::buffer(input_buffer_space_))
+#endif // defined(ASIO_HAS_SSL_BUFFER_POOL)
   {
     pending_read_.expires_at(neg_infin());
     pending_write_.expires_at(neg_infin());
@@ -53,8 +62,92 @@ struct stream_core
 
   ~stream_core()
   {
+#if defined(ASIO_HAS_SSL_BUFFER_POOL)
+    if (output_buffer_space_)
+      pool::instance().deallocate(output_buffer_space_);
+    if (input_buffer_space_)
+      pool::instance().deallocate(input_buffer_space_);
+#endif // defined(ASIO_HAS_SSL_BUFFER_POOL)
+  }
+
+#if defined(ASIO_HAS_SSL_BUFFER_POOL)
+  typedef buffer_pool<max_tls_record_size> pool;
+
+  // Take the output buffer from the pool before preparing output in it.
+  void acquire_output_buffer()
+  {
+    if (!output_buffer_space_)
+    {
+      output_buffer_space_ = pool::instance().allocate();
+      output_buffer_ = asio::buffer(output_buffer_space_, max_tls_record_size);
+    }
+  }
+
+  // Give the output buffer back once its contents have been written, unless
+  // another operation has started writing from it since.
+  void release_output_buffer()
+  {
+    if (output_buffer_space_ && expiry(pending_write_) == neg_infin())
+    {
+      pool::instance().deallocate(output_buffer_space_);
+      output_buffer_space_ = 0;
+      output_buffer_ = asio::mutable_buffer();
+    }
+  }
+
+  // Take the input buffer from the pool before reading into it.
+  void acquire_input_buffer()
+  {
+    if (!input_buffer_space_)
+    {
+      input_buffer_space_ = pool::instance().allocate();
+      input_buffer_ = asio::buffer(input_buffer_space_, max_tls_record_size);
+    }
+  }
+
+  // Give the input buffer back once the engine has taken all of its data,
+  // unless another operation is reading into it.
+  void release_input_buffer()
+  {
+    if (input_buffer_space_ && input_.size() == 0
+        && expiry(pending_read_) == neg_infin())
+    {
+      pool::instance().deallocate(input_buffer_space_);
+      input_buffer_space_ = 0;
+      input_buffer_ = asio::mutable_buffer();
+      input_ = asio::const_buffer();
+    }
+  }
+
+  // Whether the input buffer is held, i.e. a read into it may be started
+  // without waiting for the transport to become readable first.
+  bool has_input_buffer() const
+  {
+    return input_buffer_space_ != 0;
+  }
+#else // defined(ASIO_HAS_SSL_BUFFER_POOL)
+  void acquire_output_buffer()
+  {
+  }
+
+  void release_output_buffer()
+  {
+  }
+
+  void acquire_input_buffer()
+  {
+  }
+
+  void release_input_buffer()
+  {
   }
 
+  bool has_input_buffer() const
+  {
+    return true;
+  }
+#endif // defined(ASIO_HAS_SSL_BUFFER_POOL)
+
   // The SSL engine.
   engine engine_;
 
@@ -110,6 +203,21 @@ struct stream_core
   }
 #endif // defined(ASIO_HAS_BOOST_DATE_TIME)
 
+#if defined(ASIO_HAS_SSL_BUFFER_POOL)
+  // Buffer space used to prepare output intended for the transport, taken
+  // from the pool while in use and null otherwise.
+  unsigned char* output_buffer_space_;
+
+  // A buffer that may be used to prepare output intended for the transport.
+  asio::mutable_buffer output_buffer_;
+
+  // Buffer space used to read input intended for the engine, taken from the
+  // pool while in use and null otherwise.
+  unsigned char* input_buffer_space_;
+
+  // A buffer that may be used to read input intended for the engine.
+  asio::mutable_buffer input_buffer_;
+#else // defined(ASIO_HAS_SSL_BUFFER_POOL)
   // Buffer space used to prepare output intended for the transport.
   std::vector<unsigned char> output_buffer_space_;
 
@@ -121,6 +229,7 @@ struct stream_core
 
   // A buffer that may be used to read input intended for the engine.
   const asio::mutable_buffer input_buffer_;
+#endif // defined(ASIO_HAS_SSL_BUFFER_POOL)
 
   // The buffer pointing to the engine's unconsumed input.
   asio::const_buffer input_;
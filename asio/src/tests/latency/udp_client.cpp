@@ -25,11 +25,11 @@ const int num_samples = 100000;
 
 int main(int argc, char* argv[])
 {
-  if (argc != 6)
+  if (argc != 6 && argc != 8)
   {
     std::fprintf(stderr,
         "Usage: udp_client <ip> <port1> "
-        "<nports> <bufsize> {spin|block}\n");
+        "<nports> <bufsize> {spin|block} [<window> {single|batch}]\n");
     return 1;
   }
 
@@ -39,6 +39,18 @@ int main(int argc, char* argv[])
   std::size_t buf_size = static_cast<std::size_t>(std::atoi(argv[4]));
   bool spin = (std::strcmp(argv[5], "spin") == 0);
 
+  // Each sample sends a window of datagrams and waits for all of the replies,
+  // either one datagram per system call or in batches.
+  std::size_t window = argc == 8 ? std::atoi(argv[6]) : 1;
+  bool batch = (argc == 8 && std::strcmp(argv[7], "batch") == 0);
+#if !defined(ASIO_HAS_MMSG)
+  if (batch)
+  {
+    std::fprintf(stderr, "Batched datagram operations are not supported\n");
+    return 1;
+  }
+#endif // !defined(ASIO_HAS_MMSG)
+
   asio::io_context io_context;
 
   udp::socket socket(io_context, udp::endpoint(udp::v4(), 0));
@@ -51,7 +63,16 @@ int main(int argc, char* argv[])
   udp::endpoint target(asio::ip::make_address(ip), first_port);
   unsigned short last_port = first_port + num_ports - 1;
   std::vector<unsigned char> write_buf(buf_size);
-  std::vector<unsigned char> read_buf(buf_size);
+  std::vector<unsigned char> read_buf(buf_size * window);
+#if defined(ASIO_HAS_MMSG)
+  std::vector<udp::socket::const_datagram> out(window);
+  std::vector<udp::socket::mutable_datagram> in(window);
+  for (std::size_t j = 0; j < window; ++j)
+  {
+    out[j].buffer = asio::buffer(write_buf);
+    in[j].buffer = asio::buffer(&read_buf[j * buf_size], buf_size);
+  }
+#endif // defined(ASIO_HAS_MMSG)
 
   ptime start = microsec_clock::universal_time();
   boost::uint64_t start_hr = high_res_clock();
@@ -62,10 +83,34 @@ int main(int argc, char* argv[])
     boost::uint64_t t = high_res_clock();
 
     asio::error_code ec;
-    socket.send_to(asio::buffer(write_buf), target, 0, ec);
-    
-    do socket.receive(asio::buffer(read_buf), 0, ec);
-    while (ec == asio::error::would_block);
+    if (!batch)
+    {
+      for (std::size_t j = 0; j < window; ++j)
+        socket.send_to(asio::buffer(write_buf), target, 0, ec);
+
+      for (std::size_t j = 0; j < window; ++j)
+      {
+        do socket.receive(asio::buffer(read_buf, buf_size), 0, ec);
+        while (ec == asio::error::would_block);
+      }
+    }
+#if defined(ASIO_HAS_MMSG)
+    else
+    {
+      for (std::size_t j = 0; j < window; ++j)
+        out[j].endpoint = target;
+      socket.send_batch(&out[0], window, 0, ec);
+
+      for (std::size_t j = 0; j < window; )
+      {
+        std::size_t n = socket.receive_batch(&in[j], window - j, 0, ec);
+        if (!ec)
+          j += n;
+        else if (ec != asio::error::would_block)
+          break;
+      }
+    }
+#endif // defined(ASIO_HAS_MMSG)
 
     samples[i] = high_res_clock() - t;
 
@@ -101,4 +146,8 @@ int main(int argc, char* argv[])
   double total = 0.0;
   for (int i = 0; i < num_samples; ++i) total += samples[i] * scale;
   std::printf("  mean\t%f\n", total / num_samples);
+
+  // Datagrams sent and received by the client per second.
+  std::printf("packets/s\t%f\n",
+      2.0 * num_samples * window * 1000000 / elapsed_usec);
 }
@@ -0,0 +1,159 @@
+//
+// strand.cpp
+// ~~~~~~~~~~
+//
+// Copyright (c) 2003-2020 Christopher M. Kohlhoff (chris at kohlhoff dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+// Measures strand throughput when many threads post to a set of strands.
+//
+// Build once as-is and once with ASIO_ENABLE_LOCK_FREE_STRAND defined to
+// compare the mutex-based and lock-free strand implementations.
+
+#include "asio.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <list>
+#include <vector>
+
+typedef asio::strand<asio::io_context::executor_type> strand_type;
+
+class counter
+{
+public:
+  explicit counter(long* total)
+    : total_(total)
+  {
+  }
+
+  void operator()()
+  {
+    ++*total_;
+  }
+
+private:
+  long* total_;
+};
+
+class producer
+{
+public:
+  producer(std::vector<strand_type>* strands,
+      std::vector<long>* totals, std::size_t handlers, unsigned seed)
+    : strands_(strands),
+      totals_(totals),
+      handlers_(handlers),
+      seed_(seed)
+  {
+  }
+
+  void operator()()
+  {
+    for (std::size_t i = 0; i < handlers_; ++i)
+    {
+      seed_ = seed_ * 1103515245 + 12345;
+      std::size_t n = (seed_ >> 8) % strands_->size();
+      asio::post((*strands_)[n], counter(&(*totals_)[n]));
+    }
+  }
+
+private:
+  std::vector<strand_type>* strands_;
+  std::vector<long>* totals_;
+  std::size_t handlers_;
+  unsigned seed_;
+};
+
+class runner
+{
+public:
+  explicit runner(asio::io_context* ioc)
+    : ioc_(ioc)
+  {
+  }
+
+  void operator()()
+  {
+    ioc_->run();
+  }
+
+private:
+  asio::io_context* ioc_;
+};
+
+int main(int argc, char* argv[])
+{
+  if (argc != 5)
+  {
+    std::fprintf(stderr, "Usage: strand <strands> "
+        "<producer threads> <runner threads> <handlers per producer>\n");
+    return 1;
+  }
+
+  std::size_t num_strands = std::atoi(argv[1]);
+  int num_producers = std::atoi(argv[2]);
+  int num_runners = std::atoi(argv[3]);
+  std::size_t num_handlers = std::atoi(argv[4]);
+
+  asio::io_context ioc(num_runners);
+  std::vector<strand_type> strands;
+  for (std::size_t i = 0; i < num_strands; ++i)
+    strands.push_back(asio::make_strand(ioc));
+  std::vector<long> totals(num_strands, 0);
+
+  asio::executor_work_guard<asio::io_context::executor_type> work
+    = asio::make_work_guard(ioc);
+
+  asio::chrono::steady_clock::time_point start
+    = asio::chrono::steady_clock::now();
+
+  std::list<asio::thread*> threads;
+  for (int i = 0; i < num_runners; ++i)
+    threads.push_back(new asio::thread(runner(&ioc)));
+
+  std::list<asio::thread*> producers;
+  for (int i = 0; i < num_producers; ++i)
+    producers.push_back(new asio::thread(
+          producer(&strands, &totals, num_handlers, i + 1)));
+
+  while (!producers.empty())
+  {
+    producers.front()->join();
+    delete producers.front();
+    producers.pop_front();
+  }
+
+  work.reset();
+
+  while (!threads.empty())
+  {
+    threads.front()->join();
+    delete threads.front();
+    threads.pop_front();
+  }
+
+  asio::chrono::steady_clock::duration elapsed
+    = asio::chrono::steady_clock::now() - start;
+  double secs = asio::chrono::duration_cast<
+    asio::chrono::microseconds>(elapsed).count() / 1e6;
+
+  long total = 0;
+  for (std::size_t i = 0; i < num_strands; ++i)
+    total += totals[i];
+
+#if defined(ASIO_HAS_LOCK_FREE_STRAND)
+  const char* impl = "lock-free";
+#else // defined(ASIO_HAS_LOCK_FREE_STRAND)
+  const char* impl = "mutex";
+#endif // defined(ASIO_HAS_LOCK_FREE_STRAND)
+
+  std::printf("%-9s %8d strands %3d producers %3d runners "
+      "%10ld handlers %8.3f s %12.0f handlers/s\n", impl,
+      static_cast<int>(num_strands), num_producers, num_runners,
+      total, secs, total / secs);
+
+  return 0;
+}
@@ -20,6 +20,7 @@
 #include "asio/ip/tcp.hpp"
 
 #include <cstring>
+#include <vector>
 #include "asio/io_context.hpp"
 #include "asio/read.hpp"
 #include "asio/write.hpp"
@@ -567,6 +568,13 @@ void handle_write(const asio::error_code& err,
   ASIO_CHECK(bytes_transferred == sizeof(write_data));
 }
 
+void handle_zerocopy_transfer(const asio::error_code& err,
+    size_t bytes_transferred, size_t* length)
+{
+  ASIO_CHECK(!err);
+  *length = bytes_transferred;
+}
+
 void handle_read_cancel(const asio::error_code& err,
     size_t bytes_transferred, bool* called)
 {
@@ -653,6 +661,44 @@ void test()
   ASIO_CHECK(write_completed);
   ASIO_CHECK(memcmp(read_buffer, write_data, sizeof(write_data)) == 0);
 
+#if defined(ASIO_HAS_MSG_ZEROCOPY)
+  // Zero-copy write, which sends everything and completes once the kernel has
+  // released the buffer. Skipped if the kernel lacks SO_ZEROCOPY.
+
+  asio::error_code zerocopy_ec;
+  server_side_socket.set_zerocopy_threshold(1024, zerocopy_ec);
+  if (!zerocopy_ec)
+  {
+    ASIO_CHECK(server_side_socket.zerocopy_threshold() == 1024);
+
+    std::vector<char> zerocopy_data(256 * 1024);
+    for (std::size_t i = 0; i < zerocopy_data.size(); ++i)
+      zerocopy_data[i] = static_cast<char>(i % 251);
+    std::vector<char> zerocopy_read(zerocopy_data.size());
+
+    std::size_t zerocopy_read_length = 0;
+    asio::async_read(client_side_socket,
+        asio::buffer(zerocopy_read),
+        bindns::bind(handle_zerocopy_transfer,
+          _1, _2, &zerocopy_read_length));
+
+    std::size_t zerocopy_write_length = 0;
+    server_side_socket.async_write_some(
+        asio::buffer(zerocopy_data),
+        bindns::bind(handle_zerocopy_transfer,
+          _1, _2, &zerocopy_write_length));
+
+    ioc.restart();
+    ioc.run();
+    ASIO_CHECK(zerocopy_read_length == zerocopy_data.size());
+    ASIO_CHECK(zerocopy_write_length == zerocopy_data.size());
+    ASIO_CHECK(zerocopy_read == zerocopy_data);
+
+    server_side_socket.set_zerocopy_threshold(0);
+    ASIO_CHECK(server_side_socket.zerocopy_threshold() == 0);
+  }
+#endif // defined(ASIO_HAS_MSG_ZEROCOPY)
+
   // Cancelled read.
 
   bool read_cancel_completed = false;
@@ -440,6 +440,29 @@ void test()
     int i29 = socket1.async_receive_from(null_buffers(),
         endpoint, in_flags, lazy);
     (void)i29;
+
+#if defined(ASIO_HAS_MMSG)
+    ip::udp::socket::const_datagram out_datagrams[2];
+    ip::udp::socket::mutable_datagram in_datagrams[2];
+
+    socket1.send_batch(out_datagrams, 2);
+    socket1.send_batch(out_datagrams, 2, in_flags, ec);
+    socket1.async_send_batch(out_datagrams, 2, send_handler());
+    socket1.async_send_batch(out_datagrams, 2, in_flags, send_handler());
+    int i30 = socket1.async_send_batch(out_datagrams, 2, lazy);
+    (void)i30;
+    int i31 = socket1.async_send_batch(out_datagrams, 2, in_flags, lazy);
+    (void)i31;
+
+    socket1.receive_batch(in_datagrams, 2);
+    socket1.receive_batch(in_datagrams, 2, in_flags, ec);
+    socket1.async_receive_batch(in_datagrams, 2, receive_handler());
+    socket1.async_receive_batch(in_datagrams, 2, in_flags, receive_handler());
+    int i32 = socket1.async_receive_batch(in_datagrams, 2, lazy);
+    (void)i32;
+    int i33 = socket1.async_receive_batch(in_datagrams, 2, in_flags, lazy);
+    (void)i33;
+#endif // defined(ASIO_HAS_MMSG)
   }
   catch (std::exception&)
   {
@@ -470,6 +493,13 @@ void handle_recv(size_t expected_bytes_recvd,
   ASIO_CHECK(expected_bytes_recvd == bytes_recvd);
 }
 
+void handle_recv_batch(size_t* datagrams_recvd,
+    const asio::error_code& err, size_t datagrams)
+{
+  ASIO_CHECK(!err);
+  *datagrams_recvd = datagrams;
+}
+
 void test()
 {
   using namespace std; // For memcmp and memset.
@@ -517,6 +547,95 @@ void test()
   ASIO_CHECK(memcmp(send_msg, recv_msg, sizeof(send_msg)) == 0);
 }
 
+#if defined(ASIO_HAS_MMSG)
+
+void test_batch()
+{
+  using namespace std; // For memcmp and memset.
+  using namespace asio;
+  namespace ip = asio::ip;
+
+#if defined(ASIO_HAS_BOOST_BIND)
+  namespace bindns = boost;
+#else // defined(ASIO_HAS_BOOST_BIND)
+  namespace bindns = std;
+#endif // defined(ASIO_HAS_BOOST_BIND)
+  using bindns::placeholders::_1;
+  using bindns::placeholders::_2;
+
+  io_context ioc;
+
+  ip::udp::socket s1(ioc, ip::udp::endpoint(ip::address_v4::loopback(), 0));
+  ip::udp::socket s2(ioc, ip::udp::endpoint(ip::address_v4::loopback(), 0));
+
+  // More datagrams than fit in one system call, of different sizes.
+  const size_t count = 100;
+  char send_msg[count][count + 1];
+  ip::udp::socket::const_datagram out[count];
+  for (size_t i = 0; i < count; ++i)
+  {
+    memset(send_msg[i], 'a' + static_cast<char>(i % 26), i + 1);
+    out[i].buffer = buffer(send_msg[i], i + 1);
+    out[i].endpoint = s1.local_endpoint();
+    out[i].size = 0;
+  }
+
+  size_t sent = s2.send_batch(out, count);
+  ASIO_CHECK(sent == count);
+  ASIO_CHECK(out[0].size == 1);
+  ASIO_CHECK(out[count - 1].size == count);
+
+  char recv_msg[count][count + 1];
+  ip::udp::socket::mutable_datagram in[count];
+  for (size_t i = 0; i < count; ++i)
+  {
+    in[i].buffer = buffer(recv_msg[i], count + 1);
+    in[i].size = 0;
+  }
+
+  size_t recvd = 0;
+  while (recvd < count)
+  {
+    size_t n = s1.receive_batch(in + recvd, count - recvd);
+    ASIO_CHECK(n > 0 && n <= 64);
+    recvd += n;
+  }
+  ASIO_CHECK(recvd == count);
+  for (size_t i = 0; i < count; ++i)
+  {
+    ASIO_CHECK(in[i].size == i + 1);
+    ASIO_CHECK(memcmp(send_msg[i], recv_msg[i], i + 1) == 0);
+    ASIO_CHECK(in[i].endpoint == s2.local_endpoint());
+  }
+
+  memset(recv_msg, 0, sizeof(recv_msg));
+
+  s2.async_send_batch(out, count,
+      bindns::bind(handle_send, count, _1, _2));
+  ioc.run();
+
+  ioc.restart();
+  recvd = 0;
+  while (recvd < count)
+  {
+    size_t n = 0;
+    s1.async_receive_batch(in + recvd, count - recvd,
+        bindns::bind(handle_recv_batch, &n, _1, _2));
+    ioc.run();
+    ioc.restart();
+    ASIO_CHECK(n > 0);
+    recvd += n;
+  }
+  ASIO_CHECK(recvd == count);
+  for (size_t i = 0; i < count; ++i)
+  {
+    ASIO_CHECK(in[i].size == i + 1);
+    ASIO_CHECK(memcmp(send_msg[i], recv_msg[i], i + 1) == 0);
+  }
+}
+
+#endif // defined(ASIO_HAS_MMSG)
+
 } // namespace ip_udp_socket_runtime
 
 //------------------------------------------------------------------------------
@@ -669,5 +788,8 @@ ASIO_TEST_SUITE
   "ip/udp",
   ASIO_TEST_CASE(ip_udp_socket_compile::test)
   ASIO_TEST_CASE(ip_udp_socket_runtime::test)
+#if defined(ASIO_HAS_MMSG)
+  ASIO_TEST_CASE(ip_udp_socket_runtime::test_batch)
+#endif // defined(ASIO_HAS_MMSG)
   ASIO_TEST_CASE(ip_udp_resolver_compile::test)
 )
@@ -17,7 +17,9 @@
 #include "asio/strand.hpp"
 
 #include <sstream>
+#include <vector>
 #include "asio/executor.hpp"
+#include "asio/executor_work_guard.hpp"
 #include "asio/io_context.hpp"
 #include "asio/dispatch.hpp"
 #include "asio/post.hpp"
@@ -239,6 +241,75 @@ void strand_test()
   ASIO_CHECK(count == 0);
 }
 
+struct ordering_state
+{
+  int in_flight;
+  int overlaps;
+  std::vector<int> last_seen;
+  std::vector<int> out_of_order;
+};
+
+void check_order(ordering_state* st, int producer, int seq)
+{
+  if (++st->in_flight != 1)
+    ++st->overlaps;
+  if (st->last_seen[producer] + 1 != seq)
+    ++st->out_of_order[producer];
+  st->last_seen[producer] = seq;
+  --st->in_flight;
+}
+
+void post_sequence(strand<io_context::executor_type>* s,
+    ordering_state* st, int producer, int count)
+{
+  for (int seq = 0; seq < count; ++seq)
+    post(*s, bindns::bind(check_order, st, producer, seq));
+}
+
+void strand_ordering_test()
+{
+  io_context ioc;
+  strand<io_context::executor_type> s = make_strand(ioc);
+
+  const int num_producers = 4;
+  const int num_handlers = 20000;
+
+  ordering_state st;
+  st.in_flight = 0;
+  st.overlaps = 0;
+  st.last_seen.assign(num_producers, -1);
+  st.out_of_order.assign(num_producers, 0);
+
+  // Post from several threads while several other threads run the handlers.
+  executor_work_guard<io_context::executor_type> work
+    = make_work_guard(ioc);
+  thread runner1(bindns::bind(io_context_run, &ioc));
+  thread runner2(bindns::bind(io_context_run, &ioc));
+  thread runner3(bindns::bind(io_context_run, &ioc));
+
+  thread producer1(bindns::bind(post_sequence, &s, &st, 0, num_handlers));
+  thread producer2(bindns::bind(post_sequence, &s, &st, 1, num_handlers));
+  thread producer3(bindns::bind(post_sequence, &s, &st, 2, num_handlers));
+  thread producer4(bindns::bind(post_sequence, &s, &st, 3, num_handlers));
+  producer1.join();
+  producer2.join();
+  producer3.join();
+  producer4.join();
+
+  work.reset();
+  runner1.join();
+  runner2.join();
+  runner3.join();
+
+  // Handlers never overlap, and each producer's handlers run in order.
+  ASIO_CHECK(st.overlaps == 0);
+  for (int i = 0; i < num_producers; ++i)
+  {
+    ASIO_CHECK(st.last_seen[i] == num_handlers - 1);
+    ASIO_CHECK(st.out_of_order[i] == 0);
+  }
+}
+
 void strand_conversion_test()
 {
   io_context ioc;
@@ -259,5 +330,6 @@ ASIO_TEST_SUITE
 (
   "strand",
   ASIO_TEST_CASE(strand_test)
+  ASIO_TEST_CASE(strand_ordering_test)
   ASIO_COMPILE_TEST_CASE(strand_conversion_test)
 )
@@ -0,0 +1,27 @@
+//
+// strand_lock_free.cpp
+// ~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2003-2020 Christopher M. Kohlhoff (chris at kohlhoff dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+// Disable autolinking for unit tests.
+#if !defined(BOOST_ALL_NO_LIB)
+#define BOOST_ALL_NO_LIB 1
+#endif // !defined(BOOST_ALL_NO_LIB)
+
+// The strand tests, run against the lock-free strand_executor_service. The
+// implementation is chosen when the service is compiled, so this test is
+// always header-only, even when the library is compiled separately.
+#if defined(ASIO_SEPARATE_COMPILATION)
+# undef ASIO_SEPARATE_COMPILATION
+#endif // defined(ASIO_SEPARATE_COMPILATION)
+
+#if !defined(ASIO_ENABLE_LOCK_FREE_STRAND)
+# define ASIO_ENABLE_LOCK_FREE_STRAND 1
+#endif // !defined(ASIO_ENABLE_LOCK_FREE_STRAND)
+
+#include "strand.cpp"
@@ -0,0 +1,238 @@
+//
+// thread_info_base.cpp
+// ~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2003-2020 Christopher M. Kohlhoff (chris at kohlhoff dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+// Disable autolinking for unit tests.
+#if !defined(BOOST_ALL_NO_LIB)
+#define BOOST_ALL_NO_LIB 1
+#endif // !defined(BOOST_ALL_NO_LIB)
+
+// Test that header file is self-contained.
+#include "asio/detail/thread_info_base.hpp"
+
+#include <cstring>
+#include <vector>
+#include "asio/detail/mutex.hpp"
+#include "asio/thread.hpp"
+#include "unit_test.hpp"
+
+#if defined(ASIO_HAS_BOOST_BIND)
+# include <boost/bind/bind.hpp>
+#else // defined(ASIO_HAS_BOOST_BIND)
+# include <functional>
+#endif // defined(ASIO_HAS_BOOST_BIND)
+
+using asio::detail::thread_info_base;
+
+#if defined(ASIO_HAS_BOOST_BIND)
+namespace bindns = boost;
+#else // defined(ASIO_HAS_BOOST_BIND)
+namespace bindns = std;
+#endif
+
+// One size from each size class, and one too large for any of them.
+static const std::size_t sizes[] = { 1, 64, 65, 128, 200, 256, 500,
+  512, 1000, 1024, 2048, 4000, 4096, 4097, 10000 };
+static const std::size_t num_sizes = sizeof(sizes) / sizeof(sizes[0]);
+
+// Fill a block, and check that it still holds what it was filled with.
+static void fill(void* pointer, std::size_t size, unsigned char value)
+{
+  std::memset(pointer, value, size);
+}
+
+static bool filled(void* pointer, std::size_t size, unsigned char value)
+{
+  const unsigned char* p = static_cast<const unsigned char*>(pointer);
+  for (std::size_t i = 0; i < size; ++i)
+    if (p[i] != value)
+      return false;
+  return true;
+}
+
+void round_trip_test()
+{
+  thread_info_base this_thread;
+
+  void* blocks[num_sizes];
+  for (std::size_t i = 0; i < num_sizes; ++i)
+  {
+    blocks[i] = thread_info_base::allocate(&this_thread, sizes[i]);
+    ASIO_CHECK(blocks[i] != 0);
+    fill(blocks[i], sizes[i], static_cast<unsigned char>(i));
+  }
+
+  for (std::size_t i = 0; i < num_sizes; ++i)
+  {
+    ASIO_CHECK(filled(blocks[i], sizes[i], static_cast<unsigned char>(i)));
+    thread_info_base::deallocate(&this_thread, blocks[i], sizes[i]);
+  }
+
+  // A block freed on a thread comes back for the next allocation of the same
+  // size class on that thread, whatever the size within the class.
+  void* block = thread_info_base::allocate(&this_thread, 33);
+  ASIO_CHECK(block == blocks[1] || block == blocks[0]);
+  fill(block, 64, 0xff);
+  thread_info_base::deallocate(&this_thread, block, 33);
+
+  block = thread_info_base::allocate(&this_thread, 3000);
+  ASIO_CHECK(block == blocks[12] || block == blocks[11]);
+  fill(block, 4096, 0xff);
+  thread_info_base::deallocate(&this_thread, block, 3000);
+
+  thread_info_base::cache_statistics s =
+    thread_info_base::statistics(&this_thread);
+  ASIO_CHECK(s.hits == 2);
+  ASIO_CHECK(s.oversized == 2);
+  ASIO_CHECK(s.cached == num_sizes - 2 + 2);
+
+  // Without a thread, blocks go to and from the shared depot.
+  block = thread_info_base::allocate(0, 100);
+  ASIO_CHECK(block != 0);
+  fill(block, 100, 1);
+  thread_info_base::deallocate(0, block, 100);
+  block = thread_info_base::allocate(0, 5000);
+  fill(block, 5000, 1);
+  thread_info_base::deallocate(0, block, 5000);
+}
+
+void depot_test()
+{
+  const std::size_t count = 256;
+  std::vector<void*> blocks(count);
+
+  {
+    thread_info_base producer;
+    for (std::size_t i = 0; i < count; ++i)
+      blocks[i] = thread_info_base::allocate(&producer, 300);
+    for (std::size_t i = 0; i < count; ++i)
+      thread_info_base::deallocate(&producer, blocks[i], 300);
+
+    // The thread's free list overflows: some blocks go to the depot, and
+    // once the depot is full the rest are freed.
+    thread_info_base::cache_statistics s =
+      thread_info_base::statistics(&producer);
+    ASIO_CHECK(s.cached == count);
+    ASIO_CHECK(s.returned > 0);
+    ASIO_CHECK(s.freed > 0);
+    ASIO_CHECK(s.returned + s.freed < count);
+  }
+
+  // Another thread with an empty free list is refilled from the depot.
+  thread_info_base consumer;
+  void* block = thread_info_base::allocate(&consumer, 300);
+  fill(block, 512, 2);
+  void* next = thread_info_base::allocate(&consumer, 300);
+  fill(next, 512, 3);
+  ASIO_CHECK(filled(block, 512, 2));
+
+  thread_info_base::cache_statistics s =
+    thread_info_base::statistics(&consumer);
+  ASIO_CHECK(s.depot_hits == 1);
+  ASIO_CHECK(s.hits == 1);
+  ASIO_CHECK(s.misses == 0);
+
+  thread_info_base::deallocate(&consumer, next, 300);
+  thread_info_base::deallocate(&consumer, block, 300);
+}
+
+void exit_test()
+{
+  thread_info_base::cache_statistics before =
+    thread_info_base::exited_thread_statistics();
+
+  {
+    thread_info_base this_thread;
+    void* block = thread_info_base::allocate(&this_thread, 64);
+    thread_info_base::deallocate(&this_thread, block, 64);
+    block = thread_info_base::allocate(&this_thread, 64);
+    thread_info_base::deallocate(&this_thread, block, 64);
+  }
+
+  thread_info_base::cache_statistics after =
+    thread_info_base::exited_thread_statistics();
+  ASIO_CHECK(after.hits == before.hits + 1);
+  ASIO_CHECK(after.cached == before.cached + 2);
+}
+
+// Blocks handed from thread to thread: each thread frees, on its own free
+// lists, the blocks that the previous thread allocated.
+struct exchange
+{
+  asio::detail::mutex mutex;
+  std::vector<void*> blocks[num_sizes];
+  std::size_t corrupted;
+};
+
+static void exchange_blocks(exchange* e, int id, int rounds)
+{
+  thread_info_base this_thread;
+  unsigned char value = static_cast<unsigned char>(id + 1);
+
+  for (int round = 0; round < rounds; ++round)
+  {
+    std::size_t i = (id + round) % num_sizes;
+    void* mine = thread_info_base::allocate(&this_thread, sizes[i]);
+    fill(mine, sizes[i], value);
+
+    void* theirs = 0;
+    {
+      asio::detail::mutex::scoped_lock lock(e->mutex);
+      e->blocks[i].push_back(mine);
+      if (e->blocks[i].size() > 1)
+      {
+        theirs = e->blocks[i].front();
+        e->blocks[i].erase(e->blocks[i].begin());
+      }
+    }
+
+    if (theirs)
+    {
+      const unsigned char* p = static_cast<const unsigned char*>(theirs);
+      if (!filled(theirs, sizes[i], p[0]) || p[0] == 0)
+      {
+        asio::detail::mutex::scoped_lock lock(e->mutex);
+        ++e->corrupted;
+      }
+      thread_info_base::deallocate(&this_thread, theirs, sizes[i]);
+    }
+  }
+}
+
+void threads_test()
+{
+  exchange e;
+  e.corrupted = 0;
+
+  const int num_threads = 4;
+  asio::thread* threads[num_threads];
+  for (int i = 0; i < num_threads; ++i)
+    threads[i] = new asio::thread(
+        bindns::bind(exchange_blocks, &e, i, 20000));
+  for (int i = 0; i < num_threads; ++i)
+  {
+    threads[i]->join();
+    delete threads[i];
+  }
+
+  ASIO_CHECK(e.corrupted == 0);
+
+  for (std::size_t i = 0; i < num_sizes; ++i)
+    for (std::size_t j = 0; j < e.blocks[i].size(); ++j)
+      thread_info_base::deallocate(0, e.blocks[i][j], sizes[i]);
+}
+
+ASIO_TEST_SUITE
+(
+  "thread_info_base",
+  ASIO_TEST_CASE(round_trip_test)
+  ASIO_TEST_CASE(depot_test)
+  ASIO_TEST_CASE(exit_test)
+  ASIO_TEST_CASE(threads_test)
+)
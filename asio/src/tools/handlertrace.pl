@@ -0,0 +1,291 @@
+#!/usr/bin/perl -w
+#
+# handlertrace.pl
+# ~~~~~~~~~~~~~~~
+#
+# A tool for post-processing the binary trace files generated by Asio-based
+# programs compiled with the define `ASIO_ENABLE_BINARY_HANDLER_TRACKING'.
+# Programs write a trace file when they call binary_handler_tracking::dump(),
+# or at exit if the environment variable `ASIO_HANDLER_TRACKING_FILE' is set.
+#
+# By default the tool prints a per-handler latency breakdown, grouped by the
+# operation that created the handler:
+#
+#   perl handlertrace.pl trace.bin
+#
+# To produce a Chrome trace-event timeline (for chrome://tracing or Perfetto):
+#
+#   perl handlertrace.pl --chrome trace.bin > trace.json
+#
+# Copyright (c) 2003-2020 Christopher M. Kohlhoff (chris at kohlhoff dot com)
+#
+# Distributed under the Boost Software License, Version 1.0. (See accompanying
+# file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#
+
+use strict;
+
+my $chrome = 0;
+if (@ARGV && $ARGV[0] eq "--chrome")
+{
+  $chrome = 1;
+  shift @ARGV;
+}
+
+die "Usage: handlertrace.pl [--chrome] <trace file>\n" unless @ARGV == 1;
+
+# Event types, as defined by asio::detail::binary_handler_tracking.
+my $CREATION = 1;
+my $INVOCATION_BEGIN = 2;
+my $INVOCATION_END = 3;
+my $DESTROYED = 4;
+my $EXCEPTION = 5;
+my $OPERATION = 6;
+my $REACTOR_REGISTRATION = 7;
+my $REACTOR_DEREGISTRATION = 8;
+my $REACTOR_EVENTS = 9;
+my $REACTOR_OPERATION = 10;
+
+my @events = ();
+my %strings = ();
+my $ns_per_tick = 1.0;
+my $first_ticks;
+
+#-------------------------------------------------------------------------------
+# Read the trace file into a list of events.
+
+sub read_bytes
+{
+  my ($fh, $length) = @_;
+  my $data = "";
+  my $n = read($fh, $data, $length);
+  die "Truncated trace file\n" unless defined($n) && $n == $length;
+  return $data;
+}
+
+sub parse_trace_file
+{
+  my ($path) = @_;
+  open(my $fh, "<:raw", $path) or die "Cannot open $path: $!\n";
+
+  my $magic = read_bytes($fh, 8);
+  die "$path is not an Asio trace file\n" unless $magic eq "ASIOTRC1";
+
+  my ($version, $event_size) = unpack("L<L<", read_bytes($fh, 8));
+  die "Unsupported trace version $version\n" unless $version == 1;
+
+  my ($start_ticks, $start_ns, $end_ticks, $end_ns)
+    = unpack("Q<Q<Q<Q<", read_bytes($fh, 32));
+  if ($end_ticks > $start_ticks && $end_ns > $start_ns)
+  {
+    $ns_per_tick = ($end_ns - $start_ns) / ($end_ticks - $start_ticks);
+  }
+
+  my ($thread_count) = unpack("L<L<", read_bytes($fh, 8));
+  for (my $i = 0; $i < $thread_count; ++$i)
+  {
+    my ($thread) = unpack("L<L<", read_bytes($fh, 8));
+    my ($count) = unpack("Q<", read_bytes($fh, 8));
+    for (my $j = 0; $j < $count; ++$j)
+    {
+      my ($ticks, $id, $arg, $name, $op, $type, $error)
+        = unpack("Q<Q<Q<Q<Q<L<l<", read_bytes($fh, $event_size));
+      push(@events, { ticks => $ticks, id => $id, arg => $arg,
+          name => $name, op => $op, type => $type, error => $error,
+          thread => $thread });
+      $first_ticks = $ticks
+        if !defined($first_ticks) || $ticks < $first_ticks;
+    }
+  }
+
+  my ($string_count) = unpack("L<L<", read_bytes($fh, 8));
+  for (my $i = 0; $i < $string_count; ++$i)
+  {
+    my ($address) = unpack("Q<", read_bytes($fh, 8));
+    my ($length) = unpack("L<", read_bytes($fh, 4));
+    $strings{$address} = $length ? read_bytes($fh, $length) : "";
+  }
+
+  close($fh);
+
+  @events = sort { $a->{ticks} <=> $b->{ticks} } @events;
+}
+
+sub string_at
+{
+  my ($address) = @_;
+  return "" unless $address;
+  return exists($strings{$address}) ? $strings{$address} : "?";
+}
+
+sub micros
+{
+  my ($ticks) = @_;
+  return ($ticks - $first_ticks) * $ns_per_tick / 1000.0;
+}
+
+#-------------------------------------------------------------------------------
+# Per-handler latency breakdown.
+
+sub percentile
+{
+  my ($values, $p) = @_;
+  return 0 unless @$values;
+  my $index = int($p * (@$values - 1) + 0.5);
+  return $values->[$index];
+}
+
+sub print_latency_breakdown
+{
+  my %handlers = ();
+  my $unmatched = 0;
+
+  foreach my $e (@events)
+  {
+    my $h = $handlers{$e->{id}} ||= {};
+    if ($e->{type} == $CREATION)
+    {
+      $h->{label} = string_at($e->{name}) . "." . string_at($e->{op});
+      $h->{created} = $e->{ticks};
+    }
+    elsif ($e->{type} == $INVOCATION_BEGIN)
+    {
+      $h->{begin} = $e->{ticks};
+    }
+    elsif ($e->{type} == $INVOCATION_END)
+    {
+      $h->{end} = $e->{ticks};
+    }
+  }
+
+  my %groups = ();
+  foreach my $id (keys %handlers)
+  {
+    my $h = $handlers{$id};
+    next unless defined($h->{begin}) && defined($h->{end});
+    if (!defined($h->{created}))
+    {
+      ++$unmatched;
+      next;
+    }
+    my $g = $groups{$h->{label}} ||= { wait => [], run => [] };
+    push(@{$g->{wait}}, ($h->{begin} - $h->{created}) * $ns_per_tick / 1000.0);
+    push(@{$g->{run}}, ($h->{end} - $h->{begin}) * $ns_per_tick / 1000.0);
+  }
+
+  printf("%-40s %8s %10s %10s %10s %10s %10s %10s\n", "operation", "count",
+      "wait p50", "wait p99", "wait max", "run p50", "run p99", "run max");
+  foreach my $label (sort { @{$groups{$b}->{run}} <=> @{$groups{$a}->{run}} }
+      keys %groups)
+  {
+    my @wait = sort { $a <=> $b } @{$groups{$label}->{wait}};
+    my @run = sort { $a <=> $b } @{$groups{$label}->{run}};
+    printf("%-40.40s %8d %10.2f %10.2f %10.2f %10.2f %10.2f %10.2f\n",
+        $label, scalar(@run),
+        percentile(\@wait, 0.5), percentile(\@wait, 0.99), $wait[-1],
+        percentile(\@run, 0.5), percentile(\@run, 0.99), $run[-1]);
+  }
+  print("(times in microseconds; wait is creation to invocation)\n");
+  print("$unmatched invocations whose creation was not in the trace\n")
+    if $unmatched;
+}
+
+#-------------------------------------------------------------------------------
+# Chrome trace-event JSON timeline.
+
+sub json_string
+{
+  my ($s) = @_;
+  $s =~ s/(["\\])/\\$1/g;
+  $s =~ s/([\x00-\x1f])/sprintf("\\u%04x", ord($1))/ge;
+  return "\"$s\"";
+}
+
+sub print_chrome_trace
+{
+  my %labels = ();
+  my %open = ();
+  my @out = ();
+
+  foreach my $e (@events)
+  {
+    my $ts = sprintf("%.3f", micros($e->{ticks}));
+    my $tid = $e->{thread};
+    my $id = $e->{id};
+
+    if ($e->{type} == $CREATION)
+    {
+      my $label = string_at($e->{name}) . "." . string_at($e->{op});
+      $labels{$id} = $label;
+      push(@out, "{\"name\":" . json_string($label) . ",\"ph\":\"i\","
+          . "\"s\":\"t\",\"ts\":$ts,\"pid\":1,\"tid\":$tid,"
+          . "\"args\":{\"id\":$id,\"parent\":$e->{arg}}}");
+      push(@out, "{\"name\":\"handler\",\"cat\":\"flow\",\"ph\":\"s\","
+          . "\"id\":$id,\"ts\":$ts,\"pid\":1,\"tid\":$tid}");
+    }
+    elsif ($e->{type} == $INVOCATION_BEGIN)
+    {
+      $open{$id} = $e;
+      push(@out, "{\"name\":\"handler\",\"cat\":\"flow\",\"ph\":\"f\","
+          . "\"bp\":\"e\",\"id\":$id,\"ts\":$ts,\"pid\":1,\"tid\":$tid}")
+        if exists($labels{$id});
+    }
+    elsif ($e->{type} == $INVOCATION_END && exists($open{$id}))
+    {
+      my $begin = $open{$id};
+      delete($open{$id});
+      my $label = exists($labels{$id}) ? $labels{$id} : "handler $id";
+      my $start = sprintf("%.3f", micros($begin->{ticks}));
+      my $dur = sprintf("%.3f", micros($e->{ticks}) - micros($begin->{ticks}));
+      push(@out, "{\"name\":" . json_string($label) . ",\"ph\":\"X\","
+          . "\"ts\":$start,\"dur\":$dur,\"pid\":1,\"tid\":$begin->{thread},"
+          . "\"args\":{\"id\":$id,\"ec\":" . json_string(
+            string_at($begin->{name}) . ":" . $begin->{error})
+          . ",\"arg\":$begin->{arg}}}");
+    }
+    elsif ($e->{type} == $DESTROYED || $e->{type} == $EXCEPTION)
+    {
+      my $what = $e->{type} == $DESTROYED ? "destroyed" : "exception";
+      push(@out, "{\"name\":\"$what\",\"ph\":\"i\",\"s\":\"t\","
+          . "\"ts\":$ts,\"pid\":1,\"tid\":$tid,\"args\":{\"id\":$id}}");
+    }
+    elsif ($e->{type} == $OPERATION || $e->{type} == $REACTOR_OPERATION)
+    {
+      my $label = string_at($e->{op});
+      $label = string_at($e->{name}) . "." . $label
+        if $e->{type} == $OPERATION;
+      push(@out, "{\"name\":" . json_string($label) . ",\"ph\":\"i\","
+          . "\"s\":\"t\",\"ts\":$ts,\"pid\":1,\"tid\":$tid,"
+          . "\"args\":{\"id\":$id,\"arg\":$e->{arg},"
+          . "\"error\":$e->{error}}}");
+    }
+    elsif ($e->{type} == $REACTOR_REGISTRATION
+        || $e->{type} == $REACTOR_DEREGISTRATION
+        || $e->{type} == $REACTOR_EVENTS)
+    {
+      my $what = $e->{type} == $REACTOR_REGISTRATION ? "reactor register"
+        : $e->{type} == $REACTOR_DEREGISTRATION ? "reactor deregister"
+        : "reactor events";
+      push(@out, "{\"name\":\"$what\",\"ph\":\"i\",\"s\":\"t\","
+          . "\"ts\":$ts,\"pid\":1,\"tid\":$tid,"
+          . "\"args\":{\"registration\":$id,\"arg\":$e->{arg}}}");
+    }
+  }
+
+  print("{\"traceEvents\":[\n");
+  print(join(",\n", @out));
+  print("\n],\"displayTimeUnit\":\"ns\"}\n");
+}
+
+#-------------------------------------------------------------------------------
+
+parse_trace_file($ARGV[0]);
+
+if ($chrome)
+{
+  print_chrome_trace();
+}
+else
+{
+  print_latency_breakdown();
+}
@@ -0,0 +1,30 @@
+#ifndef BENCH_CLOCK_HPP
+#define BENCH_CLOCK_HPP
+
+#include <chrono>
+#include <time.h>
+#include <sys/resource.h>
+
+// the clocks the benchmarks time their runs with, in seconds
+
+// CPU time used by the process
+inline double cpu_seconds() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6
+        + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+// CPU time used by the calling thread
+inline double thread_cpu_seconds() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+inline double wall_seconds() {
+    return std::chrono::duration<double>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#endif
@@ -0,0 +1,255 @@
+// chat_bench.cpp: message latency through a running chat_server
+//
+// Connects <clients> participants to the server, over TCP, its unix domain
+// socket or its shared memory transport, and has the first one send
+// <messages> messages one at a time. Each message is timed from the send
+// until every other participant has read it, and the CPU time of the
+// benchmark itself is reported too, so running it against the same server
+// with each address form compares the transports. Run the server under
+// `time` to see its side of the cost.
+//
+// Given several ports, the clients are spread over the nodes of a federated
+// room (see chat_server --peer) to measure how fan-out scales with nodes.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+#include "bench_clock.hpp"
+#include "chat_message.hpp"
+#include "shm_ring.hpp"
+
+#include "asio.hpp"
+using asio::ip::tcp;
+
+// the id of the i-th benchmark client
+std::string client_id(std::size_t i) {
+    std::string id = "b" + std::to_string(i);
+    id.resize(chat_message::id_length, '\0');
+    return id;
+}
+
+chat_message make_message(const std::string& id, const std::string& text) {
+    chat_message msg;
+    msg.body_length(text.size() + chat_message::id_length);
+    std::memcpy(msg.id(), id.data(), chat_message::id_length);
+    std::memcpy(msg.msg(), text.data(), text.size());
+    msg.encode_header();
+    return msg;
+}
+
+bool has_text(const chat_message& msg, const std::string& text) {
+    std::size_t length = msg.body_length() - chat_message::id_length;
+    return length == text.size() && std::memcmp(msg.msg(), text.data(), length) == 0;
+}
+
+// small frames go out right away on TCP, as they do on a unix socket
+void no_delay(tcp::socket& socket) {
+    socket.set_option(tcp::no_delay(true));
+}
+
+template <typename Socket>
+void no_delay(Socket&) {
+}
+
+// a participant connected over a socket
+template <typename Protocol>
+class socket_client {
+public:
+    socket_client(asio::io_context& io_context,
+        const typename Protocol::endpoint& endpoint, const std::string& id) :
+        socket_(io_context) {
+        socket_.connect(endpoint);
+        no_delay(socket_);
+        asio::write(socket_, asio::buffer(id));
+    }
+
+    void send(const chat_message& msg) {
+        asio::write(socket_, asio::buffer(msg.data(), msg.length()));
+    }
+
+    // read frames until the one with the given text; the Admin messages and
+    // the history that the room sends along the way are skipped
+    void read_until(const std::string& text) {
+        chat_message msg;
+        do {
+            asio::read(socket_, asio::buffer(msg.data(), chat_message::header_length));
+            msg.decode_header();
+            asio::read(socket_, asio::buffer(msg.body(), msg.body_length()));
+        } while (!has_text(msg, text));
+    }
+
+    // the sender gets the Admin messages of everyone joining, throw them away
+    void drain() {
+        static char buf[65536];
+        while (::recv(socket_.native_handle(), buf, sizeof(buf), MSG_DONTWAIT) > 0)
+            ;
+    }
+
+private:
+    typename Protocol::socket socket_;
+};
+
+// a participant on the server's shared memory transport
+class shm_client {
+public:
+    shm_client(asio::io_context& io_context, const std::string& path,
+        const std::string& id) :
+        control_(io_context) {
+        control_.connect(asio::local::stream_protocol::endpoint(path));
+        asio::write(control_, asio::buffer(id));
+        int fd = -1, event_fd = -1;
+        if (!receive_fds(control_.native_handle(), fd, event_fd)
+            || !channel_.attach(fd, event_fd))
+            throw std::runtime_error("can't attach to the shared memory channel");
+    }
+
+    void send(const chat_message& msg) {
+        shm_ring& out = channel_.shared().to_server;
+        while (!out.push(msg.data(), msg.length()))
+            channel_.wait_client(spin_,
+                [&]() { return !out.full(); },
+                [&]() { out.producer_sleeps(); });
+        if (out.consumer_asleep())
+            channel_.wake_server();
+    }
+
+    void read_until(const std::string& text) {
+        shm_ring& in = channel_.shared().to_client;
+        chat_message msg;
+        do {
+            channel_.wait_client(spin_,
+                [&]() { return !in.empty(); },
+                [&]() { in.consumer_sleeps(); });
+            pop(msg);
+        } while (!has_text(msg, text));
+    }
+
+    void drain() {
+        chat_message msg;
+        while (pop(msg))
+            ;
+    }
+
+private:
+    bool pop(chat_message& msg) {
+        shm_ring& in = channel_.shared().to_client;
+        if (!in.pop(msg))
+            return false;
+        if (in.producer_asleep())
+            channel_.wake_server();
+        return true;
+    }
+
+    asio::local::stream_protocol::socket control_;
+    shm_channel channel_;
+    adaptive_spin spin_;
+};
+
+// the clients are made with make_client(i)
+template <typename Client, typename MakeClient>
+void run(std::size_t clients, std::size_t messages, MakeClient make_client) {
+    std::vector<std::unique_ptr<Client> > participants;
+    for (std::size_t i = 0; i < clients; ++i)
+        participants.emplace_back(make_client(i));
+
+    // make sure everyone has joined before the clock starts; the room tells
+    // every participant about its own joining too
+    for (std::size_t i = 0; i < clients; ++i)
+        participants[i]->read_until(
+            std::string(client_id(i).c_str()) + " joined the chat");
+
+    std::vector<double> latencies;
+    latencies.reserve(messages);
+    double cpu = 0;
+    for (std::size_t i = 0; i <= messages; ++i) {
+        std::string text = i == 0 ? "warm up" : "m" + std::to_string(i);
+        chat_message msg = make_message(client_id(0), text);
+
+        double wall_start = wall_seconds();
+        double cpu_start = cpu_seconds();
+        participants[0]->send(msg);
+        for (std::size_t j = 1; j < clients; ++j)
+            participants[j]->read_until(text);
+        if (i > 0) {
+            latencies.push_back(wall_seconds() - wall_start);
+            cpu += cpu_seconds() - cpu_start;
+        }
+        participants[0]->drain();
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    double total = 0;
+    for (auto latency : latencies)
+        total += latency;
+    std::printf("%zu clients, %zu messages\n", clients, messages);
+    std::printf("latency us: mean %.1f p50 %.1f p99 %.1f max %.1f\n",
+        total * 1e6 / messages, latencies[messages / 2] * 1e6,
+        latencies[messages * 99 / 100] * 1e6, latencies.back() * 1e6);
+    std::printf("client cpu us/message: %.1f\n", cpu * 1e6 / messages);
+    std::printf("deliveries/s: %.0f\n", (clients - 1) * messages / total);
+}
+
+int main(int argc, char* argv[]) {
+    bool local = argc == 4 && std::strncmp(argv[1], "unix:", 5) == 0;
+    bool shm = argc == 4 && std::strncmp(argv[1], "shm:", 4) == 0;
+    if (argc != 5 && !local && !shm) {
+        std::cerr << "Usage: chat_bench <host> <port>[,<port>...] <clients> <messages>"
+            << std::endl;
+        std::cerr << "       chat_bench unix:<socket path> <clients> <messages>"
+            << std::endl;
+        std::cerr << "       chat_bench shm:<socket path> <clients> <messages>"
+            << std::endl;
+        return 1;
+    }
+
+    std::size_t clients = std::atoi(argv[argc - 2]);
+    std::size_t messages = std::atoi(argv[argc - 1]);
+    if (clients < 2 || messages < 1) {
+        std::cerr << "need at least 2 clients and 1 message" << std::endl;
+        return 1;
+    }
+
+    try {
+        asio::io_context io_context;
+        if (shm) {
+            std::string path(argv[1] + 4);
+            run<shm_client>(clients, messages, [&](std::size_t i) {
+                return new shm_client(io_context, path, client_id(i));
+            });
+        } else if (local) {
+            typedef asio::local::stream_protocol protocol;
+            protocol::endpoint endpoint(argv[1] + 5);
+            run<socket_client<protocol> >(clients, messages, [&](std::size_t i) {
+                return new socket_client<protocol>(io_context, endpoint, client_id(i));
+            });
+        } else {
+            // with several ports, e.g. the nodes of a federated room, the
+            // clients are spread over them in turn
+            tcp::resolver resolver(io_context);
+            std::vector<tcp::endpoint> endpoints;
+            std::string ports(argv[2]);
+            for (std::size_t start = 0; start <= ports.size(); ) {
+                std::size_t end = std::min(ports.find(',', start), ports.size());
+                endpoints.push_back(*resolver.resolve(argv[1],
+                    ports.substr(start, end - start)).begin());
+                start = end + 1;
+            }
+            run<socket_client<tcp> >(clients, messages, [&](std::size_t i) {
+                return new socket_client<tcp>(io_context,
+                    endpoints[i % endpoints.size()], client_id(i));
+            });
+        }
+    } catch (std::exception& e) {
+        std::cerr << "Exception: " << e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
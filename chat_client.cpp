@@ -2,26 +2,162 @@
 
 //#define DEBUG
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <cstdlib>
 #include <deque>
 #include <iostream>
+#include <list>
+#include <map>
+#include <string>
 #include <thread>
+#include <vector>
 //#include <boost/asio.hpp>
 #include "chat_message.hpp"
+#include "chunk_frame.hpp"
+#include "direct_frame.hpp"
+#include "retry_frame.hpp"
+#include "shm_ring.hpp"
+#include "topic_frame.hpp"
 
 //using boost::asio::ip::tcp;
 //namespace asio = boost::asio;
 //using boost::asio;
 #include "asio.hpp"
+#include "asio/ssl.hpp"
 using asio::ip::tcp;
 
+// "/msg <userid> <text>" sends the text to that user only (see
+// direct_frame.hpp); false if line isn't one
+bool encode_direct(chat_message& msg, const char* id, const std::string& line) {
+    if (line.compare(0, 5, "/msg ") != 0)
+        return false;
+    std::size_t space = line.find(' ', 5);
+    std::string user = line.substr(5, space == std::string::npos
+        ? std::string::npos : space - 5);
+    if (user.empty() || user.size() > chat_message::id_length)
+        return false;
+    char recipient[chat_message::id_length] = "";
+    std::memcpy(recipient, user.data(), user.size());
+    std::string text = space == std::string::npos ? "" : line.substr(space + 1);
+    direct_frame::encode(msg, id, recipient, text.data(), text.size());
+    return true;
+}
+
+// "/sub <pattern>" and "/unsub <pattern>" subscribe to and unsubscribe from
+// the topics matching the pattern, "/pub <topic> <text>" publishes the text
+// on the topic (see topic_frame.hpp); false if line isn't one of them
+bool encode_topic(chat_message& msg, const char* id, const std::string& line) {
+    static const struct {
+        const char* command;
+        topic_frame::op op;
+    } commands[] = {
+        { "/sub ", topic_frame::subscribe_op },
+        { "/unsub ", topic_frame::unsubscribe_op },
+        { "/pub ", topic_frame::publish_op },
+    };
+    for (auto& c : commands) {
+        std::size_t length = std::strlen(c.command);
+        if (line.compare(0, length, c.command) != 0)
+            continue;
+        std::size_t space = line.find(' ', length);
+        std::string topic = line.substr(length, space == std::string::npos
+            ? std::string::npos : space - length);
+        if (topic.empty())
+            return false;
+        std::string text = space == std::string::npos ? "" : line.substr(space + 1);
+        topic_frame::encode(msg, id, c.op, topic, text);
+        return true;
+    }
+    return false;
+}
+
+// a line that is a command rather than a message for the room
+bool encode_command(chat_message& msg, const char* id, const std::string& line) {
+    return encode_direct(msg, id, line) || encode_topic(msg, id, line);
+}
+
+// a line too long for one message goes out as a transfer, and so does one
+// that would look like a chunk, a credit, a retry frame, a direct message or
+// a topic frame
+bool needs_transfer(const std::string& line) {
+    return line.size() > chat_message::max_body_length - chat_message::id_length
+        || (!line.empty() && (line[0] == chunk_frame::chunk_kind
+            || line[0] == chunk_frame::credit_kind
+            || line[0] == retry_frame::retry_kind
+            || line[0] == direct_frame::direct_kind
+            || line[0] == topic_frame::topic_kind));
+}
+
+void print_message(const chat_message& msg) {
+    std::cout.write(msg.id(), chat_message::id_length);
+    if (direct_frame::is_direct(msg)) {
+        std::cout << " says to you: ";
+        std::cout.write(direct_frame::text(msg), direct_frame::text_length(msg));
+    } else if (topic_frame::is_topic(msg)) {
+        std::cout << " says on " << topic_frame::topic(msg) << ": "
+            << topic_frame::text(msg);
+    } else {
+        std::cout << " says: ";
+        std::cout.write(msg.msg(), msg.body_length() - chat_message::id_length);
+    }
+    std::cout << "\n";
+}
+
+// the protocol of chat_client<tls>: a TCP connection with TLS on top, to
+// the server's TLS port
+struct tls {
+    typedef asio::ssl::stream<tcp::socket> socket;
+    typedef tcp::endpoint endpoint;
+};
+
+// a TLS connection shakes hands before the id goes out, other sockets are
+// ready once connected
+template <typename Socket, typename Handler>
+void start_stream(Socket&, Handler handler) {
+    handler(std::error_code());
+}
+
+template <typename Handler>
+void start_stream(tls::socket& socket, Handler handler) {
+    socket.async_handshake(asio::ssl::stream_base::client, handler);
+}
+
+// a client the server refuses connects again when it says; a TLS stream
+// can't be used for a second connection, so that one just gives up
+template <typename Socket>
+bool can_reconnect(Socket&) {
+    return true;
+}
+
+inline bool can_reconnect(tls::socket&) {
+    return false;
+}
+
+// a client over a stream socket of the given protocol: TCP, or a unix
+// domain socket when the server runs on the same host, or TLS
+template <typename Protocol>
 class chat_client {
 public:
+    typedef typename Protocol::endpoint endpoint_type;
+    typedef std::vector<endpoint_type> endpoints_type;
+
     chat_client(asio::io_context& io_context, 
-        tcp::resolver::results_type& endpoints,
+        const endpoints_type& endpoints,
         char* id) :
         io_context_(io_context), 
-        socket_(io_context){
+        socket_(io_context),
+        endpoints_(endpoints),
+        retry_timer_(io_context),
+        refusals_(0),
+        ready_(false),
+        joined_(false),
+        writing_(false),
+        closing_(false),
+        next_transfer_(0),
+        in_flight_(0) {
 
         #ifdef DEBUG
         std::cout << __FUNCTION__ << std::endl;
@@ -32,15 +168,38 @@ public:
         do_connect(endpoints);
     }
 
+    // over TLS, with the client's ssl::context; the server's certificate
+    // has to be valid for host
+    chat_client(asio::io_context& io_context, asio::ssl::context& context,
+        const std::string& host, const endpoints_type& endpoints, char* id) :
+        io_context_(io_context),
+        socket_(io_context, context),
+        endpoints_(endpoints),
+        retry_timer_(io_context),
+        refusals_(0),
+        ready_(false),
+        joined_(false),
+        writing_(false),
+        closing_(false),
+        next_transfer_(0),
+        in_flight_(0) {
+        SSL_set_tlsext_host_name(socket_.native_handle(), host.c_str());
+        socket_.set_verify_mode(asio::ssl::verify_peer);
+        socket_.set_verify_callback(asio::ssl::host_name_verification(host));
+
+        std::memcpy(id_, id, chat_message::id_length);
+
+        do_connect(endpoints);
+    }
+
     void write(chat_message& msg) {
         #ifdef DEBUG
         std::cout << __FUNCTION__ << std::endl;
         #endif
 
         auto f = [this, msg]() {
-            bool write_in_progress = !write_msgs_.empty();
             write_msgs_.push_back(msg);
-            if (!write_in_progress) {
+            if (!writing_ && ready_) {
                 do_write();
             }
         };
@@ -48,35 +207,90 @@ public:
         asio::post(io_context_, f);
     }
 
+    // send a payload too large for one message as a transfer of chunks
+    // (see chunk_frame.hpp), which messages written later may overtake
+    void write_transfer(const std::string& payload) {
+        #ifdef DEBUG
+        std::cout << __FUNCTION__ << std::endl;
+        #endif
+
+        auto f = [this, payload]() {
+            transfers_.push_back(outgoing_transfer());
+            outgoing_transfer& transfer = transfers_.back();
+            transfer.number = next_transfer_++;
+            transfer.payload = payload;
+            transfer.sent = 0;
+            transfer.in_flight = 0;
+            if (!writing_ && ready_) {
+                do_write();
+            }
+        };
+        asio::post(io_context_, f);
+    }
+
+    // close once everything written so far has gone out
     void close() {
         #ifdef DEBUG
         std::cout << __FUNCTION__ << std::endl;
         #endif
 
         auto f = [this]() {
-            socket_.close();
+            closing_ = true;
+            if (!writing_ && transfers_.empty())
+                socket_.lowest_layer().close();
         };
         //f();
         asio::post(io_context_, f);
     }
     
 private:
+    struct outgoing_transfer {
+        std::uint32_t number;
+        std::string payload;
+        std::size_t sent;
+        // sent but not credited back by the server yet
+        std::size_t in_flight;
+    };
+
     asio::io_context& io_context_;
-    tcp::socket socket_;
+    typename Protocol::socket socket_;
+    endpoints_type endpoints_;
+    asio::steady_timer retry_timer_;
+    // times in a row the server has refused us
+    unsigned refusals_;
+    // messages wait in write_msgs_ until the id has gone out
+    bool ready_;
+    // only the first frame can tell us to come back later
+    bool joined_;
+    bool writing_;
+    bool closing_;
     chat_message read_msg_;
     std::deque<chat_message> write_msgs_;
+    // transfers with payload left to send, taking turns
+    std::list<outgoing_transfer> transfers_;
+    std::uint32_t next_transfer_;
+    // sent but not credited back yet, over all the transfers
+    std::size_t in_flight_;
+    // transfers being received, by sender and number
+    std::map<std::pair<std::string, std::uint32_t>, std::string> incoming_;
     char id_[chat_message::id_length + 1];
 
-    void do_connect(const tcp::resolver::results_type& endpoints) {
+    void do_connect(const endpoints_type& endpoints) {
         #ifdef DEBUG
         std::cout << __FUNCTION__ << std::endl;
         #endif
 
-        asio::async_connect(socket_, endpoints, 
-            [this](std::error_code error, tcp::endpoint) {
+        asio::async_connect(socket_.lowest_layer(), endpoints, 
+            [this](std::error_code error, endpoint_type) {
                 if (!error) {
-                    //do_read_header();
-                    send_id();
+                    start_stream(socket_, [this](const std::error_code& error) {
+                        if (!error) {
+                            //do_read_header();
+                            send_id();
+                        } else {
+                            std::cerr << error.message() << std::endl;
+                        }
+                    });
                 }
             });
     }
@@ -90,6 +304,8 @@ private:
             asio::buffer(id_, chat_message::id_length), 
             [this](std::error_code error, std::size_t /*length*/) {
                 if (!error) {
+                    ready_ = true;
+                    do_write();
                     do_read_header();
                 }
             });
@@ -106,7 +322,7 @@ private:
                 if (!error && read_msg_.decode_header()) {
                     do_read_body();
                 } else {
-                    socket_.close();
+                    socket_.lowest_layer().close();
                 }
             });
     }
@@ -119,75 +335,326 @@ private:
         asio::async_read(socket_,
             asio::buffer(read_msg_.body(), read_msg_.body_length()), 
             [this](std::error_code error, std::size_t /*length*/){
+                std::uint32_t retry_ms = 0;
+                if (!error && !joined_ && retry_frame::decode(read_msg_, retry_ms)) {
+                    retry(retry_ms);
+                    return;
+                }
                 if (!error) {
-                    std::cout.write(read_msg_.id(), chat_message::id_length);
-                    std::cout << " says: ";
-                    std::cout.write(read_msg_.msg(), read_msg_.body_length() - chat_message::id_length);
-                    std::cout << "\n";
+                    joined_ = true;
+                    refusals_ = 0;
+                    if (chunk_frame::is_chunk(read_msg_)
+                        || chunk_frame::is_credit(read_msg_)) {
+                        read_transfer();
+                    } else {
+                        print_message(read_msg_);
+                    }
                     do_read_header();
                 } else {
-                    socket_.close();
+                    socket_.lowest_layer().close();
                 }
             });
     }
 
+    // the server is busy: connect again when it says, and after longer and
+    // longer waits if it keeps saying so
+    void retry(std::uint32_t retry_ms) {
+        std::error_code ignored;
+        socket_.lowest_layer().close(ignored);
+        ready_ = false;
+        if (!can_reconnect(socket_)) {
+            std::cerr << "server busy, try again in " << retry_ms << " ms"
+                << std::endl;
+            return;
+        }
+
+        std::uint64_t wait_ms = static_cast<std::uint64_t>(retry_ms)
+            << std::min(refusals_++, 4u);
+        std::cerr << "server busy, connecting again in " << wait_ms << " ms"
+            << std::endl;
+        retry_timer_.expires_after(std::chrono::milliseconds(wait_ms));
+        retry_timer_.async_wait([this](const std::error_code& error) {
+            if (!error)
+                do_connect(endpoints_);
+        });
+    }
+
+    // a chunk of a transfer, or the credit the server gives back for one.
+    // The server sends credit under our own id; it doesn't pass on credit
+    // from anyone else, and we don't take it either
+    void read_transfer() {
+        chunk_frame chunk;
+        if (!chunk.decode(read_msg_))
+            return;
+
+        if (chunk.type() == chunk_frame::credit_kind) {
+            if (std::strncmp(read_msg_.id(), id_, chat_message::id_length) != 0)
+                return;
+            in_flight_ -= std::min(in_flight_, chunk.length());
+            for (auto& transfer : transfers_)
+                if (transfer.number == chunk.transfer()
+                    && transfer.in_flight >= chunk.length())
+                    transfer.in_flight -= chunk.length();
+            if (!writing_)
+                do_write();
+            return;
+        }
+
+        // a transfer that started before we joined can't be put together
+        auto key = std::make_pair(std::string(read_msg_.id(), chat_message::id_length),
+            chunk.transfer());
+        if (chunk.offset() == 0 && chunk.total() <= chunk_frame::max_payload)
+            incoming_[key].reserve(chunk.total());
+        auto incoming = incoming_.find(key);
+        if (incoming == incoming_.end())
+            return;
+        std::string& payload = incoming->second;
+        if (chunk.offset() != payload.size()) {
+            incoming_.erase(incoming);
+            return;
+        }
+        payload.append(chunk.data(), chunk.length());
+        if (payload.size() == chunk.total()) {
+            std::cout.write(read_msg_.id(), chat_message::id_length);
+            std::cout << " says: " << payload << "\n";
+            incoming_.erase(incoming);
+        }
+    }
+
+    // messages go first. When none is waiting, the next chunk of a transfer
+    // that has credit left is queued, the transfers taking turns
+    bool next_chunk() {
+        for (auto transfer = transfers_.begin(); transfer != transfers_.end(); ++transfer) {
+            std::size_t length = std::min<std::size_t>(chunk_frame::max_data,
+                transfer->payload.size() - transfer->sent);
+            if (transfer->in_flight + length > chunk_frame::window)
+                continue;
+            if (in_flight_ + length > chunk_frame::sender_window)
+                return false;
+
+            chat_message msg;
+            chunk_frame::encode_chunk(msg, id_, transfer->number,
+                transfer->sent, transfer->payload.size(),
+                transfer->payload.data() + transfer->sent, length);
+            write_msgs_.push_back(msg);
+            transfer->sent += length;
+            transfer->in_flight += length;
+            in_flight_ += length;
+            if (transfer->sent == transfer->payload.size())
+                transfers_.erase(transfer);
+            else
+                transfers_.splice(transfers_.end(), transfers_, transfer);
+            return true;
+        }
+        return false;
+    }
+
     void do_write() {
         #ifdef DEBUG
         std::cout << __FUNCTION__ << std::endl;
         #endif
 
+        writing_ = !write_msgs_.empty() || next_chunk();
+        if (!writing_) {
+            if (closing_ && transfers_.empty())
+                socket_.lowest_layer().close();
+            return;
+        }
+
         chat_message& msg = write_msgs_.front();
         asio::async_write(socket_, 
             asio::buffer(msg.data(), msg.length()), 
             [this](std::error_code error, std::size_t /*length*/){
                 if (!error) {
                     write_msgs_.pop_front();
-                    if (!write_msgs_.empty()) {
-                        do_write();
-                    }
+                    do_write();
                 } else {
-                    socket_.close();
+                    writing_ = false;
+                    socket_.lowest_layer().close();
                 }
             });
     }
 };
 
+// send the lines of stdin as messages from client until it ends
+template <typename Protocol>
+void run_client(asio::io_context& io_context, chat_client<Protocol>& client,
+    char* id) {
+    std::thread t([&io_context]() {
+        io_context.run();
+        });
+
+    std::string line;
+    while (std::getline(std::cin, line)) {
+        chat_message command;
+        if (encode_command(command, id, line)) {
+            client.write(command);
+            continue;
+        }
+        if (line.size() > chunk_frame::max_payload) {
+            std::cerr << "line too long, at most " << chunk_frame::max_payload
+                << " bytes" << std::endl;
+            continue;
+        }
+        if (needs_transfer(line)) {
+            client.write_transfer(line);
+            continue;
+        }
+
+        chat_message msg;
+        std::size_t len = line.size();
+        msg.body_length(len + chat_message::id_length);
+        std::memcpy(msg.id(), id, chat_message::id_length);
+        std::memcpy(msg.msg(), line.data(), len);
+        msg.encode_header();
+        client.write(msg);
+    }
+
+    client.close();
+    t.join();
+}
+
+// talk to the room over the server's shared memory transport. The control
+// connection only sets the channel up; closing it tells the server we left
+void run_shm_client(asio::io_context& io_context, const char* path, char* id) {
+    asio::local::stream_protocol::socket control(io_context);
+    control.connect(asio::local::stream_protocol::endpoint(path));
+    asio::write(control, asio::buffer(id, chat_message::id_length));
+
+    int fd = -1, event_fd = -1;
+    shm_channel channel;
+    if (!receive_fds(control.native_handle(), fd, event_fd)
+        || !channel.attach(fd, event_fd)) {
+        std::cerr << "can't attach to the shared memory channel" << std::endl;
+        return;
+    }
+
+    shm_ring& in = channel.shared().to_client;
+    shm_ring& out = channel.shared().to_server;
+    std::atomic<bool> done(false);
+    std::thread t([&]() {
+        adaptive_spin spin;
+        chat_message msg;
+        for (;;) {
+            channel.wait_client(spin,
+                [&]() { return !in.empty() || done; },
+                [&]() { in.consumer_sleeps(); });
+            if (!in.pop(msg))
+                break;
+            if (in.producer_asleep())
+                channel.wake_server();
+            print_message(msg);
+        }
+        });
+
+    adaptive_spin spin;
+    auto send = [&](const chat_message& msg) {
+        while (!out.push(msg.data(), msg.length()))
+            channel.wait_client(spin,
+                [&]() { return !out.full(); },
+                [&]() { out.producer_sleeps(); });
+        if (out.consumer_asleep())
+            channel.wake_server();
+    };
+
+    // lines are routed as over TCP. A transfer goes out chunk after chunk,
+    // as fast as the server empties the ring, which stands in for the
+    // credit a TCP session gets back
+    std::uint32_t next_transfer = 0;
+    std::string line;
+    while (std::getline(std::cin, line)) {
+        chat_message msg;
+        if (encode_command(msg, id, line)) {
+            send(msg);
+            continue;
+        }
+        if (line.size() > chunk_frame::max_payload) {
+            std::cerr << "line too long, at most " << chunk_frame::max_payload
+                << " bytes" << std::endl;
+            continue;
+        }
+        if (needs_transfer(line)) {
+            std::uint32_t transfer = next_transfer++;
+            std::size_t sent = 0;
+            do {
+                std::size_t length = std::min<std::size_t>(chunk_frame::max_data,
+                    line.size() - sent);
+                chunk_frame::encode_chunk(msg, id, transfer, sent, line.size(),
+                    line.data() + sent, length);
+                send(msg);
+                sent += length;
+            } while (sent < line.size());
+            continue;
+        }
+
+        msg.body_length(line.size() + chat_message::id_length);
+        std::memcpy(msg.id(), id, chat_message::id_length);
+        std::memcpy(msg.msg(), line.data(), line.size());
+        msg.encode_header();
+        send(msg);
+    }
+
+    done = true;
+    channel.wake_client();
+    t.join();
+    control.close();
+}
+
 int main(int argc, char* argv[]) {
-    if (argc != 4) {
+    // a server on the same host can also be reached at unix:<socket path>,
+    // or over shared memory at shm:<socket path>. tls:<host> connects to
+    // the server's TLS port, trusting the system's CAs or the given file
+    bool local = argc == 3 && std::strncmp(argv[1], "unix:", 5) == 0;
+    bool shm = argc == 3 && std::strncmp(argv[1], "shm:", 4) == 0;
+    bool secure = (argc == 4 || argc == 5) && std::strncmp(argv[1], "tls:", 4) == 0;
+    if (argc != 4 && !local && !shm && !secure) {
         std::cerr << "Usage: chat_client <host> <port> <userid>" << std::endl;
+        std::cerr << "       chat_client unix:<socket path> <userid>" << std::endl;
+        std::cerr << "       chat_client shm:<socket path> <userid>" << std::endl;
+        std::cerr << "       chat_client tls:<host> <port> <userid> [<CA file>]" << std::endl;
         return 1;
     }
 
-    if (std::strlen(argv[3]) > chat_message::id_length) {
+    const char* user = argv[secure ? 3 : argc - 1];
+    if (std::strlen(user) > chat_message::id_length) {
         std::cerr << "Error: userid's length exceeds " << chat_message::id_length << std::endl;
         return 1;
     }
 
     char id[chat_message::id_length + 1] = "";
-    std::memcpy(id, argv[3], std::strlen(argv[3]));
+    std::memcpy(id, user, std::strlen(user));
 
     try {
         asio::io_context io_context;
-        tcp::resolver resolver(io_context);
-        auto endpoints = resolver.resolve(argv[1], argv[2]);
-        chat_client client(io_context, endpoints, id);
-        std::thread t([&io_context]() {
-            io_context.run();
-            });
-
-        char line[chat_message::max_body_length + 1];
-        while (std::cin.getline(line, chat_message::max_body_length + 1)) {
-            chat_message msg;
-            std::size_t len = std::strlen(line);
-            msg.body_length(len + chat_message::id_length);
-            std::memcpy(msg.id(), id, chat_message::id_length);
-            std::memcpy(msg.msg(), line, len);
-            msg.encode_header();
-            client.write(msg);
+        if (shm) {
+            run_shm_client(io_context, argv[1] + 4, id);
+        } else if (local) {
+            typedef asio::local::stream_protocol protocol;
+            chat_client<protocol>::endpoints_type endpoints(
+                1, protocol::endpoint(argv[1] + 5));
+            chat_client<protocol> client(io_context, endpoints, id);
+            run_client(io_context, client, id);
+        } else if (secure) {
+            std::string host(argv[1] + 4);
+            asio::ssl::context context(asio::ssl::context::tls_client);
+            if (argc == 5)
+                context.load_verify_file(argv[4]);
+            else
+                context.set_default_verify_paths();
+            tcp::resolver resolver(io_context);
+            auto results = resolver.resolve(host, argv[2]);
+            chat_client<tls>::endpoints_type endpoints(
+                results.begin(), results.end());
+            chat_client<tls> client(io_context, context, host, endpoints, id);
+            run_client(io_context, client, id);
+        } else {
+            tcp::resolver resolver(io_context);
+            auto results = resolver.resolve(argv[1], argv[2]);
+            chat_client<tcp>::endpoints_type endpoints(
+                results.begin(), results.end());
+            chat_client<tcp> client(io_context, endpoints, id);
+            run_client(io_context, client, id);
         }
-
-        client.close();
-        t.join();
     } catch (std::exception& e) {
         std::cerr << e.what() << std::endl;
     }
@@ -195,4 +662,3 @@ int main(int argc, char* argv[]) {
 
     return 0;
 }
-
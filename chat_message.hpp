@@ -4,19 +4,84 @@
 #include <cstdio>
 #include <cstring>
 #include <cstdlib>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include "message_slab.hpp"
+
+// the longest body a message may have, id included. Every program talking
+// to the room has to be built with the same limit; the 4 digit header can't
+// describe more than 9999
+#if !defined(CHAT_MAX_BODY_LENGTH)
+#define CHAT_MAX_BODY_LENGTH 4096
+#endif
 
 class chat_message {
 
     //data : xxxxyyyyyyyy.........
     //xxxx: header, encode body length, fixed 4 chars
     //yyyyyyyy: id, fixed 8 chars
-
-public : 
+    //
+    //The frame is kept in a message_slab block just big enough for it, which
+    //grows when body_length() or decode_header() make the frame longer. A
+    //new message has room for the header, the id and a short body.
+    //
+    //A move takes the block along, so it can't throw and containers move
+    //messages rather than copy them. The message moved from is left without
+    //a block, until body_length() or an assignment gives it one.
+
+public :
     enum { header_length = 4 }; // 4 digit header
     enum { id_length = 8 }; // 4 digit id_length
-    enum { max_body_length = 1024 }; // at most 1KB body
+    enum { max_body_length = CHAT_MAX_BODY_LENGTH };
+    static_assert(CHAT_MAX_BODY_LENGTH >= id_length
+        && CHAT_MAX_BODY_LENGTH <= 9999,
+        "CHAT_MAX_BODY_LENGTH must fit the 4 digit header");
 
     chat_message() : body_length_(0) {
+        allocate(0);
+    }
+
+    chat_message(const chat_message& other) : body_length_(other.body_length_) {
+        allocate(message_slab::size_class(other.length()));
+        // a message moved from has no block, and nothing to copy
+        if (other.data_)
+            std::memcpy(data_, other.data_, other.length());
+    }
+
+    chat_message(chat_message&& other) noexcept :
+        data_(other.data_),
+        size_class_(other.size_class_),
+        body_length_(other.body_length_) {
+        other.release();
+    }
+
+    ~chat_message() {
+        if (data_)
+            message_slab::deallocate(data_, size_class_);
+    }
+
+    chat_message& operator=(const chat_message& other) {
+        if (this != &other) {
+            body_length_ = 0;
+            reserve(other.length());
+            if (other.data_)
+                std::memcpy(data_, other.data_, other.length());
+            body_length_ = other.body_length_;
+        }
+        return *this;
+    }
+
+    chat_message& operator=(chat_message&& other) noexcept {
+        if (this != &other) {
+            if (data_)
+                message_slab::deallocate(data_, size_class_);
+            data_ = other.data_;
+            size_class_ = other.size_class_;
+            body_length_ = other.body_length_;
+            other.release();
+        }
+        return *this;
     }
 
     const char* data() const {
@@ -27,10 +92,10 @@ public :
         return data_;
     }
 
-    std::size_t length() {
+    std::size_t length() const {
         return body_length_ + header_length;
     }
-    
+
     const char* id() const {
         return data_ + header_length;
     }
@@ -55,27 +120,26 @@ public :
         return data_ + header_length + id_length;
     }
 
-    std::size_t body_length() {
+    std::size_t body_length() const {
         return body_length_;
     }
 
-    void body_length(std::size_t new_length) { 
+    void body_length(std::size_t new_length) {
+        if (new_length > max_body_length)
+            new_length = max_body_length;
+        reserve(header_length + new_length);
         body_length_ = new_length;
-        if (body_length_ > max_body_length) 
-            body_length_ = max_body_length;
         //body_length = std::max(new_length, max_body_length);
     }
 
     bool decode_header() {
         char header[header_length + 1] = "";
         std::strncat(header, data_, header_length);
-        body_length_ = std::atoi(header);
-        if (body_length_ > max_body_length) 
-            body_length_ = max_body_length;
+        body_length(std::atoi(header));
         return true;
     }
 
-    bool encode_header() { 
+    bool encode_header() {
         char header[header_length + 1] = "";
         sprintf(header, "%4d", static_cast<int>(body_length_));
         std::memcpy(data_, header, header_length);
@@ -83,8 +147,42 @@ public :
     }
 
 private:
-    char data_[header_length + id_length + max_body_length];
-    std::size_t body_length_;
+    void allocate(std::size_t size_class) {
+        size_class_ = static_cast<std::uint8_t>(size_class);
+        data_ = message_slab::allocate(size_class);
+    }
+
+    // what is left of a message whose block was moved away
+    void release() {
+        data_ = nullptr;
+        size_class_ = 0;
+        body_length_ = 0;
+    }
+
+    // make room for a frame of length bytes, keeping what is there. The id
+    // is kept even before the body length is set
+    void reserve(std::size_t length) {
+        if (data_ && length <= message_slab::class_size(size_class_))
+            return;
+        char* old_data = data_;
+        std::size_t old_class = size_class_;
+        allocate(message_slab::size_class(length));
+        if (!old_data)
+            return;
+        std::size_t keep = header_length + id_length + body_length_;
+        if (keep > message_slab::class_size(old_class))
+            keep = message_slab::class_size(old_class);
+        std::memcpy(data_, old_data, keep);
+        message_slab::deallocate(old_data, old_class);
+    }
+
+    char* data_;
+    std::uint8_t size_class_;
+    std::uint32_t body_length_;
 };
 
-#endif
\ No newline at end of file
+static_assert(std::is_nothrow_move_constructible<chat_message>::value
+    && std::is_nothrow_move_assignable<chat_message>::value,
+    "containers must be able to move chat_message");
+
+#endif
@@ -0,0 +1,416 @@
+// chat_proxy.cpp : edge proxy in front of chat_server
+//
+// Clients connect to the proxy just as they would to chat_server. The proxy
+// keeps a few connections to the server's proxy port (chat_server
+// --proxy-port) and carries each client as a stream of mux records on one of
+// them, so the server sends every room message once per connection rather
+// than once per user, and the proxy fans it out to its own clients.
+
+//#define DEBUG
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "chat_message.hpp"
+#include "mux_record.hpp"
+
+#include "asio.hpp"
+using asio::ip::tcp;
+
+class upstream;
+
+// a client of the proxy, framed like a chat_session on the server: the id
+// first, then chat messages in both directions
+class edge_session :
+    public std::enable_shared_from_this<edge_session> {
+
+public:
+    edge_session(asio::io_context& io_context, upstream& link) :
+        socket_(io_context),
+        upstream_(link),
+        stream_(0),
+        stopped_(false),
+        id_() {
+    }
+
+    tcp::socket& socket() {
+        return socket_;
+    }
+
+    const char* id() const {
+        return id_;
+    }
+
+    void wait_for_id() {
+        #ifdef DEBUG
+        std::cout << __FUNCTION__ << std::endl;
+        #endif
+
+        asio::async_read(socket_,
+            asio::buffer(id_, chat_message::id_length),
+            std::bind(&edge_session::start,
+                shared_from_this(),
+                std::placeholders::_1));
+    }
+
+    void deliver(const chat_message& msg) {
+        bool write_in_progress = !write_msgs_.empty();
+        write_msgs_.push_back(msg);
+        if (!write_in_progress)
+            write_next();
+    }
+
+    void stop();
+
+private:
+    void start(const std::error_code& error);
+
+    void read_header() {
+        asio::async_read(socket_,
+            asio::buffer(read_msg_.data(), chat_message::header_length),
+            std::bind(&edge_session::handle_read_header,
+                shared_from_this(),
+                std::placeholders::_1));
+    }
+
+    void handle_read_header(const std::error_code& error) {
+        if (!error && read_msg_.decode_header()
+            && read_msg_.body_length() >= chat_message::id_length) {
+            asio::async_read(socket_,
+                asio::buffer(read_msg_.body(), read_msg_.body_length()),
+                std::bind(&edge_session::handle_read_body,
+                    shared_from_this(),
+                    std::placeholders::_1));
+        } else {
+            stop();
+        }
+    }
+
+    void handle_read_body(const std::error_code& error);
+
+    void write_next() {
+        chat_message& write_msg = write_msgs_.front();
+        asio::async_write(socket_,
+            asio::buffer(write_msg.data(), write_msg.length()),
+            std::bind(&edge_session::handle_write,
+                shared_from_this(),
+                std::placeholders::_1));
+    }
+
+    void handle_write(const std::error_code& error) {
+        if (!error) {
+            write_msgs_.pop_front();
+            if (!write_msgs_.empty())
+                write_next();
+        } else {
+            stop();
+        }
+    }
+
+    tcp::socket socket_;
+    upstream& upstream_;
+    std::uint64_t stream_;
+    bool stopped_;
+    chat_message read_msg_;
+    std::deque<chat_message> write_msgs_;
+    char id_[chat_message::id_length + 1];
+};
+
+typedef std::shared_ptr<edge_session> edge_session_ptr;
+
+// one connection to the server, carrying the streams of many clients.
+// Records queued while a write is in progress go out together in one gather
+// write. If the connection drops, its clients are disconnected and it is
+// opened again after a while
+class upstream {
+public:
+    enum { max_batch = 64 };
+    enum { reconnect_ms = 1000 };
+
+    upstream(asio::io_context& io_context, const tcp::endpoint& server) :
+        io_context_(io_context),
+        socket_(io_context),
+        server_(server),
+        timer_(io_context),
+        connected_(false),
+        next_stream_(1),
+        writing_(0) {
+        connect();
+    }
+
+    bool connected() const {
+        return connected_;
+    }
+
+    std::size_t sessions() const {
+        return sessions_.size();
+    }
+
+    // a new client with its id; returns its stream
+    std::uint64_t open(edge_session_ptr session) {
+        std::uint64_t stream = next_stream_++;
+        sessions_[stream] = session;
+        write_records_.emplace_back();
+        write_records_.back().open(stream, session->id());
+        if (writing_ == 0)
+            write_next();
+        return stream;
+    }
+
+    void send(std::uint64_t stream, const chat_message& msg) {
+        if (!connected_)
+            return;
+        write_records_.emplace_back();
+        write_records_.back().assign(mux_record::stream_message, stream, msg);
+        if (writing_ == 0)
+            write_next();
+    }
+
+    void close(std::uint64_t stream) {
+        if (sessions_.erase(stream) == 0 || !connected_)
+            return;
+        write_records_.emplace_back();
+        write_records_.back().close(stream);
+        if (writing_ == 0)
+            write_next();
+    }
+
+private:
+    void connect() {
+        socket_.async_connect(server_,
+            [this](const std::error_code& error) {
+                if (error) {
+                    socket_.close();
+                    reconnect();
+                    return;
+                }
+                socket_.set_option(tcp::no_delay(true));
+                connected_ = true;
+                std::cout << "connected to " << server_ << std::endl;
+                read_prefix();
+            });
+    }
+
+    void reconnect() {
+        timer_.expires_after(std::chrono::milliseconds(reconnect_ms));
+        timer_.async_wait([this](const std::error_code& error) {
+            if (!error)
+                connect();
+        });
+    }
+
+    void read_prefix() {
+        asio::async_read(socket_,
+            asio::buffer(read_record_.data(),
+                mux_record::prefix_length + chat_message::header_length),
+            [this](const std::error_code& error, std::size_t /*length*/) {
+                std::size_t frame_length = read_record_.frame_length();
+                if (error || frame_length > chat_message::header_length
+                    + chat_message::id_length + chat_message::max_body_length) {
+                    drop();
+                    return;
+                }
+
+                std::size_t read = mux_record::prefix_length
+                    + chat_message::header_length;
+                std::size_t length = mux_record::prefix_length + frame_length;
+                asio::async_read(socket_,
+                    asio::buffer(read_record_.data() + read, length - read),
+                    [this, length](const std::error_code& error, std::size_t) {
+                        if (error || !read_record_.decode(length)) {
+                            drop();
+                            return;
+                        }
+                        if (read_record_.record_kind() == mux_record::stream_message)
+                            dispatch(read_record_.stream(), read_record_.message());
+                        read_prefix();
+                    });
+            });
+    }
+
+    // a message for all the clients (but its sender), or for one
+    void dispatch(std::uint64_t stream, const chat_message& msg) {
+        if (stream != mux_record::all_streams) {
+            auto session = sessions_.find(stream);
+            if (session != sessions_.end())
+                session->second->deliver(msg);
+            return;
+        }
+
+        for (auto& session : sessions_)
+            if (std::strncmp(msg.id(), session.second->id(), chat_message::id_length) != 0)
+                session.second->deliver(msg);
+    }
+
+    void write_next() {
+        if (!connected_)
+            return;
+        write_buffers_.clear();
+        for (auto& record : write_records_) {
+            write_buffers_.push_back(asio::buffer(record.data(), record.length()));
+            if (write_buffers_.size() == max_batch)
+                break;
+        }
+        writing_ = write_buffers_.size();
+        asio::async_write(socket_,
+            write_buffers_,
+            [this](const std::error_code& error, std::size_t /*length*/) {
+                if (error) {
+                    drop();
+                    return;
+                }
+                write_records_.erase(write_records_.begin(),
+                    write_records_.begin() + writing_);
+                writing_ = 0;
+                if (!write_records_.empty())
+                    write_next();
+            });
+    }
+
+    // the server is gone: so are the clients, who can come back once the
+    // connection is up again
+    void drop() {
+        if (!connected_)
+            return;
+        std::cout << "lost " << server_ << std::endl;
+        connected_ = false;
+        std::error_code ignored;
+        socket_.close(ignored);
+        write_records_.clear();
+        writing_ = 0;
+
+        std::map<std::uint64_t, edge_session_ptr> sessions;
+        sessions.swap(sessions_);
+        for (auto& session : sessions)
+            session.second->stop();
+        reconnect();
+    }
+
+    asio::io_context& io_context_;
+    tcp::socket socket_;
+    tcp::endpoint server_;
+    asio::steady_timer timer_;
+    bool connected_;
+    std::uint64_t next_stream_;
+    std::map<std::uint64_t, edge_session_ptr> sessions_;
+    mux_record read_record_;
+    // the records being written are the first writing_ of write_records_
+    std::deque<mux_record> write_records_;
+    std::vector<asio::const_buffer> write_buffers_;
+    std::size_t writing_;
+};
+
+void edge_session::start(const std::error_code& error) {
+    #ifdef DEBUG
+    std::cout << __FUNCTION__ << std::endl;
+    #endif
+
+    if (error || !upstream_.connected()) {
+        stop();
+        return;
+    }
+    stream_ = upstream_.open(shared_from_this());
+    read_header();
+}
+
+void edge_session::handle_read_body(const std::error_code& error) {
+    if (error) {
+        stop();
+        return;
+    }
+    upstream_.send(stream_, read_msg_);
+    read_header();
+}
+
+void edge_session::stop() {
+    if (stopped_)
+        return;
+    stopped_ = true;
+    write_msgs_.clear();
+    std::error_code ignored;
+    socket_.close(ignored);
+    if (stream_ != 0)
+        upstream_.close(stream_);
+}
+
+// accepts clients and spreads them over the upstream connections
+class chat_proxy {
+public:
+    chat_proxy(asio::io_context& io_context, const tcp::endpoint& endpoint,
+        const tcp::endpoint& server, std::size_t connections) :
+        io_context_(io_context),
+        acceptor_(io_context, endpoint) {
+        for (std::size_t i = 0; i < connections; ++i)
+            upstreams_.emplace_back(new upstream(io_context, server));
+        accept_next();
+    }
+
+private:
+    void accept_next() {
+        edge_session_ptr session(new edge_session(io_context_, pick()));
+        acceptor_.async_accept(session->socket(),
+            std::bind(&chat_proxy::handle_accept, this, session,
+                std::placeholders::_1));
+    }
+
+    void handle_accept(edge_session_ptr session, const std::error_code& error) {
+        if (!error) {
+            session->socket().set_option(tcp::no_delay(true));
+            session->wait_for_id();
+        }
+        accept_next();
+    }
+
+    // the connected upstream with the fewest clients
+    upstream& pick() {
+        upstream* best = upstreams_.front().get();
+        for (auto& link : upstreams_)
+            if (link->connected() && (!best->connected()
+                || link->sessions() < best->sessions()))
+                best = link.get();
+        return *best;
+    }
+
+    asio::io_context& io_context_;
+    tcp::acceptor acceptor_;
+    std::vector<std::unique_ptr<upstream> > upstreams_;
+};
+
+int main(int argc, char* argv[]) {
+    if (argc != 4 && argc != 5) {
+        std::cerr << "Usage: chat_proxy <port> <server host> <server proxy port> "
+            << "[<connections>]" << std::endl;
+        std::cerr << "  e.g. chat_proxy 2000 127.0.0.1 1002 2" << std::endl;
+        return 1;
+    }
+
+    try {
+        asio::io_context io_context;
+        tcp::resolver resolver(io_context);
+        tcp::endpoint server = *resolver.resolve(argv[2], argv[3]).begin();
+        std::size_t connections = argc == 5 ? std::atoi(argv[4]) : 2;
+        if (connections == 0)
+            connections = 1;
+
+        chat_proxy proxy(io_context,
+            tcp::endpoint(tcp::v4(), std::atoi(argv[1])), server, connections);
+
+        asio::signal_set signals(io_context, SIGINT, SIGTERM);
+        signals.async_wait([&io_context](const std::error_code&, int) {
+            io_context.stop();
+        });
+
+        io_context.run();
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+    }
+
+    return 0;
+}
@@ -3,302 +3,4274 @@
 //#define DEBUG
 
 #include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
 #include <cstdlib>
+#include <ctime>
 #include <deque>
+#include <functional>
+#include <iterator>
 #include <iostream>
 #include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#if defined(CHAT_COROUTINE_SESSIONS)
+#include <optional>
+#endif
+#include <random>
 #include <set>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <sys/sendfile.h>
 //#include <boost/bind.hpp>
 //#include <boost/shared_ptr.hpp>
 //#include <boost/enable_shared_from_this.hpp>
 //#include <boost/asio.hpp>
+#include "bench_clock.hpp"
 #include "chat_message.hpp"
+#include "chunk_frame.hpp"
+#include "direct_frame.hpp"
+#include "frame_pipe.hpp"
+#include "history_log.hpp"
+#include "ktls.hpp"
+#include "multicast_record.hpp"
+#include "mux_record.hpp"
+#include "participant_list.hpp"
+#include "relay_record.hpp"
+#include "retry_frame.hpp"
+#include "shm_ring.hpp"
+#include "token_bucket.hpp"
+#include "topic_frame.hpp"
+#include "topic_trie.hpp"
 
 //using boost::asio::ip::tcp;
 //namespace asio = boost::asio;
 #include "asio.hpp"
+#include "asio/ssl.hpp"
+
+// CHAT_COROUTINE_SESSIONS builds chat_session on C++20 coroutines instead of
+// callbacks (see the chat_server_coro target in the makefile)
+#if defined(CHAT_COROUTINE_SESSIONS) && !defined(ASIO_HAS_CO_AWAIT)
+#error "CHAT_COROUTINE_SESSIONS needs a compiler with C++20 coroutines"
+#endif
+
+#if defined(CHAT_COROUTINE_SESSIONS)
+// the coroutines run on the io_context's own executor type: through the
+// sockets' polymorphic executor every completion would be wrapped and
+// allocated before being dispatched
+typedef asio::io_context::executor_type session_executor;
+template <typename T>
+using session_awaitable = asio::awaitable<T, session_executor>;
+constexpr asio::use_awaitable_t<session_executor> use_session_awaitable;
+#endif
 using asio::ip::tcp;
+using asio::ip::udp;
+
+// the credit for one chunk of a transfer (see chunk_frame.hpp), given back
+// to its sender once the last participant holding the chunk lets go of it
+class chunk_credit {
+public:
+    explicit chunk_credit(std::function<void()> release) :
+        release_(release) {
+    }
+
+    ~chunk_credit() {
+        release_();
+    }
+
+private:
+    std::function<void()> release_;
+};
+
+typedef std::shared_ptr<chunk_credit> chunk_credit_ptr;
+
+// the payload a sender's transfers hold in the room's queues, i.e. the
+// credit it has spent and not had back: at most a window for each transfer,
+// and a sender_window for all of them (see chunk_frame.hpp)
+class transfer_windows {
+public:
+    transfer_windows() :
+        total_(0) {
+    }
+
+    // false if the chunk goes over its transfer's window or the sender's
+    bool spend(const chunk_frame& chunk) {
+        std::size_t& in_flight = in_flight_[chunk.transfer()];
+        if (in_flight + chunk.length() > chunk_frame::window
+            || total_ + chunk.length() > chunk_frame::sender_window) {
+            if (in_flight == 0)
+                in_flight_.erase(chunk.transfer());
+            return false;
+        }
+        in_flight += chunk.length();
+        total_ += chunk.length();
+        return true;
+    }
+
+    // false if the transfer holds nothing
+    bool give_back(std::uint32_t transfer, std::size_t length) {
+        auto in_flight = in_flight_.find(transfer);
+        if (in_flight == in_flight_.end())
+            return false;
+        in_flight->second -= length;
+        total_ -= length;
+        if (in_flight->second == 0)
+            in_flight_.erase(in_flight);
+        return true;
+    }
+
+private:
+    // payload bytes of each transfer not yet credited back
+    std::map<std::uint32_t, std::size_t> in_flight_;
+    std::size_t total_;
+};
+
+class chat_participant {
+public:
+    virtual ~chat_participant(){}
+    virtual const char* id() const = 0;
+    virtual void deliver(const chat_message& msg) = 0;
+
+    // deliver a frame the server made itself, a notice of the room's, which
+    // may be written ahead of the participants' messages
+    virtual void deliver_notice(const chat_message& msg) {
+        deliver(msg);
+    }
+
+    // deliver a chunk of a transfer, which may be overtaken by messages
+    // delivered after it. Keeping hold of credit holds up the sender
+    virtual void deliver_chunk(const chat_message& msg, const chunk_credit_ptr& credit) {
+        deliver(msg);
+    }
+
+    // deliver a message that the room has also loaded into a frame pipe
+    virtual void deliver(const chat_message& msg, frame_pipe& frame) {
+        deliver(msg);
+    }
+
+    // deliver the recent messages to a participant that just joined
+    virtual void deliver_history(const std::deque<chat_message>& msgs) {
+        for (auto msg : msgs)
+            deliver(msg);
+    }
+
+    // deliver recent messages that are stored in the history log
+    virtual void deliver_history(const std::deque<history_log::extent>& extents) {
+        std::deque<chat_message> msgs;
+        for (auto& extent : extents) {
+            std::vector<char> data(extent.length);
+            if (pread(extent.file->fd, data.data(), data.size(), extent.offset)
+                != static_cast<ssize_t>(data.size()))
+                return;
+
+            for (std::size_t offset = 0; offset < data.size(); ) {
+                chat_message msg;
+                std::memcpy(msg.data(), &data[offset], chat_message::header_length);
+                msg.decode_header();
+                std::memcpy(msg.body(), &data[offset + chat_message::header_length],
+                    msg.body_length());
+                msgs.push_back(msg);
+                offset += msg.length();
+            }
+        }
+        deliver_history(msgs);
+    }
+};
+
+//typedef boost::shared_ptr<chat_participant> chat_participant_ptr;
+
+typedef std::shared_ptr<chat_participant> chat_participant_ptr;
+
+// publishes every room message once to a multicast group. The messages are
+// numbered so that viewers notice gaps, and the last `window` of them are
+// kept for viewers to fetch over their TCP connection
+class multicast_publisher {
+public:
+    enum { window = 4096 };
+    enum { heartbeat_ms = 500 };
+
+    multicast_publisher(asio::io_context& io_context, 
+        const udp::endpoint& group, const asio::ip::address& interface) :
+        socket_(io_context, group.protocol()),
+        group_(group),
+        timer_(io_context),
+        records_(window),
+        next_(0),
+        published_(false),
+        dropped_(0) {
+        if (interface.is_v4())
+            socket_.set_option(asio::ip::multicast::outbound_interface(
+                interface.to_v4()));
+        socket_.set_option(asio::ip::multicast::enable_loopback(true));
+        socket_.non_blocking(true);
+        wait_heartbeat();
+    }
+
+    void publish(const chat_message& msg) {
+        multicast_record& record = records_[next_ % window];
+        record.assign(next_++, msg);
+        send(record);
+        published_ = true;
+    }
+
+    std::uint64_t next_seq() const {
+        return next_;
+    }
+
+    // the oldest message that is still kept
+    std::uint64_t oldest_seq() const {
+        return next_ > window ? next_ - window : 0;
+    }
+
+    const multicast_record& record(std::uint64_t seq) const {
+        return records_[seq % window];
+    }
+
+    std::uint64_t dropped() const {
+        return dropped_;
+    }
+
+private:
+    // a datagram that the socket can't take right away is dropped, and
+    // viewers fetch it like any other lost one
+    void send(const multicast_record& record) {
+        std::error_code error;
+        socket_.send_to(asio::buffer(record.data(), record.length()), 
+            group_, 0, error);
+        if (error)
+            ++dropped_;
+    }
+
+    // while the room is quiet, tell the viewers the next sequence number so
+    // that they notice the messages lost at the end of a burst
+    void wait_heartbeat() {
+        timer_.expires_after(std::chrono::milliseconds(heartbeat_ms));
+        timer_.async_wait([this](const std::error_code& error) {
+            if (error)
+                return;
+            if (!published_) {
+                multicast_record record;
+                record.heartbeat(next_);
+                send(record);
+            }
+            published_ = false;
+            wait_heartbeat();
+        });
+    }
+
+    udp::socket socket_;
+    udp::endpoint group_;
+    asio::steady_timer timer_;
+    std::vector<multicast_record> records_;
+    std::uint64_t next_;
+    bool published_;
+    std::uint64_t dropped_;
+};
+
+class relay_hub;
+
+// a TCP connection to another node of the room. Both ends send a hello
+// with their node id and then relay records in either direction
+class relay_link :
+    public std::enable_shared_from_this<relay_link> {
+
+public:
+    relay_link(asio::io_context& io_context, relay_hub& hub) :
+        socket_(io_context),
+        hub_(hub),
+        node_(0),
+        closed_(false) {
+    }
+
+    tcp::socket& socket() {
+        return socket_;
+    }
+
+    // the node on the other end, once its hello has arrived
+    std::uint64_t node() const {
+        return node_;
+    }
+
+    void start(std::uint64_t local_node);
+
+    void send(const relay_record& record) {
+        if (closed_)
+            return;
+        bool write_in_progress = !write_records_.empty();
+        write_records_.push_back(record);
+        if (!write_in_progress)
+            write_next();
+    }
+
+private:
+    void read_prefix() {
+        asio::async_read(socket_,
+            asio::buffer(read_record_.data(),
+                relay_record::prefix_length + chat_message::header_length),
+            std::bind(&relay_link::handle_read_prefix,
+                shared_from_this(),
+                std::placeholders::_1));
+    }
+
+    void handle_read_prefix(const std::error_code& error) {
+        std::size_t frame_length = read_record_.frame_length();
+        if (error || frame_length > chat_message::header_length
+            + chat_message::id_length + chat_message::max_body_length) {
+            close();
+            return;
+        }
+
+        std::size_t read = relay_record::prefix_length + chat_message::header_length;
+        std::size_t length = relay_record::prefix_length + frame_length;
+        asio::async_read(socket_,
+            asio::buffer(read_record_.data() + read, length - read),
+            std::bind(&relay_link::handle_read_record,
+                shared_from_this(),
+                std::placeholders::_1,
+                length));
+    }
+
+    void handle_read_record(const std::error_code& error, std::size_t length);
+
+    void write_next() {
+        relay_record& record = write_records_.front();
+        asio::async_write(socket_,
+            asio::buffer(record.data(), record.length()),
+            std::bind(&relay_link::handle_write,
+                shared_from_this(),
+                std::placeholders::_1));
+    }
+
+    void handle_write(const std::error_code& error) {
+        if (!error) {
+            write_records_.pop_front();
+            if (!write_records_.empty())
+                write_next();
+        } else {
+            close();
+        }
+    }
+
+    void close();
+
+    tcp::socket socket_;
+    relay_hub& hub_;
+    std::uint64_t node_;
+    bool closed_;
+    relay_record read_record_;
+    std::deque<relay_record> write_records_;
+};
+
+typedef std::shared_ptr<relay_link> relay_link_ptr;
+
+// links this node's room with the same room on other nodes. Messages that
+// enter the room here are numbered and sent once over every link; messages
+// that arrive over a link are delivered to the local participants and
+// passed on over the other links, so the nodes can be linked in any shape.
+// Each node remembers which sequence numbers it has seen from every origin
+// and drops the copies that come back around a loop.
+//
+// Passing messages on costs each node a copy from every other node in a
+// full mesh, where every node already has each message straight from its
+// origin. Nodes told they are in a full mesh (see relay_topology) only pass
+// on what did not come straight from its origin
+class relay_hub {
+public:
+    enum relay_topology { any_topology, full_mesh };
+    enum { reconnect_ms = 1000 };
+    // how far behind the newest message of an origin a late copy may be
+    enum { window = 64 };
+
+    relay_hub(asio::io_context& io_context, std::uint64_t node,
+        std::function<void(const chat_message&)> deliver_local) :
+        io_context_(io_context),
+        acceptor_(io_context),
+        node_(node),
+        // start from the clock, so the numbers still go up when a node
+        // restarts and its peers remember the old ones
+        next_(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count()),
+        deliver_local_(deliver_local),
+        topology_(any_topology) {
+    }
+
+    // in a full mesh, a node that is down gets nothing until its links are
+    // back, as no one passes on what it missed
+    void topology(relay_topology topology) {
+        topology_ = topology;
+    }
+
+    std::uint64_t node() const {
+        return node_;
+    }
+
+    // accept links from peers that connect to us
+    void listen(const tcp::endpoint& endpoint) {
+        acceptor_.open(endpoint.protocol());
+        acceptor_.set_option(tcp::acceptor::reuse_address(true));
+        acceptor_.bind(endpoint);
+        acceptor_.listen();
+        accept_next();
+    }
+
+    // keep a link to a peer, reconnecting whenever it drops
+    void connect(const tcp::endpoint& peer) {
+        relay_link_ptr link(new relay_link(io_context_, *this));
+        link->socket().async_connect(peer,
+            std::bind(&relay_hub::handle_connect, this, link, peer,
+                std::placeholders::_1));
+    }
+
+    // a message that entered the room at this node
+    void publish(const chat_message& msg) {
+        relay_record record;
+        record.assign(node_, next_++, msg);
+        for (auto link : links_)
+            link->send(record);
+    }
+
+    // the hello of a link has arrived. Returns false for a link back to
+    // this node, which must be dropped
+    bool linked(relay_link_ptr link) {
+        if (link->node() == node_)
+            return false;
+        std::cout << "node " << link->node() << " linked" << std::endl;
+        return true;
+    }
+
+    void receive(relay_link_ptr from, const relay_record& record) {
+        if (record.origin() == node_ || !first_seen(record.origin(), record.seq()))
+            return;
+
+        if (topology_ != full_mesh || from->node() != record.origin())
+            for (auto link : links_)
+                if (link != from && link->node() != record.origin())
+                    link->send(record);
+        deliver_local_(record.message());
+    }
+
+    void closed(relay_link_ptr link) {
+        links_.erase(link);
+        if (link->node() == node_)
+            return;
+        if (link->node() != 0)
+            std::cout << "node " << link->node() << " unlinked" << std::endl;
+
+        auto peer = peers_.find(link.get());
+        if (peer != peers_.end()) {
+            tcp::endpoint endpoint = peer->second;
+            peers_.erase(peer);
+            reconnect(endpoint);
+        }
+    }
+
+private:
+    void accept_next() {
+        relay_link_ptr link(new relay_link(io_context_, *this));
+        acceptor_.async_accept(link->socket(),
+            std::bind(&relay_hub::handle_accept, this, link,
+                std::placeholders::_1));
+    }
+
+    void handle_accept(relay_link_ptr link, const std::error_code& error) {
+        if (!error) {
+            start(link);
+            accept_next();
+        }
+    }
+
+    void handle_connect(relay_link_ptr link, tcp::endpoint peer,
+        const std::error_code& error) {
+        if (error) {
+            reconnect(peer);
+            return;
+        }
+        peers_[link.get()] = peer;
+        start(link);
+    }
+
+    void reconnect(const tcp::endpoint& peer) {
+        std::shared_ptr<asio::steady_timer> timer(
+            new asio::steady_timer(io_context_,
+                std::chrono::milliseconds(reconnect_ms)));
+        timer->async_wait([this, timer, peer](const std::error_code& error) {
+            if (!error)
+                connect(peer);
+        });
+    }
+
+    void start(relay_link_ptr link) {
+        std::error_code ignored;
+        link->socket().set_option(tcp::no_delay(true), ignored);
+        links_.insert(link);
+        link->start(node_);
+    }
+
+    // true the first time a message is seen. Per origin, a bit mask marks
+    // which of the last `window` sequence numbers have been seen
+    bool first_seen(std::uint64_t origin, std::uint64_t seq) {
+        seen& s = seen_[origin];
+        if (s.mask == 0 || seq > s.high) {
+            std::uint64_t shift = s.mask == 0 ? window : seq - s.high;
+            s.mask = shift >= window ? 1 : (s.mask << shift) | 1;
+            s.high = seq;
+            return true;
+        }
+
+        std::uint64_t behind = s.high - seq;
+        if (behind >= window || (s.mask & (std::uint64_t(1) << behind)))
+            return false;
+        s.mask |= std::uint64_t(1) << behind;
+        return true;
+    }
+
+    struct seen {
+        seen() : high(0), mask(0) {
+        }
+
+        std::uint64_t high;
+        std::uint64_t mask;
+    };
+
+    asio::io_context& io_context_;
+    tcp::acceptor acceptor_;
+    std::uint64_t node_;
+    std::uint64_t next_;
+    std::function<void(const chat_message&)> deliver_local_;
+    relay_topology topology_;
+    std::set<relay_link_ptr> links_;
+    // the peer of every link that we connected, to reconnect to
+    std::map<relay_link*, tcp::endpoint> peers_;
+    std::unordered_map<std::uint64_t, seen> seen_;
+};
+
+void relay_link::start(std::uint64_t local_node) {
+    relay_record hello;
+    hello.hello(local_node);
+    send(hello);
+    read_prefix();
+}
+
+void relay_link::handle_read_record(const std::error_code& error,
+    std::size_t length) {
+    if (error || !read_record_.decode(length)) {
+        close();
+        return;
+    }
+
+    if (!read_record_.has_frame()) {
+        if (node_ == 0) {
+            node_ = read_record_.origin();
+            if (!hub_.linked(shared_from_this())) {
+                close();
+                return;
+            }
+        }
+    } else if (node_ != 0) {
+        hub_.receive(shared_from_this(), read_record_);
+    }
+    read_prefix();
+}
+
+void relay_link::close() {
+    if (closed_)
+        return;
+    closed_ = true;
+    write_records_.clear();
+    std::error_code ignored;
+    socket_.close(ignored);
+    hub_.closed(shared_from_this());
+}
+
+// flood protection for the messages the clients send. Every session has a
+// token bucket of rate messages a second, in bursts of up to burst, and the
+// room has one of room_rate for all the sessions together; a rate of 0 is
+// no limit. A session over its own rate has the message that went over
+// dropped, or its reads paused until its bucket has a token again, or is
+// disconnected, as excess says. Over the room's rate, or while fan-out is
+// overloaded (more than max_backlog frames queued in all the sessions'
+// lanes), no one client is to blame and reads are just paused.
+//
+// A client that doesn't read what it is sent would hold its frames in the
+// backlog for good, so a session with more than max_session_backlog frames
+// queued is disconnected. Unless set, that is half of max_backlog, and at
+// least min_session_backlog, which holds the chunks of two transfer windows
+struct flood_policy {
+    enum action { drop_excess, delay_excess, disconnect_excess };
+    enum { min_session_backlog = 2 * chunk_frame::window / chunk_frame::max_data };
+
+    flood_policy() :
+        rate(0),
+        burst(0),
+        room_rate(0),
+        room_burst(0),
+        max_backlog(0),
+        max_session_backlog(0),
+        excess(delay_excess) {
+    }
+
+    // 0 if a session may queue without limit
+    std::size_t session_backlog() const {
+        if (max_session_backlog != 0 || max_backlog == 0)
+            return max_session_backlog;
+        return std::max<std::size_t>(max_backlog / 2, min_session_backlog);
+    }
+
+    double rate;
+    double burst;
+    double room_rate;
+    double room_burst;
+    std::size_t max_backlog;
+    std::size_t max_session_backlog;
+    action excess;
+};
+
+// how the room's fan-out went: the broadcasts, the turns they were
+// delivered in, and the longest turn, which is the longest fan-out held up
+// the io_context
+class fanout_metrics {
+public:
+    static void broadcast() {
+        ++get().broadcasts;
+    }
+
+    static void turn(std::chrono::steady_clock::duration length, bool continued) {
+        counters& k = get();
+        long long us = std::chrono::duration_cast<std::chrono::microseconds>(
+            length).count();
+        ++k.turns;
+        k.continued += continued;
+        k.total_us += us;
+        k.max_us = std::max(k.max_us, us);
+    }
+
+    static void report(std::ostream& out) {
+        counters& k = get();
+        out << "fanout: " << k.broadcasts << " broadcasts in " << k.turns
+            << " turns, " << k.continued << " continued later, "
+            << "mean turn " << (k.turns ? k.total_us / k.turns : 0) << " us, "
+            << "longest " << k.max_us << " us" << std::endl;
+    }
+
+private:
+    struct counters {
+        unsigned long long broadcasts;
+        unsigned long long turns;
+        unsigned long long continued;
+        unsigned long long total_us;
+        long long max_us;
+    };
+
+    static counters& get() {
+        static counters all;
+        return all;
+    }
+};
+
+// whether the room takes a frame from a client. Credit and retry frames,
+// and anything from "Admin", only ever come from the server, so a frame
+// that could pass for one of them is not passed on to anyone
+inline bool accepted_from_client(const chat_message& msg) {
+    if (msg.body_length() < chat_message::id_length
+        || std::strncmp(msg.id(), "Admin", chat_message::id_length) == 0)
+        return false;
+    return msg.body_length() == chat_message::id_length
+        || (msg.msg()[0] != chunk_frame::credit_kind
+            && msg.msg()[0] != retry_frame::retry_kind);
+}
+
+// what a participant said, for the server's log. Only the recipient of a
+// direct message is logged, not what it says, and only the topic of a
+// message published on one
+inline void log_message(const char* id, const chat_message& msg) {
+    if (topic_frame::is_topic(msg)) {
+        static const char* ops[] = { " subscribes to ", " unsubscribes from ",
+            " publishes on " };
+        topic_frame::op o = topic_frame::operation(msg);
+        std::cout << id << ops[o == topic_frame::subscribe_op ? 0
+            : o == topic_frame::unsubscribe_op ? 1 : 2]
+            << topic_frame::topic(msg) << std::endl;
+        return;
+    }
+    if (direct_frame::is_direct(msg)) {
+        const char* recipient = direct_frame::recipient(msg);
+        std::cout << id << " writes to ";
+        std::cout.write(recipient, ::strnlen(recipient, chat_message::id_length));
+        std::cout << std::endl;
+        return;
+    }
+    std::cout << id << " says: ";
+    std::cout.write(msg.msg(), msg.body_length() - chat_message::id_length);
+    std::cout << std::endl;
+}
+
+// the participants by id, for direct messages (see direct_frame.hpp). An id
+// isn't unique: a user may be in the room from several sessions at once,
+// each of which gets the user's direct messages, and one of them leaving
+// leaves the others in the directory
+class user_directory {
+public:
+    void add(const chat_participant_ptr& participant) {
+        users_[key(participant->id())].push_back(participant);
+    }
+
+    void remove(const chat_participant_ptr& participant) {
+        auto user = users_.find(key(participant->id()));
+        if (user == users_.end())
+            return;
+        std::vector<chat_participant_ptr>& sessions = user->second;
+        sessions.erase(std::remove(sessions.begin(), sessions.end(), participant),
+            sessions.end());
+        if (sessions.empty())
+            users_.erase(user);
+    }
+
+    // the sessions of the user with this id, nullptr if there is no such user
+    const std::vector<chat_participant_ptr>* find(const char* id) const {
+        auto user = users_.find(key(id));
+        return user == users_.end() ? nullptr : &user->second;
+    }
+
+private:
+    // the id's 8 chars, NUL padded like on the wire
+    static std::uint64_t key(const char* id) {
+        std::uint64_t k = 0;
+        std::memcpy(&k, id, chat_message::id_length);
+        return k;
+    }
+
+    std::unordered_map<std::uint64_t, std::vector<chat_participant_ptr> > users_;
+};
+
+class chat_room {
+public: 
+    // how deliver() copies a message to the participants
+    //   copy_fanout: each participant queues its own copy of the message
+    //   splice_fanout: the frame goes into a pipe once and is tee()'d and
+    //       splice()'d to each idle socket, so the kernel shares its pages
+    enum fanout_strategy { copy_fanout, splice_fanout };
+
+    enum { default_budget_us = 1000 };
+
+    chat_room(asio::io_context& io_context) :
+        io_context_(io_context),
+        fanout_(copy_fanout),
+        history_frames_(max_recent_msg),
+        budget_(default_budget_us),
+        sequence_(0),
+        turn_(0),
+        fanning_out_(false) {
+    }
+
+    // how long one turn of fan-out may hold up the io_context (see
+    // fan_out()); 0 delivers every message to everyone at once
+    void fanout_budget(std::chrono::microseconds budget) {
+        budget_ = budget;
+    }
+
+    // returns false if the strategy is not available
+    bool fanout(fanout_strategy strategy) {
+        if (strategy == splice_fanout && !frame_) {
+            std::unique_ptr<frame_pipe> frame(new frame_pipe);
+            if (!frame->is_open())
+                return false;
+            frame_ = std::move(frame);
+        }
+        fanout_ = strategy;
+        return true;
+    }
+
+    // also publish every message to a multicast group, for viewers
+    void multicast(asio::io_context& io_context, const udp::endpoint& group,
+        const asio::ip::address& interface) {
+        multicast_.reset(new multicast_publisher(io_context, group, interface));
+    }
+
+    multicast_publisher* publisher() {
+        return multicast_.get();
+    }
+
+    // see flood_policy
+    void limit_floods(const flood_policy& policy) {
+        floods_ = policy;
+        bucket_ = token_bucket(policy.room_rate, policy.room_burst);
+    }
+
+    const flood_policy& floods() const {
+        return floods_;
+    }
+
+    // take a token from the room's share of the flood_policy: zero if there
+    // was one, otherwise how long until there is. Sessions on the fan-out
+    // workers' threads take from it too
+    token_bucket::clock::duration take_token(token_bucket::clock::time_point now) {
+        std::lock_guard<std::mutex> lock(bucket_mutex_);
+        token_bucket::clock::duration wait = bucket_.wait(now);
+        if (wait == token_bucket::clock::duration::zero())
+            bucket_.take(now);
+        return wait;
+    }
+
+    // link the room with the same room on other nodes
+    relay_hub& federate(asio::io_context& io_context, std::uint64_t node) {
+        relay_.reset(new relay_hub(io_context, node,
+            [this](const chat_message& msg) { deliver_local(msg); }));
+        return *relay_;
+    }
+
+    // keep the history in log segments under dir and replay the last
+    // `frames` messages from there with sendfile()
+    bool log_history(const std::string& dir, std::size_t frames) {
+        std::unique_ptr<history_log> log(new history_log(frames));
+        if (!log->open(dir))
+            return false;
+        log_ = std::move(log);
+        history_frames_ = frames;
+        return true;
+    }
+
+    void join(chat_participant_ptr new_participant) {
+        #ifdef DEBUG
+        std::cout << __FUNCTION__ << std::endl;
+        #endif
+
+        participants_[new_participant] = sequence_;
+        welcome(new_participant);
+    }
+
+    void leave(chat_participant_ptr participant) {
+        #ifdef DEBUG
+        std::cout << __FUNCTION__ << std::endl;
+        #endif
+
+        participants_.erase(participant);
+        farewell(participant);
+    }
+
+    // an edge proxy (see chat_proxy.cpp) takes every message once, for all
+    // of its users
+    void attach(chat_participant_ptr proxy) {
+        proxies_.insert(proxy);
+    }
+
+    void detach(chat_participant_ptr proxy) {
+        proxies_.erase(proxy);
+    }
+
+    // a user behind an edge proxy gets its history and is announced like
+    // any participant, but the room's messages reach it through the proxy
+    void join_proxied(chat_participant_ptr new_participant) {
+        welcome(new_participant);
+    }
+
+    void leave_proxied(chat_participant_ptr participant) {
+        farewell(participant);
+    }
+
+    // a participant subscribes to the topics matching a pattern, or
+    // unsubscribes (see topic_frame.hpp). A malformed pattern is ignored, and
+    // so is one too long or past the participant's max_subscriptions
+    void subscription(chat_participant_ptr participant, const chat_message& msg) {
+        if (!topic_frame::is_subscription(msg))
+            return;
+        std::string pattern = topic_frame::topic(msg);
+        if (pattern.size() > topic_frame::max_pattern_length)
+            return;
+        std::set<std::string>& patterns = subscriptions_[participant];
+        if (topic_frame::operation(msg) == topic_frame::subscribe_op) {
+            if (patterns.size() < topic_frame::max_subscriptions
+                && patterns.insert(pattern).second
+                && !topics_.subscribe(pattern, participant))
+                patterns.erase(pattern);
+        } else if (patterns.erase(pattern) > 0) {
+            topics_.unsubscribe(pattern, participant);
+        }
+        if (patterns.empty())
+            subscriptions_.erase(participant);
+    }
+
+    // credit comes with the chunks of a transfer from a local session
+    void deliver(const chat_message& msg,
+        const chunk_credit_ptr& credit = chunk_credit_ptr()) {
+        #ifdef DEBUG
+        std::cout << __FUNCTION__ << std::endl;
+        #endif
+
+        // the other nodes get the message once over each relay link. A
+        // message on a topic, or for one user, goes to them as well: each node
+        // routes it to its own subscribers, or to the user if it is there
+        if (relay_)
+            relay_->publish(msg);
+
+        deliver_local(msg, credit);
+    }
+
+    // deliver a message to the participants of this node, which is all that
+    // is left to do for a message relayed from another node. A notice is
+    // one of the room's own
+    void deliver_local(const chat_message& msg,
+        const chunk_credit_ptr& credit = chunk_credit_ptr(), bool notice = false) {
+        #ifdef DEBUG
+        std::cout << __FUNCTION__ << std::endl;
+        #endif
+
+        // a direct message only goes to its recipient, and a message on a
+        // topic to its subscribers
+        if (direct_frame::is_direct(msg) || topic_frame::is_topic(msg)) {
+            send_routed(msg);
+            return;
+        }
+
+        // the chunks of a transfer aren't kept as history, and may be sent
+        // after messages that come later
+        if (chunk_frame::is_chunk(msg)) {
+            for (auto proxy : proxies_)
+                proxy->deliver_chunk(msg, credit);
+            start_broadcast(msg, credit);
+            return;
+        }
+
+        // push the new message into the queue
+        recent_msg_.push_back(msg);
+        while (recent_msg_.size() > max_recent_msg) recent_msg_.pop_front();
+
+        // recent_msg_ is kept either way, so the room can go back to it if
+        // the log can't be written
+        if (log_ && !log_->append(msg.data(), msg.length())) {
+            std::cerr << "history log: " << std::strerror(errno)
+                << ", keeping the history in memory" << std::endl;
+            log_.reset();
+        }
+
+        // viewers get the message from one multicast datagram
+        if (multicast_)
+            multicast_->publish(msg);
+
+        // the proxies leave out the sender themselves
+        for (auto proxy : proxies_)
+            proxy->deliver(msg);
+
+        start_broadcast(msg, credit, notice);
+    }
+
+private:
+    // a message on its way to the participants, in turns
+    struct broadcast {
+        broadcast(const chat_message& m, const chunk_credit_ptr& c,
+            bool n, std::uint64_t s) :
+            msg(m),
+            credit(c),
+            chunk(chunk_frame::is_chunk(m)),
+            notice(n),
+            sequence(s) {
+        }
+
+        chat_message msg;
+        chunk_credit_ptr credit;
+        bool chunk;
+        bool notice;
+        // the participants who joined after it don't get it, they have it
+        // in their history already
+        std::uint64_t sequence;
+        // the last participant it went to, none before its first turn
+        chat_participant_ptr last;
+    };
+
+    // participants taken in one go, between looks at the clock
+    enum { slice_size = 64 };
+
+    // a direct message, or one on a topic, waiting for the broadcasts
+    // before it
+    struct routed {
+        routed(const chat_message& m, std::uint64_t a) :
+            msg(m),
+            after(a) {
+        }
+
+        chat_message msg;
+        // the last broadcast before it
+        std::uint64_t after;
+    };
+
+    void start_broadcast(const chat_message& msg, const chunk_credit_ptr& credit,
+        bool notice = false) {
+        fanout_metrics::broadcast();
+        broadcasts_.emplace_back(msg, credit, notice, ++sequence_);
+        if (!fanning_out_)
+            fan_out();
+    }
+
+    // deliver the pending broadcasts, taking turns of a slice each, until
+    // they are all done or the budget is spent; the rest of them wait for
+    // the next call, posted to the io_context so that whatever else is
+    // ready runs first. A broadcast never gets ahead of an older one, so
+    // everyone still gets the messages in the order they were sent
+    void fan_out() {
+        fanning_out_ = true;
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        bool spent = false;
+        while (!broadcasts_.empty() && !spent) {
+            if (turn_ >= broadcasts_.size())
+                turn_ = 0;
+            if (deliver_slice(turn_))
+                broadcasts_.erase(broadcasts_.begin() + turn_);
+            else
+                ++turn_;
+            spent = budget_.count() > 0
+                && std::chrono::steady_clock::now() - start >= budget_;
+        }
+        fanout_metrics::turn(std::chrono::steady_clock::now() - start,
+            !broadcasts_.empty());
+        release_routed();
+
+        fanning_out_ = !broadcasts_.empty();
+        if (fanning_out_)
+            asio::post(io_context_, std::bind(&chat_room::fan_out, this));
+    }
+
+    // deliver broadcast i to the next slice_size participants, going no
+    // further than the broadcast before it has. True once it has been to
+    // everyone
+    bool deliver_slice(std::size_t i) {
+        broadcast& b = broadcasts_[i];
+        auto stop = participants_.end();
+        if (i > 0) {
+            const chat_participant_ptr& older = broadcasts_[i - 1].last;
+            if (!older)
+                return false;
+            stop = participants_.upper_bound(older);
+        }
+        auto next = b.last ? participants_.upper_bound(b.last) : participants_.begin();
+
+        // with the splice fan-out the frame is copied into the kernel once
+        // a slice
+        bool spliced = !b.chunk && !b.notice && fanout_ == splice_fanout 
+            && frame_->load(b.msg.data(), b.msg.length());
+
+        std::size_t taken = 0;
+        for (; next != stop && taken < slice_size; ++next, ++taken) {
+            const chat_participant_ptr& participant = next->first;
+            if (next->second >= b.sequence
+                || std::strncmp(b.msg.id(), participant->id(), chat_message::id_length) == 0)
+                continue;
+            if (b.chunk)
+                participant->deliver_chunk(b.msg, b.credit);
+            else if (b.notice)
+                participant->deliver_notice(b.msg);
+            else if (spliced)
+                participant->deliver(b.msg, *frame_);
+            else
+                participant->deliver(b.msg);
+        }
+
+        if (spliced)
+            frame_->clear();
+        if (taken > 0)
+            b.last = std::prev(next)->first;
+        return next == participants_.end();
+    }
+
+    // the recipients of a direct message, or of a message on a topic, are
+    // looked up and it is delivered at once, unless a broadcast is still on
+    // its way to the participants: then it waits for the broadcasts before
+    // it, so that no one gets it ahead of them
+    void send_routed(const chat_message& msg) {
+        if (broadcasts_.empty())
+            deliver_routed(msg);
+        else
+            routed_.emplace_back(msg, sequence_);
+    }
+
+    void release_routed() {
+        while (!routed_.empty() && (broadcasts_.empty()
+            || broadcasts_.front().sequence > routed_.front().after)) {
+            deliver_routed(routed_.front().msg);
+            routed_.pop_front();
+        }
+    }
+
+    void deliver_routed(const chat_message& msg) {
+        if (direct_frame::is_direct(msg))
+            deliver_direct(msg);
+        else if (topic_frame::operation(msg) == topic_frame::publish_op)
+            deliver_topic(msg);
+    }
+
+    // once to every participant with a matching subscription, however many
+    // of its subscriptions match, leaving out the sender
+    void deliver_topic(const chat_message& msg) {
+        std::vector<chat_participant_ptr> subscribers;
+        topics_.match(topic_frame::topic(msg),
+            [&subscribers](const chat_participant_ptr& subscriber) {
+                subscribers.push_back(subscriber);
+            });
+        std::sort(subscribers.begin(), subscribers.end());
+        subscribers.erase(std::unique(subscribers.begin(), subscribers.end()),
+            subscribers.end());
+        for (auto& subscriber : subscribers)
+            if (std::strncmp(msg.id(), subscriber->id(), chat_message::id_length) != 0)
+                subscriber->deliver(msg);
+    }
+
+    // to every session of the recipient. With no such user here the sender
+    // is told so, unless the room spans other nodes, where the user may be
+    void deliver_direct(const chat_message& msg) {
+        if (const std::vector<chat_participant_ptr>* sessions
+            = users_.find(direct_frame::recipient(msg))) {
+            for (auto& session : *sessions)
+                session->deliver(msg);
+            return;
+        }
+
+        const std::vector<chat_participant_ptr>* senders = users_.find(msg.id());
+        if (relay_ || !senders)
+            return;
+        chat_message notice;
+        char admin_id[chat_message::id_length + 1] = "Admin";
+        std::string admin_msg(direct_frame::recipient(msg),
+            ::strnlen(direct_frame::recipient(msg), chat_message::id_length));
+        admin_msg += " is not in the chat";
+
+        notice.body_length(admin_msg.length() + chat_message::id_length);
+        std::memcpy(notice.id(), admin_id, chat_message::id_length);
+        std::memcpy(notice.msg(), admin_msg.c_str(), admin_msg.length());
+        notice.encode_header();
+        for (auto& sender : *senders)
+            sender->deliver_notice(notice);
+    }
+
+    void welcome(chat_participant_ptr new_participant) {
+        std::cout << new_participant->id() << " joined the chat" << std::endl;
+        users_.add(new_participant);
+
+        // deliver recent messages to the new participants
+        if (log_) {
+            std::deque<history_log::extent> extents;
+            log_->tail(history_frames_, extents);
+            new_participant->deliver_history(extents);
+        } else {
+            new_participant->deliver_history(recent_msg_);
+        }
+        
+        // deliever the messages that a new participant joined the chat
+        chat_message msg;
+        char admin_id[chat_message::id_length + 1] = "Admin";
+        std::string admin_msg(new_participant->id());
+        admin_msg += " joined the chat";
+
+        msg.body_length(admin_msg.length() + chat_message::id_length);
+        std::memcpy(msg.id(), admin_id, chat_message::id_length);
+        std::memcpy(msg.msg(), admin_msg.c_str(), admin_msg.length());
+        msg.encode_header();
+
+        announce(msg);
+    }
+
+    // a notice of the room's own, which the other nodes get as an ordinary
+    // message
+    void announce(const chat_message& msg) {
+        if (relay_)
+            relay_->publish(msg);
+
+        deliver_local(msg, chunk_credit_ptr(), true);
+    }
+
+    void farewell(chat_participant_ptr participant) {
+        std::cout << participant->id() << " left the chat" << std::endl;
+        users_.remove(participant);
+        auto subscribed = subscriptions_.find(participant);
+        if (subscribed != subscriptions_.end()) {
+            for (auto& pattern : subscribed->second)
+                topics_.unsubscribe(pattern, participant);
+            subscriptions_.erase(subscribed);
+        }
+
+        // deliever the messages that a participant left the chat
+        chat_message msg;
+        char admin_id[chat_message::id_length + 1] = "Admin";
+        std::string admin_msg(participant->id());
+        admin_msg += " left the chat";
+
+        msg.body_length(admin_msg.length() + chat_message::id_length);
+        std::memcpy(msg.id(), admin_id, chat_message::id_length);
+        std::memcpy(msg.msg(), admin_msg.c_str(), admin_msg.length());
+        msg.encode_header();
+
+        announce(msg);
+    }
+
+    asio::io_context& io_context_;
+    // the participants, with the last broadcast before they joined
+    std::map<chat_participant_ptr, std::uint64_t> participants_;
+    std::set<chat_participant_ptr> proxies_;
+    // everyone in the room, by id: the participants, and the users behind
+    // proxies and fan-out workers
+    user_directory users_;
+    // who subscribed to which topics, and each one's patterns
+    topic_trie<chat_participant_ptr> topics_;
+    std::map<chat_participant_ptr, std::set<std::string> > subscriptions_;
+    enum { max_recent_msg = 100 };
+    std::deque<chat_message> recent_msg_;
+    fanout_strategy fanout_;
+    std::unique_ptr<frame_pipe> frame_;
+    std::unique_ptr<history_log> log_;
+    std::size_t history_frames_;
+    std::unique_ptr<multicast_publisher> multicast_;
+    std::unique_ptr<relay_hub> relay_;
+    flood_policy floods_;
+    std::mutex bucket_mutex_;
+    token_bucket bucket_;
+    std::chrono::microseconds budget_;
+    // the broadcasts so far, and those still under way, oldest first
+    std::uint64_t sequence_;
+    std::deque<broadcast> broadcasts_;
+    // the broadcast whose turn is next
+    std::size_t turn_;
+    // a call to fan_out() is running or posted
+    bool fanning_out_;
+    // direct messages and messages on topics waiting for broadcasts, oldest
+    // first
+    std::deque<routed> routed_;
+};
+
+// a thread of its own for a share of the room's sessions (see
+// --fanout-threads). The room hands each message to the worker once, like
+// to an edge proxy, and the worker delivers it to its sessions on its
+// thread, so that all the workers write to their slices of the room at the
+// same time. A worker gets the room's messages in the order the room sends
+// them, and so does each of its sessions, history first.
+//
+// The worker's sessions are kept in a participant_list that the room's
+// thread writes as they join and leave and the worker's thread reads, each
+// without waiting for the other. The joins and leaves that come in while
+// the room's thread is busy are applied together, in one commit of the
+// list, so a storm of joins doesn't copy it once per session. Like the
+// room, the worker delivers in turns of a slice of sessions at a time,
+// until its fan-out budget is spent
+class fanout_worker :
+    public chat_participant,
+    public std::enable_shared_from_this<fanout_worker> {
+
+public:
+    fanout_worker(asio::io_context& room_context, chat_room& room) :
+        room_context_(room_context),
+        room_(room),
+        work_(asio::make_work_guard(io_context_)),
+        reader_(members_.reader()),
+        posted_(0),
+        budget_(chat_room::default_budget_us),
+        queued_(0),
+        next_(0),
+        fanning_out_(false) {
+    }
+
+    ~fanout_worker() {
+        stop();
+    }
+
+    // the sessions of the worker are made on this io_context
+    asio::io_context& context() {
+        return io_context_;
+    }
+
+    void start() {
+        room_.attach(shared_from_this());
+        thread_ = std::thread([this]() { io_context_.run(); });
+    }
+
+    void stop() {
+        io_context_.stop();
+        if (thread_.joinable())
+            thread_.join();
+    }
+
+    const char* id() const {
+        return "fanout";
+    }
+
+    // see chat_room::fanout_budget()
+    void fanout_budget(std::chrono::microseconds budget) {
+        asio::post(io_context_, [this, budget]() {
+            budget_ = budget;
+        });
+    }
+
+    // a room message, on the room's thread. The messages are numbered as
+    // they are posted, so that a session gets none of those posted before
+    // it joined: they are in its history
+    void deliver(const chat_message& msg) {
+        post(msg, chunk_credit_ptr(), false);
+    }
+
+    void deliver_notice(const chat_message& msg) {
+        post(msg, chunk_credit_ptr(), true);
+    }
+
+    void deliver_chunk(const chat_message& msg, const chunk_credit_ptr& credit) {
+        post(msg, credit, false);
+    }
+
+    // the rest is called on the session's thread, which is the worker's. A
+    // session is announced to the room, which sends its history back through
+    // the worker
+    void join(chat_participant_ptr session) {
+        chat_participant_ptr member(new fanout_member(shared_from_this(), session));
+        change(session, member, true);
+    }
+
+    void leave(chat_participant_ptr session) {
+        change(session, chat_participant_ptr(), false);
+    }
+
+    // a subscription of one of the sessions, which the room keeps for the
+    // session as it sees it
+    void subscription(chat_participant_ptr session, const chat_message& msg) {
+        std::shared_ptr<chat_message> frame(new chat_message(msg));
+        asio::post(room_context_, [this, session, frame]() {
+            auto member = proxied_.find(session.get());
+            if (member != proxied_.end())
+                room_.subscription(member->second, *frame);
+        });
+    }
+
+    // a message from one of the sessions, for the room
+    void send(const chat_message& msg, const chunk_credit_ptr& credit) {
+        std::shared_ptr<chat_message> frame(new chat_message(msg));
+        asio::post(room_context_, [this, frame, credit]() {
+            room_.deliver(*frame, credit);
+        });
+    }
+
+private:
+    // a room message waiting for its turn on the worker
+    struct broadcast {
+        broadcast(const chat_message& m, const chunk_credit_ptr& c,
+            bool n, std::uint64_t s) :
+            msg(m),
+            credit(c),
+            chunk(chunk_frame::is_chunk(m)),
+            notice(n),
+            sequence(s) {
+        }
+
+        chat_message msg;
+        chunk_credit_ptr credit;
+        bool chunk;
+        bool notice;
+        std::uint64_t sequence;
+    };
+
+    // a message for one session, waiting for the broadcasts up to after
+    struct routed {
+        routed(const chat_participant_ptr& s, const chat_message& m,
+            bool n, std::uint64_t a) :
+            session(s),
+            msg(m),
+            notice(n),
+            after(a) {
+        }
+
+        chat_participant_ptr session;
+        chat_message msg;
+        bool notice;
+        std::uint64_t after;
+    };
+
+    // sessions taken in one go, between looks at the clock
+    enum { slice_size = 64 };
+
+    // a session joining or leaving, on its way to the room's thread
+    struct membership {
+        membership(const chat_participant_ptr& s, const chat_participant_ptr& m,
+            bool j) :
+            session(s),
+            member(m),
+            joining(j) {
+        }
+
+        chat_participant_ptr session;
+        chat_participant_ptr member;
+        bool joining;
+    };
+
+    // a session of the worker as the room sees it, on the room's thread
+    class fanout_member : public chat_participant {
+    public:
+        fanout_member(std::shared_ptr<fanout_worker> worker,
+            chat_participant_ptr session) :
+            worker_(worker),
+            session_(session),
+            id_() {
+            std::memcpy(id_, session->id(), chat_message::id_length);
+        }
+
+        const char* id() const {
+            return id_;
+        }
+
+        // a direct message, or one on a topic, which goes through the worker
+        // like the room's messages so that it keeps its place among them
+        void deliver(const chat_message& msg) {
+            route(msg, false);
+        }
+
+        void deliver_notice(const chat_message& msg) {
+            route(msg, true);
+        }
+
+        void deliver_history(const std::deque<chat_message>& msgs) {
+            chat_participant_ptr session(session_);
+            asio::post(worker_->io_context_, [session, msgs]() {
+                session->deliver_history(msgs);
+            });
+        }
+
+        void deliver_history(const std::deque<history_log::extent>& extents) {
+            chat_participant_ptr session(session_);
+            asio::post(worker_->io_context_, [session, extents]() {
+                session->deliver_history(extents);
+            });
+        }
+
+    private:
+        void route(const chat_message& msg, bool notice) {
+            std::shared_ptr<chat_message> frame(new chat_message(msg));
+            std::shared_ptr<fanout_worker> worker(worker_);
+            chat_participant_ptr session(session_);
+            asio::post(worker_->io_context_, [worker, session, frame, notice]() {
+                worker->send_routed(session, *frame, notice);
+            });
+        }
+
+        std::shared_ptr<fanout_worker> worker_;
+        chat_participant_ptr session_;
+        char id_[chat_message::id_length + 1];
+    };
+
+    // the first change since the room's thread last took them posts the
+    // call that takes them all
+    void change(const chat_participant_ptr& session,
+        const chat_participant_ptr& member, bool joining) {
+        std::lock_guard<std::mutex> lock(changes_mutex_);
+        changes_.emplace_back(session, member, joining);
+        if (changes_.size() == 1)
+            asio::post(room_context_, std::bind(&fanout_worker::apply_changes, this));
+    }
+
+    // on the room's thread: the sessions are in the list, or out of it,
+    // before the room is told, so that a session that joined gets everything
+    // posted from its join on
+    void apply_changes() {
+        std::vector<membership> changes;
+        {
+            std::lock_guard<std::mutex> lock(changes_mutex_);
+            changes.swap(changes_);
+        }
+        for (auto& c : changes) {
+            if (c.joining) {
+                members_.insert(c.session, posted_);
+                proxied_[c.session.get()] = c.member;
+                continue;
+            }
+            auto member = proxied_.find(c.session.get());
+            if (member == proxied_.end())
+                continue;
+            members_.erase(c.session);
+            c.member = member->second;
+            proxied_.erase(member);
+        }
+        members_.commit();
+        for (auto& c : changes) {
+            if (c.joining)
+                room_.join_proxied(c.member);
+            else if (c.member)
+                room_.leave_proxied(c.member);
+        }
+    }
+
+    void post(const chat_message& msg, const chunk_credit_ptr& credit,
+        bool notice) {
+        std::shared_ptr<chat_message> frame(new chat_message(msg));
+        std::uint64_t sequence = ++posted_;
+        asio::post(io_context_, [this, frame, credit, notice, sequence]() {
+            broadcasts_.emplace_back(*frame, credit, notice, sequence);
+            queued_ = sequence;
+            if (!fanning_out_)
+                fan_out();
+        });
+    }
+
+    // the rest is on the worker's thread
+    //
+    // a message for one session waits for the broadcasts queued before it,
+    // as in chat_room::send_routed()
+    void send_routed(const chat_participant_ptr& session,
+        const chat_message& msg, bool notice) {
+        if (broadcasts_.empty())
+            deliver_routed(*session, msg, notice);
+        else
+            routed_.emplace_back(session, msg, notice, queued_);
+    }
+
+    void release_routed() {
+        while (!routed_.empty() && (broadcasts_.empty()
+            || broadcasts_.front().sequence > routed_.front().after)) {
+            routed& r = routed_.front();
+            deliver_routed(*r.session, r.msg, r.notice);
+            routed_.pop_front();
+        }
+    }
+
+    static void deliver_routed(chat_participant& session,
+        const chat_message& msg, bool notice) {
+        if (notice)
+            session.deliver_notice(msg);
+        else
+            session.deliver(msg);
+    }
+
+    // deliver the queued broadcasts, oldest first, a slice at a time until
+    // they are done or the budget is spent, and post the rest, as
+    // chat_room::fan_out() does. A broadcast is delivered from one snapshot
+    // of the sessions, kept from its first slice to its last, so that a
+    // session that joins or leaves in between doesn't shift the others; one
+    // that left is only reclaimed once the broadcast is done
+    void fan_out() {
+        fanning_out_ = true;
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        bool spent = false;
+        while (!broadcasts_.empty() && !spent) {
+            if (deliver_slice(broadcasts_.front())) {
+                broadcasts_.pop_front();
+                snapshot_.reset();
+                next_ = 0;
+            }
+            spent = budget_.count() > 0
+                && std::chrono::steady_clock::now() - start >= budget_;
+        }
+        release_routed();
+
+        fanning_out_ = !broadcasts_.empty();
+        if (fanning_out_)
+            asio::post(io_context_, std::bind(&fanout_worker::fan_out, this));
+    }
+
+    // deliver b to the next slice_size sessions; true once it has been to
+    // all of them
+    bool deliver_slice(const broadcast& b) {
+        if (!snapshot_)
+            snapshot_.reset(new participant_list<chat_participant>::snapshot(
+                members_, reader_));
+        auto member = snapshot_->begin() + next_;
+        std::size_t taken = 0;
+        for (; member != snapshot_->end() && taken < slice_size; ++member, ++taken) {
+            chat_participant* session = member->participant;
+            if (member->since >= b.sequence
+                || std::strncmp(b.msg.id(), session->id(), chat_message::id_length) == 0)
+                continue;
+            if (b.chunk)
+                session->deliver_chunk(b.msg, b.credit);
+            else if (b.notice)
+                session->deliver_notice(b.msg);
+            else
+                session->deliver(b.msg);
+        }
+        next_ += taken;
+        return member == snapshot_->end();
+    }
+
+    asio::io_context& room_context_;
+    chat_room& room_;
+    asio::io_context io_context_;
+    asio::executor_work_guard<asio::io_context::executor_type> work_;
+    std::thread thread_;
+    // the worker's sessions, with the last message posted before they
+    // joined, and the worker's slot for reading them
+    participant_list<chat_participant> members_;
+    std::size_t reader_;
+    // on the room's thread: the sessions as the room sees them
+    std::unordered_map<chat_participant*, chat_participant_ptr> proxied_;
+    std::uint64_t posted_;
+    // the sessions' joins and leaves, not yet taken by the room's thread
+    std::mutex changes_mutex_;
+    std::vector<membership> changes_;
+    // on the worker's thread: the broadcasts not yet delivered to every
+    // session, the last one queued, and where the oldest has got to
+    std::chrono::microseconds budget_;
+    std::deque<broadcast> broadcasts_;
+    std::uint64_t queued_;
+    std::unique_ptr<participant_list<chat_participant>::snapshot> snapshot_;
+    std::size_t next_;
+    // a call to fan_out() is running or posted
+    bool fanning_out_;
+    std::deque<routed> routed_;
+};
+
+typedef std::shared_ptr<fanout_worker> fanout_worker_ptr;
+
+// the protocol of chat_session<tls>: a TCP connection with TLS on top
+struct tls {
+    typedef asio::ssl::stream<tcp::socket> socket;
+};
+
+// the write priority of a frame queued for a session: the room's notices and
+// transfer credits, the participants' messages, and the chunks of transfers.
+// The class comes from whoever made the frame, never from what is in it, so
+// that a client can't make its own frames jump the queue
+enum message_class { control_class, chat_class, bulk_class, message_classes };
+
+// raise a maximum that several threads may be raising at once
+template <typename T>
+void raise_max(std::atomic<T>& max, T value) {
+    T seen = max.load(std::memory_order_relaxed);
+    while (value > seen && !max.compare_exchange_weak(seen, value,
+        std::memory_order_relaxed)) {
+    }
+}
+
+// how long the frames of each class waited in the sessions' lanes before
+// their write started, over all sessions and the threads they run on.
+// Delays are counted in power of two buckets of microseconds, which is what
+// the p99 is read from
+class lane_metrics {
+public:
+    enum { buckets = 32 };
+
+    static void record(message_class c, std::chrono::steady_clock::duration delay) {
+        long long us = std::chrono::duration_cast<std::chrono::microseconds>(
+            delay).count();
+        counters& k = get(c);
+        // bucket b holds delays below 2^b us
+        std::size_t bucket = us <= 0 ? 0 : 64 - __builtin_clzll(us);
+        ++k.histogram[std::min<std::size_t>(bucket, buckets - 1)];
+        ++k.frames;
+        k.total_us += us;
+        raise_max(k.max_us, us);
+    }
+
+    static void report(std::ostream& out) {
+        static const char* names[message_classes] = { "control", "chat", "bulk" };
+        for (std::size_t c = 0; c < message_classes; ++c) {
+            counters& k = get(static_cast<message_class>(c));
+            // the upper bound of the bucket holding the 99th percentile
+            long long p99 = 0;
+            unsigned long long seen = 0;
+            for (std::size_t bucket = 0; bucket < buckets && k.frames > 0; ++bucket) {
+                seen += k.histogram[bucket];
+                if (seen * 100 >= k.frames * 99) {
+                    p99 = 1LL << bucket;
+                    break;
+                }
+            }
+            out << "write delay " << names[c] << ": " << k.frames << " frames, "
+                << "mean " << (k.frames ? k.total_us / k.frames : 0) << " us, "
+                << "p99 < " << p99 << " us, "
+                << "max " << k.max_us << " us" << std::endl;
+        }
+    }
+
+private:
+    struct counters {
+        std::atomic<unsigned long long> frames;
+        std::atomic<unsigned long long> total_us;
+        std::atomic<long long> max_us;
+        std::atomic<unsigned long long> histogram[buckets];
+    };
+
+    static counters& get(message_class c) {
+        static counters all[message_classes];
+        return all[c];
+    }
+};
+
+// the frames queued in all the sessions' lanes, which is how far fan-out is
+// behind, and their bytes. Over the limit, fan-out counts as overloaded
+// until the backlog is down to half of it, so that paused sessions don't
+// all start and stop reading at every frame written
+class overload_governor {
+public:
+    static void queued(std::ptrdiff_t frames, std::ptrdiff_t bytes) {
+        get().backlog += frames;
+        get().bytes += bytes;
+    }
+
+    static std::size_t queued_bytes() {
+        return get().bytes;
+    }
+
+    static bool overloaded(std::size_t limit) {
+        state& s = get();
+        if (limit == 0)
+            return false;
+        std::ptrdiff_t backlog = s.backlog;
+        bool overloaded = s.overloaded;
+        if (!overloaded && backlog > static_cast<std::ptrdiff_t>(limit)) {
+            if (!s.overloaded.exchange(true))
+                ++s.engaged;
+            return true;
+        } else if (overloaded && backlog <= static_cast<std::ptrdiff_t>(limit / 2)) {
+            s.overloaded = false;
+            return false;
+        }
+        return overloaded;
+    }
+
+    // how many times fan-out has become overloaded
+    static unsigned long long engaged() {
+        return get().engaged;
+    }
+
+private:
+    // updated by the sessions on every thread
+    struct state {
+        std::atomic<std::ptrdiff_t> backlog;
+        std::atomic<std::ptrdiff_t> bytes;
+        std::atomic<bool> overloaded;
+        std::atomic<unsigned long long> engaged;
+    };
+
+    static state& get() {
+        static state s;
+        return s;
+    }
+};
+
+// what the flood_policy did with the messages the clients sent. A message
+// that waits is counted once for every pause, which can be for the
+// session's rate first and then for the room's, or for overload
+enum throttle_event { admitted, dropped, paused_session, paused_room,
+    paused_overload, disconnected, disconnected_slow, throttle_events };
+
+class throttle_metrics {
+public:
+    static void record(throttle_event e) {
+        ++get().events[e];
+    }
+
+    static void paused(std::chrono::steady_clock::duration pause) {
+        get().paused_us += std::chrono::duration_cast<std::chrono::microseconds>(
+            pause).count();
+    }
+
+    static void report(std::ostream& out) {
+        static const char* names[throttle_events] = { "admitted", "dropped",
+            "paused for the session's rate", "paused for the room's rate",
+            "paused for overload", "disconnected",
+            "disconnected for not reading" };
+        counters& k = get();
+        out << "throttle:";
+        for (std::size_t e = 0; e < throttle_events; ++e)
+            out << (e == 0 ? " " : ", ") << k.events[e] << " " << names[e];
+        out << ", reads paused " << k.paused_us / 1000 << " ms, "
+            << "overloaded " << overload_governor::engaged() << " times"
+            << std::endl;
+    }
+
+private:
+    struct counters {
+        std::atomic<unsigned long long> events[throttle_events];
+        std::atomic<unsigned long long> paused_us;
+    };
+
+    static counters& get() {
+        static counters all;
+        return all;
+    }
+};
+
+// a session's queued frames, in a lane per message_class. The writer takes
+// from the lanes by weight (smooth weighted round robin: every lane with
+// frames gains its weight, the one furthest ahead goes and pays back the
+// weights of all), so under a backlog of chat frames a control frame waits
+// for about one write, and chunks still get a share
+class write_lanes {
+public:
+    struct frame {
+        frame(const chat_message& m, const chunk_credit_ptr& c) :
+            msg(m),
+            credit(c),
+            queued(std::chrono::steady_clock::now()) {
+        }
+
+        chat_message msg;
+        chunk_credit_ptr credit;
+        std::chrono::steady_clock::time_point queued;
+    };
+
+    write_lanes() :
+        lane_(message_classes),
+        frames_(0),
+        max_frames_(0) {
+        for (std::size_t c = 0; c < message_classes; ++c)
+            current_[c] = 0;
+    }
+
+    // at most frames may be queued; 0 is no limit
+    void limit(std::size_t frames) {
+        max_frames_ = frames;
+    }
+
+    ~write_lanes() {
+        for (std::size_t c = 0; c < message_classes; ++c)
+            for (auto& f : lanes_[c])
+                overload_governor::queued(-1,
+                    -static_cast<std::ptrdiff_t>(f.msg.length()));
+    }
+
+    bool empty() const {
+        for (std::size_t c = 0; c < message_classes; ++c)
+            if (!lanes_[c].empty())
+                return false;
+        return true;
+    }
+
+    // false, with nothing queued, if the lanes are full
+    bool push(message_class c, const chat_message& msg,
+        const chunk_credit_ptr& credit = chunk_credit_ptr()) {
+        if (max_frames_ != 0 && frames_ >= max_frames_)
+            return false;
+        lanes_[c].emplace_back(msg, credit);
+        ++frames_;
+        overload_governor::queued(1, msg.length());
+        return true;
+    }
+
+    // choose the frame to write next, which stays queued until pop()
+    chat_message& next() {
+        static const int weight[message_classes] = { 8, 4, 1 };
+        int total = 0;
+        lane_ = message_classes;
+        for (std::size_t c = 0; c < message_classes; ++c) {
+            if (lanes_[c].empty()) {
+                current_[c] = 0;
+                continue;
+            }
+            current_[c] += weight[c];
+            total += weight[c];
+            if (lane_ == message_classes || current_[c] > current_[lane_])
+                lane_ = c;
+        }
+        current_[lane_] -= total;
+
+        frame& f = lanes_[lane_].front();
+        lane_metrics::record(static_cast<message_class>(lane_),
+            std::chrono::steady_clock::now() - f.queued);
+        return f.msg;
+    }
+
+    // the frame from next() has been written
+    void pop() {
+        overload_governor::queued(-1,
+            -static_cast<std::ptrdiff_t>(lanes_[lane_].front().msg.length()));
+        lanes_[lane_].pop_front();
+        --frames_;
+    }
+
+private:
+    std::deque<frame> lanes_[message_classes];
+    int current_[message_classes];
+    std::size_t lane_;
+    std::size_t frames_;
+    std::size_t max_frames_;
+};
+
+// keep little unsent data in a TCP socket's send buffer (TCP_NOTSENT_LOWAT):
+// a backlog then waits in the session's lanes, where control frames can
+// overtake it, rather than in the kernel, where nothing can
+enum { unsent_limit = 32 * 1024 };
+
+template <typename Socket>
+void limit_unsent(Socket&) {
+}
+
+inline void limit_unsent(tcp::socket& socket) {
+    #if defined(TCP_NOTSENT_LOWAT)
+    typedef asio::detail::socket_option::integer<IPPROTO_TCP, TCP_NOTSENT_LOWAT>
+        notsent_lowat;
+    std::error_code ignored;
+    socket.set_option(notsent_lowat(unsent_limit), ignored);
+    #endif
+}
+
+// splice() and sendfile() write to the socket behind the session's back,
+// which a TLS stream only allows once the kernel does the encryption
+template <typename Socket>
+bool kernel_writes(Socket&) {
+    return true;
+}
+
+inline bool kernel_writes(tls::socket& socket) {
+    return ktls::sending(socket.native_handle());
+}
+
+template <typename Socket, typename Buffers, typename Handler>
+auto async_send(Socket& socket, const Buffers& buffers, Handler handler)
+    -> decltype(asio::async_write(socket, buffers, handler)) {
+    return asio::async_write(socket, buffers, handler);
+}
+
+// with kernel TLS the frames go to the socket as they are
+template <typename Buffers, typename Handler>
+auto async_send(tls::socket& socket, const Buffers& buffers, Handler handler)
+    -> decltype(asio::async_write(socket, buffers, handler)) {
+    if (ktls::sending(socket.native_handle()))
+        return asio::async_write(socket.next_layer(), buffers, handler);
+    return asio::async_write(socket, buffers, handler);
+}
+
+// a participant connected over a stream socket of the given protocol, TCP
+// for remote clients or a unix domain socket for co-located ones, or over
+// TLS
+template <typename Protocol>
+class chat_session : 
+    public chat_participant,
+    public std::enable_shared_from_this<chat_session<Protocol> > {
+
+public: 
+    typedef typename Protocol::socket socket_type;
+
+    // a session for a client that has been accepted. It runs on the
+    // socket's io_context
+    chat_session(socket_type&& socket, chat_room& room) :
+        socket_(std::move(socket)),
+        room_(room),
+        writing_buf_(false),
+        id_(),
+        stopped_(false),
+        bucket_(room.floods().rate, room.floods().burst),
+        pause_timer_(socket_.get_executor()),
+        retry_ms_(0),
+        worker_(nullptr) {
+        write_lanes_.limit(room.floods().session_backlog());
+    }
+
+    // a TLS session needs the server's ssl::context
+    chat_session(asio::io_context& io_context, asio::ssl::context& context,
+        chat_room& room) :
+        socket_(io_context, context),
+        room_(room),
+        writing_buf_(false),
+        id_(),
+        stopped_(false),
+        bucket_(room.floods().rate, room.floods().burst),
+        pause_timer_(io_context),
+        retry_ms_(0),
+        worker_(nullptr) {
+        write_lanes_.limit(room.floods().session_backlog());
+    }
+
+    socket_type& socket() {
+        return socket_;
+    }
+
+    // the server can't take the client now: instead of joining the room,
+    // the session tells it to come back in retry_ms (see retry_frame.hpp)
+    void refuse(std::uint32_t retry_ms) {
+        retry_ms_ = retry_ms;
+    }
+
+    // the session was made on the worker's io_context, and is in the room
+    // through the worker
+    void run_on(fanout_worker& worker) {
+        worker_ = &worker;
+    }
+
+#if defined(CHAT_COROUTINE_SESSIONS)
+    // the session runs as two coroutines: one reads the client's frames, the
+    // other writes whatever is queued and parks otherwise. Their frames, and
+    // those of the operations they await, come from the thread's recycling
+    // allocator, like handlers do
+    void wait_for_id() {
+        #ifdef DEBUG
+        std::cout << __FUNCTION__ << std::endl;
+        #endif
+
+        std::shared_ptr<chat_session> self = this->shared_from_this();
+        asio::co_spawn(executor(),
+            [self]() { return self->read_loop(self); },
+            asio::detached);
+    }
+
+    // sessions are always made on an io_context
+    session_executor executor() {
+        return *socket_.get_executor().template target<session_executor>();
+    }
+
+    // once the reader is done, so is the session: it leaves the room and
+    // stops the writer
+    session_awaitable<void> read_loop(std::shared_ptr<chat_session> self) {
+        if (retry_ms_ != 0) {
+            co_await send_refusal(self);
+            co_return;
+        }
+
+        bool joined = false;
+        try {
+            co_await asio::async_read(socket_,
+                asio::buffer(id_, chat_message::id_length),
+                use_session_awaitable);
+
+            enter_room();
+            joined = true;
+            asio::co_spawn(executor(),
+                [self]() { return self->write_loop(self); },
+                asio::detached);
+
+            for (;;) {
+                co_await asio::async_read(socket_,
+                    asio::buffer(read_msg_.data(), chat_message::header_length),
+                    use_session_awaitable);
+                if (!read_msg_.decode_header())
+                    break;
+                co_await asio::async_read(socket_,
+                    asio::buffer(read_msg_.body(), read_msg_.body_length()),
+                    use_session_awaitable);
+
+                if (!accepted_from_client(read_msg_))
+                    continue;
+                if (chunk_frame::is_chunk(read_msg_)) {
+                    if (!receive_chunk())
+                        break;
+                    continue;
+                }
+
+                std::chrono::steady_clock::duration pause;
+                admission admitted;
+                while ((admitted = admit(pause)) == delay_message) {
+                    pause_timer_.expires_after(pause);
+                    co_await pause_timer_.async_wait(use_session_awaitable);
+                }
+                if (admitted == disconnect_session)
+                    break;
+                if (admitted == drop_message)
+                    continue;
+
+                log_message(id_, read_msg_);
+
+                send_to_room(read_msg_);
+            }
+        } catch (std::exception&) {
+        }
+
+        stopped_ = true;
+        if (joined)
+            exit_room();
+        std::error_code ignored;
+        socket_.lowest_layer().close(ignored);
+        write_next();
+    }
+
+    // write the retry_frame, stop sending and read whatever the client sent
+    // until it hangs up, or for refusal_linger_ms: closing with its id
+    // unread would reset the connection, and the frame might be lost
+    session_awaitable<void> send_refusal(std::shared_ptr<chat_session> self) {
+        try {
+            retry_frame::encode(read_msg_, retry_ms_);
+            co_await asio::async_write(socket_,
+                asio::buffer(read_msg_.data(), read_msg_.length()),
+                use_session_awaitable);
+            socket_.lowest_layer().shutdown(asio::socket_base::shutdown_send);
+            pause_timer_.expires_after(std::chrono::milliseconds(refusal_linger_ms));
+            pause_timer_.async_wait([self](const std::error_code&) {
+                std::error_code ignored;
+                self->socket_.lowest_layer().close(ignored);
+            });
+            for (;;)
+                co_await socket_.async_read_some(
+                    asio::buffer(read_msg_.data(), chat_message::header_length),
+                    use_session_awaitable);
+        } catch (std::exception&) {
+        }
+
+        pause_timer_.cancel();
+        std::error_code ignored;
+        socket_.lowest_layer().close(ignored);
+    }
+
+    // write_buf_ goes first, then the history in the log, then the lanes,
+    // as in the callback version. A failed write closes the socket, which
+    // ends the reader
+    session_awaitable<void> write_loop(std::shared_ptr<chat_session> self) {
+        try {
+            while (!stopped_) {
+                if (!write_buf_.empty()) {
+                    // zero-copy sends transmit from write_buf_ directly, so
+                    // it stays untouched until the write completes
+                    writing_buf_ = true;
+                    co_await async_send(socket_, asio::buffer(write_buf_),
+                        use_session_awaitable);
+                    write_buf_.clear();
+                    writing_buf_ = false;
+                } else if (!log_extents_.empty()) {
+                    co_await send_history();
+                } else if (!write_lanes_.empty()) {
+                    chat_message& write_msg = write_lanes_.next();
+                    co_await async_send(socket_,
+                        asio::buffer(write_msg.data(), write_msg.length()),
+                        use_session_awaitable);
+                    write_lanes_.pop();
+                } else {
+                    co_await asio::async_initiate<
+                        const asio::use_awaitable_t<session_executor>&, void()>(
+                        [this](wake_handler handler) {
+                            parked_.emplace(std::move(handler));
+                        }, use_session_awaitable);
+                }
+            }
+        } catch (std::exception&) {
+            log_extents_.clear();
+            std::error_code ignored;
+            socket_.lowest_layer().close(ignored);
+        }
+    }
+#else
+    void wait_for_id() {
+        #ifdef DEBUG
+        std::cout << __FUNCTION__ << std::endl;
+        #endif
+
+        if (retry_ms_ != 0) {
+            send_refusal();
+            return;
+        }
+
+        asio::async_read(socket_,
+            asio::buffer(id_, chat_message::id_length),
+            std::bind(&chat_session::start, 
+                this->shared_from_this(),  
+                //boost::asio::placeholders::error));
+                std::placeholders::_1));
+    }
+    
+    // write the retry_frame, stop sending and read whatever the client sent
+    // until it hangs up, or for refusal_linger_ms: closing with its id
+    // unread would reset the connection, and the frame might be lost
+    void send_refusal() {
+        #ifdef DEBUG
+        std::cout << __FUNCTION__ << std::endl;
+        #endif
+
+        retry_frame::encode(read_msg_, retry_ms_);
+        asio::async_write(socket_,
+            asio::buffer(read_msg_.data(), read_msg_.length()),
+            std::bind(&chat_session::handle_refusal,
+                this->shared_from_this(),
+                std::placeholders::_1));
+    }
+
+    void handle_refusal(const std::error_code& error) {
+        #ifdef DEBUG
+        std::cout << __FUNCTION__ << std::endl;
+        #endif
+
+        std::error_code ignored;
+        if (error) {
+            socket_.lowest_layer().close(ignored);
+            return;
+        }
+        socket_.lowest_layer().shutdown(asio::socket_base::shutdown_send, ignored);
+        std::shared_ptr<chat_session> self = this->shared_from_this();
+        pause_timer_.expires_after(std::chrono::milliseconds(refusal_linger_ms));
+        pause_timer_.async_wait([self](const std::error_code&) {
+            std::error_code ignored;
+            self->socket_.lowest_layer().close(ignored);
+        });
+        linger(std::error_code(), 0);
+    }
+
+    void linger(const std::error_code& error, std::size_t) {
+        if (error) {
+            pause_timer_.cancel();
+            std::error_code ignored;
+            socket_.lowest_layer().close(ignored);
+            return;
+        }
+        socket_.async_read_some(
+            asio::buffer(read_msg_.data(), chat_message::header_length),
+            std::bind(&chat_session::linger,
+                this->shared_from_this(),
+                std::placeholders::_1,
+                std::placeholders::_2));
+    }
+
+    void start(const std::error_code& error) {
+        #ifdef DEBUG
+        std::cout << __FUNCTION__ << std::endl;
+        #endif
+
+
+        enter_room();
+        // read the header from read_msg_ first
+        // invoke handle_read_header and trigger the body reading event
+        asio::async_read(socket_,
+            asio::buffer(read_msg_.data(), chat_message::header_length),
+            std::bind(&chat_session::handle_read_header, 
+                this->shared_from_this(),  
+                //boost::asio::placeholders::error));
+                std::placeholders::_1));
+    }
+
+    void handle_read_header(const std::error_code& error) {
+        #ifdef DEBUG
+        std::cout << __FUNCTION__ << std::endl;
+        #endif
+
+        if (!error && read_msg_.decode_header()) {
+            //std::cout << id_ << " sends message with length:" << read_msg_.body_length() << std::endl;
+            asio::async_read(socket_, 
+                asio::buffer(read_msg_.body(), read_msg_.body_length()), 
+                bind(&chat_session::handle_read_body,
+                    this->shared_from_this(),
+                    //boost::asio::placeholders::error));
+                    std::placeholders::_1));
+        } else {
+            leave();
+        }
+    }
+
+    void handle_read_body(const std::error_code& error) {
+        #ifdef DEBUG
+        std::cout << __FUNCTION__ << std::endl;
+        #endif
+
+        bool chunk = !error && chunk_frame::is_chunk(read_msg_);
+        if (!error && !chunk) {
+            pass_on(error);
+        } else if (!error && receive_chunk()) {
+            // wait for the next message
+            asio::async_read(socket_,
+                asio::buffer(read_msg_.data(), chat_message::header_length),
+                std::bind(&chat_session::handle_read_header, 
+                    this->shared_from_this(),  
+                    //boost::asio::placeholders::error));
+                    std::placeholders::_1));
+        } else {
+            leave();
+        }
+    }
+
+    // hand read_msg_ to the room once the flood_policy lets it, then read
+    // the next message. Reads stay paused while the message waits
+    void pass_on(const std::error_code& error) {
+        #ifdef DEBUG
+        std::cout << __FUNCTION__ << std::endl;
+        #endif
+
+        std::chrono::steady_clock::duration pause;
+        admission admitted = error ? disconnect_session
+            : !accepted_from_client(read_msg_) ? drop_message
+            : admit(pause);
+        switch (admitted) {
+        case delay_message:
+            pause_timer_.expires_after(pause);
+            pause_timer_.async_wait(std::bind(&chat_session::pass_on,
+                this->shared_from_this(),
+                std::placeholders::_1));
+            return;
+        case disconnect_session: {
+            std::error_code ignored;
+            socket_.lowest_layer().close(ignored);
+            leave();
+            return;
+        }
+        case admit_message:
+            log_message(id_, read_msg_);
+
+            send_to_room(read_msg_);
+            break;
+        case drop_message:
+            break;
+        }
+
+        // wait for the next message
+        asio::async_read(socket_,
+            asio::buffer(read_msg_.data(), chat_message::header_length),
+            std::bind(&chat_session::handle_read_header, 
+                this->shared_from_this(),  
+                std::placeholders::_1));
+    }
+#endif
+
+    void deliver(const chat_message& msg) {
+        #ifdef DEBUG
+        std::cout << __FUNCTION__ << std::endl;
+        #endif
+
+        bool write_in_progress = writing();
+        if (!write_lanes_.push(chat_class, msg))
+            hang_up_slow();
+        else if (!write_in_progress)
+            write_next();
+    }
+
+    void deliver_notice(const chat_message& msg) {
+        #ifdef DEBUG
+        std::cout << __FUNCTION__ << std::endl;
+        #endif
+
+        bool write_in_progress = writing();
+        if (!write_lanes_.push(control_class, msg))
+            hang_up_slow();
+        else if (!write_in_progress)
+            write_next();
+    }
+
+    // chunks wait in the bulk lane, so a message waits for one chunk at most
+    void deliver_chunk(const chat_message& msg, const chunk_credit_ptr& credit) {
+        #ifdef DEBUG
+        std::cout << __FUNCTION__ << std::endl;
+        #endif
+
+        bool write_in_progress = writing();
+        if (!write_lanes_.push(bulk_class, msg, credit))
+            hang_up_slow();
+        else if (!write_in_progress)
+            write_next();
+    }
+
+    void deliver(const chat_message& msg, frame_pipe& frame) {
+        #ifdef DEBUG
+        std::cout << __FUNCTION__ << std::endl;
+        #endif
+
+        // only an idle socket can take the frame directly, anything else
+        // would overtake the queued messages
+        bool write_in_progress = writing();
+        if (write_in_progress || !make_non_blocking()
+            || !frame.send_to(socket_.lowest_layer().native_handle(), write_buf_)) {
+            deliver(msg);
+            return;
+        }
+
+        // the socket was full, write the rest of the frame when it drains
+        if (!write_buf_.empty())
+            write_next();
+    }
+
+    // pack the recent messages into one buffer so that they go out in a
+    // single write, which is large enough to be sent with zero-copy
+    void deliver_history(const std::deque<chat_message>& msgs) {
+        #ifdef DEBUG
+        std::cout << __FUNCTION__ << std::endl;
+        #endif
+
+        // a buffer that is being written can't grow, and anything queued
+        // already must stay in front of the history
+        bool write_in_progress = writing();
+        if (write_in_progress) {
+            chat_participant::deliver_history(msgs);
+            return;
+        }
+
+        for (auto msg : msgs)
+            write_buf_.insert(write_buf_.end(), msg.data(), msg.data() + msg.length());
+        if (!write_buf_.empty())
+            write_next();
+    }
+
+    // stream the history straight from the log files with sendfile()
+    void deliver_history(const std::deque<history_log::extent>& extents) {
+        #ifdef DEBUG
+        std::cout << __FUNCTION__ << std::endl;
+        #endif
+
+        bool write_in_progress = writing();
+        if (write_in_progress || !make_non_blocking()) {
+            chat_participant::deliver_history(extents);
+            return;
+        }
+
+        log_extents_ = extents;
+        if (!log_extents_.empty())
+            write_next();
+    }
+
+#if defined(CHAT_COROUTINE_SESSIONS)
+    // resume the writer, which is parked whenever this is called. Like the
+    // callback version it starts writing right away, from within the call:
+    // the session's handlers all run on the io_context's thread, so the
+    // handler is called directly rather than dispatched through the
+    // polymorphic executor, which would allocate for every wake
+    void write_next() {
+        #ifdef DEBUG
+        std::cout << __FUNCTION__ << std::endl;
+        #endif
+
+        if (!parked_)
+            return;
+        wake_handler handler(std::move(*parked_));
+        parked_.reset();
+        handler();
+    }
+
+    // send as much of the log extents as the socket takes, waiting for it
+    // to become writable again in between
+    session_awaitable<void> send_history() {
+        while (!log_extents_.empty()) {
+            history_log::extent& extent = log_extents_.front();
+            off_t offset = extent.offset;
+            ssize_t n = sendfile(socket_.lowest_layer().native_handle(), extent.file->fd,
+                &offset, extent.length);
+            if (n > 0) {
+                extent.offset += n;
+                extent.length -= n;
+                if (extent.length == 0)
+                    log_extents_.pop_front();
+            } else if (n < 0 && errno == EAGAIN) {
+                co_await socket_.lowest_layer().async_wait(
+                    asio::socket_base::wait_write, use_session_awaitable);
+            } else if (n < 0 && errno == EINTR) {
+                continue;
+            } else {
+                throw std::system_error(n < 0 ? errno : EPIPE,
+                    std::system_category());
+            }
+        }
+    }
+#else
+    void write_next() {
+        #ifdef DEBUG
+        std::cout << __FUNCTION__ << std::endl;
+        #endif
+
+        // write_buf_ goes first, and must stay untouched until the write
+        // completes since zero-copy sends transmit from it directly
+        writing_buf_ = !write_buf_.empty();
+        if (writing_buf_) {
+            async_send(socket_,
+                asio::buffer(write_buf_),
+                std::bind(&chat_session::handle_write,
+                    this->shared_from_this(),
+                    std::placeholders::_1));
+        } else if (!log_extents_.empty()) {
+            send_history();
+        } else {
+            chat_message& write_msg = write_lanes_.next();
+            async_send(socket_, 
+                asio::buffer(write_msg.data(), write_msg.length()), 
+                std::bind(&chat_session::handle_write,
+                    this->shared_from_this(),
+                    //boost::asio::placeholders::error));
+                    std::placeholders::_1));
+        }
+    }
+
+    void handle_write(const std::error_code& error) {
+        #ifdef DEBUG
+        std::cout << __FUNCTION__ << std::endl;
+        #endif
+
+        if (!error) {
+            if (writing_buf_) {
+                write_buf_.clear();
+                writing_buf_ = false;
+            } else {
+                write_lanes_.pop();
+            }
+
+            //iteratively call itself, until no message in the queue
+            if (!write_buf_.empty() || !write_lanes_.empty())
+                write_next();
+        } else {
+            leave();
+        }
+    }
+
+    // send as much of the log extents as the socket takes, then wait for it
+    // to become writable again
+    void send_history() {
+        #ifdef DEBUG
+        std::cout << __FUNCTION__ << std::endl;
+        #endif
+
+        while (!log_extents_.empty()) {
+            history_log::extent& extent = log_extents_.front();
+            off_t offset = extent.offset;
+            ssize_t n = sendfile(socket_.lowest_layer().native_handle(), extent.file->fd,
+                &offset, extent.length);
+            if (n > 0) {
+                extent.offset += n;
+                extent.length -= n;
+                if (extent.length == 0)
+                    log_extents_.pop_front();
+            } else if (n < 0 && errno == EAGAIN) {
+                socket_.lowest_layer().async_wait(asio::socket_base::wait_write,
+                    std::bind(&chat_session::handle_history_wait,
+                        this->shared_from_this(),
+                        std::placeholders::_1));
+                return;
+            } else if (n < 0 && errno == EINTR) {
+                continue;
+            } else {
+                log_extents_.clear();
+                leave();
+                return;
+            }
+        }
+
+        if (!write_lanes_.empty())
+            write_next();
+    }
+
+    void handle_history_wait(const std::error_code& error) {
+        #ifdef DEBUG
+        std::cout << __FUNCTION__ << std::endl;
+        #endif
+
+        if (!error) {
+            send_history();
+        } else {
+            log_extents_.clear();
+            leave();
+        }
+    }
+
+    // a session leaves once, whether its read or its write fails first
+    void leave() {
+        if (stopped_)
+            return;
+        stopped_ = true;
+        exit_room();
+    }
+#endif
+
+    const char* id() const{
+        return id_;
+    }
+
+private:
+    bool writing() const {
+        return writing_buf_ || !log_extents_.empty() || !write_lanes_.empty();
+    }
+
+    // the client isn't reading, and its lanes are full: closing the socket
+    // fails the write and the read, the session leaves, and what it had
+    // queued goes with it
+    void hang_up_slow() {
+        if (!socket_.lowest_layer().is_open())
+            return;
+        std::cout << id_ << " is not reading, disconnected" << std::endl;
+        throttle_metrics::record(disconnected_slow);
+        std::error_code ignored;
+        socket_.lowest_layer().close(ignored);
+    }
+
+    void enter_room() {
+        if (worker_)
+            worker_->join(this->shared_from_this());
+        else
+            room_.join(this->shared_from_this());
+    }
+
+    void exit_room() {
+        if (worker_)
+            worker_->leave(this->shared_from_this());
+        else
+            room_.leave(this->shared_from_this());
+    }
+
+    void send_to_room(const chat_message& msg,
+        const chunk_credit_ptr& credit = chunk_credit_ptr()) {
+        if (topic_frame::is_subscription(msg) && worker_)
+            worker_->subscription(this->shared_from_this(), msg);
+        else if (topic_frame::is_subscription(msg))
+            room_.subscription(this->shared_from_this(), msg);
+        else if (worker_)
+            worker_->send(msg, credit);
+        else
+            room_.deliver(msg, credit);
+    }
+
+    // what becomes of read_msg_ under the room's flood_policy
+    enum admission { admit_message, drop_message, delay_message,
+        disconnect_session };
+    enum { overload_pause_ms = 5 };
+    enum { refusal_linger_ms = 1000 };
+
+    // the message takes a token from the session's bucket and one from the
+    // room's, once both have one. Only the session's own rate can get the
+    // message dropped or the session disconnected; with delay_message, ask
+    // again after pause
+    admission admit(std::chrono::steady_clock::duration& pause) {
+        const flood_policy& policy = room_.floods();
+        if (overload_governor::overloaded(policy.max_backlog)) {
+            pause = std::chrono::milliseconds(overload_pause_ms);
+            throttle_metrics::record(paused_overload);
+            throttle_metrics::paused(pause);
+            return delay_message;
+        }
+
+        token_bucket::clock::time_point now = token_bucket::clock::now();
+        pause = bucket_.wait(now);
+        if (pause != token_bucket::clock::duration::zero()) {
+            switch (policy.excess) {
+            case flood_policy::drop_excess:
+                throttle_metrics::record(dropped);
+                return drop_message;
+            case flood_policy::disconnect_excess:
+                std::cout << id_ << " is flooding, disconnected" << std::endl;
+                throttle_metrics::record(disconnected);
+                return disconnect_session;
+            case flood_policy::delay_excess:
+                throttle_metrics::record(paused_session);
+                throttle_metrics::paused(pause);
+                return delay_message;
+            }
+        }
+
+        pause = room_.take_token(now);
+        if (pause != token_bucket::clock::duration::zero()) {
+            throttle_metrics::record(paused_room);
+            throttle_metrics::paused(pause);
+            return delay_message;
+        }
+
+        bucket_.take(now);
+        throttle_metrics::record(admitted);
+        return admit_message;
+    }
+
+    // pass a chunk of the client's transfer on to the room, as long as the
+    // client stays within its windows, and hang up otherwise. The credit
+    // goes back to the client when every session has written the chunk,
+    // which may be on another thread than the session's
+    bool receive_chunk() {
+        chunk_frame chunk;
+        if (!chunk.decode(read_msg_))
+            return false;
+        if (!transfers_.spend(chunk)) {
+            std::cout << id_ << " sends past its transfer window, disconnected"
+                << std::endl;
+            return false;
+        }
+        if (chunk.offset() == 0)
+            std::cout << id_ << " sends " << chunk.total() << " bytes" << std::endl;
+
+        std::weak_ptr<chat_session> weak(this->shared_from_this());
+        std::uint32_t transfer = chunk.transfer();
+        std::size_t length = chunk.length();
+        send_to_room(read_msg_, std::make_shared<chunk_credit>(
+            [weak, transfer, length]() {
+                if (auto self = weak.lock())
+                    asio::post(self->socket_.get_executor(), [self, transfer, length]() {
+                        self->credit(transfer, length);
+                    });
+            }));
+        return true;
+    }
+
+    void credit(std::uint32_t transfer, std::size_t length) {
+        if (stopped_ || !transfers_.give_back(transfer, length))
+            return;
+
+        chat_message msg;
+        chunk_frame::encode_credit(msg, id_, transfer, length);
+        deliver_notice(msg);
+    }
+
+    // splice() and sendfile() need the socket itself to be non-blocking,
+    // and can't be used under TLS unless the kernel encrypts
+    bool make_non_blocking() {
+        if (!kernel_writes(socket_))
+            return false;
+        if (socket_.lowest_layer().non_blocking())
+            return true;
+        std::error_code error;
+        socket_.lowest_layer().non_blocking(true, error);
+        return !error;
+    }
+
+    socket_type socket_;
+    chat_room& room_;
+    chat_message read_msg_;
+    write_lanes write_lanes_;
+    // encoded frames that go out before the lanes: the history replay and
+    // the tails of spliced frames that the socket couldn't take at once
+    std::vector<char> write_buf_;
+    bool writing_buf_;
+    // history still to be sent from the log, before the lanes
+    std::deque<history_log::extent> log_extents_;
+    // the credit the client's transfers have spent
+    transfer_windows transfers_;
+    char id_[chat_message::id_length + 1];
+    bool stopped_;
+    // the session's share of the room's flood_policy
+    token_bucket bucket_;
+    // holds up the next read while a message waits to be admitted, or
+    // ends the wait for a refused client to hang up
+    asio::steady_timer pause_timer_;
+    // not 0 if the client is refused
+    std::uint32_t retry_ms_;
+    // the fan-out worker the session runs on, if any
+    fanout_worker* worker_;
+#if defined(CHAT_COROUTINE_SESSIONS)
+    // the continuation of the writer while it has nothing to write
+    typedef asio::async_result<asio::use_awaitable_t<session_executor>,
+        void()>::handler_type wake_handler;
+    std::optional<wake_handler> parked_;
+#endif
+};
+
+template <typename Protocol>
+using chat_session_ptr = std::shared_ptr<chat_session<Protocol> >;
+
+// ------------------------------------------------------
+
+// a participant on the same host that talks to the room over a shm_channel.
+// It connects to the shm socket and sends its id like any client, gets the
+// channel's descriptors back, and from then on only closes the connection
+// when it leaves
+class shm_session :
+    public chat_participant,
+    public std::enable_shared_from_this<shm_session> {
+
+public:
+    shm_session(asio::io_context& io_context, chat_room& room) :
+        socket_(io_context),
+        event_(io_context),
+        room_(room),
+        polls_(0),
+        closed_(false),
+        id_() {
+    }
+
+    asio::local::stream_protocol::socket& socket() {
+        return socket_;
+    }
+
+    void start() {
+        #ifdef DEBUG
+        std::cout << __FUNCTION__ << std::endl;
+        #endif
+
+        asio::async_read(socket_,
+            asio::buffer(id_, chat_message::id_length),
+            std::bind(&shm_session::handle_id,
+                shared_from_this(),
+                std::placeholders::_1));
+    }
+
+    void handle_id(const std::error_code& error) {
+        #ifdef DEBUG
+        std::cout << __FUNCTION__ << std::endl;
+        #endif
+
+        if (error || !channel_.create()
+            || !send_fds(socket_.native_handle(), channel_.fd(), channel_.event_fd()))
+            return;
+
+        std::error_code assign_error;
+        event_.assign(dup(channel_.event_fd()), assign_error);
+        if (assign_error)
+            return;
+
+        room_.join(shared_from_this());
+        poll();
+
+        // the client sends nothing more, so the connection becoming
+        // readable means it has gone
+        socket_.async_wait(asio::local::stream_protocol::socket::wait_read,
+            std::bind(&shm_session::handle_close,
+                shared_from_this(),
+                std::placeholders::_1));
+    }
+
+    void deliver(const chat_message& msg) {
+        #ifdef DEBUG
+        std::cout << __FUNCTION__ << std::endl;
+        #endif
+
+        if (closed_)
+            return;
+
+        shm_ring& ring = channel_.shared().to_client;
+        if (backlog_.empty() && ring.push(msg.data(), msg.length())) {
+            if (ring.consumer_asleep())
+                channel_.wake_client();
+            return;
+        }
+
+        // the client isn't keeping up, hold on to the message until it makes
+        // room in the ring
+        backlog_.push_back(msg);
+        flush_backlog();
+    }
+
+    const char* id() const {
+        return id_;
+    }
+
+private:
+    // take the client's messages and refill its ring, then keep polling for
+    // a while on the io_context before going to sleep on the eventfd
+    void poll() {
+        #ifdef DEBUG
+        std::cout << __FUNCTION__ << std::endl;
+        #endif
+
+        if (closed_)
+            return;
+
+        shm_ring& ring = channel_.shared().to_server;
+        bool worked = false;
+        chat_message msg;
+        while (ring.pop(msg)) {
+            worked = true;
+            if (ring.producer_asleep())
+                channel_.wake_client();
+            if (msg.body_length() < chat_message::id_length
+                || !accepted_from_client(msg))
+                continue;
+
+            log_message(id_, msg);
+
+            if (topic_frame::is_subscription(msg))
+                room_.subscription(shared_from_this(), msg);
+            else
+                room_.deliver(msg);
+        }
+        if (!backlog_.empty())
+            worked = flush_backlog() || worked;
+
+        if (worked) {
+            if (polls_ != 0)
+                spin_.succeeded();
+            polls_ = 0;
+        }
+
+        if (++polls_ < spin_.limit()) {
+            asio::post(socket_.get_executor(),
+                std::bind(&shm_session::poll, shared_from_this()));
+            return;
+        }
+
+        spin_.failed();
+        polls_ = 0;
+        ring.consumer_sleeps();
+        if (!ring.empty() 
+            || (!backlog_.empty() && !channel_.shared().to_client.full())) {
+            asio::post(socket_.get_executor(),
+                std::bind(&shm_session::poll, shared_from_this()));
+            return;
+        }
+
+        event_.async_wait(asio::posix::stream_descriptor::wait_read,
+            std::bind(&shm_session::handle_wakeup,
+                shared_from_this(),
+                std::placeholders::_1));
+    }
+
+    void handle_wakeup(const std::error_code& error) {
+        #ifdef DEBUG
+        std::cout << __FUNCTION__ << std::endl;
+        #endif
+
+        if (!error) {
+            channel_.clear_server_wakeups();
+            poll();
+        }
+    }
+
+    // move as much of the backlog into the ring as fits. Returns true if
+    // anything was moved
+    bool flush_backlog() {
+        shm_ring& ring = channel_.shared().to_client;
+        bool pushed = false;
+        for (;;) {
+            while (!backlog_.empty() 
+                && ring.push(backlog_.front().data(), backlog_.front().length())) {
+                backlog_.pop_front();
+                pushed = true;
+            }
+            if (backlog_.empty())
+                break;
+
+            // have the client wake us when it pops, unless it already made
+            // room while we weren't looking
+            ring.producer_sleeps();
+            if (ring.full())
+                break;
+        }
+        if (pushed && ring.consumer_asleep())
+            channel_.wake_client();
+        return pushed;
+    }
+
+    void handle_close(const std::error_code& /*error*/) {
+        #ifdef DEBUG
+        std::cout << __FUNCTION__ << std::endl;
+        #endif
+
+        closed_ = true;
+        backlog_.clear();
+        std::error_code ignored;
+        event_.cancel(ignored);
+        room_.leave(shared_from_this());
+    }
+
+    asio::local::stream_protocol::socket socket_;
+    asio::posix::stream_descriptor event_;
+    chat_room& room_;
+    shm_channel channel_;
+    // messages for the client that didn't fit in its ring
+    std::deque<chat_message> backlog_;
+    adaptive_spin spin_;
+    std::size_t polls_;
+    bool closed_;
+    char id_[chat_message::id_length + 1];
+};
+
+typedef std::shared_ptr<shm_session> shm_session_ptr;
+
+class shm_server {
+public:
+    shm_server(asio::io_context& io_context, const std::string& path,
+        chat_room& room) :
+        io_context_(io_context),
+        acceptor_(io_context),
+        path_(path),
+        room_(room) {
+        ::unlink(path.c_str());
+        acceptor_.open(asio::local::stream_protocol());
+        acceptor_.bind(asio::local::stream_protocol::endpoint(path));
+        acceptor_.listen();
+        accept_next();
+    }
+
+    ~shm_server() {
+        ::unlink(path_.c_str());
+    }
+
+private:
+    void accept_next() {
+        shm_session_ptr session(new shm_session(io_context_, room_));
+        acceptor_.async_accept(session->socket(),
+            std::bind(&shm_server::handle_accept, this, session,
+                std::placeholders::_1));
+    }
+
+    void handle_accept(shm_session_ptr session,
+        const std::error_code& error) {
+        if (!error) {
+            session->start();
+            accept_next();
+        }
+    }
+
+    asio::io_context& io_context_;
+    asio::local::stream_protocol::acceptor acceptor_;
+    std::string path_;
+    chat_room& room_;
+};
+
+// ------------------------------------------------------
+
+class proxy_link;
+
+// a user behind an edge proxy, i.e. one stream of a proxy_link. The room
+// sends the stream its history; everything else goes to the whole proxy
+class proxy_stream : public chat_participant {
+public:
+    proxy_stream(proxy_link& link, std::uint64_t stream, const char* id) :
+        link_(link),
+        stream_(stream),
+        id_() {
+        std::memcpy(id_, id, chat_message::id_length);
+    }
+
+    const char* id() const {
+        return id_;
+    }
+
+    void deliver(const chat_message& msg);
+
+    std::uint64_t stream() const {
+        return stream_;
+    }
+
+    // the credit the user's transfers have spent
+    transfer_windows& transfers() {
+        return transfers_;
+    }
+
+private:
+    proxy_link& link_;
+    std::uint64_t stream_;
+    char id_[chat_message::id_length + 1];
+    transfer_windows transfers_;
+};
+
+typedef std::shared_ptr<proxy_stream> proxy_stream_ptr;
+
+// the connection from an edge proxy, carrying the streams of many users as
+// mux records. The room delivers each message to the link once, and the
+// proxy hands it to its users
+class proxy_link :
+    public chat_participant,
+    public std::enable_shared_from_this<proxy_link> {
+
+public:
+    // records queued while a write is in progress go out together, in one
+    // gather write of up to this many
+    enum { max_batch = 64 };
+
+    proxy_link(asio::io_context& io_context, chat_room& room) :
+        socket_(io_context),
+        room_(room),
+        writing_(0),
+        closed_(false) {
+    }
+
+    tcp::socket& socket() {
+        return socket_;
+    }
+
+    void start() {
+        room_.attach(shared_from_this());
+        read_prefix();
+    }
+
+    const char* id() const {
+        return "proxy";
+    }
+
+    // a room message, for all the users of the proxy
+    void deliver(const chat_message& msg) {
+        send(mux_record::all_streams, msg);
+    }
+
+    void send(std::uint64_t stream, const chat_message& msg) {
+        if (closed_)
+            return;
+        write_records_.emplace_back();
+        write_records_.back().assign(mux_record::stream_message, stream, msg);
+        if (writing_ == 0)
+            write_next();
+    }
+
+private:
+    void read_prefix() {
+        asio::async_read(socket_,
+            asio::buffer(read_record_.data(),
+                mux_record::prefix_length + chat_message::header_length),
+            std::bind(&proxy_link::handle_read_prefix,
+                shared_from_this(),
+                std::placeholders::_1));
+    }
+
+    void handle_read_prefix(const std::error_code& error) {
+        std::size_t frame_length = read_record_.frame_length();
+        if (error || frame_length > chat_message::header_length
+            + chat_message::id_length + chat_message::max_body_length) {
+            close();
+            return;
+        }
+
+        std::size_t read = mux_record::prefix_length + chat_message::header_length;
+        std::size_t length = mux_record::prefix_length + frame_length;
+        asio::async_read(socket_,
+            asio::buffer(read_record_.data() + read, length - read),
+            std::bind(&proxy_link::handle_read_record,
+                shared_from_this(),
+                std::placeholders::_1,
+                length));
+    }
+
+    void handle_read_record(const std::error_code& error, std::size_t length) {
+        if (error || !read_record_.decode(length)) {
+            close();
+            return;
+        }
+
+        std::uint64_t stream = read_record_.stream();
+        auto user = streams_.find(stream);
+        switch (read_record_.record_kind()) {
+        case mux_record::open_stream:
+            if (stream != mux_record::all_streams && user == streams_.end()) {
+                proxy_stream_ptr new_user(
+                    new proxy_stream(*this, stream, read_record_.message().id()));
+                streams_[stream] = new_user;
+                room_.join_proxied(new_user);
+            }
+            break;
+        case mux_record::stream_message:
+            if (user != streams_.end()) {
+                chat_message msg = read_record_.message();
+                if (!accepted_from_client(msg))
+                    break;
+                log_message(user->second->id(), msg);
+
+                if (chunk_frame::is_chunk(msg)) {
+                    if (!receive_chunk(user->second, msg))
+                        drop(user->second);
+                } else if (topic_frame::is_subscription(msg))
+                    room_.subscription(user->second, msg);
+                else
+                    room_.deliver(msg);
+            }
+            break;
+        case mux_record::close_stream:
+            if (user != streams_.end())
+                drop(user->second);
+            break;
+        }
+        read_prefix();
+    }
+
+    // a chunk of a user's transfer, under the same windows as a session's
+    // (see chat_session::receive_chunk). The credit goes back on the user's
+    // stream. False if the user goes over its windows
+    bool receive_chunk(const proxy_stream_ptr& user, const chat_message& msg) {
+        chunk_frame chunk;
+        if (!chunk.decode(msg))
+            return false;
+        if (!user->transfers().spend(chunk)) {
+            std::cout << user->id() << " sends past its transfer window, "
+                << "disconnected" << std::endl;
+            return false;
+        }
+
+        std::weak_ptr<proxy_link> weak(shared_from_this());
+        std::weak_ptr<proxy_stream> weak_user(user);
+        std::uint32_t transfer = chunk.transfer();
+        std::size_t length = chunk.length();
+        room_.deliver(msg, std::make_shared<chunk_credit>(
+            [weak, weak_user, transfer, length]() {
+                if (auto self = weak.lock())
+                    asio::post(self->socket_.get_executor(),
+                        [self, weak_user, transfer, length]() {
+                            if (auto user = weak_user.lock())
+                                self->credit(*user, transfer, length);
+                        });
+            }));
+        return true;
+    }
+
+    void credit(proxy_stream& user, std::uint32_t transfer, std::size_t length) {
+        if (closed_ || !user.transfers().give_back(transfer, length))
+            return;
+
+        chat_message msg;
+        chunk_frame::encode_credit(msg, user.id(), transfer, length);
+        user.deliver(msg);
+    }
+
+    // the user leaves the room; the proxy's frames for the stream are
+    // ignored from then on
+    void drop(proxy_stream_ptr user) {
+        auto stream = streams_.find(user->stream());
+        if (stream == streams_.end() || stream->second != user)
+            return;
+        streams_.erase(stream);
+        room_.leave_proxied(user);
+    }
+
+    void write_next() {
+        write_buffers_.clear();
+        for (auto& record : write_records_) {
+            write_buffers_.push_back(asio::buffer(record.data(), record.length()));
+            if (write_buffers_.size() == max_batch)
+                break;
+        }
+        writing_ = write_buffers_.size();
+        asio::async_write(socket_,
+            write_buffers_,
+            std::bind(&proxy_link::handle_write,
+                shared_from_this(),
+                std::placeholders::_1));
+    }
+
+    void handle_write(const std::error_code& error) {
+        if (!error) {
+            write_records_.erase(write_records_.begin(),
+                write_records_.begin() + writing_);
+            writing_ = 0;
+            if (!write_records_.empty())
+                write_next();
+        } else {
+            close();
+        }
+    }
+
+    // the proxy is gone, and all its users with it
+    void close() {
+        if (closed_)
+            return;
+        closed_ = true;
+        write_records_.clear();
+        std::error_code ignored;
+        socket_.close(ignored);
+        room_.detach(shared_from_this());
+
+        std::map<std::uint64_t, proxy_stream_ptr> streams;
+        streams.swap(streams_);
+        for (auto& user : streams)
+            room_.leave_proxied(user.second);
+    }
+
+    tcp::socket socket_;
+    chat_room& room_;
+    mux_record read_record_;
+    // the records being written are the first writing_ of write_records_
+    std::deque<mux_record> write_records_;
+    std::vector<asio::const_buffer> write_buffers_;
+    std::size_t writing_;
+    bool closed_;
+    std::map<std::uint64_t, proxy_stream_ptr> streams_;
+};
+
+typedef std::shared_ptr<proxy_link> proxy_link_ptr;
+
+void proxy_stream::deliver(const chat_message& msg) {
+    link_.send(stream_, msg);
+}
+
+class proxy_server {
+public:
+    proxy_server(asio::io_context& io_context, const tcp::endpoint& endpoint,
+        chat_room& room) :
+        io_context_(io_context),
+        acceptor_(io_context, endpoint),
+        room_(room) {
+        accept_next();
+    }
+
+private:
+    void accept_next() {
+        proxy_link_ptr link(new proxy_link(io_context_, room_));
+        acceptor_.async_accept(link->socket(),
+            std::bind(&proxy_server::handle_accept, this, link,
+                std::placeholders::_1));
+    }
+
+    void handle_accept(proxy_link_ptr link, const std::error_code& error) {
+        if (!error) {
+            link->socket().set_option(tcp::no_delay(true));
+            link->start();
+        }
+        accept_next();
+    }
+
+    asio::io_context& io_context_;
+    tcp::acceptor acceptor_;
+    chat_room& room_;
+};
 
-class chat_participant {
+// ------------------------------------------------------
+
+// admission control for the acceptors, so that a storm of new connections,
+// each getting the history, doesn't starve the users already in the room.
+// It watches how late the io_context runs a timer (the event loop's lag),
+// the bytes queued in the sessions' lanes and the CPU the process uses,
+// each against a limit (0 leaves it unwatched); the pressure is the worst
+// of them. From half a limit on, accepts are spaced out, up to
+// max_accept_pause_ms apart. Over a limit, new clients get a retry_frame
+// telling them when to come back, and are let go
+class admission_control {
 public:
-    virtual ~chat_participant(){}
-    virtual const char* id() const = 0;
-    virtual void deliver(const chat_message& msg) = 0;
-};
+    typedef std::chrono::steady_clock clock;
+    enum { sample_ms = 10 };
+    enum { max_accept_pause_ms = 50 };
+    enum { retry_base_ms = 1000 };
+    enum { max_retry_ms = 30000 };
 
-//typedef boost::shared_ptr<chat_participant> chat_participant_ptr;
+    admission_control(asio::io_context& io_context, double max_lag_ms,
+        std::size_t max_queued_bytes, double max_cpu_percent) :
+        timer_(io_context),
+        max_lag_ms_(max_lag_ms),
+        max_queued_bytes_(max_queued_bytes),
+        max_cpu_percent_(max_cpu_percent),
+        lag_ms_(0),
+        cpu_percent_(0),
+        cpu_(cpu_seconds()),
+        sampled_(clock::now()),
+        due_(sampled_ + std::chrono::milliseconds(sample_ms)),
+        random_(std::random_device()()) {
+        wait();
+    }
 
-typedef std::shared_ptr<chat_participant> chat_participant_ptr;
+    // how long an acceptor waits before it takes the next connection
+    std::chrono::milliseconds accept_pause() {
+        double p = pressure();
+        if (p < 0.5 || p >= 1)
+            return std::chrono::milliseconds(0);
+        ++get().paused;
+        double pause_ms = static_cast<double>(max_accept_pause_ms) * (p - 0.5) * 2;
+        return std::chrono::milliseconds(static_cast<long>(pause_ms));
+    }
 
-class chat_room {
-public: 
+    // 0 to let a new client in, or how many milliseconds it should stay
+    // away. The hint grows with the pressure and is spread out, so that the
+    // refused clients don't all come back at once
+    std::uint32_t admit() {
+        double p = pressure();
+        if (p < 1) {
+            ++get().admitted;
+            return 0;
+        }
+        ++get().refused;
+        std::uniform_real_distribution<double> spread(1, 2);
+        double retry_ms = static_cast<double>(retry_base_ms) * std::min(p, 8.0)
+            * spread(random_);
+        return static_cast<std::uint32_t>(std::min<double>(retry_ms, max_retry_ms));
+    }
 
-    void join(chat_participant_ptr new_participant) {
-        #ifdef DEBUG
-        std::cout << __FUNCTION__ << std::endl;
-        #endif
+    static void report(std::ostream& out) {
+        counters& k = get();
+        out << "admission: " << k.admitted << " admitted, "
+            << k.refused << " refused, "
+            << k.paused << " accepts paused, "
+            << "loop lag " << k.lag_ms << " ms, "
+            << "cpu " << k.cpu_percent << "%, "
+            << "queued " << overload_governor::queued_bytes() << " bytes"
+            << std::endl;
+    }
 
-        std::cout << new_participant->id() << " joined the chat" << std::endl;
+private:
+    struct counters {
+        unsigned long long admitted;
+        unsigned long long refused;
+        unsigned long long paused;
+        double lag_ms;
+        double cpu_percent;
+    };
 
-        participants_.insert(new_participant);
+    static counters& get() {
+        static counters all;
+        return all;
+    }
 
-        // deliver recent messages to the new participants
-        for (auto msg : recent_msg_)
-            new_participant->deliver(msg);
-        
-        // deliever the messages that a new participant joined the chat
-        chat_message msg;
-        char admin_id[chat_message::id_length + 1] = "Admin";
-        std::string admin_msg(new_participant->id());
-        admin_msg += " joined the chat";
+    static double cpu_seconds() {
+        return static_cast<double>(std::clock()) / CLOCKS_PER_SEC;
+    }
 
-        msg.body_length(admin_msg.length() + chat_message::id_length);
-        std::memcpy(msg.id(), admin_id, chat_message::id_length);
-        std::memcpy(msg.msg(), admin_msg.c_str(), admin_msg.length());
-        msg.encode_header();
+    double pressure() const {
+        double p = 0;
+        if (max_lag_ms_ > 0)
+            p = std::max(p, lag_ms_ / max_lag_ms_);
+        if (max_queued_bytes_ > 0)
+            p = std::max(p, static_cast<double>(overload_governor::queued_bytes())
+                / max_queued_bytes_);
+        if (max_cpu_percent_ > 0)
+            p = std::max(p, cpu_percent_ / max_cpu_percent_);
+        return p;
+    }
 
-        deliver(msg);
+    void wait() {
+        timer_.expires_at(due_);
+        timer_.async_wait(std::bind(&admission_control::sample, this,
+            std::placeholders::_1));
     }
 
-    void leave(chat_participant_ptr participant) {
-        #ifdef DEBUG
-        std::cout << __FUNCTION__ << std::endl;
-        #endif
+    // a spike of lag is remembered for a few samples, the CPU is averaged
+    // over about ten
+    void sample(const std::error_code& error) {
+        if (error)
+            return;
+        clock::time_point now = clock::now();
+        double lag_ms = std::chrono::duration<double, std::milli>(now - due_).count();
+        lag_ms_ = std::max(lag_ms, lag_ms_ * 0.75);
+        double cpu = cpu_seconds();
+        double wall = std::chrono::duration<double>(now - sampled_).count();
+        if (wall > 0)
+            cpu_percent_ += 0.1 * ((cpu - cpu_) / wall * 100 - cpu_percent_);
+        cpu_ = cpu;
+        sampled_ = now;
+        get().lag_ms = lag_ms_;
+        get().cpu_percent = cpu_percent_;
 
-        std::cout << participant->id() << " left the chat" << std::endl;
+        // the next sample is due from now, so late ones don't pile up
+        due_ = now + std::chrono::milliseconds(sample_ms);
+        wait();
+    }
 
-        participants_.erase(participant);
+    asio::steady_timer timer_;
+    double max_lag_ms_;
+    std::size_t max_queued_bytes_;
+    double max_cpu_percent_;
+    double lag_ms_;
+    double cpu_percent_;
+    double cpu_;
+    clock::time_point sampled_;
+    clock::time_point due_;
+    std::minstd_rand random_;
+};
 
-        // deliever the messages that a participant left the chat
-        chat_message msg;
-        char admin_id[chat_message::id_length + 1] = "Admin";
-        std::string admin_msg(participant->id());
-        admin_msg += " left the chat";
+// accepts clients over TLS. The handshakes run on threads of their own, so
+// the public key work of many clients connecting at once doesn't hold up
+// the room; a session only joins the room, on the io_context's thread, once
+// its handshake is done. Returning clients can skip most of that work: they
+// resume with a session ticket, or by session id from the server's cache.
+// With kernel_offload, the kernel takes over the encryption of what is sent
+// where it can (see ktls.hpp), so the room's frames are sent as they are and
+// can be spliced
+class tls_server {
+public:
+    enum { session_cache_size = 20480 };
+    enum { session_timeout_s = 7200 };
 
-        msg.body_length(admin_msg.length() + chat_message::id_length);
-        std::memcpy(msg.id(), admin_id, chat_message::id_length);
-        std::memcpy(msg.msg(), admin_msg.c_str(), admin_msg.length());
-        msg.encode_header();
+    tls_server(asio::io_context& io_context, const tcp::endpoint& endpoint,
+        chat_room& room, const std::string& certificate,
+        const std::string& private_key, std::size_t handshake_threads,
+        bool kernel_offload) :
+        io_context_(io_context),
+        acceptor_(io_context, endpoint),
+        context_(asio::ssl::context::tls_server),
+        handshakes_(handshake_threads),
+        room_(room),
+        kernel_offload_(kernel_offload),
+        offload_failed_(false),
+        admission_(nullptr) {
+        context_.set_options(asio::ssl::context::default_workarounds
+            | asio::ssl::context::no_sslv2 | asio::ssl::context::no_sslv3
+            | asio::ssl::context::no_tlsv1 | asio::ssl::context::no_tlsv1_1);
+        context_.use_certificate_chain_file(certificate);
+        context_.use_private_key_file(private_key, asio::ssl::context::pem);
 
-        deliver(msg);
+        static const unsigned char id_context[] = "chat_server";
+        SSL_CTX* ctx = context_.native_handle();
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+        SSL_CTX_sess_set_cache_size(ctx, session_cache_size);
+        SSL_CTX_set_timeout(ctx, session_timeout_s);
+        SSL_CTX_set_session_id_context(ctx, id_context, sizeof(id_context) - 1);
+        if (kernel_offload_)
+            ktls::prepare(ctx);
+
+        accept_next();
     }
 
-    void deliver(const chat_message& msg) {
-        #ifdef DEBUG
-        std::cout << __FUNCTION__ << std::endl;
-        #endif
+    // see admission_control
+    void control_admission(admission_control& admission) {
+        admission_ = &admission;
+    }
 
-        // push the new message into the queue
-        recent_msg_.push_back(msg);
-        while (recent_msg_.size() > max_recent_msg) recent_msg_.pop_front();
+private:
+    // wait as long as admission control says before accepting again
+    void pace_accept() {
+        std::chrono::milliseconds pause = admission_
+            ? admission_->accept_pause() : std::chrono::milliseconds(0);
+        if (pause.count() == 0) {
+            accept_next();
+            return;
+        }
+        std::shared_ptr<asio::steady_timer> timer(
+            new asio::steady_timer(io_context_, pause));
+        timer->async_wait([this, timer](const std::error_code&) {
+            accept_next();
+        });
+    }
 
-        // deliver the new message to all the participants
-        for (auto participant : participants_)
-            if (std::strncmp(msg.id(), participant->id(), chat_message::id_length) != 0)
-                participant->deliver(msg);
-            else {
-                //std::cout.write(msg.id(), chat_message::id_length);
-                //std::cout << "\n";
-                //std::cout.write(participant->id(), chat_message::id_length);
-            }
+    void accept_next() {
+        chat_session_ptr<tls> session(
+            new chat_session<tls>(io_context_, context_, room_));
+        acceptor_.async_accept(session->socket().lowest_layer(),
+            std::bind(&tls_server::handle_accept, this, session,
+                std::placeholders::_1));
     }
 
-private:
-    std::set<chat_participant_ptr> participants_;
-    enum { max_recent_msg = 100 };
-    std::deque<chat_message> recent_msg_;
+    // the steps of the handshake run on the handshake threads, since that
+    // is where their completion handler is bound
+    void handle_accept(chat_session_ptr<tls> session,
+        const std::error_code& error) {
+        if (!error) {
+            std::error_code ignored;
+            session->socket().lowest_layer().set_option(tcp::no_delay(true),
+                ignored);
+            limit_unsent(session->socket().lowest_layer());
+            // a refused client still shakes hands, to be able to read why
+            std::uint32_t retry_ms = admission_ ? admission_->admit() : 0;
+            if (retry_ms != 0)
+                session->refuse(retry_ms);
+            session->socket().async_handshake(asio::ssl::stream_base::server,
+                asio::bind_executor(handshakes_.get_executor(),
+                    std::bind(&tls_server::handle_handshake, this, session,
+                        std::placeholders::_1)));
+        }
+        pace_accept();
+    }
+
+    // the handshake's output has all been written when it completes, so
+    // the kernel can take over from here
+    void handle_handshake(chat_session_ptr<tls> session,
+        const std::error_code& error) {
+        if (error)
+            return;
+        if (kernel_offload_ && !ktls::offload(session->socket().native_handle(),
+                session->socket().lowest_layer().native_handle())
+            && !offload_failed_.exchange(true))
+            std::cerr << "kernel TLS not available, encrypting in user space"
+                << std::endl;
+        asio::post(io_context_,
+            std::bind(&chat_session<tls>::wait_for_id, session));
+    }
+
+    asio::io_context& io_context_;
+    tcp::acceptor acceptor_;
+    asio::ssl::context context_;
+    asio::thread_pool handshakes_;
+    chat_room& room_;
+    bool kernel_offload_;
+    // the first connection that stays in user space says so
+    std::atomic<bool> offload_failed_;
+    admission_control* admission_;
 };
 
-class chat_session : 
-    public chat_participant,
-    public std::enable_shared_from_this<chat_session> {
+// ------------------------------------------------------
 
-public: 
-    chat_session(asio::io_context& io_context, chat_room& room) :
+// the TCP connection of a multicast viewer. The viewer sends its id, gets
+// the next sequence number back (as a heartbeat record), and from then on
+// asks for the messages it missed on the multicast group
+class viewer_session :
+    public std::enable_shared_from_this<viewer_session> {
+
+public:
+    viewer_session(asio::io_context& io_context, 
+        multicast_publisher& publisher) :
         socket_(io_context),
-        room_(room) {
+        publisher_(publisher),
+        id_() {
     }
 
     tcp::socket& socket() {
         return socket_;
     }
 
-    void wait_for_id() {
+    void start() {
         #ifdef DEBUG
         std::cout << __FUNCTION__ << std::endl;
         #endif
 
         asio::async_read(socket_,
             asio::buffer(id_, chat_message::id_length),
-            std::bind(&chat_session::start, 
-                shared_from_this(),  
-                //boost::asio::placeholders::error));
+            std::bind(&viewer_session::handle_id,
+                shared_from_this(),
                 std::placeholders::_1));
     }
-    
-    void start(const std::error_code& error) {
+
+    void handle_id(const std::error_code& error) {
         #ifdef DEBUG
         std::cout << __FUNCTION__ << std::endl;
         #endif
 
+        if (error)
+            return;
 
-        room_.join(shared_from_this());
-        // read the header from read_msg_ first
-        // invoke handle_read_header and trigger the body reading event
+        std::cout << id_ << " is viewing the chat" << std::endl;
+
+        multicast_record hello;
+        hello.heartbeat(publisher_.next_seq());
+        write(std::string(hello.data(), hello.length()));
+        read_request();
+    }
+
+    void read_request() {
         asio::async_read(socket_,
-            asio::buffer(read_msg_.data(), chat_message::header_length),
-            std::bind(&chat_session::handle_read_header, 
-                shared_from_this(),  
-                //boost::asio::placeholders::error));
+            asio::buffer(request_, multicast_record::request_length),
+            std::bind(&viewer_session::handle_request,
+                shared_from_this(),
                 std::placeholders::_1));
     }
 
-    void handle_read_header(const std::error_code& error) {
+    // answer a request for [first, last] with the kept messages of the
+    // range, preceded by a lost record for the part that is no longer kept
+    void handle_request(const std::error_code& error) {
         #ifdef DEBUG
         std::cout << __FUNCTION__ << std::endl;
         #endif
 
-        if (!error && read_msg_.decode_header()) {
-            //std::cout << id_ << " sends message with length:" << read_msg_.body_length() << std::endl;
-            asio::async_read(socket_, 
-                asio::buffer(read_msg_.body(), read_msg_.body_length()), 
-                bind(&chat_session::handle_read_body,
-                    shared_from_this(),
-                    //boost::asio::placeholders::error));
-                    std::placeholders::_1));
-        } else {
-            room_.leave(shared_from_this());
+        std::uint64_t first = 0, last = 0;
+        if (error 
+            || !multicast_record::decode_seq(request_, first)
+            || !multicast_record::decode_seq(
+                request_ + multicast_record::seq_length, last)) {
+            std::cout << id_ << " stopped viewing the chat" << std::endl;
+            return;
+        }
+
+        std::string reply;
+        std::uint64_t next = publisher_.next_seq();
+        std::uint64_t oldest = publisher_.oldest_seq();
+        if (last >= next)
+            last = next - 1;
+        if (next > 0 && first <= last) {
+            if (first < oldest) {
+                multicast_record lost;
+                lost.lost(std::min(last, oldest - 1));
+                reply.append(lost.data(), lost.length());
+                first = oldest;
+            }
+            for (std::uint64_t seq = first; seq <= last; ++seq) {
+                const multicast_record& record = publisher_.record(seq);
+                reply.append(record.data(), record.length());
+            }
         }
+        if (!reply.empty())
+            write(reply);
+        read_request();
     }
 
-    void handle_read_body(const std::error_code& error) {
-        #ifdef DEBUG
-        std::cout << __FUNCTION__ << std::endl;
-        #endif
+private:
+    void write(const std::string& data) {
+        bool write_in_progress = !write_bufs_.empty();
+        write_bufs_.push_back(data);
+        if (!write_in_progress)
+            write_next();
+    }
 
+    void write_next() {
+        asio::async_write(socket_,
+            asio::buffer(write_bufs_.front()),
+            std::bind(&viewer_session::handle_write,
+                shared_from_this(),
+                std::placeholders::_1));
+    }
+
+    void handle_write(const std::error_code& error) {
         if (!error) {
-            std::cout << id_ << " says: ";
-            std::cout.write(read_msg_.msg(), read_msg_.body_length() - chat_message::id_length);
-            std::cout << std::endl;
+            write_bufs_.pop_front();
+            if (!write_bufs_.empty())
+                write_next();
+        }
+    }
 
-            room_.deliver(read_msg_);
+    tcp::socket socket_;
+    multicast_publisher& publisher_;
+    char request_[multicast_record::request_length];
+    std::deque<std::string> write_bufs_;
+    char id_[chat_message::id_length + 1];
+};
 
-            // wait for the next message
-            asio::async_read(socket_,
-                asio::buffer(read_msg_.data(), chat_message::header_length),
-                std::bind(&chat_session::handle_read_header, 
-                    shared_from_this(),  
-                    //boost::asio::placeholders::error));
-                    std::placeholders::_1));
-        } else {
-            room_.leave(shared_from_this());
+typedef std::shared_ptr<viewer_session> viewer_session_ptr;
+
+class viewer_server {
+public:
+    viewer_server(asio::io_context& io_context, const tcp::endpoint& endpoint,
+        multicast_publisher& publisher) :
+        io_context_(io_context),
+        acceptor_(io_context, endpoint),
+        publisher_(publisher) {
+        accept_next();
+    }
+
+private:
+    void accept_next() {
+        viewer_session_ptr session(new viewer_session(io_context_, publisher_));
+        acceptor_.async_accept(session->socket(),
+            std::bind(&viewer_server::handle_accept, this, session,
+                std::placeholders::_1));
+    }
+
+    void handle_accept(viewer_session_ptr session,
+        const std::error_code& error) {
+        if (!error) {
+            session->socket().set_option(tcp::no_delay(true));
+            session->start();
         }
+        accept_next();
     }
 
-    void deliver(const chat_message& msg) {
+    asio::io_context& io_context_;
+    tcp::acceptor acceptor_;
+    multicast_publisher& publisher_;
+};
+
+// ------------------------------------------------------
+
+// move an accepted socket to another io_context, which is then the one
+// that runs its operations. False if it can't be, and the socket is closed
+template <typename Socket>
+bool move_to(asio::io_context& io_context, Socket& socket) {
+    std::error_code error;
+    auto protocol = socket.local_endpoint(error).protocol();
+    auto handle = error ? -1 : socket.release(error);
+    if (error) {
+        socket.close(error);
+        return false;
+    }
+    Socket moved(io_context);
+    moved.assign(protocol, handle, error);
+    if (error) {
+        ::close(handle);
+        return false;
+    }
+    socket = std::move(moved);
+    return true;
+}
+
+class chat_server {
+public:
+    // how long to wait before accepting again when out of file descriptors,
+    // for the sessions that hold them to go away
+    enum { fd_limit_pause_ms = 100 };
+
+    // with fanout_threads, the TCP and unix socket sessions run on that
+    // many fan-out workers, taken in turn, instead of on the room's thread
+    // (see fanout_worker). The room's flood_policy is set before the first
+    // session is made, as each session takes its share of it when it is
+    chat_server(asio::io_context& io_context, tcp::endpoint& endpoint,
+        std::size_t zerocopy_threshold, std::size_t fanout_threads = 0,
+        const flood_policy& floods = flood_policy()) : 
+        io_context_(io_context), 
+        acceptor_(io_context, endpoint),
+        local_acceptor_(io_context),
+        room_(io_context),
+        zerocopy_threshold_(zerocopy_threshold),
+        admission_(nullptr),
+        next_worker_(0) {
         #ifdef DEBUG
         std::cout << __FUNCTION__ << std::endl;
         #endif
-
-        bool write_in_progress = !write_msgs_.empty();
-        write_msgs_.push_back(msg);
-        if (!write_in_progress) {
-            chat_message& write_msg = write_msgs_.front();
-            asio::async_write(socket_, 
-                asio::buffer(write_msg.data(), write_msg.length()), 
-                std::bind(&chat_session::handle_write,
-                    shared_from_this(),
-                    //boost::asio::placeholders::error));
-                    std::placeholders::_1));
+        
+        room_.limit_floods(floods);
+        for (std::size_t i = 0; i < fanout_threads; ++i) {
+            workers_.emplace_back(new fanout_worker(io_context_, room_));
+            workers_.back()->start();
         }
+        accept_next(acceptor_);
     }
 
-    void handle_write(const std::error_code& error) {
+    // also accept co-located clients on a unix domain socket, which skips
+    // the TCP/IP stack. A socket file left behind by an earlier run is
+    // replaced
+    void listen_local(const std::string& path) {
         #ifdef DEBUG
         std::cout << __FUNCTION__ << std::endl;
         #endif
 
-        if (!error) {
-            write_msgs_.pop_front();
-
-            if (!write_msgs_.empty()) {
-                //iteratively call itself, until no message in the queue
-                chat_message& write_msg = write_msgs_.front();
-                asio::async_write(socket_, 
-                    asio::buffer(write_msg.data(), write_msg.length()), 
-                    std::bind(&chat_session::handle_write,
-                        shared_from_this(),
-                        //boost::asio::placeholders::error));
-                        std::placeholders::_1));
-            }
-        } else {
-            room_.leave(shared_from_this());
-        }
+        ::unlink(path.c_str());
+        local_acceptor_.open(asio::local::stream_protocol());
+        local_acceptor_.bind(asio::local::stream_protocol::endpoint(path));
+        local_acceptor_.listen();
+        local_path_ = path;
+        accept_next(local_acceptor_);
     }
 
-    const char* id() const{
-        return id_;
+    ~chat_server() {
+        if (!local_path_.empty())
+            ::unlink(local_path_.c_str());
+        for (auto& worker : workers_)
+            worker->stop();
     }
 
-private:
-    tcp::socket socket_;
-    chat_room& room_;
-    chat_message read_msg_;
-    std::deque<chat_message> write_msgs_;
-    char id_[chat_message::id_length + 1];
-};
+    // see admission_control
+    void control_admission(admission_control& admission) {
+        admission_ = &admission;
+    }
 
-typedef std::shared_ptr<chat_session> chat_session_ptr;
+    // see chat_room::fanout_budget(); the fan-out workers take turns of the
+    // same length
+    void fanout_budget(std::chrono::microseconds budget) {
+        room_.fanout_budget(budget);
+        for (auto& worker : workers_)
+            worker->fanout_budget(budget);
+    }
 
-// ------------------------------------------------------
+    // wait as long as admission control says before accepting again
+    template <typename Protocol>
+    void pace_accept(asio::basic_socket_acceptor<Protocol>& acceptor) {
+        accept_after(acceptor, admission_
+            ? admission_->accept_pause() : std::chrono::milliseconds(0));
+    }
 
-class chat_server {
-public:
-    chat_server(asio::io_context& io_context, tcp::endpoint& endpoint) : 
-        io_context_(io_context), 
-        acceptor_(io_context, endpoint) {
+    template <typename Protocol>
+    void accept_after(asio::basic_socket_acceptor<Protocol>& acceptor,
+        std::chrono::milliseconds pause) {
+        if (pause.count() == 0) {
+            accept_next(acceptor);
+            return;
+        }
+        std::shared_ptr<asio::steady_timer> timer(
+            new asio::steady_timer(io_context_, pause));
+        timer->async_wait([this, timer, &acceptor](const std::error_code&) {
+            accept_next(acceptor);
+        });
+    }
+
+    template <typename Protocol>
+    void accept_next(asio::basic_socket_acceptor<Protocol>& acceptor) {
         #ifdef DEBUG
         std::cout << __FUNCTION__ << std::endl;
         #endif
-        
-        chat_session_ptr session(new chat_session(io_context_, room_));
-        acceptor_.async_accept(session->socket(), 
-            std::bind(&chat_server::handle_accept, this, session, 
-                //boost::asio::placeholders::error));
-                std::placeholders::_1));
+
+        // the client's socket only moves to the worker's io_context, and
+        // the session is only made, once the client is accepted. A pending
+        // accept is dropped when the server's io_context is, after the
+        // workers are gone, and must not hold anything of theirs
+        fanout_worker* worker = nullptr;
+        if (!workers_.empty())
+            worker = workers_[next_worker_++ % workers_.size()].get();
+        acceptor.async_accept(
+            std::bind(&chat_server::handle_accept<Protocol>, this, 
+                std::ref(acceptor), worker, 
+                std::placeholders::_1, std::placeholders::_2));
     }
 
-    void handle_accept(chat_session_ptr session, 
-        const std::error_code &error) {
+    template <typename Protocol>
+    void handle_accept(asio::basic_socket_acceptor<Protocol>& acceptor,
+        fanout_worker* worker, const std::error_code &error,
+        typename Protocol::socket socket) {
         #ifdef DEBUG
         std::cout << __FUNCTION__ << std::endl;
         #endif
         
+        // a failed accept leaves the listening socket as it was, so keep
+        // accepting; at the fd limit, give the sessions a moment to close
+        if (error == asio::error::operation_aborted)
+            return;
+        if (error == asio::error::no_descriptors
+            || error == std::errc::too_many_files_open_in_system) {
+            accept_after(acceptor,
+                std::chrono::milliseconds(fd_limit_pause_ms));
+            return;
+        }
+        if (error || (worker && !move_to(worker->context(), socket))) {
+            pace_accept(acceptor);
+            return;
+        }
         if (!error) {
-            session->wait_for_id();
-            chat_session_ptr new_session(new chat_session(io_context_, room_));
-            acceptor_.async_accept(new_session->socket(), 
-                std::bind(&chat_server::handle_accept, this, new_session, 
-                    //boost::asio::placeholders::error));
-                    std::placeholders::_1));
+            chat_session_ptr<Protocol> session(
+                new chat_session<Protocol>(std::move(socket), room_));
+            if (worker)
+                session->run_on(*worker);
+
+            #if defined(ASIO_HAS_MSG_ZEROCOPY)
+            // large writes (e.g. the history replay) are sent with zero-copy;
+            // if the kernel can't do it (or it's a unix domain socket) we
+            // just keep copying
+            std::error_code zerocopy_error;
+            session->socket().set_zerocopy_threshold(zerocopy_threshold_, 
+                zerocopy_error);
+            #ifdef DEBUG
+            if (zerocopy_error)
+                std::cout << "zerocopy: " << zerocopy_error.message() << std::endl;
+            #endif
+            #endif
+
+            limit_unsent(session->socket());
+            std::uint32_t retry_ms = admission_ ? admission_->admit() : 0;
+            if (retry_ms != 0)
+                session->refuse(retry_ms);
+            // the session starts on its own thread
+            asio::post(session->socket().get_executor(),
+                std::bind(&chat_session<Protocol>::wait_for_id, session));
+            pace_accept(acceptor);
         } 
     }
 
+    chat_room& room() {
+        return room_;
+    }
+
 private:
     asio::io_context& io_context_;
     tcp::acceptor acceptor_;
+    asio::local::stream_protocol::acceptor local_acceptor_;
+    std::string local_path_;
     chat_room room_;
+    std::size_t zerocopy_threshold_;
+    admission_control* admission_;
+    std::vector<fanout_worker_ptr> workers_;
+    std::size_t next_worker_;
 
 };
 
 typedef std::shared_ptr<chat_server> chat_server_ptr;
 
+// dump the handler memory cache counters of the io thread, the sessions'
+// write delays, what flood protection and admission control did, and how
+// fan-out went, on SIGUSR1
+void wait_for_stats_signal(asio::signal_set& signals) {
+    signals.async_wait([&signals](const std::error_code& error, int) {
+        if (!error) {
+            asio::detail::thread_info_base::cache_statistics stats = 
+                asio::detail::thread_info_base::statistics(
+                    asio::detail::thread_context::thread_call_stack::top());
+            std::cout << "handler cache: " 
+                << stats.hits << " hits, "
+                << stats.depot_hits << " depot hits, "
+                << stats.misses << " misses, "
+                << stats.oversized << " oversized, "
+                << stats.cached << " cached, "
+                << stats.returned << " returned, "
+                << stats.freed << " freed" << std::endl;
+            lane_metrics::report(std::cout);
+            throttle_metrics::report(std::cout);
+            admission_control::report(std::cout);
+            fanout_metrics::report(std::cout);
+            wait_for_stats_signal(signals);
+        }
+    });
+}
+
+// a member of the room for --fanout-bench, which only counts what it gets
+// from the bench: once it has its first message, and once it has them all
+class bench_member : public chat_participant {
+public:
+    bench_member(std::size_t i, std::size_t messages,
+        std::atomic<std::size_t>& ready, std::atomic<std::size_t>& done) :
+        messages_(messages),
+        received_(0),
+        ready_(ready),
+        done_(done) {
+        std::snprintf(id_, sizeof(id_), "m%07zu", i % 10000000);
+    }
+
+    static const char* bench_id() {
+        return "bench\0\0\0";
+    }
+
+    const char* id() const {
+        return id_;
+    }
+
+    void deliver(const chat_message& msg) {
+        if (std::strncmp(msg.id(), bench_id(), chat_message::id_length) != 0)
+            return;
+        if (++received_ == 1)
+            ready_.fetch_add(1);
+        if (received_ == messages_)
+            done_.fetch_add(1);
+    }
+
+private:
+    std::size_t messages_;
+    std::size_t received_;
+    std::atomic<std::size_t>& ready_;
+    std::atomic<std::size_t>& done_;
+    char id_[chat_message::id_length + 1];
+};
+
+// run the room's io_context until count gets to target
+void run_until(asio::io_context& io_context,
+    const std::atomic<std::size_t>& count, std::size_t target) {
+    asio::steady_timer timer(io_context);
+    std::function<void()> poll = [&]() {
+        if (count.load() >= target)
+            return;
+        timer.expires_after(std::chrono::milliseconds(1));
+        timer.async_wait([&](const std::error_code&) { poll(); });
+    };
+    io_context.restart();
+    poll();
+    io_context.run();
+}
+
+// --fanout-bench: how long a room of in-process members takes to get
+// messages, fanned out on the room's thread and then on 1 to max_threads
+// workers. The members are joined, and have all the join notices, before
+// the clock starts; what is timed is the room handing the messages to the
+// workers and the workers delivering them, without any sockets
+void fanout_bench(std::size_t members, std::size_t messages,
+    std::size_t max_threads, std::chrono::microseconds budget) {
+    // the room says who joins and leaves
+    std::streambuf* console = std::cout.rdbuf(nullptr);
+    std::ostream out(console);
+    out << members << " members, " << messages << " messages each" << std::endl;
+
+    chat_message msg;
+    msg.body_length(chat_message::id_length + 64);
+    std::memcpy(msg.id(), bench_member::bench_id(), chat_message::id_length);
+    std::memset(msg.msg(), 'x', 64);
+    msg.encode_header();
+
+    for (std::size_t threads = 0; threads <= max_threads; ++threads) {
+        asio::io_context io_context;
+        chat_room room(io_context);
+        room.fanout_budget(budget);
+        std::vector<fanout_worker_ptr> workers;
+        for (std::size_t i = 0; i < threads; ++i) {
+            workers.emplace_back(new fanout_worker(io_context, room));
+            workers.back()->fanout_budget(budget);
+            workers.back()->start();
+        }
+
+        std::atomic<std::size_t> ready(0);
+        std::atomic<std::size_t> done(0);
+        for (std::size_t i = 0; i < members; ++i) {
+            chat_participant_ptr member(
+                new bench_member(i, messages + 1, ready, done));
+            if (workers.empty())
+                room.join(member);
+            else
+                workers[i % workers.size()]->join(member);
+        }
+        asio::post(io_context, [&]() { room.deliver(msg); });
+        run_until(io_context, ready, members);
+
+        double wall = wall_seconds();
+        double cpu = cpu_seconds();
+        asio::post(io_context, [&]() {
+            for (std::size_t i = 0; i < messages; ++i)
+                room.deliver(msg);
+        });
+        run_until(io_context, done, members);
+        wall = wall_seconds() - wall;
+        cpu = cpu_seconds() - cpu;
+
+        char line[128];
+        std::snprintf(line, sizeof(line),
+            "%2zu fan-out threads: %9.1f ms, %8.1f ns a delivery, "
+            "%5.2f cpu s", threads, wall * 1e3,
+            wall * 1e9 / (members * messages), cpu);
+        out << line << std::endl;
+
+        for (auto& worker : workers)
+            worker->stop();
+    }
+    std::cout.rdbuf(console);
+}
+
 int main(int argc, char* argv[]) {
 
     try {
         asio::io_context io_context;
-        tcp::endpoint endpoint(tcp::v4(), 1000);
-        chat_server_ptr server(new chat_server(io_context, endpoint));
+        unsigned short port = 1000;
+
+        // writes of at least this many bytes use zero-copy, 0 turns it off
+        std::size_t zerocopy_threshold = 16384;
+        chat_room::fanout_strategy fanout = chat_room::copy_fanout;
+        // how long one turn of fan-out may run, 0 for no limit
+        long fanout_budget_us = chat_room::default_budget_us;
+        // with fan-out threads, the TCP and unix socket sessions run on them
+        std::size_t fanout_threads = 0;
+        // with a log directory, the history is replayed from log segments
+        std::string history_dir;
+        std::size_t history_frames = 100;
+        // with a multicast group, viewers connect to the viewer port
+        std::string multicast_group;
+        std::string multicast_interface;
+        unsigned short viewer_port = 1001;
+        // with a socket path, local clients can connect without TCP
+        std::string unix_path;
+        // local clients that connect here talk to the room over shared memory
+        std::string shm_path;
+        // with a relay port or peers, the room spans several nodes
+        std::uint64_t node = std::random_device()() 
+            | static_cast<std::uint64_t>(std::random_device()()) << 32;
+        unsigned short relay_port = 0;
+        std::vector<std::string> peers;
+        relay_hub::relay_topology relay_topology = relay_hub::any_topology;
+        // edge proxies connect here, see chat_proxy.cpp
+        unsigned short proxy_port = 0;
+        // with a TLS port, clients can connect over TLS there
+        unsigned short tls_port = 0;
+        std::string tls_certificate;
+        std::string tls_key;
+        std::size_t handshake_threads = 2;
+        bool kernel_tls = false;
+        // flood protection, off unless a rate or a backlog limit is given
+        flood_policy floods;
+        // admission control, off unless one of its limits is given
+        double max_lag_ms = 0;
+        std::size_t max_queued_bytes = 0;
+        double max_cpu_percent = 0;
+        // with a bench size, fan-out is benchmarked instead of serving
+        std::string fanout_bench_size;
+
+        for (int i = 1; i + 1 < argc; i += 2) {
+            std::string option(argv[i]);
+            std::string value(argv[i + 1]);
+            if (option == "--zerocopy-threshold")
+                zerocopy_threshold = std::atoi(value.c_str());
+            else if (option == "--fanout" && value == "copy")
+                fanout = chat_room::copy_fanout;
+            else if (option == "--fanout" && value == "splice")
+                fanout = chat_room::splice_fanout;
+            else if (option == "--fanout-budget")
+                fanout_budget_us = std::atol(value.c_str());
+            else if (option == "--fanout-threads")
+                fanout_threads = std::max(0, std::atoi(value.c_str()));
+            else if (option == "--history-log")
+                history_dir = value;
+            else if (option == "--history")
+                history_frames = std::atoi(value.c_str());
+            else if (option == "--multicast")
+                multicast_group = value;
+            else if (option == "--multicast-interface")
+                multicast_interface = value;
+            else if (option == "--viewer-port")
+                viewer_port = std::atoi(value.c_str());
+            else if (option == "--unix")
+                unix_path = value;
+            else if (option == "--shm")
+                shm_path = value;
+            else if (option == "--port")
+                port = std::atoi(value.c_str());
+            else if (option == "--node")
+                node = std::strtoull(value.c_str(), NULL, 10);
+            else if (option == "--relay-port")
+                relay_port = std::atoi(value.c_str());
+            else if (option == "--peer")
+                peers.push_back(value);
+            else if (option == "--relay-topology" && value == "any")
+                relay_topology = relay_hub::any_topology;
+            else if (option == "--relay-topology" && value == "mesh")
+                relay_topology = relay_hub::full_mesh;
+            else if (option == "--proxy-port")
+                proxy_port = std::atoi(value.c_str());
+            else if (option == "--tls-port")
+                tls_port = std::atoi(value.c_str());
+            else if (option == "--tls-cert")
+                tls_certificate = value;
+            else if (option == "--tls-key")
+                tls_key = value;
+            else if (option == "--tls-offload" && value == "kernel")
+                kernel_tls = true;
+            else if (option == "--tls-offload" && value == "user")
+                kernel_tls = false;
+            else if (option == "--handshake-threads")
+                handshake_threads = std::max(1, std::atoi(value.c_str()));
+            else if (option == "--rate")
+                floods.rate = std::atof(value.c_str());
+            else if (option == "--burst")
+                floods.burst = std::atof(value.c_str());
+            else if (option == "--room-rate")
+                floods.room_rate = std::atof(value.c_str());
+            else if (option == "--room-burst")
+                floods.room_burst = std::atof(value.c_str());
+            else if (option == "--max-backlog")
+                floods.max_backlog = std::atoi(value.c_str());
+            else if (option == "--max-session-backlog")
+                floods.max_session_backlog = std::atoi(value.c_str());
+            else if (option == "--flood-action" && value == "drop")
+                floods.excess = flood_policy::drop_excess;
+            else if (option == "--flood-action" && value == "delay")
+                floods.excess = flood_policy::delay_excess;
+            else if (option == "--flood-action" && value == "disconnect")
+                floods.excess = flood_policy::disconnect_excess;
+            else if (option == "--max-loop-lag")
+                max_lag_ms = std::atof(value.c_str());
+            else if (option == "--max-queued")
+                max_queued_bytes = std::strtoull(value.c_str(), NULL, 10);
+            else if (option == "--max-cpu")
+                max_cpu_percent = std::atof(value.c_str());
+            else if (option == "--fanout-bench")
+                fanout_bench_size = value;
+            else
+                argc = -1;
+        }
+        if (argc < 0 || argc % 2 == 0 || node == 0
+            || (tls_port != 0 && (tls_certificate.empty() || tls_key.empty()))) {
+            std::cerr << "Usage: chat_server [--port <port>] "
+                << "[--zerocopy-threshold <bytes>] "
+                << "[--fanout copy|splice] [--fanout-budget <us>] "
+                << "[--fanout-threads <n>] "
+                << "[--history-log <dir>] "
+                << "[--history <messages>] [--multicast <group>:<port>] "
+                << "[--multicast-interface <address>] [--viewer-port <port>] "
+                << "[--unix <socket path>] [--shm <socket path>] "
+                << "[--node <id>] [--relay-port <port>] "
+                << "[--peer <host>:<port>]... [--relay-topology any|mesh] "
+                << "[--proxy-port <port>] "
+                << "[--tls-port <port> --tls-cert <chain file> "
+                << "--tls-key <key file> [--handshake-threads <n>] "
+                << "[--tls-offload kernel|user]] "
+                << "[--rate <messages/s> [--burst <messages>]] "
+                << "[--room-rate <messages/s> [--room-burst <messages>]] "
+                << "[--flood-action drop|delay|disconnect] "
+                << "[--max-backlog <frames>] "
+                << "[--max-session-backlog <frames>] "
+                << "[--max-loop-lag <ms>] [--max-queued <bytes>] "
+                << "[--max-cpu <percent>]" << std::endl;
+            std::cerr << "       chat_server --fanout-bench <members>:<messages> "
+                << "[--fanout-threads <max>] [--fanout-budget <us>]" << std::endl;
+            return 1;
+        }
+
+        if (!fanout_bench_size.empty()) {
+            std::size_t colon = fanout_bench_size.find(':');
+            std::size_t members = std::atoi(fanout_bench_size.c_str());
+            std::size_t messages = colon == std::string::npos ? 100
+                : std::atoi(fanout_bench_size.substr(colon + 1).c_str());
+            if (fanout_threads == 0)
+                fanout_threads = std::max(1u, std::thread::hardware_concurrency());
+            fanout_bench(members, std::max<std::size_t>(messages, 1),
+                fanout_threads, std::chrono::microseconds(fanout_budget_us));
+            return 0;
+        }
+
+        tcp::endpoint endpoint(tcp::v4(), port);
+        chat_server_ptr server(new chat_server(io_context, endpoint, 
+            zerocopy_threshold, fanout_threads, floods));
+        server->fanout_budget(std::chrono::microseconds(fanout_budget_us));
+        if (!server->room().fanout(fanout))
+            std::cerr << "splice fan-out is not available, copying" << std::endl;
+        if (!history_dir.empty() 
+            && !server->room().log_history(history_dir, history_frames)) {
+            std::cerr << "can't open the history log in " << history_dir 
+                << std::endl;
+            return 1;
+        }
+        std::unique_ptr<admission_control> admission;
+        if (max_lag_ms > 0 || max_queued_bytes > 0 || max_cpu_percent > 0) {
+            admission.reset(new admission_control(io_context, max_lag_ms,
+                max_queued_bytes, max_cpu_percent));
+            server->control_admission(*admission);
+        }
+        if (!unix_path.empty())
+            server->listen_local(unix_path);
+        std::unique_ptr<shm_server> shm;
+        if (!shm_path.empty())
+            shm.reset(new shm_server(io_context, shm_path, server->room()));
+        std::unique_ptr<proxy_server> proxies;
+        if (proxy_port != 0)
+            proxies.reset(new proxy_server(io_context, 
+                tcp::endpoint(tcp::v4(), proxy_port), server->room()));
+        std::unique_ptr<tls_server> tls_clients;
+        if (tls_port != 0)
+            tls_clients.reset(new tls_server(io_context,
+                tcp::endpoint(tcp::v4(), tls_port), server->room(),
+                tls_certificate, tls_key, handshake_threads, kernel_tls));
+        if (tls_clients && admission)
+            tls_clients->control_admission(*admission);
+
+        if (relay_port != 0 || !peers.empty()) {
+            relay_hub& relay = server->room().federate(io_context, node);
+            relay.topology(relay_topology);
+            if (relay_port != 0)
+                relay.listen(tcp::endpoint(tcp::v4(), relay_port));
+            tcp::resolver resolver(io_context);
+            for (auto& peer : peers) {
+                std::size_t colon = peer.rfind(':');
+                relay.connect(*resolver.resolve(peer.substr(0, colon), 
+                    peer.substr(colon + 1)).begin());
+            }
+            std::cout << "node " << node << std::endl;
+        }
+
+        std::unique_ptr<viewer_server> viewers;
+        if (!multicast_group.empty()) {
+            std::size_t colon = multicast_group.rfind(':');
+            udp::endpoint group(
+                asio::ip::make_address(multicast_group.substr(0, colon)),
+                std::atoi(multicast_group.substr(colon + 1).c_str()));
+            asio::ip::address interface;
+            if (!multicast_interface.empty())
+                interface = asio::ip::make_address(multicast_interface);
+            server->room().multicast(io_context, group, interface);
+            viewers.reset(new viewer_server(io_context, 
+                tcp::endpoint(tcp::v4(), viewer_port), 
+                *server->room().publisher()));
+        }
+
+        // a socket closed under splice() raises SIGPIPE instead of failing
+        signal(SIGPIPE, SIG_IGN);
+        asio::signal_set signals(io_context, SIGUSR1);
+        wait_for_stats_signal(signals);
+
+        // stop cleanly so that exit-time work (e.g. trace dumps) can run
+        asio::signal_set stop_signals(io_context, SIGINT, SIGTERM);
+        stop_signals.async_wait([&io_context](const std::error_code&, int) {
+            io_context.stop();
+        });
+
         io_context.run();
     } catch (std::exception &e) {
         std::cerr << e.what() << std::endl;
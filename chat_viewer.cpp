@@ -0,0 +1,325 @@
+// chat_viewer.cpp : read-only chat room viewer over multicast
+
+//#define DEBUG
+
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <string>
+#include "chat_message.hpp"
+#include "multicast_record.hpp"
+
+#include "asio.hpp"
+using asio::ip::tcp;
+using asio::ip::udp;
+
+// receives the room messages from the multicast group and prints them in
+// sequence order. Missing messages are requested over the TCP connection to
+// the server's viewer port, which also tells us where the sequence starts
+class chat_viewer {
+public:
+    enum { history = 100 };
+
+    chat_viewer(asio::io_context& io_context,
+        tcp::resolver::results_type& endpoints,
+        const char* id,
+        const udp::endpoint& group,
+        const asio::ip::address& interface,
+        unsigned drop_every) :
+        socket_(io_context),
+        group_socket_(io_context),
+        expected_(0),
+        request_from_(0),
+        started_(false),
+        drop_every_(drop_every),
+        datagrams_(0),
+        printed_(0),
+        recovered_(0),
+        lost_(0) {
+
+        #ifdef DEBUG
+        std::cout << __FUNCTION__ << std::endl;
+        #endif
+
+        std::memcpy(id_, id, chat_message::id_length);
+
+        // several viewers on one host can share the group's port
+        udp::endpoint listen_endpoint(
+            group.address().is_v4() ? udp::endpoint(udp::v4(), group.port())
+                : udp::endpoint(udp::v6(), group.port()));
+        group_socket_.open(listen_endpoint.protocol());
+        group_socket_.set_option(udp::socket::reuse_address(true));
+        group_socket_.bind(listen_endpoint);
+        if (interface.is_v4() && group.address().is_v4())
+            group_socket_.set_option(asio::ip::multicast::join_group(
+                group.address().to_v4(), interface.to_v4()));
+        else
+            group_socket_.set_option(
+                asio::ip::multicast::join_group(group.address()));
+
+        do_connect(endpoints);
+    }
+
+    void print_stats() const {
+        std::cerr << "printed " << printed_ << ", recovered " << recovered_
+            << ", lost " << lost_ << ", next " << expected_ << std::endl;
+    }
+
+private:
+    tcp::socket socket_;
+    udp::socket group_socket_;
+    udp::endpoint sender_;
+    multicast_record datagram_;
+    multicast_record reply_;
+    std::deque<std::string> write_bufs_;
+    // records that arrived ahead of expected_
+    std::map<std::uint64_t, multicast_record> pending_;
+    // the next message to print
+    std::uint64_t expected_;
+    // everything before this has been received or requested
+    std::uint64_t request_from_;
+    bool started_;
+    unsigned drop_every_;
+    std::uint64_t datagrams_;
+    std::uint64_t printed_;
+    std::uint64_t recovered_;
+    std::uint64_t lost_;
+    char id_[chat_message::id_length + 1];
+
+    void do_connect(const tcp::resolver::results_type& endpoints) {
+        #ifdef DEBUG
+        std::cout << __FUNCTION__ << std::endl;
+        #endif
+
+        asio::async_connect(socket_, endpoints,
+            [this](std::error_code error, tcp::endpoint) {
+                if (!error) {
+                    socket_.set_option(tcp::no_delay(true));
+                    send_id();
+                }
+            });
+    }
+
+    void send_id() {
+        #ifdef DEBUG
+        std::cout << __FUNCTION__ << std::endl;
+        #endif
+
+        asio::async_write(socket_,
+            asio::buffer(id_, chat_message::id_length),
+            [this](std::error_code error, std::size_t /*length*/) {
+                if (!error)
+                    read_hello();
+            });
+    }
+
+    // the server answers with the next sequence number; start with the
+    // recent history before it, and listen to the group from there on
+    void read_hello() {
+        asio::async_read(socket_,
+            asio::buffer(reply_.data(), multicast_record::seq_length),
+            [this](std::error_code error, std::size_t /*length*/) {
+                if (error || !reply_.decode(multicast_record::seq_length)) {
+                    socket_.close();
+                    return;
+                }
+
+                std::uint64_t next = reply_.seq();
+                expected_ = next > history ? next - history : 0;
+                request_from_ = expected_;
+                started_ = true;
+                request(next);
+                do_read_record();
+                do_receive();
+            });
+    }
+
+    void do_receive() {
+        group_socket_.async_receive_from(
+            asio::buffer(datagram_.data(), multicast_record::max_length),
+            sender_,
+            [this](std::error_code error, std::size_t length) {
+                if (error)
+                    return;
+
+                if (started_ && datagram_.decode(length)) {
+                    if (!datagram_.has_frame())
+                        request(datagram_.seq());
+                    else if (drop_every_ == 0 || ++datagrams_ % drop_every_ != 0)
+                        accept(datagram_, false);
+                    // else: simulated loss of a message, to exercise the
+                    // recovery path
+                }
+                do_receive();
+            });
+    }
+
+    // records read from the TCP connection in answer to our requests
+    void do_read_record() {
+        std::size_t prefix = multicast_record::seq_length
+            + chat_message::header_length;
+        asio::async_read(socket_,
+            asio::buffer(reply_.data(), prefix),
+            [this, prefix](std::error_code error, std::size_t /*length*/) {
+                if (error) {
+                    socket_.close();
+                    return;
+                }
+
+                std::size_t length = multicast_record::seq_length
+                    + reply_.frame_length();
+                asio::async_read(socket_,
+                    asio::buffer(reply_.data() + prefix, length - prefix),
+                    [this, length](std::error_code error, std::size_t) {
+                        if (error || !reply_.decode(length)) {
+                            socket_.close();
+                            return;
+                        }
+                        if (reply_.has_frame())
+                            accept(reply_, true);
+                        else
+                            skip_lost(reply_.seq());
+                        do_read_record();
+                    });
+            });
+    }
+
+    // ask for everything from request_from_ up to (not including) seq
+    void request(std::uint64_t seq) {
+        if (seq <= request_from_)
+            return;
+
+        std::string data(multicast_record::request_length, '\0');
+        multicast_record::encode_seq(&data[0], request_from_);
+        multicast_record::encode_seq(&data[multicast_record::seq_length], seq - 1);
+        request_from_ = seq;
+
+        bool write_in_progress = !write_bufs_.empty();
+        write_bufs_.push_back(data);
+        if (!write_in_progress)
+            do_write();
+    }
+
+    void do_write() {
+        asio::async_write(socket_,
+            asio::buffer(write_bufs_.front()),
+            [this](std::error_code error, std::size_t /*length*/) {
+                if (!error) {
+                    write_bufs_.pop_front();
+                    if (!write_bufs_.empty())
+                        do_write();
+                } else {
+                    socket_.close();
+                }
+            });
+    }
+
+    void accept(const multicast_record& record, bool recovered) {
+        std::uint64_t seq = record.seq();
+        if (seq < expected_ || pending_.count(seq))
+            return;
+
+        // anything between what we have and this one is missing
+        request(seq);
+        if (request_from_ <= seq)
+            request_from_ = seq + 1;
+
+        if (recovered)
+            ++recovered_;
+        if (seq != expected_) {
+            pending_[seq] = record;
+            return;
+        }
+
+        print(record);
+        ++expected_;
+        flush_pending();
+    }
+
+    // the server no longer has the messages up to and including seq
+    void skip_lost(std::uint64_t seq) {
+        while (expected_ <= seq) {
+            auto next = pending_.begin();
+            if (next == pending_.end() || next->first > seq) {
+                lost_ += seq + 1 - expected_;
+                expected_ = seq + 1;
+                break;
+            }
+            lost_ += next->first - expected_;
+            print(next->second);
+            expected_ = next->first + 1;
+            pending_.erase(next);
+        }
+        flush_pending();
+    }
+
+    void flush_pending() {
+        auto next = pending_.begin();
+        while (next != pending_.end() && next->first == expected_) {
+            print(next->second);
+            ++expected_;
+            next = pending_.erase(next);
+        }
+    }
+
+    void print(const multicast_record& record) {
+        chat_message msg = record.message();
+        std::cout.write(msg.id(), chat_message::id_length);
+        std::cout << " says: ";
+        std::cout.write(msg.msg(), msg.body_length() - chat_message::id_length);
+        std::cout << "\n";
+        ++printed_;
+    }
+};
+
+int main(int argc, char* argv[]) {
+    if (argc != 5 && argc != 6 && argc != 7) {
+        std::cerr << "Usage: chat_viewer <host> <viewer port> <userid> "
+            << "<group>:<port> [<interface> [<drop every>]]" << std::endl;
+        std::cerr << "  e.g. chat_viewer 127.0.0.1 1001 carol "
+            << "239.255.0.1:30001 127.0.0.1" << std::endl;
+        return 1;
+    }
+
+    if (std::strlen(argv[3]) > chat_message::id_length) {
+        std::cerr << "Error: userid's length exceeds " << chat_message::id_length << std::endl;
+        return 1;
+    }
+
+    char id[chat_message::id_length + 1] = "";
+    std::memcpy(id, argv[3], std::strlen(argv[3]));
+
+    try {
+        asio::io_context io_context;
+        tcp::resolver resolver(io_context);
+        auto endpoints = resolver.resolve(argv[1], argv[2]);
+
+        std::string group(argv[4]);
+        std::size_t colon = group.rfind(':');
+        udp::endpoint group_endpoint(
+            asio::ip::make_address(group.substr(0, colon)),
+            std::atoi(group.substr(colon + 1).c_str()));
+        asio::ip::address interface;
+        if (argc > 5)
+            interface = asio::ip::make_address(argv[5]);
+        unsigned drop_every = argc > 6 ? std::atoi(argv[6]) : 0;
+
+        chat_viewer viewer(io_context, endpoints, id, group_endpoint,
+            interface, drop_every);
+
+        asio::signal_set signals(io_context, SIGINT, SIGTERM);
+        signals.async_wait([&io_context](const std::error_code&, int) {
+            io_context.stop();
+        });
+
+        io_context.run();
+        std::cout.flush();
+        viewer.print_stats();
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+    }
+
+    return 0;
+}
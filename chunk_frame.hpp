@@ -0,0 +1,179 @@
+#ifndef CHUNK_FRAME_HPP
+#define CHUNK_FRAME_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "chat_message.hpp"
+
+// chunk_frame: a payload too large for one message, sent as a transfer
+//
+// A transfer is a series of ordinary frames whose text starts with a chunk
+// prefix and goes on with the next piece of the payload:
+//
+//   kttttttttoooooooollllllll....
+//   k: chunk_kind
+//   tttttttt: the transfer, numbered by its sender, 8 hex digits
+//   oooooooo: the offset of the piece in the payload, 8 hex digits
+//   llllllll: the length of the whole payload, 8 hex digits
+//
+// The pieces of a transfer go in order, but other messages and the chunks
+// of other transfers can come in between, so one large payload doesn't
+// hold up everything sent after it.
+//
+// Each transfer has window bytes of credit. The sender spends it on every
+// chunk and the server gives it back, with a credit frame
+//
+//   kttttttttcccccccc
+//   k: credit_kind
+//   cccccccc: the bytes of payload given back, 8 hex digits
+//
+// once the chunk has been written to everyone it went to, so a transfer can
+// only ever hold window bytes in the server's queues. All the transfers of
+// one sender together hold at most sender_window bytes; the server hangs up
+// on a sender that goes over either.
+//
+// Text starting with either kind is reserved for these frames.
+
+class chunk_frame {
+
+public :
+    enum kind { chunk_kind = '\x1c', credit_kind = '\x1d' };
+    enum { field_length = 8 };
+    enum { chunk_prefix_length = 1 + 3 * field_length };
+    enum { credit_length = 1 + 2 * field_length };
+    enum { max_data = chat_message::max_body_length - chat_message::id_length
+        - chunk_prefix_length };
+    enum { window = 128 * 1024 };
+    enum { sender_window = 4 * window };
+    // the largest payload a receiver puts back together
+    enum { max_payload = 64 * 1024 * 1024 };
+
+    chunk_frame() :
+        kind_(chunk_kind),
+        transfer_(0),
+        offset_(0),
+        total_(0),
+        data_(nullptr),
+        length_(0) {
+    }
+
+    static bool is_chunk(const chat_message& msg) {
+        return msg.body_length() > chat_message::id_length
+            && msg.msg()[0] == chunk_kind;
+    }
+
+    static bool is_credit(const chat_message& msg) {
+        return msg.body_length() > chat_message::id_length
+            && msg.msg()[0] == credit_kind;
+    }
+
+    static void encode_chunk(chat_message& msg, const char* id,
+        std::uint32_t transfer, std::uint32_t offset, std::uint32_t total,
+        const char* data, std::size_t length) {
+        msg.body_length(chat_message::id_length + chunk_prefix_length + length);
+        std::memcpy(msg.id(), id, chat_message::id_length);
+        char* text = msg.msg();
+        text[0] = chunk_kind;
+        encode_field(text + 1, transfer);
+        encode_field(text + 1 + field_length, offset);
+        encode_field(text + 1 + 2 * field_length, total);
+        std::memcpy(text + chunk_prefix_length, data, length);
+        msg.encode_header();
+    }
+
+    static void encode_credit(chat_message& msg, const char* id,
+        std::uint32_t transfer, std::uint32_t length) {
+        msg.body_length(chat_message::id_length + credit_length);
+        std::memcpy(msg.id(), id, chat_message::id_length);
+        char* text = msg.msg();
+        text[0] = credit_kind;
+        encode_field(text + 1, transfer);
+        encode_field(text + 1 + field_length, length);
+        msg.encode_header();
+    }
+
+    // parse a chunk or credit frame; false if msg is neither, or malformed.
+    // data() points into msg
+    bool decode(const chat_message& msg) {
+        if (msg.body_length() <= chat_message::id_length)
+            return false;
+        std::size_t text_length = msg.body_length() - chat_message::id_length;
+        const char* text = msg.msg();
+        if (text[0] == chunk_kind) {
+            if (text_length < chunk_prefix_length
+                || !decode_field(text + 1, transfer_)
+                || !decode_field(text + 1 + field_length, offset_)
+                || !decode_field(text + 1 + 2 * field_length, total_))
+                return false;
+            length_ = text_length - chunk_prefix_length;
+            if (offset_ > total_ || length_ > total_ - offset_)
+                return false;
+            data_ = text + chunk_prefix_length;
+        } else if (text[0] == credit_kind) {
+            std::uint32_t length;
+            if (text_length != credit_length
+                || !decode_field(text + 1, transfer_)
+                || !decode_field(text + 1 + field_length, length))
+                return false;
+            offset_ = total_ = 0;
+            data_ = nullptr;
+            length_ = length;
+        } else {
+            return false;
+        }
+        kind_ = static_cast<kind>(text[0]);
+        return true;
+    }
+
+    kind type() const {
+        return kind_;
+    }
+
+    std::uint32_t transfer() const {
+        return transfer_;
+    }
+
+    std::uint32_t offset() const {
+        return offset_;
+    }
+
+    std::uint32_t total() const {
+        return total_;
+    }
+
+    // the piece of payload of a chunk
+    const char* data() const {
+        return data_;
+    }
+
+    // the length of the piece, or the bytes given back by a credit
+    std::size_t length() const {
+        return length_;
+    }
+
+private:
+    static void encode_field(char* data, std::uint32_t value) {
+        char text[field_length + 1];
+        std::snprintf(text, sizeof(text), "%08x", static_cast<unsigned>(value));
+        std::memcpy(data, text, field_length);
+    }
+
+    static bool decode_field(const char* data, std::uint32_t& value) {
+        char text[field_length + 1] = "";
+        std::strncat(text, data, field_length);
+        char* end = nullptr;
+        value = static_cast<std::uint32_t>(std::strtoul(text, &end, 16));
+        return end == text + field_length;
+    }
+
+    kind kind_;
+    std::uint32_t transfer_;
+    std::uint32_t offset_;
+    std::uint32_t total_;
+    const char* data_;
+    std::size_t length_;
+};
+
+#endif
@@ -0,0 +1,290 @@
+// direct_bench.cpp: one-to-one messages through a running chat_server, as
+// direct messages and as broadcasts filtered by the clients
+//
+// Connects <users> participants, then sends <messages> messages, each from
+// a random user to another random user, with at most <window> of them on
+// their way at once; a message is on its way until its recipient has read
+// it. It is done twice: with direct messages (see direct_frame.hpp), which
+// the server routes to the recipient alone, and by broadcasting each message
+// with the recipient's id in front, for every client to read and all but
+// one to throw away. The frames all the clients read show what each costs.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include "bench_clock.hpp"
+#include "chat_message.hpp"
+#include "direct_frame.hpp"
+
+#include "asio.hpp"
+using asio::ip::tcp;
+
+std::string make_id(const std::string& id) {
+    std::string padded = id;
+    padded.resize(chat_message::id_length, '\0');
+    return padded;
+}
+
+// one participant, which counts the frames it reads and tells the bench
+// when a message for it arrives, and when the room has settled: when it has
+// read the join notice of the last user to join
+class user {
+public:
+    user(asio::io_context& io_context, const tcp::endpoint& endpoint,
+        const std::string& id, const std::string& last_notice,
+        std::function<void()> settled, std::function<void()> received) :
+        socket_(io_context),
+        id_(make_id(id)),
+        last_notice_(last_notice),
+        settled_(settled),
+        received_(received),
+        frames_(0),
+        writing_(false) {
+        socket_.connect(endpoint);
+        socket_.set_option(tcp::no_delay(true));
+        asio::write(socket_, asio::buffer(id_));
+        read_header();
+    }
+
+    const std::string& id() const {
+        return id_;
+    }
+
+    unsigned long long frames() const {
+        return frames_;
+    }
+
+    void send_direct(const std::string& to, const std::string& text) {
+        chat_message msg;
+        direct_frame::encode(msg, id_.data(), to.data(), text.data(), text.size());
+        send(msg);
+    }
+
+    // the recipient's id, then the text
+    void send_broadcast(const std::string& to, const std::string& text) {
+        chat_message msg;
+        msg.body_length(2 * chat_message::id_length + text.size());
+        std::memcpy(msg.id(), id_.data(), chat_message::id_length);
+        std::memcpy(msg.msg(), to.data(), chat_message::id_length);
+        std::memcpy(msg.msg() + chat_message::id_length, text.data(), text.size());
+        msg.encode_header();
+        send(msg);
+    }
+
+    void stop() {
+        std::error_code ignored;
+        socket_.close(ignored);
+    }
+
+private:
+    void send(const chat_message& msg) {
+        write_msgs_.push_back(msg);
+        if (!writing_)
+            write_next();
+    }
+
+    void write_next() {
+        writing_ = true;
+        asio::async_write(socket_,
+            asio::buffer(write_msgs_.front().data(), write_msgs_.front().length()),
+            [this](const std::error_code& error, std::size_t) {
+                write_msgs_.pop_front();
+                writing_ = false;
+                if (!error && !write_msgs_.empty())
+                    write_next();
+            });
+    }
+
+    void read_header() {
+        asio::async_read(socket_,
+            asio::buffer(in_.data(), chat_message::header_length),
+            [this](const std::error_code& error, std::size_t) {
+                if (error || !in_.decode_header())
+                    return;
+                asio::async_read(socket_,
+                    asio::buffer(in_.body(), in_.body_length()),
+                    [this](const std::error_code& error, std::size_t) {
+                        if (error)
+                            return;
+                        ++frames_;
+                        if (for_me())
+                            received_();
+                        else if (is_last_notice())
+                            settled_();
+                        read_header();
+                    });
+            });
+    }
+
+    bool is_last_notice() const {
+        return std::strncmp(in_.id(), "Admin", chat_message::id_length) == 0
+            && in_.body_length() == chat_message::id_length + last_notice_.size()
+            && std::memcmp(in_.msg(), last_notice_.data(), last_notice_.size()) == 0;
+    }
+
+    bool for_me() const {
+        if (direct_frame::is_direct(in_))
+            return true;
+        return std::strncmp(in_.id(), "Admin", chat_message::id_length) != 0
+            && in_.body_length() >= 2 * chat_message::id_length
+            && std::memcmp(in_.msg(), id_.data(), chat_message::id_length) == 0;
+    }
+
+    tcp::socket socket_;
+    std::string id_;
+    std::string last_notice_;
+    std::function<void()> settled_;
+    std::function<void()> received_;
+    unsigned long long frames_;
+    chat_message in_;
+    std::deque<chat_message> write_msgs_;
+    bool writing_;
+};
+
+class run {
+public:
+    run(std::vector<std::unique_ptr<user> >& users, std::size_t messages,
+        std::size_t window, bool direct, std::function<void()> finished) :
+        users_(users),
+        messages_(messages),
+        window_(window),
+        direct_(direct),
+        sent_(0),
+        received_(0),
+        frames_(0),
+        start_(0),
+        random_(messages),
+        finished_(finished) {
+    }
+
+    void start() {
+        frames_ = frames();
+        start_ = wall_seconds();
+        while (sent_ < messages_ && sent_ - received_ < window_)
+            send();
+    }
+
+    void received() {
+        if (++received_ == messages_) {
+            report();
+            finished_();
+            return;
+        }
+        if (sent_ < messages_)
+            send();
+    }
+
+private:
+    void send() {
+        std::size_t from = random_() % users_.size();
+        std::size_t to = (from + 1 + random_() % (users_.size() - 1)) % users_.size();
+        std::string text = "message " + std::to_string(sent_++);
+        if (direct_)
+            users_[from]->send_direct(users_[to]->id(), text);
+        else
+            users_[from]->send_broadcast(users_[to]->id(), text);
+    }
+
+    unsigned long long frames() const {
+        unsigned long long total = 0;
+        for (auto& u : users_)
+            total += u->frames();
+        return total;
+    }
+
+    void report() const {
+        double wall = wall_seconds() - start_;
+        unsigned long long frames = this->frames() - frames_;
+        std::printf("%s: %zu messages in %.2f s, %.0f messages/s, "
+            "%.1f frames read per message\n",
+            direct_ ? "direct" : "broadcast and filter", messages_, wall,
+            messages_ / wall, static_cast<double>(frames) / messages_);
+        std::fflush(stdout);
+    }
+
+    std::vector<std::unique_ptr<user> >& users_;
+    std::size_t messages_;
+    std::size_t window_;
+    bool direct_;
+    std::size_t sent_;
+    std::size_t received_;
+    unsigned long long frames_;
+    double start_;
+    std::mt19937 random_;
+    std::function<void()> finished_;
+};
+
+int main(int argc, char* argv[]) {
+    if (argc < 5 || argc > 6) {
+        std::cerr << "Usage: direct_bench <host> <port> <users> <messages> "
+            << "[<window>]" << std::endl;
+        return 1;
+    }
+
+    std::size_t users = std::atoi(argv[3]);
+    std::size_t messages = std::atoi(argv[4]);
+    std::size_t window = argc == 6 ? std::atoi(argv[5]) : 100;
+    if (users < 2 || messages < 1 || window < 1) {
+        std::cerr << "need at least 2 users, 1 message and a window of 1"
+            << std::endl;
+        return 1;
+    }
+
+    // a socket per user
+    rlimit files;
+    getrlimit(RLIMIT_NOFILE, &files);
+    files.rlim_cur = files.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &files);
+
+    try {
+        asio::io_context io_context;
+        tcp::resolver resolver(io_context);
+        tcp::endpoint endpoint = *resolver.resolve(argv[1], argv[2]).begin();
+
+        // direct messages first, then broadcasts, once everyone has joined.
+        // Sessions on different fan-out threads may be announced out of
+        // order, so the last few notices get a moment longer
+        run* current = nullptr;
+        asio::steady_timer settle(io_context);
+        std::size_t settled = 0;
+        std::string last_notice = "d" + std::to_string(users - 1) + " joined the chat";
+        std::vector<std::unique_ptr<user> > room;
+        for (std::size_t i = 0; i < users; ++i)
+            room.emplace_back(new user(io_context, endpoint,
+                "d" + std::to_string(i), last_notice,
+                [&]() {
+                    if (++settled < users)
+                        return;
+                    settle.expires_after(std::chrono::milliseconds(500));
+                    settle.async_wait([&current](const std::error_code&) {
+                        current->start();
+                    });
+                },
+                [&current]() { current->received(); }));
+
+        run broadcasts(room, messages, window, false, [&room]() {
+            for (auto& u : room)
+                u->stop();
+        });
+        run directs(room, messages, window, true, [&]() {
+            current = &broadcasts;
+            broadcasts.start();
+        });
+        current = &directs;
+        io_context.run();
+    } catch (std::exception& e) {
+        std::cerr << "Exception: " << e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
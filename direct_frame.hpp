@@ -0,0 +1,60 @@
+#ifndef DIRECT_FRAME_HPP
+#define DIRECT_FRAME_HPP
+
+#include <cstring>
+#include "chat_message.hpp"
+
+// direct_frame: a message for one user rather than for the whole room
+//
+// A direct message is an ordinary frame from its sender whose text is
+//
+//   krrrrrrrr....
+//   k: direct_kind
+//   rrrrrrrr: the id of the user it is for, 8 chars like any id
+//   ....: the message
+//
+// The server looks the user up by id and passes the frame on as it is, to
+// every session the user has; it isn't kept as history. Text starting with
+// direct_kind is reserved for this frame.
+
+class direct_frame {
+
+public :
+    enum { direct_kind = '\x1f' };
+    enum { prefix_length = 1 + chat_message::id_length };
+    enum { max_text = chat_message::max_body_length - chat_message::id_length
+        - prefix_length };
+
+    static bool is_direct(const chat_message& msg) {
+        return msg.body_length() >= chat_message::id_length + prefix_length
+            && msg.msg()[0] == direct_kind;
+    }
+
+    // text is cut to max_text
+    static void encode(chat_message& msg, const char* id, const char* recipient,
+        const char* text, std::size_t length) {
+        if (length > max_text)
+            length = max_text;
+        msg.body_length(chat_message::id_length + prefix_length + length);
+        std::memcpy(msg.id(), id, chat_message::id_length);
+        msg.msg()[0] = direct_kind;
+        std::memcpy(msg.msg() + 1, recipient, chat_message::id_length);
+        std::memcpy(msg.msg() + prefix_length, text, length);
+        msg.encode_header();
+    }
+
+    // the id of the user a direct message is for, not NUL terminated
+    static const char* recipient(const chat_message& msg) {
+        return msg.msg() + 1;
+    }
+
+    static const char* text(const chat_message& msg) {
+        return msg.msg() + prefix_length;
+    }
+
+    static std::size_t text_length(const chat_message& msg) {
+        return msg.body_length() - chat_message::id_length - prefix_length;
+    }
+};
+
+#endif
@@ -0,0 +1,176 @@
+// fanout_bench.cpp: cost of fanning one frame out to many sockets
+//
+// Opens <recipients> loopback TCP connections and sends the same frame to all
+// of them, <rounds> times, either with one send() per recipient (what the
+// copy fan-out ends up doing) or through a frame_pipe (the splice fan-out).
+// The receiving ends are drained between rounds, outside the timed part.
+// The connections are TCP, or unix domain socket pairs with `unix`.
+//
+// Every connection takes two descriptors, so large runs need a matching
+// `ulimit -n`, e.g. 100000 descriptors for 50000 recipients.
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include <sys/socket.h>
+#include "bench_clock.hpp"
+#include "frame_pipe.hpp"
+
+#include "asio.hpp"
+using asio::ip::tcp;
+
+struct result {
+    result() : wall(0), cpu(0), bytes(0), short_sends(0) {
+    }
+
+    double wall;
+    double cpu;
+    std::size_t bytes;
+    std::size_t short_sends;
+};
+
+template <typename Socket>
+void fanout_copy(const std::vector<char>& frame,
+    std::vector<Socket>& senders, result& r) {
+    for (auto& socket : senders) {
+        ssize_t n = ::send(socket.native_handle(), frame.data(), frame.size(),
+            MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n > 0)
+            r.bytes += n;
+        if (n != static_cast<ssize_t>(frame.size()))
+            ++r.short_sends;
+    }
+}
+
+template <typename Socket>
+void fanout_splice(const std::vector<char>& frame, frame_pipe& pipe,
+    std::vector<Socket>& senders, result& r) {
+    std::vector<char> rest;
+    pipe.load(frame.data(), frame.size());
+    for (auto& socket : senders) {
+        rest.clear();
+        if (!pipe.send_to(socket.native_handle(), rest)) {
+            ++r.short_sends;
+            continue;
+        }
+        r.bytes += frame.size() - rest.size();
+        if (!rest.empty())
+            ++r.short_sends;
+    }
+    pipe.clear();
+}
+
+template <typename Socket>
+void drain(std::vector<Socket>& receivers) {
+    static char buf[65536];
+    for (auto& socket : receivers)
+        while (::recv(socket.native_handle(), buf, sizeof(buf), MSG_DONTWAIT) > 0)
+            ;
+}
+
+void report(const char* name, const result& r, std::size_t sends) {
+    std::printf("%-7s %10.1f ns/send %10.1f cpu-ns/send %8.3f GB/s"
+        " %zu short sends\n", name, r.wall * 1e9 / sends, r.cpu * 1e9 / sends,
+        r.bytes / r.wall / 1e9, r.short_sends);
+}
+
+// spread the connections over several source addresses so that a large run
+// doesn't exhaust the ephemeral ports of one address
+void connect(asio::io_context& io_context, std::size_t recipients,
+    std::vector<tcp::socket>& receivers, std::vector<tcp::socket>& senders) {
+    tcp::acceptor acceptor(io_context,
+        tcp::endpoint(asio::ip::address_v4::loopback(), 0));
+    tcp::endpoint server = acceptor.local_endpoint();
+    for (std::size_t i = 0; i < recipients; ++i) {
+        asio::ip::address_v4::bytes_type source = {{ 127, 0, 0,
+            static_cast<unsigned char>(2 + i / 20000) }};
+        receivers.emplace_back(io_context);
+        receivers.back().open(tcp::v4());
+        receivers.back().bind(tcp::endpoint(asio::ip::address_v4(source), 0));
+        receivers.back().connect(server);
+        senders.emplace_back(acceptor.accept());
+        senders.back().set_option(tcp::no_delay(true));
+        senders.back().non_blocking(true);
+    }
+}
+
+void connect(asio::io_context& io_context, std::size_t recipients,
+    std::vector<asio::local::stream_protocol::socket>& receivers,
+    std::vector<asio::local::stream_protocol::socket>& senders) {
+    for (std::size_t i = 0; i < recipients; ++i) {
+        receivers.emplace_back(io_context);
+        senders.emplace_back(io_context);
+        asio::local::connect_pair(receivers.back(), senders.back());
+        senders.back().non_blocking(true);
+    }
+}
+
+template <typename Protocol>
+void run(frame_pipe& pipe, std::size_t recipients, std::size_t rounds,
+    std::size_t frame_bytes, const char* transport) {
+    asio::io_context io_context;
+    std::vector<typename Protocol::socket> receivers, senders;
+    receivers.reserve(recipients);
+    senders.reserve(recipients);
+    connect(io_context, recipients, receivers, senders);
+
+    std::vector<char> frame(frame_bytes, 'f');
+    result copy, splice;
+
+    // alternate the two strategies so both see the same conditions
+    for (std::size_t i = 0; i < rounds; ++i) {
+        for (int strategy = 0; strategy < 2; ++strategy) {
+            result& r = strategy == 0 ? copy : splice;
+            double wall = wall_seconds();
+            double cpu = cpu_seconds();
+            if (strategy == 0)
+                fanout_copy(frame, senders, r);
+            else
+                fanout_splice(frame, pipe, senders, r);
+            r.wall += wall_seconds() - wall;
+            r.cpu += cpu_seconds() - cpu;
+            drain(receivers);
+        }
+    }
+
+    std::printf("%zu %s recipients, %zu rounds, %zu byte frames\n",
+        recipients, transport, rounds, frame_bytes);
+    report("copy", copy, recipients * rounds);
+    report("splice", splice, recipients * rounds);
+}
+
+int main(int argc, char* argv[]) {
+    if ((argc != 4 && argc != 5) || (argc == 5
+        && std::strcmp(argv[4], "tcp") != 0 && std::strcmp(argv[4], "unix") != 0)) {
+        std::cerr << "Usage: fanout_bench <recipients> <rounds> <frame bytes> "
+            << "[tcp|unix]" << std::endl;
+        return 1;
+    }
+
+    std::size_t recipients = std::atoi(argv[1]);
+    std::size_t rounds = std::atoi(argv[2]);
+    std::size_t frame_bytes = std::atoi(argv[3]);
+    bool local = argc == 5 && std::strcmp(argv[4], "unix") == 0;
+
+    frame_pipe pipe;
+    if (!pipe.is_open()) {
+        std::cerr << "frame_pipe is not available" << std::endl;
+        return 1;
+    }
+
+    try {
+        if (local)
+            run<asio::local::stream_protocol>(pipe, recipients, rounds,
+                frame_bytes, "unix");
+        else
+            run<tcp>(pipe, recipients, rounds, frame_bytes, "tcp");
+    } catch (std::exception& e) {
+        std::cerr << "Exception: " << e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
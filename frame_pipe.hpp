@@ -0,0 +1,132 @@
+#ifndef FRAME_PIPE_HPP
+#define FRAME_PIPE_HPP
+
+#include <cerrno>
+#include <cstddef>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+// frame_pipe: kernel-side fan-out of one encoded frame
+//
+// The frame is written into a source pipe once. For every recipient it is
+// tee()'d into a scratch pipe (which only takes page references) and then
+// splice()'d from there to the recipient's socket, so the payload is not
+// copied out of user space again per recipient. Whatever a full socket won't
+// take is read back from the scratch pipe so the caller can queue it.
+//
+// Only available on Linux. Sockets passed to send_to() must be non-blocking,
+// and SIGPIPE should be ignored since splice() can raise it.
+
+class frame_pipe {
+
+public :
+    frame_pipe() : null_fd_(-1), length_(0) {
+        source_[0] = source_[1] = -1;
+        scratch_[0] = scratch_[1] = -1;
+        #if defined(__linux__)
+        if (pipe2(source_, O_NONBLOCK | O_CLOEXEC) != 0
+            || pipe2(scratch_, O_NONBLOCK | O_CLOEXEC) != 0
+            || (null_fd_ = open("/dev/null", O_WRONLY | O_CLOEXEC)) < 0)
+            close_all();
+        #endif
+    }
+
+    ~frame_pipe() {
+        close_all();
+    }
+
+    bool is_open() const {
+        return null_fd_ >= 0;
+    }
+
+    // copy a frame into the source pipe, replacing the previous one
+    bool load(const char* data, std::size_t length) {
+        clear();
+        if (!is_open())
+            return false;
+        // the pipe is empty and a frame is far below its capacity, so the
+        // write is never partial
+        if (write(source_[1], data, length) != static_cast<ssize_t>(length)) {
+            clear();
+            return false;
+        }
+        length_ = length;
+        return true;
+    }
+
+    // send the loaded frame to a socket. Returns false, having sent nothing,
+    // if the frame has to go through the normal write path instead
+    bool send_to(int fd, std::vector<char>& rest) {
+        #if defined(__linux__)
+        if (length_ == 0)
+            return false;
+
+        ssize_t n = tee(source_[0], scratch_[1], length_, SPLICE_F_NONBLOCK);
+        if (n != static_cast<ssize_t>(length_)) {
+            discard(scratch_[0], n > 0 ? n : 0);
+            return false;
+        }
+
+        n = splice(scratch_[0], NULL, fd, NULL, length_,
+            SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n < 0 && errno != EAGAIN) {
+            discard(scratch_[0], length_);
+            return false;
+        }
+
+        // the socket buffer is full, keep the tail for the caller to queue
+        std::size_t sent = n > 0 ? n : 0;
+        if (sent < length_) {
+            std::size_t offset = rest.size();
+            rest.resize(offset + length_ - sent);
+            ssize_t r = read(scratch_[0], &rest[offset], length_ - sent);
+            rest.resize(offset + (r > 0 ? r : 0));
+        }
+        return true;
+        #else
+        (void)fd;
+        (void)rest;
+        return false;
+        #endif
+    }
+
+    // drop the loaded frame
+    void clear() {
+        if (length_ != 0)
+            discard(source_[0], length_);
+        length_ = 0;
+    }
+
+private:
+    void discard(int fd, std::size_t length) {
+        #if defined(__linux__)
+        while (length > 0) {
+            ssize_t n = splice(fd, NULL, null_fd_, NULL, length,
+                SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (n <= 0)
+                break;
+            length -= n;
+        }
+        #else
+        (void)fd;
+        (void)length;
+        #endif
+    }
+
+    void close_all() {
+        int* fds[] = { &source_[0], &source_[1], &scratch_[0], &scratch_[1], &null_fd_ };
+        for (int* fd : fds) {
+            if (*fd >= 0)
+                close(*fd);
+            *fd = -1;
+        }
+    }
+
+    int source_[2];
+    int scratch_[2];
+    int null_fd_;
+    std::size_t length_;
+};
+
+#endif
@@ -0,0 +1,217 @@
+#ifndef HISTORY_LOG_HPP
+#define HISTORY_LOG_HPP
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include "chat_message.hpp"
+
+// history_log: the room history as encoded frames in log segment files
+//
+// Frames are appended to segment files in one directory, in the same format
+// they go out on the wire, so any range of history is a contiguous extent of
+// a few files that can be sendfile()'d to a socket. A new segment is started
+// once the current one reaches segment_bytes, and the oldest segment is
+// removed once the others hold enough frames on their own. Segments are
+// named by sequence number and are loaded again by open(), so the history
+// survives a restart.
+//
+// Removed segments are unlinked right away, but a segment stays open for as
+// long as an extent still refers to it.
+
+class history_log {
+
+public :
+    struct segment {
+        segment() : fd(-1), number(0), size(0) {
+        }
+
+        ~segment() {
+            if (fd >= 0)
+                close(fd);
+        }
+
+        int fd;
+        std::uint64_t number;
+        std::string path;
+        // offset of every frame in the file
+        std::vector<off_t> frames;
+        off_t size;
+    };
+
+    // a range of frames within one segment
+    struct extent {
+        std::shared_ptr<const segment> file;
+        off_t offset;
+        std::size_t length;
+    };
+
+    enum { default_segment_bytes = 64 * 1024 * 1024 };
+
+    history_log(std::size_t max_frames,
+        off_t segment_bytes = default_segment_bytes) :
+        max_frames_(max_frames),
+        segment_bytes_(segment_bytes),
+        frames_(0),
+        next_number_(0) {
+    }
+
+    // load the segments that are already in the directory
+    bool open(const std::string& dir) {
+        dir_ = dir;
+        DIR* d = opendir(dir.c_str());
+        if (d == NULL)
+            return false;
+
+        std::vector<std::uint64_t> numbers;
+        while (dirent* entry = readdir(d)) {
+            char* end = NULL;
+            std::uint64_t number = std::strtoull(entry->d_name, &end, 10);
+            if (end != entry->d_name && std::strcmp(end, ".log") == 0)
+                numbers.push_back(number);
+        }
+        closedir(d);
+        std::sort(numbers.begin(), numbers.end());
+
+        for (auto number : numbers) {
+            std::shared_ptr<segment> s = open_segment(number);
+            if (!s || !load_segment(*s))
+                return false;
+            segments_.push_back(s);
+            frames_ += s->frames.size();
+            next_number_ = number + 1;
+        }
+        trim();
+        return true;
+    }
+
+    bool append(const char* data, std::size_t length) {
+        if (segments_.empty()
+            || segments_.back()->size + static_cast<off_t>(length) > segment_bytes_) {
+            std::shared_ptr<segment> s = open_segment(next_number_);
+            if (!s)
+                return false;
+            ++next_number_;
+            segments_.push_back(s);
+        }
+
+        segment& s = *segments_.back();
+        std::size_t written = 0;
+        while (written < length) {
+            ssize_t n = write(s.fd, data + written, length - written);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0) {
+                // drop the partial frame so the segment stays parseable, or
+                // the whole segment if that fails too
+                if (ftruncate(s.fd, s.size) != 0) {
+                    frames_ -= s.frames.size();
+                    unlink(s.path.c_str());
+                    segments_.pop_back();
+                }
+                return false;
+            }
+            written += n;
+        }
+
+        s.frames.push_back(s.size);
+        s.size += length;
+        ++frames_;
+        trim();
+        return true;
+    }
+
+    // the extents holding the last `frames` frames, oldest first. Returns the
+    // number of frames they cover
+    std::size_t tail(std::size_t frames, std::deque<extent>& extents) const {
+        frames = std::min(frames, frames_);
+        std::size_t covered = 0;
+        for (auto s = segments_.rbegin(); s != segments_.rend() && covered < frames; ++s) {
+            std::size_t count = std::min(frames - covered, (*s)->frames.size());
+            if (count == 0)
+                continue;
+            extent e;
+            e.file = *s;
+            e.offset = (*s)->frames[(*s)->frames.size() - count];
+            e.length = (*s)->size - e.offset;
+            extents.push_front(e);
+            covered += count;
+        }
+        return covered;
+    }
+
+    std::size_t frames() const {
+        return frames_;
+    }
+
+private:
+    std::shared_ptr<segment> open_segment(std::uint64_t number) {
+        char name[32];
+        std::snprintf(name, sizeof(name), "/%020llu.log",
+            static_cast<unsigned long long>(number));
+
+        std::shared_ptr<segment> s(new segment);
+        s->number = number;
+        s->path = dir_ + name;
+        s->fd = ::open(s->path.c_str(),
+            O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (s->fd < 0)
+            return std::shared_ptr<segment>();
+        return s;
+    }
+
+    // index the frames of a segment, cutting off a torn frame at the end
+    bool load_segment(segment& s) {
+        off_t size = lseek(s.fd, 0, SEEK_END);
+        if (size < 0)
+            return false;
+
+        std::vector<char> data(size);
+        if (size > 0 && pread(s.fd, &data[0], size, 0) != size)
+            return false;
+
+        chat_message msg;
+        off_t offset = 0;
+        while (offset + chat_message::header_length <= size) {
+            std::memcpy(msg.data(), &data[offset], chat_message::header_length);
+            msg.decode_header();
+            if (msg.body_length() == 0
+                || offset + static_cast<off_t>(msg.length()) > size)
+                break;
+            s.frames.push_back(offset);
+            offset += msg.length();
+        }
+        s.size = offset;
+        return offset == size || ftruncate(s.fd, offset) == 0;
+    }
+
+    // drop the oldest segments that aren't needed to keep max_frames_
+    void trim() {
+        while (segments_.size() > 1
+            && frames_ - segments_.front()->frames.size() >= max_frames_) {
+            frames_ -= segments_.front()->frames.size();
+            unlink(segments_.front()->path.c_str());
+            segments_.pop_front();
+        }
+    }
+
+    std::string dir_;
+    std::size_t max_frames_;
+    off_t segment_bytes_;
+    std::deque<std::shared_ptr<segment> > segments_;
+    std::size_t frames_;
+    std::uint64_t next_number_;
+};
+
+#endif
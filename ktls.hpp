@@ -0,0 +1,232 @@
+#ifndef KTLS_HPP
+#define KTLS_HPP
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <openssl/evp.h>
+#include <openssl/kdf.h>
+#include <openssl/ssl.h>
+#if defined(__linux__)
+#include <linux/tls.h>
+#endif
+
+// ktls: kernel encryption for the sending side of a TLS 1.3 connection
+//
+// Once the handshake is done, the key and IV of the sending direction are
+// derived from its application traffic secret (HKDF-Expand-Label, RFC 8446
+// 7.3) and installed on the socket with setsockopt(SOL_TLS, TLS_TX), after
+// attaching the "tls" upper layer protocol. From then on plaintext written to
+// the socket, by write(), sendfile() or splice(), leaves it as TLS records.
+//
+// OpenSSL doesn't hand out the secret, nor the number of records it has
+// already sent with it (the session tickets), so prepare() puts a keylog
+// callback and a message callback on the SSL_CTX that keep both per
+// connection. Reading stays with OpenSSL: whatever it has buffered already
+// couldn't be handed over. Nothing may be written through OpenSSL once the
+// kernel sends, so a peer's request for a key update can't be answered.
+//
+// Only AES-GCM and ChaCha20-Poly1305 under TLS 1.3 on Linux; anything else,
+// including a kernel without the tls module, leaves the connection with
+// OpenSSL and offload() returns false.
+
+class ktls {
+
+public :
+    // install the callbacks; the context's keylog callback is taken over
+    static void prepare(SSL_CTX* ctx) {
+        state_index();
+        SSL_CTX_set_keylog_callback(ctx, &ktls::keylog);
+        SSL_CTX_set_msg_callback(ctx, &ktls::message);
+    }
+
+    // move the sending side of a connection whose handshake has completed,
+    // and whose output has all been written to fd, to the kernel
+    static bool offload(SSL* ssl, int fd) {
+        state* s = get(ssl);
+        if (s == nullptr || s->secret.empty())
+            return false;
+        bool done = install(ssl, fd, *s);
+        OPENSSL_cleanse(s->secret.data(), s->secret.size());
+        s->secret.clear();
+        s->sending = done;
+        return done;
+    }
+
+    // whether the kernel encrypts what is written to the connection's socket
+    static bool sending(SSL* ssl) {
+        state* s = get(ssl);
+        return s != nullptr && s->sending;
+    }
+
+private:
+    struct state {
+        state() : counting(false), records(0), sending(false) {
+        }
+
+        // the application traffic secret of the sending direction
+        std::vector<unsigned char> secret;
+        // records are counted from the one after the secret took over
+        bool counting;
+        std::uint64_t records;
+        bool sending;
+    };
+
+    static int state_index() {
+        static int index = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr,
+            &ktls::free_state);
+        return index;
+    }
+
+    static void free_state(void*, void* ptr, CRYPTO_EX_DATA*, int, long, void*) {
+        state* s = static_cast<state*>(ptr);
+        if (s != nullptr && !s->secret.empty())
+            OPENSSL_cleanse(s->secret.data(), s->secret.size());
+        delete s;
+    }
+
+    static state* get(const SSL* ssl) {
+        return static_cast<state*>(SSL_get_ex_data(ssl, state_index()));
+    }
+
+    // the lines are "<label> <client random> <secret>", in hex
+    static void keylog(const SSL* ssl, const char* line) {
+        const char* label = SSL_is_server(const_cast<SSL*>(ssl))
+            ? "SERVER_TRAFFIC_SECRET_0 " : "CLIENT_TRAFFIC_SECRET_0 ";
+        std::size_t label_length = std::strlen(label);
+        if (std::strncmp(line, label, label_length) != 0)
+            return;
+        const char* hex = std::strchr(line + label_length, ' ');
+        if (hex == nullptr)
+            return;
+
+        state* s = get(ssl);
+        if (s == nullptr) {
+            s = new state;
+            SSL_set_ex_data(const_cast<SSL*>(ssl), state_index(), s);
+        }
+        s->secret.clear();
+        for (++hex; hex[0] != '\0' && hex[1] != '\0'; hex += 2)
+            s->secret.push_back(static_cast<unsigned char>(
+                std::stoi(std::string(hex, 2), nullptr, 16)));
+        s->counting = true;
+        s->records = 0;
+    }
+
+    static void message(int write_p, int, int content_type, const void*,
+        std::size_t, SSL* ssl, void*) {
+        if (!write_p || content_type != SSL3_RT_HEADER)
+            return;
+        state* s = get(ssl);
+        if (s != nullptr && s->counting && !s->sending)
+            ++s->records;
+    }
+
+    // HKDF-Expand-Label(secret, label, "", length)
+    static bool expand_label(const EVP_MD* md, const std::vector<unsigned char>& secret,
+        const char* label, unsigned char* out, std::size_t length) {
+        std::string full = std::string("tls13 ") + label;
+        std::vector<unsigned char> info;
+        info.push_back(static_cast<unsigned char>(length >> 8));
+        info.push_back(static_cast<unsigned char>(length));
+        info.push_back(static_cast<unsigned char>(full.size()));
+        info.insert(info.end(), full.begin(), full.end());
+        info.push_back(0);
+
+        EVP_PKEY_CTX* ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_HKDF, nullptr);
+        bool ok = ctx != nullptr
+            && EVP_PKEY_derive_init(ctx) > 0
+            && EVP_PKEY_CTX_set_hkdf_md(ctx, md) > 0
+            && EVP_PKEY_CTX_set_hkdf_mode(ctx, EVP_PKEY_HKDEF_MODE_EXPAND_ONLY) > 0
+            && EVP_PKEY_CTX_set1_hkdf_key(ctx, secret.data(), secret.size()) > 0
+            && EVP_PKEY_CTX_add1_hkdf_info(ctx, info.data(), info.size()) > 0
+            && EVP_PKEY_derive(ctx, out, &length) > 0;
+        EVP_PKEY_CTX_free(ctx);
+        return ok;
+    }
+
+    static bool install(SSL* ssl, int fd, const state& s) {
+        #if defined(__linux__) && defined(TCP_ULP) && defined(TLS_1_3_VERSION)
+        const SSL_CIPHER* cipher = SSL_get_current_cipher(ssl);
+        if (SSL_version(ssl) != TLS1_3_VERSION || cipher == nullptr)
+            return false;
+        const EVP_MD* md = SSL_CIPHER_get_handshake_digest(cipher);
+
+        unsigned char key[32];
+        unsigned char iv[12];
+        unsigned char seq[8];
+        for (int i = 0; i < 8; ++i)
+            seq[i] = static_cast<unsigned char>(s.records >> (56 - 8 * i));
+
+        union {
+            tls12_crypto_info_aes_gcm_128 aes_128;
+            tls12_crypto_info_aes_gcm_256 aes_256;
+            #if defined(TLS_CIPHER_CHACHA20_POLY1305)
+            tls12_crypto_info_chacha20_poly1305 chacha20;
+            #endif
+        } info;
+        std::memset(&info, 0, sizeof(info));
+        socklen_t info_length = 0;
+
+        switch (SSL_CIPHER_get_id(cipher)) {
+        case TLS1_3_CK_AES_128_GCM_SHA256:
+            if (!expand_label(md, s.secret, "key", key, 16)
+                || !expand_label(md, s.secret, "iv", iv, 12))
+                return false;
+            info.aes_128.info.version = TLS_1_3_VERSION;
+            info.aes_128.info.cipher_type = TLS_CIPHER_AES_GCM_128;
+            std::memcpy(info.aes_128.key, key, 16);
+            std::memcpy(info.aes_128.salt, iv, 4);
+            std::memcpy(info.aes_128.iv, iv + 4, 8);
+            std::memcpy(info.aes_128.rec_seq, seq, 8);
+            info_length = sizeof(info.aes_128);
+            break;
+        case TLS1_3_CK_AES_256_GCM_SHA384:
+            if (!expand_label(md, s.secret, "key", key, 32)
+                || !expand_label(md, s.secret, "iv", iv, 12))
+                return false;
+            info.aes_256.info.version = TLS_1_3_VERSION;
+            info.aes_256.info.cipher_type = TLS_CIPHER_AES_GCM_256;
+            std::memcpy(info.aes_256.key, key, 32);
+            std::memcpy(info.aes_256.salt, iv, 4);
+            std::memcpy(info.aes_256.iv, iv + 4, 8);
+            std::memcpy(info.aes_256.rec_seq, seq, 8);
+            info_length = sizeof(info.aes_256);
+            break;
+        #if defined(TLS_CIPHER_CHACHA20_POLY1305)
+        case TLS1_3_CK_CHACHA20_POLY1305_SHA256:
+            if (!expand_label(md, s.secret, "key", key, 32)
+                || !expand_label(md, s.secret, "iv", iv, 12))
+                return false;
+            info.chacha20.info.version = TLS_1_3_VERSION;
+            info.chacha20.info.cipher_type = TLS_CIPHER_CHACHA20_POLY1305;
+            std::memcpy(info.chacha20.key, key, 32);
+            std::memcpy(info.chacha20.iv, iv, 12);
+            std::memcpy(info.chacha20.rec_seq, seq, 8);
+            info_length = sizeof(info.chacha20);
+            break;
+        #endif
+        default:
+            return false;
+        }
+
+        // without the tls module the first call fails with ENOENT, and the
+        // socket is left as it was
+        bool done = setsockopt(fd, SOL_TCP, TCP_ULP, "tls", sizeof("tls")) == 0
+            && setsockopt(fd, SOL_TLS, TLS_TX, &info, info_length) == 0;
+        OPENSSL_cleanse(key, sizeof(key));
+        OPENSSL_cleanse(iv, sizeof(iv));
+        OPENSSL_cleanse(&info, sizeof(info));
+        return done;
+        #else
+        return false;
+        #endif
+    }
+};
+
+#endif
@@ -0,0 +1,112 @@
+// ktls_bench.cpp: CPU per GB sent over TLS on loopback, with the sender
+// encrypting in user space (OpenSSL, through asio::ssl) and with the kernel
+// encrypting (ktls.hpp)
+//
+// The sender is the TLS server end of one loopback connection and writes
+// <megabytes> MB in 16 KB writes; a thread reads them on the client end.
+// The sender's thread CPU is what is compared. Without the kernel's tls
+// module the kernel run is skipped.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "bench_clock.hpp"
+#include "ktls.hpp"
+
+#include "asio.hpp"
+#include "asio/ssl.hpp"
+using asio::ip::tcp;
+
+typedef asio::ssl::stream<tcp::socket> tls_socket;
+
+void run(const std::string& certificate, const std::string& private_key,
+    std::size_t megabytes, bool kernel) {
+    enum { chunk = 16 * 1024 };
+
+    asio::io_context io_context;
+    asio::ssl::context server_context(asio::ssl::context::tls_server);
+    server_context.use_certificate_chain_file(certificate);
+    server_context.use_private_key_file(private_key, asio::ssl::context::pem);
+    if (kernel)
+        ktls::prepare(server_context.native_handle());
+    asio::ssl::context client_context(asio::ssl::context::tls_client);
+
+    tcp::acceptor acceptor(io_context,
+        tcp::endpoint(asio::ip::address_v4::loopback(), 0));
+    tls_socket sender(io_context, server_context);
+    tls_socket receiver(io_context, client_context);
+    receiver.lowest_layer().connect(acceptor.local_endpoint());
+    acceptor.accept(sender.lowest_layer());
+
+    std::thread handshake([&receiver]() {
+        receiver.handshake(asio::ssl::stream_base::client);
+    });
+    sender.handshake(asio::ssl::stream_base::server);
+    handshake.join();
+
+    if (kernel && !ktls::offload(sender.native_handle(),
+            sender.lowest_layer().native_handle())) {
+        std::printf("kernel: not available (%s), skipped\n", std::strerror(errno));
+        return;
+    }
+
+    std::size_t total = megabytes * 1024 * 1024;
+    double receiver_cpu = 0;
+    std::thread reader([&receiver, &receiver_cpu, total]() {
+        double start = thread_cpu_seconds();
+        std::vector<char> buf(chunk);
+        std::size_t received = 0;
+        std::error_code error;
+        while (received < total && !error)
+            received += receiver.read_some(asio::buffer(buf), error);
+        receiver_cpu = thread_cpu_seconds() - start;
+    });
+
+    std::vector<char> buf(chunk, 'x');
+    double wall = wall_seconds();
+    double cpu = thread_cpu_seconds();
+    for (std::size_t sent = 0; sent < total; sent += chunk) {
+        if (kernel)
+            asio::write(sender.next_layer(), asio::buffer(buf));
+        else
+            asio::write(sender, asio::buffer(buf));
+    }
+    cpu = thread_cpu_seconds() - cpu;
+    reader.join();
+    wall = wall_seconds() - wall;
+
+    double gigabytes = total / (1024.0 * 1024 * 1024);
+    std::printf("%s: %zu MB, %s\n", kernel ? "kernel" : "user", megabytes,
+        SSL_get_cipher(sender.native_handle()));
+    std::printf("  MB/s: %.0f\n", megabytes / wall);
+    std::printf("  sender cpu s/GB: %.3f\n", cpu / gigabytes);
+    std::printf("  receiver cpu s/GB: %.3f\n", receiver_cpu / gigabytes);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 3 && argc != 4) {
+        std::cerr << "Usage: ktls_bench <certificate chain file> <key file> "
+            << "[<megabytes>]" << std::endl;
+        return 1;
+    }
+
+    std::size_t megabytes = argc == 4 ? std::atoi(argv[3]) : 1024;
+    if (megabytes < 1) {
+        std::cerr << "need at least 1 MB" << std::endl;
+        return 1;
+    }
+
+    try {
+        run(argv[1], argv[2], megabytes, false);
+        run(argv[1], argv[2], megabytes, true);
+    } catch (std::exception& e) {
+        std::cerr << "Exception: " << e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
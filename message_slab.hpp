@@ -0,0 +1,92 @@
+#ifndef MESSAGE_SLAB_HPP
+#define MESSAGE_SLAB_HPP
+
+#include <cstddef>
+#include <new>
+
+// message_slab: size-classed blocks for chat_message storage
+//
+// Sizes go up in steps of a half power of two from 32 bytes (32, 48, 64,
+// 96, 128, ...), so a block wastes at most a third of itself. Freed blocks
+// are kept on a free list per class and per thread, and handed out again
+// before anything new is allocated; a block freed on another thread than
+// the one that allocated it just joins that thread's lists. Each list keeps
+// at most max_cached_bytes, the rest goes back to the heap.
+
+class message_slab {
+
+public :
+    enum { min_size = 32 };
+    // the largest, 12 KB, holds any frame a 4 digit header can describe
+    enum { classes = 18 };
+    enum { max_cached_bytes = 256 * 1024 };
+
+    // the smallest class whose blocks hold size bytes
+    static std::size_t size_class(std::size_t size) {
+        std::size_t c = 0;
+        while (c + 1 < classes && class_size(c) < size)
+            ++c;
+        return c;
+    }
+
+    static std::size_t class_size(std::size_t c) {
+        std::size_t base = static_cast<std::size_t>(min_size) << (c / 2);
+        return c % 2 == 0 ? base : base + base / 2;
+    }
+
+    static char* allocate(std::size_t c) {
+        cache& local = local_cache();
+        block* b = local.free[c];
+        if (b == nullptr)
+            return static_cast<char*>(::operator new(class_size(c)));
+        local.free[c] = b->next;
+        --local.count[c];
+        return reinterpret_cast<char*>(b);
+    }
+
+    static void deallocate(char* p, std::size_t c) {
+        cache& local = local_cache();
+        if (local.count[c] * class_size(c) >= max_cached_bytes) {
+            ::operator delete(p);
+            return;
+        }
+        block* b = reinterpret_cast<block*>(p);
+        b->next = local.free[c];
+        local.free[c] = b;
+        ++local.count[c];
+    }
+
+private:
+    struct block {
+        block* next;
+    };
+
+    struct cache {
+        cache() {
+            for (std::size_t c = 0; c < classes; ++c) {
+                free[c] = nullptr;
+                count[c] = 0;
+            }
+        }
+
+        ~cache() {
+            for (std::size_t c = 0; c < classes; ++c) {
+                while (free[c] != nullptr) {
+                    block* b = free[c];
+                    free[c] = b->next;
+                    ::operator delete(b);
+                }
+            }
+        }
+
+        block* free[classes];
+        std::size_t count[classes];
+    };
+
+    static cache& local_cache() {
+        static thread_local cache local;
+        return local;
+    }
+};
+
+#endif
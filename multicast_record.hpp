@@ -0,0 +1,126 @@
+#ifndef MULTICAST_RECORD_HPP
+#define MULTICAST_RECORD_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "chat_message.hpp"
+
+class multicast_record {
+
+    //data : ssssssssssssssssxxxxyyyyyyyy.........
+    //ssssssssssssssss: sequence number, fixed 16 hex digits
+    //xxxxyyyyyyyy...: an encoded chat_message frame
+    //
+    //On the multicast group a record with no frame is a heartbeat, carrying
+    //the sequence number of the next message. Over the viewer's TCP
+    //connection an empty frame ("   0") answers a request for a message
+    //that is no longer kept, so the viewer can skip it.
+    //
+    //Viewers ask for missing messages with a request of two sequence
+    //numbers, the first and last of the range, request_length chars.
+
+public :
+    enum { seq_length = 16 };
+    enum { request_length = 2 * seq_length };
+    enum { max_length = seq_length + chat_message::header_length
+        + chat_message::id_length + chat_message::max_body_length };
+
+    multicast_record() : seq_(0), length_(seq_length) {
+    }
+
+    void assign(std::uint64_t seq, const chat_message& msg) {
+        seq_ = seq;
+        encode_seq(data_, seq);
+        std::memcpy(data_ + seq_length, msg.data(), msg.length());
+        length_ = seq_length + msg.length();
+    }
+
+    void heartbeat(std::uint64_t seq) {
+        seq_ = seq;
+        encode_seq(data_, seq);
+        length_ = seq_length;
+    }
+
+    void lost(std::uint64_t seq) {
+        seq_ = seq;
+        encode_seq(data_, seq);
+        std::memcpy(data_ + seq_length, "   0", chat_message::header_length);
+        length_ = seq_length + chat_message::header_length;
+    }
+
+    const char* data() const {
+        return data_;
+    }
+
+    char* data() {
+        return data_;
+    }
+
+    std::size_t length() const {
+        return length_;
+    }
+
+    std::uint64_t seq() const {
+        return seq_;
+    }
+
+    // true unless the record is a heartbeat or stands for a lost message
+    bool has_frame() const {
+        return length_ > seq_length + chat_message::header_length;
+    }
+
+    // the length of the frame that follows the sequence number, from its
+    // header; data() must hold at least seq_length + header_length chars
+    std::size_t frame_length() const {
+        chat_message msg;
+        std::memcpy(msg.data(), data_ + seq_length, chat_message::header_length);
+        msg.decode_header();
+        return chat_message::header_length + msg.body_length();
+    }
+
+    // parse a record of the given length that has been read into data()
+    bool decode(std::size_t length) {
+        if (length < seq_length || length > max_length
+            || !decode_seq(data_, seq_))
+            return false;
+        if (length > seq_length
+            && (length < seq_length + chat_message::header_length
+                || frame_length() != length - seq_length))
+            return false;
+        length_ = length;
+        return true;
+    }
+
+    chat_message message() const {
+        chat_message msg;
+        std::memcpy(msg.data(), data_ + seq_length, chat_message::header_length);
+        msg.decode_header();
+        std::memcpy(msg.body(), data_ + seq_length + chat_message::header_length,
+            msg.body_length());
+        return msg;
+    }
+
+    static void encode_seq(char* data, std::uint64_t seq) {
+        char text[seq_length + 1];
+        std::snprintf(text, sizeof(text), "%016llx",
+            static_cast<unsigned long long>(seq));
+        std::memcpy(data, text, seq_length);
+    }
+
+    static bool decode_seq(const char* data, std::uint64_t& seq) {
+        char text[seq_length + 1] = "";
+        std::strncat(text, data, seq_length);
+        char* end = NULL;
+        seq = std::strtoull(text, &end, 16);
+        return end == text + seq_length;
+    }
+
+private:
+    char data_[max_length];
+    std::uint64_t seq_;
+    std::size_t length_;
+};
+
+#endif
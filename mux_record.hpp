@@ -0,0 +1,121 @@
+#ifndef MUX_RECORD_HPP
+#define MUX_RECORD_HPP
+
+#include <cstdint>
+#include <cstring>
+#include "chat_message.hpp"
+#include "multicast_record.hpp"
+
+class mux_record {
+
+    //data : kssssssssssssssssxxxxyyyyyyyy.........
+    //k: what the record does, one of kind
+    //ssssssssssssssss: the stream, i.e. one user of an edge proxy
+    //xxxxyyyyyyyy...: an encoded chat_message frame
+    //
+    //The stream is 16 hex digits, like the multicast_record sequence. The
+    //proxy opens a stream with a frame that holds just the user's id, sends
+    //the user's messages on it and closes it with an empty frame ("   0").
+    //The server sends the room's messages once, on stream 0 (all_streams),
+    //and a user's own history on the user's stream.
+
+public :
+    enum kind { open_stream = 'o', stream_message = 'm', close_stream = 'c' };
+    enum { all_streams = 0 };
+    enum { kind_length = 1 };
+    enum { prefix_length = kind_length + multicast_record::seq_length };
+    enum { max_length = prefix_length + chat_message::header_length
+        + chat_message::id_length + chat_message::max_body_length };
+
+    mux_record() : kind_(stream_message), stream_(0), length_(prefix_length) {
+    }
+
+    void assign(kind k, std::uint64_t stream, const chat_message& msg) {
+        set_prefix(k, stream);
+        std::memcpy(data_ + prefix_length, msg.data(), msg.length());
+        length_ = prefix_length + msg.length();
+    }
+
+    void open(std::uint64_t stream, const char* id) {
+        chat_message msg;
+        msg.body_length(chat_message::id_length);
+        std::memcpy(msg.id(), id, chat_message::id_length);
+        msg.encode_header();
+        assign(open_stream, stream, msg);
+    }
+
+    void close(std::uint64_t stream) {
+        set_prefix(close_stream, stream);
+        std::memcpy(data_ + prefix_length, "   0", chat_message::header_length);
+        length_ = prefix_length + chat_message::header_length;
+    }
+
+    const char* data() const {
+        return data_;
+    }
+
+    char* data() {
+        return data_;
+    }
+
+    std::size_t length() const {
+        return length_;
+    }
+
+    kind record_kind() const {
+        return kind_;
+    }
+
+    std::uint64_t stream() const {
+        return stream_;
+    }
+
+    // the length of the frame after the prefix, from its header; data() must
+    // hold at least prefix_length + header_length chars
+    std::size_t frame_length() const {
+        chat_message msg;
+        std::memcpy(msg.data(), data_ + prefix_length, chat_message::header_length);
+        msg.decode_header();
+        return chat_message::header_length + msg.body_length();
+    }
+
+    // parse a record of the given length that has been read into data()
+    bool decode(std::size_t length) {
+        if (length < prefix_length + chat_message::header_length
+            || length > max_length
+            || (data_[0] != open_stream && data_[0] != stream_message
+                && data_[0] != close_stream)
+            || !multicast_record::decode_seq(data_ + kind_length, stream_)
+            || frame_length() != length - prefix_length)
+            return false;
+        kind_ = static_cast<kind>(data_[0]);
+        length_ = length;
+        // an open carries an id, a message at least one
+        return kind_ == close_stream || frame_length() >= chat_message::header_length
+            + chat_message::id_length;
+    }
+
+    chat_message message() const {
+        chat_message msg;
+        std::memcpy(msg.data(), data_ + prefix_length, chat_message::header_length);
+        msg.decode_header();
+        std::memcpy(msg.body(), data_ + prefix_length + chat_message::header_length,
+            msg.body_length());
+        return msg;
+    }
+
+private:
+    void set_prefix(kind k, std::uint64_t stream) {
+        kind_ = k;
+        stream_ = stream;
+        data_[0] = static_cast<char>(k);
+        multicast_record::encode_seq(data_ + kind_length, stream);
+    }
+
+    char data_[max_length];
+    kind kind_;
+    std::uint64_t stream_;
+    std::size_t length_;
+};
+
+#endif
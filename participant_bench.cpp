@@ -0,0 +1,256 @@
+// participant_bench.cpp: threads delivering to one list of participants
+// while it changes
+//
+// A list of <members> participants is read by 1 to 32 threads at once, each
+// going through the whole list again and again as if delivering a message to
+// everyone, while one writer keeps replacing participants, one leaving and
+// one joining. Deliveries per second are compared for three lists:
+//
+//   rcu: a participant_list, read without locks or reference counts
+//   mutex: a vector behind a mutex, which readers and writer all take
+//   shared_ptr: a vector of shared_ptrs, swapped whole by the writer, whose
+//       readers copy the pointer to every participant they deliver to
+//
+// It also checks that no participant is reclaimed while it is still being
+// read: a reclaimed participant is marked and kept, rather than freed, and a
+// reader that comes across one counts it. That count must be 0.
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "participant_list.hpp"
+
+struct member {
+    explicit member(std::uint64_t n) : id(n), alive(1) {
+    }
+
+    std::uint64_t id;
+    std::atomic<int> alive;
+};
+
+// reclaimed members, kept until the end of a run so that a late reader
+// finds them marked instead of freed
+class graveyard {
+public:
+    std::shared_ptr<member> make(std::uint64_t id) {
+        return std::shared_ptr<member>(new member(id), [this](member* m) {
+            m->alive = 0;
+            std::lock_guard<std::mutex> lock(mutex_);
+            dead_.push_back(std::unique_ptr<member>(m));
+        });
+    }
+
+private:
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<member> > dead_;
+};
+
+struct result {
+    result() : deliveries(0), changes(0), reclaimed_reads(0) {
+    }
+
+    unsigned long long deliveries;
+    unsigned long long changes;
+    unsigned long long reclaimed_reads;
+};
+
+class rcu_list {
+public:
+    rcu_list(graveyard& dead) : dead_(dead) {
+    }
+
+    void reader() {
+        slot_ = list_.reader();
+    }
+
+    void join(std::uint64_t id) {
+        std::shared_ptr<member> m = dead_.make(id);
+        list_.insert(m, 0);
+        list_.commit();
+        members_.push_back(m);
+    }
+
+    void replace(std::size_t i, std::uint64_t id) {
+        list_.erase(members_[i]);
+        members_[i] = dead_.make(id);
+        list_.insert(members_[i], 0);
+        list_.commit();
+    }
+
+    template <typename Deliver>
+    void deliver(Deliver deliver) {
+        participant_list<member>::snapshot snapshot(list_, slot_);
+        for (auto& e : snapshot)
+            deliver(*e.participant);
+    }
+
+private:
+    graveyard& dead_;
+    participant_list<member> list_;
+    std::vector<std::shared_ptr<member> > members_;
+    static thread_local std::size_t slot_;
+};
+
+thread_local std::size_t rcu_list::slot_ = 0;
+
+class mutex_list {
+public:
+    mutex_list(graveyard& dead) : dead_(dead) {
+    }
+
+    void reader() {
+    }
+
+    void join(std::uint64_t id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        members_.push_back(dead_.make(id));
+    }
+
+    void replace(std::size_t i, std::uint64_t id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        members_[i] = dead_.make(id);
+    }
+
+    template <typename Deliver>
+    void deliver(Deliver deliver) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& m : members_)
+            deliver(*m);
+    }
+
+private:
+    graveyard& dead_;
+    std::mutex mutex_;
+    std::vector<std::shared_ptr<member> > members_;
+};
+
+class shared_list {
+public:
+    typedef std::vector<std::shared_ptr<member> > version;
+
+    shared_list(graveyard& dead) :
+        dead_(dead),
+        current_(std::make_shared<version>()) {
+    }
+
+    void reader() {
+    }
+
+    void join(std::uint64_t id) {
+        std::shared_ptr<version> next = std::make_shared<version>(*current_);
+        next->push_back(dead_.make(id));
+        std::atomic_store(&current_, next);
+    }
+
+    void replace(std::size_t i, std::uint64_t id) {
+        std::shared_ptr<version> next = std::make_shared<version>(*current_);
+        (*next)[i] = dead_.make(id);
+        std::atomic_store(&current_, next);
+    }
+
+    template <typename Deliver>
+    void deliver(Deliver deliver) {
+        std::shared_ptr<version> snapshot = std::atomic_load(&current_);
+        for (auto m : *snapshot)
+            deliver(*m);
+    }
+
+private:
+    graveyard& dead_;
+    std::shared_ptr<version> current_;
+};
+
+// where the readers' checksums go, so that their reads aren't optimized out
+std::atomic<std::uint64_t> sink(0);
+
+template <typename List>
+result run(std::size_t members, std::size_t readers, double seconds) {
+    graveyard dead;
+    result r;
+    {
+        List list(dead);
+        for (std::size_t i = 0; i < members; ++i)
+            list.join(i);
+
+        std::atomic<bool> stop(false);
+        std::atomic<unsigned long long> deliveries(0);
+        std::atomic<unsigned long long> reclaimed_reads(0);
+        std::vector<std::thread> threads;
+        for (std::size_t t = 0; t < readers; ++t)
+            threads.emplace_back([&]() {
+                list.reader();
+                unsigned long long delivered = 0;
+                unsigned long long reclaimed = 0;
+                std::uint64_t checksum = 0;
+                while (!stop.load(std::memory_order_relaxed))
+                    list.deliver([&](member& m) {
+                        checksum += m.id;
+                        reclaimed += m.alive.load(std::memory_order_relaxed) == 0;
+                        ++delivered;
+                    });
+                deliveries += delivered;
+                reclaimed_reads += reclaimed;
+                sink += checksum;
+            });
+
+        // the writer replaces participants until the time is up
+        std::mt19937 random(members);
+        std::uint64_t next_id = members;
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now()
+            + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(seconds));
+        while (std::chrono::steady_clock::now() < end) {
+            list.replace(random() % members, next_id++);
+            ++r.changes;
+        }
+        stop = true;
+        for (auto& thread : threads)
+            thread.join();
+        r.deliveries = deliveries;
+        r.reclaimed_reads = reclaimed_reads;
+    }
+    return r;
+}
+
+void report(const char* name, std::size_t readers, double seconds,
+    const result& r) {
+    std::printf("%-10s %2zu readers: %8.1f M deliveries/s, %7.0f changes/s, "
+        "%llu reads of reclaimed participants\n",
+        name, readers, r.deliveries / seconds / 1e6, r.changes / seconds,
+        r.reclaimed_reads);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 3) {
+        std::cerr << "Usage: participant_bench [<members> [<seconds>]]"
+            << std::endl;
+        return 1;
+    }
+
+    std::size_t members = argc >= 2 ? std::atoi(argv[1]) : 10000;
+    double seconds = argc == 3 ? std::atof(argv[2]) : 0.5;
+    if (members < 1 || seconds <= 0) {
+        std::cerr << "need at least 1 member and some time" << std::endl;
+        return 1;
+    }
+
+    std::printf("%zu members, %u cores, %.1f s a run\n", members,
+        std::thread::hardware_concurrency(), seconds);
+    unsigned long long reclaimed_reads = 0;
+    for (std::size_t readers = 1; readers <= 32; readers *= 2) {
+        result r = run<rcu_list>(members, readers, seconds);
+        reclaimed_reads += r.reclaimed_reads;
+        report("rcu", readers, seconds, r);
+        report("mutex", readers, seconds, run<mutex_list>(members, readers, seconds));
+        report("shared_ptr", readers, seconds, run<shared_list>(members, readers, seconds));
+    }
+    return reclaimed_reads == 0 ? 0 : 1;
+}
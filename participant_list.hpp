@@ -0,0 +1,209 @@
+#ifndef PARTICIPANT_LIST_HPP
+#define PARTICIPANT_LIST_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// participant_list: who to deliver to, read without locks
+//
+// The list is read-mostly. Readers, the threads that deliver, take a
+// snapshot and go through it without a lock and without touching a
+// reference count; the writer copies the list, changes the copy and
+// publishes it in place of the old one, RCU style. There is one writer at a
+// time, and up to max_readers reading threads, each with a slot of its own
+// (see reader()).
+//
+// Copying the list is what a change costs, so the writer stages its
+// changes and publishes them together with commit(): a storm of n joins
+// between two commits copies the list once, rather than n times.
+//
+// What the writer replaces, the old copy and the participant that left with
+// it, is reclaimed by epochs: a reader marks its slot with the epoch it
+// started reading in, the writer retires what it replaced with the epoch it
+// was replaced in and moves the epoch on, and frees whatever was retired
+// before the oldest reader still reading. The writer reclaims whenever it
+// publishes, so a participant that left lives on until the next commit.
+
+template <typename Participant>
+class participant_list {
+
+public :
+    enum { max_readers = 64 };
+
+    struct entry {
+        Participant* participant;
+        // the writer's mark, e.g. the last message before it joined
+        std::uint64_t since;
+    };
+
+    typedef std::vector<entry> version;
+
+    // the list as it was when the snapshot was taken, which stays valid
+    // until the snapshot goes. A reader takes one snapshot at a time
+    class snapshot {
+    public:
+        snapshot(participant_list& list, std::size_t reader) :
+            slot_(list.slots_[reader].epoch) {
+            slot_.store(list.epoch_.load());
+            version_ = list.current_.load();
+        }
+
+        ~snapshot() {
+            slot_.store(0, std::memory_order_release);
+        }
+
+        typename version::const_iterator begin() const {
+            return version_->begin();
+        }
+
+        typename version::const_iterator end() const {
+            return version_->end();
+        }
+
+        std::size_t size() const {
+            return version_->size();
+        }
+
+    private:
+        snapshot(const snapshot&);
+        snapshot& operator=(const snapshot&);
+
+        std::atomic<std::uint64_t>& slot_;
+        const version* version_;
+    };
+
+    participant_list() :
+        current_(new version),
+        epoch_(1),
+        readers_(0) {
+        for (std::size_t i = 0; i < max_readers; ++i)
+            slots_[i].epoch = 0;
+    }
+
+    ~participant_list() {
+        delete current_.load();
+    }
+
+    // the slot of a thread that is going to read the list, once per thread.
+    // Throws std::length_error if max_readers threads already have one
+    std::size_t reader() {
+        std::size_t reader = readers_++;
+        if (reader >= max_readers) {
+            --readers_;
+            throw std::length_error("participant_list: too many readers");
+        }
+        return reader;
+    }
+
+    // the rest is for the writer only. insert() and erase() are staged,
+    // and readers only see them once they are committed
+    void insert(const std::shared_ptr<Participant>& participant,
+        std::uint64_t since) {
+        if (!owners_.insert(std::make_pair(participant.get(), participant)).second)
+            return;
+        entry e = { participant.get(), since };
+        joined_.push_back(e);
+    }
+
+    void erase(const std::shared_ptr<Participant>& participant) {
+        auto owner = owners_.find(participant.get());
+        if (owner == owners_.end())
+            return;
+        left_.push_back(std::move(owner->second));
+        owners_.erase(owner);
+    }
+
+    // publish the staged changes as one new version
+    void commit() {
+        if (joined_.empty() && left_.empty())
+            return;
+        const version& current = *current_.load();
+        std::unique_ptr<version> next(new version);
+        next->reserve(current.size() + joined_.size());
+        if (left_.empty()) {
+            next->insert(next->end(), current.begin(), current.end());
+            next->insert(next->end(), joined_.begin(), joined_.end());
+        } else {
+            std::unordered_set<Participant*> left;
+            for (auto& participant : left_)
+                left.insert(participant.get());
+            for (auto& e : current)
+                if (left.count(e.participant) == 0)
+                    next->push_back(e);
+            for (auto& e : joined_)
+                if (left.count(e.participant) == 0)
+                    next->push_back(e);
+        }
+        joined_.clear();
+        publish(std::move(next));
+    }
+
+    // changes staged but not yet committed
+    bool staged() const {
+        return !joined_.empty() || !left_.empty();
+    }
+
+    // everyone in the list, staged changes included
+    std::size_t size() const {
+        return owners_.size();
+    }
+
+    // versions and participants retired but not yet reclaimed
+    std::size_t retired() const {
+        return retired_.size();
+    }
+
+private:
+    struct retired_version {
+        std::uint64_t epoch;
+        std::unique_ptr<const version> list;
+        std::vector<std::shared_ptr<Participant> > left;
+    };
+
+    // the participants that left go with the version they were last in
+    void publish(std::unique_ptr<version> next) {
+        retired_version old;
+        old.list.reset(current_.exchange(next.release()));
+        old.left.swap(left_);
+        old.epoch = epoch_++;
+        retired_.push_back(std::move(old));
+        reclaim();
+    }
+
+    // free what was retired before the epoch of every reader still reading
+    void reclaim() {
+        std::uint64_t oldest = epoch_.load();
+        for (std::size_t i = 0; i < max_readers; ++i) {
+            std::uint64_t epoch = slots_[i].epoch.load();
+            if (epoch != 0 && epoch < oldest)
+                oldest = epoch;
+        }
+        while (!retired_.empty() && retired_.front().epoch < oldest)
+            retired_.pop_front();
+    }
+
+    // padded so that readers don't share a cache line
+    struct slot {
+        std::atomic<std::uint64_t> epoch;
+        char padding[64 - sizeof(std::atomic<std::uint64_t>)];
+    };
+
+    std::atomic<version*> current_;
+    std::atomic<std::uint64_t> epoch_;
+    std::atomic<std::size_t> readers_;
+    slot slots_[max_readers];
+    // the writer's side: who is in the list, the changes not yet committed,
+    // and what waits to be reclaimed
+    std::unordered_map<Participant*, std::shared_ptr<Participant> > owners_;
+    std::vector<entry> joined_;
+    std::vector<std::shared_ptr<Participant> > left_;
+    std::deque<retired_version> retired_;
+};
+
+#endif
@@ -0,0 +1,225 @@
+// proxy_bench.cpp: room throughput, directly or through edge proxies
+//
+// Connects <clients> participants and has the first one send <messages>
+// messages in bursts of <burst>, each burst as fast as the connection takes
+// it; the next burst starts once every other participant has read the last
+// one. Point it at chat_server's client port, or at one or more chat_proxy
+// ports (the clients are spread over them in turn), and run the server
+// under `time`: through proxies the server sends each message once per
+// proxy connection instead of once per client.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "bench_clock.hpp"
+#include "chat_message.hpp"
+
+#include "asio.hpp"
+using asio::ip::tcp;
+
+// the id of the i-th benchmark client
+std::string client_id(std::size_t i) {
+    std::string id = "p" + std::to_string(i);
+    id.resize(chat_message::id_length, '\0');
+    return id;
+}
+
+// a participant that reads frames until the connection closes. It counts
+// the sender's messages from its own join notice on, so the history of an
+// earlier run doesn't count
+class participant {
+public:
+    participant(asio::io_context& io_context, const tcp::endpoint& endpoint,
+        const std::string& id, const std::string& sender,
+        std::function<void()> joined, std::function<void()> received) :
+        socket_(io_context),
+        id_(id),
+        sender_(sender),
+        joined_(joined),
+        received_(received),
+        counting_(false) {
+        socket_.connect(endpoint);
+        socket_.set_option(tcp::no_delay(true));
+        asio::write(socket_, asio::buffer(id_));
+        read_header();
+    }
+
+    tcp::socket& socket() {
+        return socket_;
+    }
+
+private:
+    void read_header() {
+        asio::async_read(socket_,
+            asio::buffer(msg_.data(), chat_message::header_length),
+            [this](const std::error_code& error, std::size_t /*length*/) {
+                if (error)
+                    return;
+                msg_.decode_header();
+                asio::async_read(socket_,
+                    asio::buffer(msg_.body(), msg_.body_length()),
+                    [this](const std::error_code& error, std::size_t) {
+                        if (error)
+                            return;
+                        handle_message();
+                        read_header();
+                    });
+            });
+    }
+
+    void handle_message() {
+        std::size_t length = msg_.body_length() - chat_message::id_length;
+        if (counting_) {
+            if (std::memcmp(msg_.id(), sender_.data(), chat_message::id_length) == 0)
+                received_();
+            return;
+        }
+
+        std::string notice = std::string(id_.c_str()) + " joined the chat";
+        if (length == notice.size()
+            && std::memcmp(msg_.msg(), notice.data(), length) == 0) {
+            counting_ = true;
+            joined_();
+        }
+    }
+
+    tcp::socket socket_;
+    std::string id_;
+    std::string sender_;
+    std::function<void()> joined_;
+    std::function<void()> received_;
+    bool counting_;
+    chat_message msg_;
+};
+
+class bench {
+public:
+    bench(asio::io_context& io_context,
+        const std::vector<tcp::endpoint>& endpoints,
+        std::size_t clients, std::size_t messages, std::size_t burst) :
+        io_context_(io_context),
+        clients_(clients),
+        messages_(messages),
+        burst_(burst),
+        joined_(0),
+        sent_(0),
+        received_(0),
+        start_(0),
+        cpu_start_(0) {
+        std::string sender = client_id(0);
+        for (std::size_t i = 0; i < clients; ++i)
+            participants_.emplace_back(new participant(io_context,
+                endpoints[i % endpoints.size()], client_id(i), sender,
+                std::bind(&bench::joined, this),
+                std::bind(&bench::received, this)));
+    }
+
+    void report() const {
+        double wall = wall_seconds() - start_;
+        double cpu = cpu_seconds() - cpu_start_;
+        std::size_t deliveries = (clients_ - 1) * messages_;
+        std::printf("%zu clients, %zu messages in bursts of %zu\n",
+            clients_, messages_, burst_);
+        std::printf("messages/s: %.0f\n", messages_ / wall);
+        std::printf("deliveries/s: %.0f\n", deliveries / wall);
+        std::printf("client cpu us/delivery: %.2f\n", cpu * 1e6 / deliveries);
+    }
+
+private:
+    void joined() {
+        if (++joined_ < clients_)
+            return;
+        start_ = wall_seconds();
+        cpu_start_ = cpu_seconds();
+        send_burst();
+    }
+
+    void received() {
+        // the sender doesn't get its own messages, so a burst is through
+        // when the others have read burst * (clients - 1) of them
+        if (++received_ < sent_ * (clients_ - 1))
+            return;
+        if (sent_ == messages_) {
+            report();
+            io_context_.stop();
+            return;
+        }
+        send_burst();
+    }
+
+    void send_burst() {
+        std::size_t n = std::min(burst_, messages_ - sent_);
+        buf_.clear();
+        for (std::size_t i = 0; i < n; ++i) {
+            std::string text = "t" + std::to_string(sent_ + i);
+            chat_message msg;
+            msg.body_length(text.size() + chat_message::id_length);
+            std::memcpy(msg.id(), client_id(0).data(), chat_message::id_length);
+            std::memcpy(msg.msg(), text.data(), text.size());
+            msg.encode_header();
+            buf_.insert(buf_.end(), msg.data(), msg.data() + msg.length());
+        }
+        sent_ += n;
+        asio::async_write(participants_.front()->socket(), asio::buffer(buf_),
+            [](const std::error_code& error, std::size_t /*length*/) {
+                if (error)
+                    std::cerr << "send: " << error.message() << std::endl;
+            });
+    }
+
+    asio::io_context& io_context_;
+    std::size_t clients_;
+    std::size_t messages_;
+    std::size_t burst_;
+    std::vector<std::unique_ptr<participant> > participants_;
+    std::size_t joined_;
+    std::size_t sent_;
+    std::size_t received_;
+    std::vector<char> buf_;
+    double start_;
+    double cpu_start_;
+};
+
+int main(int argc, char* argv[]) {
+    if (argc != 5 && argc != 6) {
+        std::cerr << "Usage: proxy_bench <host> <port>[,<port>...] <clients> "
+            << "<messages> [<burst>]" << std::endl;
+        return 1;
+    }
+
+    std::size_t clients = std::atoi(argv[3]);
+    std::size_t messages = std::atoi(argv[4]);
+    std::size_t burst = argc == 6 ? std::atoi(argv[5]) : 100;
+    if (clients < 2 || messages < 1 || burst < 1) {
+        std::cerr << "need at least 2 clients, 1 message and bursts of 1"
+            << std::endl;
+        return 1;
+    }
+
+    try {
+        asio::io_context io_context;
+        tcp::resolver resolver(io_context);
+        std::vector<tcp::endpoint> endpoints;
+        std::string ports(argv[2]);
+        for (std::size_t start = 0; start <= ports.size(); ) {
+            std::size_t end = std::min(ports.find(',', start), ports.size());
+            endpoints.push_back(*resolver.resolve(argv[1],
+                ports.substr(start, end - start)).begin());
+            start = end + 1;
+        }
+
+        bench b(io_context, endpoints, clients, messages, burst);
+        io_context.run();
+    } catch (std::exception& e) {
+        std::cerr << "Exception: " << e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
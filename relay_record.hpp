@@ -0,0 +1,109 @@
+#ifndef RELAY_RECORD_HPP
+#define RELAY_RECORD_HPP
+
+#include <cstdint>
+#include <cstring>
+#include "chat_message.hpp"
+#include "multicast_record.hpp"
+
+class relay_record {
+
+    //data : oooooooooooooooossssssssssssssssxxxxyyyyyyyy.........
+    //oooooooooooooooo: id of the node where the message entered the room
+    //ssssssssssssssss: sequence number of the message at that node
+    //xxxxyyyyyyyy...: an encoded chat_message frame
+    //
+    //Both numbers are 16 hex digits, like the multicast_record sequence. A
+    //record with no frame is the hello that starts a link, carrying the id
+    //of the node on the other end.
+
+public :
+    enum { origin_length = 16 };
+    enum { prefix_length = origin_length + multicast_record::seq_length };
+    enum { max_length = prefix_length + chat_message::header_length
+        + chat_message::id_length + chat_message::max_body_length };
+
+    relay_record() : origin_(0), seq_(0), length_(prefix_length) {
+    }
+
+    void assign(std::uint64_t origin, std::uint64_t seq, const chat_message& msg) {
+        set_prefix(origin, seq);
+        std::memcpy(data_ + prefix_length, msg.data(), msg.length());
+        length_ = prefix_length + msg.length();
+    }
+
+    void hello(std::uint64_t node) {
+        set_prefix(node, 0);
+        std::memcpy(data_ + prefix_length, "   0", chat_message::header_length);
+        length_ = prefix_length + chat_message::header_length;
+    }
+
+    const char* data() const {
+        return data_;
+    }
+
+    char* data() {
+        return data_;
+    }
+
+    std::size_t length() const {
+        return length_;
+    }
+
+    std::uint64_t origin() const {
+        return origin_;
+    }
+
+    std::uint64_t seq() const {
+        return seq_;
+    }
+
+    bool has_frame() const {
+        return length_ > prefix_length + chat_message::header_length;
+    }
+
+    // the length of the frame after the prefix, from its header; data() must
+    // hold at least prefix_length + header_length chars
+    std::size_t frame_length() const {
+        chat_message msg;
+        std::memcpy(msg.data(), data_ + prefix_length, chat_message::header_length);
+        msg.decode_header();
+        return chat_message::header_length + msg.body_length();
+    }
+
+    // parse a record of the given length that has been read into data()
+    bool decode(std::size_t length) {
+        if (length < prefix_length + chat_message::header_length
+            || length > max_length
+            || !multicast_record::decode_seq(data_, origin_)
+            || !multicast_record::decode_seq(data_ + origin_length, seq_)
+            || frame_length() != length - prefix_length)
+            return false;
+        length_ = length;
+        return true;
+    }
+
+    chat_message message() const {
+        chat_message msg;
+        std::memcpy(msg.data(), data_ + prefix_length, chat_message::header_length);
+        msg.decode_header();
+        std::memcpy(msg.body(), data_ + prefix_length + chat_message::header_length,
+            msg.body_length());
+        return msg;
+    }
+
+private:
+    void set_prefix(std::uint64_t origin, std::uint64_t seq) {
+        origin_ = origin;
+        seq_ = seq;
+        multicast_record::encode_seq(data_, origin);
+        multicast_record::encode_seq(data_ + origin_length, seq);
+    }
+
+    char data_[max_length];
+    std::uint64_t origin_;
+    std::uint64_t seq_;
+    std::size_t length_;
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef RETRY_FRAME_HPP
+#define RETRY_FRAME_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "chat_message.hpp"
+
+// retry_frame: the server is too busy to take a new client
+//
+// Instead of joining it to the room, the server sends a client that it
+// can't take now one frame from "Admin" whose text is
+//
+//   kmmmmmmmm
+//   k: retry_kind
+//   mmmmmmmm: how long to wait before connecting again, in milliseconds,
+//             8 hex digits
+//
+// and closes the connection. Text starting with retry_kind is reserved
+// for this frame.
+
+class retry_frame {
+
+public :
+    enum { retry_kind = '\x1e' };
+    enum { field_length = 8 };
+    enum { text_length = 1 + field_length };
+
+    static void encode(chat_message& msg, std::uint32_t retry_ms) {
+        char admin_id[chat_message::id_length + 1] = "Admin";
+        char text[text_length + 1];
+        std::snprintf(text, sizeof(text), "%c%08x", static_cast<char>(retry_kind),
+            static_cast<unsigned>(retry_ms));
+        msg.body_length(chat_message::id_length + text_length);
+        std::memcpy(msg.id(), admin_id, chat_message::id_length);
+        std::memcpy(msg.msg(), text, text_length);
+        msg.encode_header();
+    }
+
+    // false if msg is not a retry frame
+    static bool decode(const chat_message& msg, std::uint32_t& retry_ms) {
+        if (msg.body_length() != chat_message::id_length + text_length
+            || std::strncmp(msg.id(), "Admin", chat_message::id_length) != 0
+            || msg.msg()[0] != retry_kind)
+            return false;
+        char text[field_length + 1] = "";
+        std::strncat(text, msg.msg() + 1, field_length);
+        char* end = nullptr;
+        retry_ms = static_cast<std::uint32_t>(std::strtoul(text, &end, 16));
+        return end == text + field_length;
+    }
+};
+
+#endif
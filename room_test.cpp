@@ -0,0 +1,431 @@
+// room_test.cpp: checks, against a running chat_server, that the room only
+// passes on what clients are allowed to send, and only to whom it is for
+//
+// Each check connects a few participants to <host> <port>, has one of them
+// send something, and looks at what the others read. With --peer <port>,
+// where another node of the same room listens on <host>, it also checks
+// what crosses the relay, and with --proxy <port>, where chat_proxy
+// listens in front of the server, what goes through the proxy. Given the
+// server's --max-backlog <frames>, it checks that a client that stops
+// reading doesn't stall the room. The program prints a line per check and
+// exits non-zero if any of them failed.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "chat_message.hpp"
+#include "chunk_frame.hpp"
+#include "direct_frame.hpp"
+#include "retry_frame.hpp"
+#include "topic_frame.hpp"
+
+#include "asio.hpp"
+using asio::ip::tcp;
+
+std::string make_id(const std::string& id) {
+    std::string padded = id;
+    padded.resize(chat_message::id_length, '\0');
+    return padded;
+}
+
+chat_message make_message(const std::string& id, const std::string& text) {
+    chat_message msg;
+    msg.body_length(chat_message::id_length + text.size());
+    std::memcpy(msg.id(), make_id(id).data(), chat_message::id_length);
+    std::memcpy(msg.msg(), text.data(), text.size());
+    msg.encode_header();
+    return msg;
+}
+
+std::string text_of(const chat_message& msg) {
+    return std::string(msg.msg(), msg.body_length() - chat_message::id_length);
+}
+
+// one participant, which keeps every frame it reads
+class participant {
+public:
+    participant(asio::io_context& io_context, const tcp::endpoint& endpoint,
+        const std::string& id) :
+        socket_(io_context),
+        id_(make_id(id)),
+        credits_seen_(0) {
+        socket_.connect(endpoint);
+        socket_.set_option(tcp::no_delay(true));
+        asio::write(socket_, asio::buffer(id_));
+        read_header();
+    }
+
+    void send(const chat_message& msg) {
+        asio::write(socket_, asio::buffer(msg.data(), msg.length()));
+    }
+
+    // send msg once the messages queued before it are written, without
+    // waiting for the server to read them
+    void queue(const chat_message& msg) {
+        bool writing = !out_.empty();
+        out_.push_back(msg);
+        if (!writing)
+            write_next();
+    }
+
+    const std::deque<chat_message>& frames() const {
+        return frames_;
+    }
+
+    // send payload as one transfer, spending no more than its window before
+    // credit comes back. False if the credit stops coming
+    bool send_transfer(asio::io_context& io_context, std::uint32_t transfer,
+        const std::string& payload) {
+        std::size_t sent = 0;
+        std::size_t in_flight = 0;
+        while (sent < payload.size()) {
+            std::size_t length = std::min<std::size_t>(chunk_frame::max_data,
+                payload.size() - sent);
+            if (in_flight + length <= chunk_frame::window) {
+                chat_message msg;
+                chunk_frame::encode_chunk(msg, id_.data(), transfer, sent,
+                    payload.size(), payload.data() + sent, length);
+                send(msg);
+                sent += length;
+                in_flight += length;
+                continue;
+            }
+            std::size_t credited = 0;
+            for (int wait = 0; wait < 20 && credited == 0; ++wait) {
+                io_context.restart();
+                io_context.run_for(std::chrono::milliseconds(100));
+                credited = take_credit(transfer);
+            }
+            if (credited == 0)
+                return false;
+            in_flight -= std::min(in_flight, credited);
+        }
+        return true;
+    }
+
+    // whether any frame read so far satisfies test
+    bool read_any(std::function<bool(const chat_message&)> test) const {
+        for (auto& msg : frames_)
+            if (test(msg))
+                return true;
+        return false;
+    }
+
+private:
+    // the credit for transfer in the frames read since the last call
+    std::size_t take_credit(std::uint32_t transfer) {
+        std::size_t credited = 0;
+        for (; credits_seen_ < frames_.size(); ++credits_seen_) {
+            chunk_frame credit;
+            const chat_message& msg = frames_[credits_seen_];
+            if (credit.decode(msg) && credit.type() == chunk_frame::credit_kind
+                && credit.transfer() == transfer
+                && std::memcmp(msg.id(), id_.data(), chat_message::id_length) == 0)
+                credited += credit.length();
+        }
+        return credited;
+    }
+
+    void write_next() {
+        asio::async_write(socket_,
+            asio::buffer(out_.front().data(), out_.front().length()),
+            [this](const std::error_code& error, std::size_t) {
+                if (error)
+                    return;
+                out_.pop_front();
+                if (!out_.empty())
+                    write_next();
+            });
+    }
+
+    void read_header() {
+        asio::async_read(socket_,
+            asio::buffer(in_.data(), chat_message::header_length),
+            [this](const std::error_code& error, std::size_t) {
+                if (error || !in_.decode_header())
+                    return;
+                asio::async_read(socket_,
+                    asio::buffer(in_.body(), in_.body_length()),
+                    [this](const std::error_code& error, std::size_t) {
+                        if (error)
+                            return;
+                        frames_.push_back(in_);
+                        read_header();
+                    });
+            });
+    }
+
+    tcp::socket socket_;
+    std::string id_;
+    chat_message in_;
+    std::deque<chat_message> frames_;
+    std::size_t credits_seen_;
+    std::deque<chat_message> out_;
+};
+
+// let the server and the participants catch up
+void settle(asio::io_context& io_context) {
+    io_context.restart();
+    io_context.run_for(std::chrono::milliseconds(300));
+}
+
+bool check(const char* name, bool passed) {
+    std::cout << (passed ? "passed: " : "FAILED: ") << name << std::endl;
+    return passed;
+}
+
+// credit frames only come from the server, so one a client sends reaches no
+// one, and can't eat into another participant's transfer window
+bool forged_credit(const tcp::endpoint& endpoint) {
+    asio::io_context io_context;
+    participant forger(io_context, endpoint, "forger");
+    participant victim(io_context, endpoint, "victim");
+    settle(io_context);
+
+    chat_message credit;
+    chunk_frame::encode_credit(credit, make_id("forger").data(), 0,
+        chunk_frame::window);
+    forger.send(credit);
+    forger.send(make_message("forger", "after the credit"));
+    settle(io_context);
+
+    bool passed = !victim.read_any([](const chat_message& msg) {
+            return chunk_frame::is_credit(msg);
+        })
+        && victim.read_any([](const chat_message& msg) {
+            return text_of(msg) == "after the credit";
+        });
+    return check("a credit frame from a client reaches no one", passed);
+}
+
+// retry frames and "Admin" notices only come from the server either. One a
+// client sends is not passed on, nor kept in the history a newcomer gets,
+// where a retry frame would turn the newcomer away
+bool forged_admin(const tcp::endpoint& endpoint) {
+    asio::io_context io_context;
+    participant forger(io_context, endpoint, "forger");
+    participant victim(io_context, endpoint, "victim");
+    settle(io_context);
+
+    chat_message retry;
+    retry_frame::encode(retry, 60000);
+    forger.send(retry);
+    std::memcpy(retry.id(), make_id("forger").data(), chat_message::id_length);
+    forger.send(retry);
+    forger.send(make_message("Admin", "forged notice"));
+    forger.send(make_message("forger", "after the forgeries"));
+    settle(io_context);
+
+    participant newcomer(io_context, endpoint, "newcomer");
+    settle(io_context);
+
+    auto forged = [](const chat_message& msg) {
+        return (msg.body_length() > chat_message::id_length
+                && msg.msg()[0] == retry_frame::retry_kind)
+            || text_of(msg) == "forged notice";
+    };
+    std::uint32_t retry_ms;
+    bool passed = !victim.read_any(forged) && !newcomer.read_any(forged)
+        && victim.read_any([](const chat_message& msg) {
+            return text_of(msg) == "after the forgeries";
+        })
+        && !newcomer.frames().empty()
+        && !retry_frame::decode(newcomer.frames().front(), retry_ms);
+    return check("retry frames and notices from a client reach no one", passed);
+}
+
+// a message on a topic, or for one user, goes to the other nodes of the
+// room too, but there only to a subscriber or to the user, like here
+bool relayed_routing(const tcp::endpoint& endpoint, const tcp::endpoint& peer) {
+    asio::io_context io_context;
+    participant sender(io_context, endpoint, "sender");
+    participant other(io_context, peer, "other");
+    participant subscriber(io_context, peer, "subscrib");
+    participant recipient(io_context, peer, "recipien");
+    settle(io_context);
+
+    chat_message msg;
+    topic_frame::encode(msg, make_id("subscrib").data(), topic_frame::subscribe_op,
+        "ops.#");
+    subscriber.send(msg);
+    settle(io_context);
+
+    topic_frame::encode(msg, make_id("sender").data(), topic_frame::publish_op,
+        "ops.disk", "on the topic");
+    sender.send(msg);
+    std::string text = "for the recipient";
+    direct_frame::encode(msg, make_id("sender").data(), make_id("recipien").data(),
+        text.data(), text.size());
+    sender.send(msg);
+    settle(io_context);
+    settle(io_context);
+
+    auto published = [](const chat_message& msg) {
+        return topic_frame::is_topic(msg)
+            && topic_frame::text(msg) == "on the topic";
+    };
+    auto direct = [](const chat_message& msg) {
+        return direct_frame::is_direct(msg)
+            && std::string(direct_frame::text(msg),
+                direct_frame::text_length(msg)) == "for the recipient";
+    };
+    bool passed = subscriber.read_any(published) && !subscriber.read_any(direct)
+        && recipient.read_any(direct) && !recipient.read_any(published)
+        && !other.read_any(published) && !other.read_any(direct);
+    return check("topic and direct messages are routed on the other node too",
+        passed);
+}
+
+// the server keeps a participant's first max_subscriptions patterns, and
+// none that is longer than max_pattern_length
+bool subscription_limits(const tcp::endpoint& endpoint) {
+    asio::io_context io_context;
+    participant sender(io_context, endpoint, "sender");
+    participant subscriber(io_context, endpoint, "subscrib");
+    settle(io_context);
+
+    chat_message msg;
+    for (std::size_t i = 0; i <= topic_frame::max_subscriptions; ++i) {
+        topic_frame::encode(msg, make_id("subscrib").data(),
+            topic_frame::subscribe_op, "limit." + std::to_string(i));
+        subscriber.send(msg);
+    }
+    std::string long_topic = "long." + std::string(topic_frame::max_pattern_length, 'x');
+    topic_frame::encode(msg, make_id("subscrib").data(), topic_frame::subscribe_op,
+        long_topic);
+    subscriber.send(msg);
+    settle(io_context);
+
+    std::vector<std::string> topics = {
+        "limit." + std::to_string(topic_frame::max_subscriptions - 1),
+        "limit." + std::to_string(topic_frame::max_subscriptions), long_topic };
+    for (auto& topic : topics) {
+        topic_frame::encode(msg, make_id("sender").data(), topic_frame::publish_op,
+            topic, "on " + topic);
+        sender.send(msg);
+    }
+    settle(io_context);
+
+    auto on = [](const std::string& topic) {
+        return [topic](const chat_message& msg) {
+            return topic_frame::is_topic(msg) && topic_frame::topic(msg) == topic;
+        };
+    };
+    bool passed = subscriber.read_any(on(topics[0]))
+        && !subscriber.read_any(on(topics[1])) && !subscriber.read_any(on(topics[2]));
+    return check("subscriptions past the limits are ignored", passed);
+}
+
+// a transfer from a user behind chat_proxy gets its credit back like one
+// from a client of the server, so it goes on past its first window
+bool proxied_transfer(const tcp::endpoint& endpoint, const tcp::endpoint& proxy) {
+    asio::io_context io_context;
+    participant sender(io_context, proxy, "sender");
+    participant receiver(io_context, endpoint, "receiver");
+    settle(io_context);
+
+    std::string payload(3 * chunk_frame::window, 'p');
+    bool credited = sender.send_transfer(io_context, 7, payload);
+    settle(io_context);
+
+    std::string received;
+    for (auto& msg : receiver.frames()) {
+        chunk_frame chunk;
+        if (chunk.decode(msg) && chunk.type() == chunk_frame::chunk_kind
+            && chunk.transfer() == 7)
+            received.append(chunk.data(), chunk.length());
+    }
+    return check("a transfer through the proxy gets its credit back",
+        credited && received == payload);
+}
+
+// a client that stops reading has its frames pile up in its lanes, past
+// max_backlog if nothing stops them. It is disconnected before that, so
+// the room's backlog drains and the others can still talk
+bool stalled_reader(const tcp::endpoint& endpoint, std::size_t max_backlog) {
+    asio::io_context io_context;
+    tcp::socket stalled(io_context);
+    stalled.open(endpoint.protocol());
+    stalled.set_option(asio::socket_base::receive_buffer_size(1024));
+    stalled.connect(endpoint);
+    asio::write(stalled, asio::buffer(make_id("stalled")));
+
+    participant flooder(io_context, endpoint, "flooder");
+    participant talker(io_context, endpoint, "talker");
+    participant listener(io_context, endpoint, "listener");
+    settle(io_context);
+
+    std::string text(1000, 'f');
+    for (std::size_t i = 0; i < 8 * max_backlog; ++i) {
+        flooder.queue(make_message("flooder", text));
+        if (i % 16 == 15) {
+            io_context.restart();
+            io_context.run_for(std::chrono::milliseconds(20));
+        }
+    }
+    for (int i = 0; i < 5; ++i)
+        settle(io_context);
+
+    talker.send(make_message("talker", "still talking"));
+    for (int i = 0; i < 5; ++i)
+        settle(io_context);
+
+    bool passed = listener.read_any([](const chat_message& msg) {
+        return text_of(msg) == "still talking";
+    });
+    return check("a client that stops reading doesn't stall the room", passed);
+}
+
+int main(int argc, char* argv[]) {
+    std::string peer_port;
+    std::string proxy_port;
+    std::size_t max_backlog = 0;
+    for (int i = 3; i + 1 < argc; i += 2) {
+        std::string option = argv[i];
+        if (option == "--peer")
+            peer_port = argv[i + 1];
+        else if (option == "--proxy")
+            proxy_port = argv[i + 1];
+        else if (option == "--max-backlog")
+            max_backlog = std::atoi(argv[i + 1]);
+        else
+            argc = -1;
+    }
+    if (argc < 3 || argc % 2 == 0) {
+        std::cerr << "Usage: room_test <host> <port> [--peer <port>] "
+            << "[--proxy <port>] [--max-backlog <frames>]" << std::endl;
+        return 1;
+    }
+
+    try {
+        asio::io_context io_context;
+        tcp::resolver resolver(io_context);
+        tcp::endpoint endpoint = *resolver.resolve(argv[1], argv[2]).begin();
+
+        bool passed = true;
+        passed = forged_credit(endpoint) && passed;
+        passed = forged_admin(endpoint) && passed;
+        passed = subscription_limits(endpoint) && passed;
+        if (!peer_port.empty()) {
+            tcp::endpoint peer = *resolver.resolve(argv[1], peer_port).begin();
+            passed = relayed_routing(endpoint, peer) && passed;
+        }
+        if (!proxy_port.empty()) {
+            tcp::endpoint proxy = *resolver.resolve(argv[1], proxy_port).begin();
+            passed = proxied_transfer(endpoint, proxy) && passed;
+        }
+        if (max_backlog != 0)
+            passed = stalled_reader(endpoint, max_backlog) && passed;
+        return passed ? 0 : 1;
+    } catch (std::exception& e) {
+        std::cerr << "Exception: " << e.what() << "\n";
+        return 1;
+    }
+}
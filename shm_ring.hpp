@@ -0,0 +1,325 @@
+#ifndef SHM_RING_HPP
+#define SHM_RING_HPP
+
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#endif
+#include "chat_message.hpp"
+
+// shm_ring: same-host message transport over shared memory
+//
+// A shm_channel is one region in /dev/shm holding two single-producer,
+// single-consumer rings of frame slots: one from the client to the server
+// and one back. Every participant has its own channel, so each ring has
+// exactly one writer and one reader and needs no locks, only the head and
+// tail counters.
+//
+// A side that finds its ring empty (or full) spins for a while, then raises
+// the ring's waiting flag and sleeps. The other side clears the flag when it
+// next pushes (or pops) and wakes it: the client sleeps on a futex in the
+// region, the server on an eventfd that its io_context can wait for. While
+// both sides keep up, a message costs no system call at all.
+//
+// The server creates the region, unlinks its name right away and hands the
+// descriptors to the client over a unix socket (see send_fds), so nothing
+// is left behind in /dev/shm when either side dies.
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2,
+    "shared memory rings need address-free atomics");
+
+// a processor hint for busy-wait loops
+inline void cpu_relax() {
+    #if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+    #elif defined(__aarch64__)
+    asm volatile("yield");
+    #endif
+}
+
+// how long to spin before sleeping. The limit grows while spinning pays off
+// and shrinks while it doesn't, so an idle side goes to sleep quickly and a
+// busy one stays awake. With a single processor the other side can't make
+// progress while we spin, so there is no spinning at all
+class adaptive_spin {
+public :
+    enum { min_spins = 16, max_spins = 16384 };
+
+    adaptive_spin() : limit_(sysconf(_SC_NPROCESSORS_ONLN) > 1 ? min_spins * 4 : 0) {
+    }
+
+    std::size_t limit() const {
+        return limit_;
+    }
+
+    void succeeded() {
+        if (limit_ != 0 && limit_ < max_spins)
+            limit_ *= 2;
+    }
+
+    void failed() {
+        if (limit_ > min_spins)
+            limit_ /= 2;
+    }
+
+private:
+    std::size_t limit_;
+};
+
+class shm_ring {
+
+    //every slot holds one encoded frame: xxxxyyyyyyyy.........
+
+public :
+    enum { slots = 1024 };
+    enum { slot_size = chat_message::header_length + chat_message::id_length
+        + chat_message::max_body_length };
+
+    // producer side. Returns false if the ring is full
+    bool push(const char* data, std::size_t length) {
+        std::uint64_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_.load(std::memory_order_acquire) == slots)
+            return false;
+        std::memcpy(slots_[head % slots], data, length);
+        head_.store(head + 1, std::memory_order_seq_cst);
+        return true;
+    }
+
+    // consumer side. Returns false if the ring is empty
+    bool pop(chat_message& msg) {
+        std::uint64_t tail = tail_.load(std::memory_order_relaxed);
+        if (head_.load(std::memory_order_acquire) == tail)
+            return false;
+        const char* slot = slots_[tail % slots];
+        std::memcpy(msg.data(), slot, chat_message::header_length);
+        if (!msg.decode_header())
+            msg.body_length(0);
+        std::memcpy(msg.body(), slot + chat_message::header_length,
+            msg.body_length());
+        tail_.store(tail + 1, std::memory_order_seq_cst);
+        return true;
+    }
+
+    bool empty() const {
+        return head_.load(std::memory_order_acquire)
+            == tail_.load(std::memory_order_acquire);
+    }
+
+    bool full() const {
+        return head_.load(std::memory_order_acquire)
+            - tail_.load(std::memory_order_acquire) == slots;
+    }
+
+    // a side about to sleep raises its flag, then checks the ring once more
+    // before sleeping; the other side takes the flag down and wakes it
+    void consumer_sleeps() {
+        consumer_waiting_.store(1, std::memory_order_seq_cst);
+    }
+
+    void producer_sleeps() {
+        producer_waiting_.store(1, std::memory_order_seq_cst);
+    }
+
+    bool consumer_asleep() {
+        return consumer_waiting_.load(std::memory_order_seq_cst) != 0
+            && consumer_waiting_.exchange(0) != 0;
+    }
+
+    bool producer_asleep() {
+        return producer_waiting_.load(std::memory_order_seq_cst) != 0
+            && producer_waiting_.exchange(0) != 0;
+    }
+
+private:
+    // the counters sit on cache lines of their own so the two sides don't
+    // keep stealing each other's line
+    alignas(64) std::atomic<std::uint64_t> head_;
+    alignas(64) std::atomic<std::uint64_t> tail_;
+    alignas(64) std::atomic<std::uint32_t> consumer_waiting_;
+    std::atomic<std::uint32_t> producer_waiting_;
+    alignas(64) char slots_[slots][slot_size];
+};
+
+class shm_channel {
+public :
+    // what the region holds; a fresh mapping is all zeros, which is the
+    // initial state of everything in it
+    struct region {
+        shm_ring to_server;
+        shm_ring to_client;
+        // the futex that client threads sleep on
+        alignas(64) std::atomic<std::uint32_t> client_wakeups;
+    };
+
+    shm_channel() : region_(NULL), fd_(-1), event_fd_(-1) {
+    }
+
+    ~shm_channel() {
+        if (region_ != NULL)
+            munmap(region_, sizeof(region));
+        if (fd_ >= 0)
+            close(fd_);
+        if (event_fd_ >= 0)
+            close(event_fd_);
+    }
+
+    // server side: a new region in /dev/shm, and the eventfd for waking the
+    // server
+    bool create() {
+        #if defined(__linux__)
+        static std::atomic<unsigned> counter(0);
+        char name[64];
+        std::snprintf(name, sizeof(name), "/chat-%d-%u",
+            static_cast<int>(getpid()), counter++);
+        fd_ = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+        if (fd_ < 0)
+            return false;
+        shm_unlink(name);
+        if (ftruncate(fd_, sizeof(region)) != 0 || !map())
+            return false;
+        event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        return event_fd_ >= 0;
+        #else
+        return false;
+        #endif
+    }
+
+    // client side: the descriptors received from the server
+    bool attach(int fd, int event_fd) {
+        fd_ = fd;
+        event_fd_ = event_fd;
+        return map();
+    }
+
+    region& shared() {
+        return *region_;
+    }
+
+    int fd() const {
+        return fd_;
+    }
+
+    int event_fd() const {
+        return event_fd_;
+    }
+
+    void wake_server() {
+        std::uint64_t one = 1;
+        ssize_t n = write(event_fd_, &one, sizeof(one));
+        (void)n;
+    }
+
+    // consume the server's wakeups
+    void clear_server_wakeups() {
+        std::uint64_t count;
+        ssize_t n = read(event_fd_, &count, sizeof(count));
+        (void)n;
+    }
+
+    void wake_client() {
+        region_->client_wakeups.fetch_add(1);
+        futex(FUTEX_WAKE, INT_MAX);
+    }
+
+    // client side: spin, then sleep until ready() holds. sleeps() raises the
+    // flag that makes the server wake us
+    template <typename Ready, typename Sleeps>
+    void wait_client(adaptive_spin& spin, Ready ready, Sleeps sleeps) {
+        for (std::size_t i = 0; i < spin.limit(); ++i) {
+            if (ready()) {
+                spin.succeeded();
+                return;
+            }
+            cpu_relax();
+        }
+        spin.failed();
+
+        while (!ready()) {
+            std::uint32_t wakeups = region_->client_wakeups.load();
+            sleeps();
+            if (ready())
+                return;
+            futex(FUTEX_WAIT, wakeups);
+        }
+    }
+
+private:
+    bool map() {
+        void* p = mmap(NULL, sizeof(region), PROT_READ | PROT_WRITE,
+            MAP_SHARED, fd_, 0);
+        if (p == MAP_FAILED)
+            return false;
+        region_ = static_cast<region*>(p);
+        return true;
+    }
+
+    // the futex is shared between processes, so no FUTEX_PRIVATE_FLAG
+    void futex(int op, std::uint32_t value) {
+        #if defined(__linux__)
+        syscall(SYS_futex, &region_->client_wakeups, op, value, NULL, NULL, 0);
+        #endif
+    }
+
+    region* region_;
+    int fd_;
+    int event_fd_;
+};
+
+// pass the channel's descriptors over a unix socket, with one byte of data
+inline bool send_fds(int socket, int fd, int event_fd) {
+    char byte = 0;
+    iovec iov = { &byte, 1 };
+    char control[CMSG_SPACE(2 * sizeof(int))];
+    std::memset(control, 0, sizeof(control));
+    msghdr msg = msghdr();
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(2 * sizeof(int));
+    int fds[2] = { fd, event_fd };
+    std::memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    return sendmsg(socket, &msg, MSG_NOSIGNAL) == 1;
+}
+
+inline bool receive_fds(int socket, int& fd, int& event_fd) {
+    char byte;
+    iovec iov = { &byte, 1 };
+    char control[CMSG_SPACE(2 * sizeof(int))];
+    msghdr msg = msghdr();
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t n;
+    do {
+        n = recvmsg(socket, &msg, MSG_CMSG_CLOEXEC);
+    } while (n < 0 && errno == EINTR);
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (n != 1 || cmsg == NULL || cmsg->cmsg_type != SCM_RIGHTS
+        || cmsg->cmsg_len != CMSG_LEN(2 * sizeof(int)))
+        return false;
+    int fds[2];
+    std::memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+    fd = fds[0];
+    event_fd = fds[1];
+    return true;
+}
+
+#endif
@@ -0,0 +1,382 @@
+// storm_bench.cpp: a reconnect storm against chat_server, as the users
+// already in the room see it
+//
+// <users> participants join first. One of them sends a message every
+// ping_ms, and another times how long each one takes to reach it, for a
+// quiet second and then during the storm. In the storm, <reconnects>
+// clients connect, <concurrent> at a time; each one joins the room, reads
+// the history like any client, and leaves as soon as its join notice
+// arrives. A client refused with a retry_frame waits as long as the server
+// says and connects again. Since the clients don't stay, a storm of 100k
+// reconnects fits under the file descriptor limit, with <concurrent> in
+// flight at once. Run it against a server with admission control
+// (--max-loop-lag, --max-queued, --max-cpu) and one without.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include "bench_clock.hpp"
+#include "chat_message.hpp"
+#include "retry_frame.hpp"
+
+#include "asio.hpp"
+using asio::ip::tcp;
+
+std::string make_id(const std::string& id) {
+    std::string padded = id;
+    padded.resize(chat_message::id_length, '\0');
+    return padded;
+}
+
+void print_latencies(const char* phase, std::vector<double>& latencies) {
+    if (latencies.empty()) {
+        std::printf("  %s: no messages\n", phase);
+        return;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    std::printf("  %s latency ms: p50 %.1f p99 %.1f max %.1f (%zu messages)\n",
+        phase, latencies[latencies.size() / 2] * 1e3,
+        latencies[latencies.size() * 99 / 100] * 1e3, latencies.back() * 1e3,
+        latencies.size());
+}
+
+// a user who stays in the room. The pinger sends the time it was sent,
+// the watcher reads it back; everyone else just reads what the room sends
+class user {
+public:
+    enum role { pinger, watcher, bystander };
+    enum { ping_ms = 20 };
+
+    user(asio::io_context& io_context, const tcp::endpoint& endpoint,
+        const std::string& id, role r) :
+        socket_(io_context),
+        timer_(io_context),
+        id_(make_id(id)),
+        role_(r),
+        storm_(false) {
+        socket_.connect(endpoint);
+        socket_.set_option(tcp::no_delay(true));
+        asio::write(socket_, asio::buffer(id_));
+        if (role_ == watcher)
+            read_header();
+        else
+            discard();
+        if (role_ == pinger)
+            ping();
+    }
+
+    void storm(bool on) {
+        storm_ = on;
+    }
+
+    void stop() {
+        std::error_code ignored;
+        timer_.cancel();
+        socket_.close(ignored);
+    }
+
+    std::vector<double> quiet;
+    std::vector<double> stormy;
+
+private:
+    void ping() {
+        timer_.expires_after(std::chrono::milliseconds(ping_ms));
+        timer_.async_wait([this](const std::error_code& error) {
+            if (error)
+                return;
+            std::string text = "ping " + std::to_string(wall_seconds());
+            out_.body_length(text.size() + chat_message::id_length);
+            std::memcpy(out_.id(), id_.data(), chat_message::id_length);
+            std::memcpy(out_.msg(), text.data(), text.size());
+            out_.encode_header();
+            asio::write(socket_, asio::buffer(out_.data(), out_.length()));
+            ping();
+        });
+    }
+
+    void discard() {
+        socket_.async_read_some(asio::buffer(buf_, sizeof(buf_)),
+            [this](const std::error_code& error, std::size_t) {
+                if (!error)
+                    discard();
+            });
+    }
+
+    void read_header() {
+        asio::async_read(socket_,
+            asio::buffer(in_.data(), chat_message::header_length),
+            [this](const std::error_code& error, std::size_t) {
+                if (error || !in_.decode_header())
+                    return;
+                asio::async_read(socket_,
+                    asio::buffer(in_.body(), in_.body_length()),
+                    [this](const std::error_code& error, std::size_t) {
+                        if (error)
+                            return;
+                        std::size_t length = in_.body_length() - chat_message::id_length;
+                        if (length > 5 && std::memcmp(in_.msg(), "ping ", 5) == 0) {
+                            double sent = std::atof(std::string(in_.msg() + 5,
+                                length - 5).c_str());
+                            (storm_ ? stormy : quiet).push_back(wall_seconds() - sent);
+                        }
+                        read_header();
+                    });
+            });
+    }
+
+    tcp::socket socket_;
+    asio::steady_timer timer_;
+    std::string id_;
+    role role_;
+    bool storm_;
+    chat_message in_;
+    chat_message out_;
+    char buf_[65536];
+};
+
+class storm;
+
+// one reconnecting client at a time, over and over
+class slot {
+public:
+    slot(asio::io_context& io_context, const tcp::endpoint& endpoint,
+        storm& owner) :
+        endpoint_(endpoint),
+        owner_(owner),
+        socket_(io_context),
+        timer_(io_context) {
+    }
+
+    void start(std::size_t client) {
+        id_ = make_id("r" + std::to_string(client));
+        notice_ = std::string(id_.c_str()) + " joined the chat";
+        connect();
+    }
+
+private:
+    void connect() {
+        socket_.async_connect(endpoint_,
+            [this](const std::error_code& error) {
+                if (error) {
+                    fail(error);
+                    return;
+                }
+                asio::async_write(socket_, asio::buffer(id_),
+                    [this](const std::error_code& error, std::size_t) {
+                        if (error)
+                            fail(error);
+                        else
+                            read_header();
+                    });
+            });
+    }
+
+    void read_header() {
+        asio::async_read(socket_,
+            asio::buffer(msg_.data(), chat_message::header_length),
+            [this](const std::error_code& error, std::size_t /*length*/) {
+                if (error || !msg_.decode_header()) {
+                    fail(error);
+                    return;
+                }
+                asio::async_read(socket_,
+                    asio::buffer(msg_.body(), msg_.body_length()),
+                    [this](const std::error_code& error, std::size_t) {
+                        if (error) {
+                            fail(error);
+                            return;
+                        }
+                        handle_message();
+                    });
+            });
+    }
+
+    void handle_message() {
+        std::uint32_t retry_ms = 0;
+        if (retry_frame::decode(msg_, retry_ms)) {
+            std::error_code ignored;
+            socket_.close(ignored);
+            refused(retry_ms);
+            timer_.expires_after(std::chrono::milliseconds(retry_ms));
+            timer_.async_wait([this](const std::error_code&) {
+                connect();
+            });
+            return;
+        }
+
+        std::size_t length = msg_.body_length() - chat_message::id_length;
+        if (length != notice_.size()
+            || std::memcmp(msg_.msg(), notice_.data(), length) != 0) {
+            read_header();
+            return;
+        }
+        std::error_code ignored;
+        socket_.close(ignored);
+        done();
+    }
+
+    void fail(const std::error_code& error);
+    void refused(std::uint32_t retry_ms);
+    void done();
+
+    tcp::endpoint endpoint_;
+    storm& owner_;
+    tcp::socket socket_;
+    asio::steady_timer timer_;
+    std::string id_;
+    std::string notice_;
+    chat_message msg_;
+};
+
+class storm {
+public:
+    storm(asio::io_context& io_context, const tcp::endpoint& endpoint,
+        std::size_t reconnects, std::size_t concurrent,
+        std::function<void()> finished) :
+        reconnects_(reconnects),
+        started_(0),
+        finished_(0),
+        failed_(0),
+        refused_(0),
+        max_retry_ms_(0),
+        start_(0),
+        cpu_start_(0),
+        done_(finished) {
+        for (std::size_t i = 0; i < concurrent; ++i)
+            slots_.emplace_back(new slot(io_context, endpoint, *this));
+    }
+
+    void run() {
+        start_ = wall_seconds();
+        cpu_start_ = cpu_seconds();
+        for (auto& s : slots_)
+            next(*s);
+    }
+
+    // a slot is free again; false once the storm is over
+    bool next(slot& s) {
+        if (started_ == reconnects_)
+            return false;
+        s.start(started_++);
+        return true;
+    }
+
+    void refused(std::uint32_t retry_ms) {
+        ++refused_;
+        max_retry_ms_ = std::max(max_retry_ms_, retry_ms);
+    }
+
+    void finished(slot& s, bool failed) {
+        ++finished_;
+        failed_ += failed;
+        if (!next(s) && finished_ == reconnects_) {
+            report();
+            done_();
+        }
+    }
+
+private:
+    void report() const {
+        double wall = wall_seconds() - start_;
+        double cpu = cpu_seconds() - cpu_start_;
+        std::printf("storm: %zu reconnects, %zu at a time, %zu failed\n",
+            reconnects_, slots_.size(), failed_);
+        std::printf("  joins/s: %.0f, over %.1f s\n", reconnects_ / wall, wall);
+        std::printf("  refused: %zu times, longest retry hint %u ms\n",
+            refused_, static_cast<unsigned>(max_retry_ms_));
+        std::printf("  client cpu us/reconnect: %.0f\n", cpu * 1e6 / reconnects_);
+    }
+
+    std::vector<std::unique_ptr<slot> > slots_;
+    std::size_t reconnects_;
+    std::size_t started_;
+    std::size_t finished_;
+    std::size_t failed_;
+    std::size_t refused_;
+    std::uint32_t max_retry_ms_;
+    double start_;
+    double cpu_start_;
+    std::function<void()> done_;
+};
+
+void slot::fail(const std::error_code& error) {
+    std::cerr << "connection: " << error.message() << std::endl;
+    std::error_code ignored;
+    socket_.close(ignored);
+    owner_.finished(*this, true);
+}
+
+void slot::refused(std::uint32_t retry_ms) {
+    owner_.refused(retry_ms);
+}
+
+void slot::done() {
+    owner_.finished(*this, false);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 4 || argc > 6) {
+        std::cerr << "Usage: storm_bench <host> <port> <reconnects> "
+            << "[<concurrent> [<users>]]" << std::endl;
+        return 1;
+    }
+
+    std::size_t reconnects = std::atoi(argv[3]);
+    std::size_t concurrent = argc >= 5 ? std::atoi(argv[4]) : 1000;
+    std::size_t users = argc == 6 ? std::atoi(argv[5]) : 20;
+    if (reconnects < 1 || concurrent < 1 || users < 2) {
+        std::cerr << "need at least 1 reconnect, 1 at a time, and 2 users"
+            << std::endl;
+        return 1;
+    }
+
+    // a slot and a user each hold a socket
+    rlimit files;
+    getrlimit(RLIMIT_NOFILE, &files);
+    files.rlim_cur = files.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &files);
+    if (concurrent + users + 16 > files.rlim_cur) {
+        std::cerr << "at most " << files.rlim_cur - users - 16
+            << " at a time under the file descriptor limit" << std::endl;
+        return 1;
+    }
+
+    try {
+        asio::io_context io_context;
+        tcp::resolver resolver(io_context);
+        tcp::endpoint endpoint = *resolver.resolve(argv[1], argv[2]).begin();
+
+        std::vector<std::unique_ptr<user> > room;
+        for (std::size_t i = 0; i < users; ++i)
+            room.emplace_back(new user(io_context, endpoint,
+                "u" + std::to_string(i),
+                i == 0 ? user::pinger : i == 1 ? user::watcher : user::bystander));
+
+        storm s(io_context, endpoint, reconnects, concurrent, [&room]() {
+            print_latencies("quiet", room[1]->quiet);
+            print_latencies("storm", room[1]->stormy);
+            for (auto& u : room)
+                u->stop();
+        });
+
+        asio::steady_timer quiet(io_context, std::chrono::seconds(1));
+        quiet.async_wait([&](const std::error_code&) {
+            room[1]->storm(true);
+            s.run();
+        });
+        io_context.run();
+    } catch (std::exception& e) {
+        std::cerr << "Exception: " << e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
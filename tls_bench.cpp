@@ -0,0 +1,262 @@
+// tls_bench.cpp: a reconnect storm against chat_server's TLS port
+//
+// Makes <connections> TLS connections, <concurrent> at a time, each one
+// shaking hands, joining the room and leaving again as soon as its join
+// notice arrives. The storm runs twice: first with a full handshake for
+// every connection, then with every connection resuming the session of the
+// last one made from the same slot; "full" or "resumed" runs just the one.
+// Run the server under `time` (or watch its CPU) to see what the resumed
+// handshakes save it.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "bench_clock.hpp"
+#include "chat_message.hpp"
+
+#include "asio.hpp"
+#include "asio/ssl.hpp"
+using asio::ip::tcp;
+
+typedef asio::ssl::stream<tcp::socket> tls_socket;
+
+class storm;
+
+// one connection at a time, over and over. With resume set, each one offers
+// the session of the one before
+class slot {
+public:
+    slot(asio::io_context& io_context, asio::ssl::context& context,
+        const tcp::endpoint& endpoint, storm& owner, std::size_t index) :
+        io_context_(io_context),
+        context_(context),
+        endpoint_(endpoint),
+        owner_(owner),
+        session_(nullptr),
+        resume_(false) {
+        std::string id = "s" + std::to_string(index);
+        id.resize(chat_message::id_length, '\0');
+        id_ = id;
+        notice_ = std::string(id_.c_str()) + " joined the chat";
+    }
+
+    ~slot() {
+        if (session_)
+            SSL_SESSION_free(session_);
+    }
+
+    void start(bool resume) {
+        resume_ = resume;
+        socket_.reset(new tls_socket(io_context_, context_));
+        if (resume_ && session_)
+            SSL_set_session(socket_->native_handle(), session_);
+        socket_->lowest_layer().async_connect(endpoint_,
+            [this](const std::error_code& error) {
+                if (error) {
+                    fail(error);
+                    return;
+                }
+                socket_->lowest_layer().set_option(tcp::no_delay(true));
+                socket_->async_handshake(asio::ssl::stream_base::client,
+                    [this](const std::error_code& error) {
+                        if (error) {
+                            fail(error);
+                            return;
+                        }
+                        asio::async_write(*socket_, asio::buffer(id_),
+                            [this](const std::error_code& error, std::size_t) {
+                                if (error)
+                                    fail(error);
+                                else
+                                    read_header();
+                            });
+                    });
+            });
+    }
+
+private:
+    void read_header() {
+        asio::async_read(*socket_,
+            asio::buffer(msg_.data(), chat_message::header_length),
+            [this](const std::error_code& error, std::size_t /*length*/) {
+                if (error || !msg_.decode_header()) {
+                    fail(error);
+                    return;
+                }
+                asio::async_read(*socket_,
+                    asio::buffer(msg_.body(), msg_.body_length()),
+                    [this](const std::error_code& error, std::size_t) {
+                        if (error) {
+                            fail(error);
+                            return;
+                        }
+                        handle_message();
+                    });
+            });
+    }
+
+    // the join notice is the last step. By then any session tickets have
+    // arrived too, since the server sends them ahead of the room's frames
+    void handle_message() {
+        std::size_t length = msg_.body_length() - chat_message::id_length;
+        if (length != notice_.size()
+            || std::memcmp(msg_.msg(), notice_.data(), length) != 0) {
+            read_header();
+            return;
+        }
+
+        SSL* ssl = socket_->native_handle();
+        bool reused = SSL_session_reused(ssl) == 1;
+        if (resume_) {
+            if (session_)
+                SSL_SESSION_free(session_);
+            session_ = SSL_get1_session(ssl);
+        }
+        // OpenSSL spoils the session of a connection dropped without a
+        // shutdown, so claim to have sent one
+        SSL_set_shutdown(ssl, SSL_SENT_SHUTDOWN);
+        std::error_code ignored;
+        socket_->lowest_layer().close(ignored);
+        done(reused);
+    }
+
+    void fail(const std::error_code& error);
+    void done(bool reused);
+
+    asio::io_context& io_context_;
+    asio::ssl::context& context_;
+    tcp::endpoint endpoint_;
+    storm& owner_;
+    std::unique_ptr<tls_socket> socket_;
+    SSL_SESSION* session_;
+    bool resume_;
+    std::string id_;
+    std::string notice_;
+    chat_message msg_;
+};
+
+class storm {
+public:
+    storm(asio::io_context& io_context, asio::ssl::context& context,
+        const tcp::endpoint& endpoint, std::size_t connections,
+        std::size_t concurrent) :
+        connections_(connections),
+        started_(0),
+        finished_(0),
+        reused_(0),
+        failed_(0),
+        resume_(false),
+        start_(0),
+        cpu_start_(0) {
+        for (std::size_t i = 0; i < concurrent; ++i)
+            slots_.emplace_back(new slot(io_context, context, endpoint, *this, i));
+    }
+
+    void run(bool resume) {
+        resume_ = resume;
+        started_ = finished_ = reused_ = failed_ = 0;
+        start_ = wall_seconds();
+        cpu_start_ = cpu_seconds();
+        for (auto& s : slots_)
+            next(*s);
+    }
+
+    // a slot is free again; false once the storm is over
+    bool next(slot& s) {
+        if (started_ == connections_)
+            return false;
+        ++started_;
+        s.start(resume_);
+        return true;
+    }
+
+    void finished(slot& s, bool reused, bool failed) {
+        ++finished_;
+        reused_ += reused;
+        failed_ += failed;
+        if (!next(s) && finished_ == connections_)
+            report();
+    }
+
+private:
+    void report() const {
+        double wall = wall_seconds() - start_;
+        double cpu = cpu_seconds() - cpu_start_;
+        std::printf("%s: %zu connections, %zu resumed, %zu failed\n",
+            resume_ ? "resumed" : "full", connections_, reused_, failed_);
+        std::printf("  connections/s: %.0f\n", connections_ / wall);
+        std::printf("  client cpu us/connection: %.0f\n",
+            cpu * 1e6 / connections_);
+    }
+
+    std::vector<std::unique_ptr<slot> > slots_;
+    std::size_t connections_;
+    std::size_t started_;
+    std::size_t finished_;
+    std::size_t reused_;
+    std::size_t failed_;
+    bool resume_;
+    double start_;
+    double cpu_start_;
+};
+
+void slot::fail(const std::error_code& error) {
+    std::cerr << "connection: " << error.message() << std::endl;
+    std::error_code ignored;
+    socket_->lowest_layer().close(ignored);
+    owner_.finished(*this, false, true);
+}
+
+void slot::done(bool reused) {
+    owner_.finished(*this, reused, false);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 4 || argc > 6) {
+        std::cerr << "Usage: tls_bench <host> <tls port> <connections> "
+            << "[<concurrent> [full|resumed]]" << std::endl;
+        return 1;
+    }
+
+    std::size_t connections = std::atoi(argv[3]);
+    std::size_t concurrent = argc >= 5 ? std::atoi(argv[4]) : 16;
+    std::string mode = argc == 6 ? argv[5] : "both";
+    if (connections < 1 || concurrent < 1) {
+        std::cerr << "need at least 1 connection, 1 at a time" << std::endl;
+        return 1;
+    }
+
+    try {
+        asio::io_context io_context;
+        tcp::resolver resolver(io_context);
+        tcp::endpoint endpoint = *resolver.resolve(argv[1], argv[2]).begin();
+
+        // the handshakes are what is measured, so the server's certificate
+        // isn't checked
+        asio::ssl::context context(asio::ssl::context::tls_client);
+        context.set_verify_mode(asio::ssl::verify_none);
+        SSL_CTX_set_session_cache_mode(context.native_handle(),
+            SSL_SESS_CACHE_CLIENT);
+
+        storm s(io_context, context, endpoint, connections, concurrent);
+        if (mode != "resumed") {
+            s.run(false);
+            io_context.run();
+            io_context.restart();
+        }
+        if (mode != "full") {
+            s.run(true);
+            io_context.run();
+        }
+    } catch (std::exception& e) {
+        std::cerr << "Exception: " << e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
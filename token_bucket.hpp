@@ -0,0 +1,69 @@
+#ifndef TOKEN_BUCKET_HPP
+#define TOKEN_BUCKET_HPP
+
+#include <algorithm>
+#include <chrono>
+
+// token_bucket: a rate with bursts
+//
+// Tokens come in at rate per second, up to burst of them, and each thing
+// let through takes one. A bucket with no rate lets everything through.
+
+class token_bucket {
+
+public :
+    typedef std::chrono::steady_clock clock;
+
+    token_bucket() : rate_(0), burst_(0), tokens_(0) {
+    }
+
+    // starts full
+    token_bucket(double rate, double burst) :
+        rate_(rate),
+        burst_(std::max(burst, 1.0)),
+        tokens_(burst_),
+        last_(clock::now()) {
+    }
+
+    bool limited() const {
+        return rate_ > 0;
+    }
+
+    // take a token if there is one
+    bool take(clock::time_point now) {
+        if (!limited())
+            return true;
+        refill(now);
+        if (tokens_ < 1)
+            return false;
+        tokens_ -= 1;
+        return true;
+    }
+
+    // how long until there is a token
+    clock::duration wait(clock::time_point now) {
+        if (!limited())
+            return clock::duration::zero();
+        refill(now);
+        if (tokens_ >= 1)
+            return clock::duration::zero();
+        return std::chrono::duration_cast<clock::duration>(
+            std::chrono::duration<double>((1 - tokens_) / rate_));
+    }
+
+private:
+    void refill(clock::time_point now) {
+        if (now <= last_)
+            return;
+        double elapsed = std::chrono::duration<double>(now - last_).count();
+        tokens_ = std::min(burst_, tokens_ + elapsed * rate_);
+        last_ = now;
+    }
+
+    double rate_;
+    double burst_;
+    double tokens_;
+    clock::time_point last_;
+};
+
+#endif
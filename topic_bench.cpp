@@ -0,0 +1,144 @@
+// topic_bench.cpp: matching a published topic against many subscriptions
+//
+// Builds a topic_trie of 10,000 subscriptions, then ten times as many, up to
+// <subscriptions>, and publishes <publishes> random topics on each. Topics
+// look like svc3.region7.host1234.metric5, with as many hosts as it takes for
+// there to be about as many topics as subscriptions, so that a topic has
+// about the same number of subscribers however many subscriptions there are.
+// Most subscriptions are to one topic; some have a * for the region or the
+// metric, and a few end in # after the host.
+//
+// The time a match takes is compared with a scan that tests every pattern,
+// which is what matching costs without an index. The scan also checks the
+// trie: both must find the same subscriptions, or the bench fails.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "bench_clock.hpp"
+#include "topic_trie.hpp"
+
+struct topic_space {
+    explicit topic_space(std::size_t subscriptions) :
+        hosts(std::max<std::size_t>(1, subscriptions / 1000)) {
+    }
+
+    std::string topic(std::mt19937& random) const {
+        return "svc" + std::to_string(random() % 10)
+            + ".region" + std::to_string(random() % 10)
+            + ".host" + std::to_string(random() % hosts)
+            + ".metric" + std::to_string(random() % 10);
+    }
+
+    // a topic, or a pattern made from one
+    std::string pattern(std::mt19937& random) const {
+        std::string svc = "svc" + std::to_string(random() % 10);
+        std::string region = "region" + std::to_string(random() % 10);
+        std::string host = "host" + std::to_string(random() % hosts);
+        std::string metric = "metric" + std::to_string(random() % 10);
+        unsigned kind = random() % 100;
+        if (kind < 5)
+            region = "*";
+        else if (kind < 9)
+            metric = "*";
+        else if (kind < 10)
+            return svc + "." + region + "." + host + ".#";
+        return svc + "." + region + "." + host + "." + metric;
+    }
+
+    std::size_t hosts;
+};
+
+// what matching costs without an index: every pattern, word by word
+bool matches(const std::vector<std::string>& pattern,
+    const std::vector<std::string>& topic) {
+    for (std::size_t i = 0; i < pattern.size(); ++i) {
+        if (pattern[i] == "#")
+            return true;
+        if (i == topic.size() || (pattern[i] != "*" && pattern[i] != topic[i]))
+            return false;
+    }
+    return pattern.size() == topic.size();
+}
+
+// false if the trie and the scan disagree
+bool run(std::size_t subscriptions, std::size_t publishes) {
+    topic_space space(subscriptions);
+    std::mt19937 random(subscriptions);
+
+    std::vector<std::string> patterns;
+    patterns.reserve(subscriptions);
+    for (std::size_t i = 0; i < subscriptions; ++i)
+        patterns.push_back(space.pattern(random));
+
+    topic_trie<std::uint32_t> trie;
+    double start = wall_seconds();
+    for (std::size_t i = 0; i < subscriptions; ++i)
+        trie.subscribe(patterns[i], static_cast<std::uint32_t>(i));
+    double build = wall_seconds() - start;
+
+    std::vector<std::string> topics;
+    for (std::size_t i = 0; i < publishes; ++i)
+        topics.push_back(space.topic(random));
+
+    unsigned long long found = 0;
+    start = wall_seconds();
+    for (auto& topic : topics)
+        trie.match(topic, [&found](std::uint32_t) { ++found; });
+    double match = wall_seconds() - start;
+
+    // the scan takes long enough with a few topics
+    std::size_t scanned = std::min<std::size_t>(publishes, 20);
+    std::vector<std::vector<std::string> > split(subscriptions);
+    for (std::size_t i = 0; i < subscriptions; ++i)
+        topic_trie<std::uint32_t>::split(patterns[i], true, split[i]);
+    bool agree = true;
+    double scan = 0;
+    for (std::size_t t = 0; t < scanned; ++t) {
+        std::vector<std::string> words;
+        topic_trie<std::uint32_t>::split(topics[t], false, words);
+        std::vector<std::uint32_t> by_scan;
+        start = wall_seconds();
+        for (std::size_t i = 0; i < subscriptions; ++i)
+            if (matches(split[i], words))
+                by_scan.push_back(static_cast<std::uint32_t>(i));
+        scan += wall_seconds() - start;
+        std::vector<std::uint32_t> by_trie;
+        trie.match(topics[t], [&by_trie](std::uint32_t s) { by_trie.push_back(s); });
+        std::sort(by_trie.begin(), by_trie.end());
+        agree = agree && by_trie == by_scan;
+    }
+
+    std::printf("%8zu subscriptions: built in %6.3f s, %7.0f ns a match "
+        "(%.1f subscribers), scan %10.0f ns a match%s\n",
+        subscriptions, build, match / publishes * 1e9,
+        static_cast<double>(found) / publishes, scan / scanned * 1e9,
+        agree ? "" : ", MISMATCH");
+    std::fflush(stdout);
+    return agree;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 3) {
+        std::cerr << "Usage: topic_bench [<subscriptions> [<publishes>]]"
+            << std::endl;
+        return 1;
+    }
+
+    std::size_t subscriptions = argc >= 2 ? std::atoi(argv[1]) : 1000000;
+    std::size_t publishes = argc == 3 ? std::atoi(argv[2]) : 100000;
+    if (subscriptions < 10000 || publishes < 1) {
+        std::cerr << "need at least 10000 subscriptions and 1 publish"
+            << std::endl;
+        return 1;
+    }
+
+    bool agree = true;
+    for (std::size_t n = 10000; n <= subscriptions; n *= 10)
+        agree = run(n, publishes) && agree;
+    return agree ? 0 : 1;
+}
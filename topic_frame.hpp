@@ -0,0 +1,89 @@
+#ifndef TOPIC_FRAME_HPP
+#define TOPIC_FRAME_HPP
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include "chat_message.hpp"
+
+// topic_frame: subscribing to topics, and publishing on one
+//
+// A client subscribes to the topics matching a pattern (see topic_trie.hpp
+// for topics and patterns), unsubscribes, or publishes a message on a topic
+// with an ordinary frame whose text is
+//
+//   kotttt...[ ....]
+//   k: topic_kind
+//   o: subscribe_op, unsubscribe_op or publish_op
+//   tttt...: the pattern or the topic, up to the first space
+//   ....: the message, after the space, when publishing
+//
+// A published message goes as it is to every participant with a matching
+// subscription, once, and isn't kept as history. Text starting with
+// topic_kind is reserved for these frames.
+//
+// The server keeps up to max_subscriptions patterns for each participant,
+// none longer than max_pattern_length, and ignores subscriptions past
+// either.
+
+class topic_frame {
+
+public :
+    enum { topic_kind = '\x1a' };
+    enum op { subscribe_op = '+', unsubscribe_op = '-', publish_op = '>' };
+    enum { prefix_length = 2 };
+    enum { max_subscriptions = 64 };
+    enum { max_pattern_length = 256 };
+
+    static bool is_topic(const chat_message& msg) {
+        return msg.body_length() > chat_message::id_length + prefix_length
+            && msg.msg()[0] == topic_kind;
+    }
+
+    // a subscription or unsubscription rather than a published message
+    static bool is_subscription(const chat_message& msg) {
+        return is_topic(msg) && msg.msg()[1] != publish_op;
+    }
+
+    // text is cut short to fit the frame
+    static void encode(chat_message& msg, const char* id, op o,
+        const std::string& topic, const std::string& text = std::string()) {
+        std::string body = topic;
+        if (o == publish_op)
+            body += " " + text;
+        std::size_t length = std::min<std::size_t>(body.size(),
+            chat_message::max_body_length - chat_message::id_length - prefix_length);
+        msg.body_length(chat_message::id_length + prefix_length + length);
+        std::memcpy(msg.id(), id, chat_message::id_length);
+        msg.msg()[0] = topic_kind;
+        msg.msg()[1] = static_cast<char>(o);
+        std::memcpy(msg.msg() + prefix_length, body.data(), length);
+        msg.encode_header();
+    }
+
+    static op operation(const chat_message& msg) {
+        return static_cast<op>(msg.msg()[1]);
+    }
+
+    static std::string topic(const chat_message& msg) {
+        const char* start = msg.msg() + prefix_length;
+        std::size_t length = text_end(msg) - start;
+        const char* space = static_cast<const char*>(std::memchr(start, ' ', length));
+        return std::string(start, space ? space : start + length);
+    }
+
+    // the published message, empty for a subscription
+    static std::string text(const chat_message& msg) {
+        const char* start = msg.msg() + prefix_length;
+        std::size_t length = text_end(msg) - start;
+        const char* space = static_cast<const char*>(std::memchr(start, ' ', length));
+        return space ? std::string(space + 1, start + length) : std::string();
+    }
+
+private:
+    static const char* text_end(const chat_message& msg) {
+        return msg.body() + msg.body_length();
+    }
+};
+
+#endif
@@ -0,0 +1,147 @@
+#ifndef TOPIC_TRIE_HPP
+#define TOPIC_TRIE_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// topic_trie: who subscribed to a topic
+//
+// A topic is a series of words separated by dots, e.g. ops.alerts.disk. A
+// subscription is a pattern of the same shape, in which a word may be *,
+// standing for any one word, and the last word may be #, standing for any
+// number of words, none included: ops.alerts.* and ops.# both match
+// ops.alerts.disk, and ops.# matches ops too.
+//
+// The patterns are kept in a trie, a word per level, with * and # as words
+// of their own. A topic is matched by walking down its words, into the
+// exact word and into * at every level and taking # on the way, so the work
+// depends on the topic and on how the patterns branch, not on how many
+// subscriptions there are.
+
+template <typename Subscriber>
+class topic_trie {
+
+public :
+    topic_trie() : size_(0) {
+    }
+
+    // false if the pattern is malformed
+    bool subscribe(const std::string& pattern, const Subscriber& subscriber) {
+        std::vector<std::string> words;
+        if (!split(pattern, true, words))
+            return false;
+        node* n = &root_;
+        for (auto& word : words) {
+            std::unique_ptr<node>& child = n->children[word];
+            if (!child)
+                child.reset(new node);
+            n = child.get();
+        }
+        n->subscribers.push_back(subscriber);
+        ++size_;
+        return true;
+    }
+
+    // false if there was no such subscription
+    bool unsubscribe(const std::string& pattern, const Subscriber& subscriber) {
+        std::vector<std::string> words;
+        if (!split(pattern, true, words) || !remove(root_, words, 0, subscriber))
+            return false;
+        --size_;
+        return true;
+    }
+
+    // call found(subscriber) for each subscription matching the topic,
+    // which can be several for one subscriber. Nothing matches a malformed
+    // topic, or one with wildcards
+    template <typename Found>
+    void match(const std::string& topic, Found found) const {
+        std::vector<std::string> words;
+        if (split(topic, false, words))
+            match(root_, words, 0, found);
+    }
+
+    // the subscriptions
+    std::size_t size() const {
+        return size_;
+    }
+
+    // splits a topic, or a pattern, into its words; false if it is malformed
+    static bool split(const std::string& topic, bool pattern,
+        std::vector<std::string>& words) {
+        words.clear();
+        std::size_t start = 0;
+        for (;;) {
+            std::size_t dot = topic.find('.', start);
+            std::string word = topic.substr(start,
+                dot == std::string::npos ? std::string::npos : dot - start);
+            if (word.empty())
+                return false;
+            bool wildcard = word == "*" || word == "#";
+            if (!wildcard && word.find_first_of("*#") != std::string::npos)
+                return false;
+            if (wildcard && !pattern)
+                return false;
+            if (!words.empty() && words.back() == "#")
+                return false;
+            words.push_back(word);
+            if (dot == std::string::npos)
+                return true;
+            start = dot + 1;
+        }
+    }
+
+private:
+    struct node {
+        std::unordered_map<std::string, std::unique_ptr<node> > children;
+        std::vector<Subscriber> subscribers;
+    };
+
+    template <typename Found>
+    static void match(const node& n, const std::vector<std::string>& words,
+        std::size_t i, Found& found) {
+        auto rest = n.children.find("#");
+        if (rest != n.children.end())
+            for (auto& subscriber : rest->second->subscribers)
+                found(subscriber);
+        if (i == words.size()) {
+            for (auto& subscriber : n.subscribers)
+                found(subscriber);
+            return;
+        }
+        auto exact = n.children.find(words[i]);
+        if (exact != n.children.end())
+            match(*exact->second, words, i + 1, found);
+        auto any = n.children.find("*");
+        if (any != n.children.end())
+            match(*any->second, words, i + 1, found);
+    }
+
+    // takes out empty nodes on the way back up
+    static bool remove(node& n, const std::vector<std::string>& words,
+        std::size_t i, const Subscriber& subscriber) {
+        if (i == words.size()) {
+            auto s = std::find(n.subscribers.begin(), n.subscribers.end(), subscriber);
+            if (s == n.subscribers.end())
+                return false;
+            n.subscribers.erase(s);
+            return true;
+        }
+        auto child = n.children.find(words[i]);
+        if (child == n.children.end()
+            || !remove(*child->second, words, i + 1, subscriber))
+            return false;
+        if (child->second->children.empty() && child->second->subscribers.empty())
+            n.children.erase(child);
+        return true;
+    }
+
+    node root_;
+    std::size_t size_;
+};
+
+#endif